@@ -0,0 +1,202 @@
+#include "actor.h"
+
+struct actor {
+    actor_system_t* system;
+    chan_t* mailbox;
+    actor_handler_fn handler;
+    void* context;
+    // Whether the actor is on the run queue or running, so that it is never scheduled twice
+    bool scheduled;
+    // Schedules the actor on every change of its mailbox
+    channel_watcher_t watcher;
+};
+
+struct actor_system {
+    // Runnable actors, with room for all of them so that scheduling never blocks
+    chan_t* runnable;
+    size_t batch;
+    size_t num_workers;
+    pthread_t* workers;
+    // Actors spawned so far, freed with the system
+    pthread_mutex_t mutex;
+    actor_t** actors;
+    size_t num_actors;
+    size_t max_actors;
+    bool open;
+};
+
+// Puts the actor on the run queue unless it is there already or running
+static void actor_schedule(actor_t* actor)
+{
+    if (!__atomic_exchange_n(&actor->scheduled, true, __ATOMIC_SEQ_CST)) {
+        channel_send(actor->system->runnable, actor, false);
+    }
+}
+
+// Watcher of the mailbox, runs with the mailbox locked
+static void actor_mailbox_changed(void* context)
+{
+    actor_t* actor = context;
+    if (buffer_current_size(actor->mailbox->buffer) > 0) {
+        actor_schedule(actor);
+    }
+}
+
+// Body of a worker thread, runs one batch of the next runnable actor at a time
+static void* actor_worker(void* arg)
+{
+    actor_system_t* system = arg;
+    void* data = NULL;
+    while (channel_receive(system->runnable, &data, true) == SUCCESS) {
+        actor_t* actor = data;
+        void* message = NULL;
+        for (size_t i = 0; i < system->batch && channel_receive(actor->mailbox, &message, false) == SUCCESS; i++) {
+            actor->handler(actor, message, actor->context);
+        }
+        __atomic_store_n(&actor->scheduled, false, __ATOMIC_SEQ_CST);
+        // a message sent while the actor was running found it scheduled, so the actor goes back to the run queue
+        // itself; checked under the mailbox lock, where the watcher of such a send runs
+        pthread_mutex_lock(&actor->mailbox->mutex);
+        bool pending = buffer_current_size(actor->mailbox->buffer) > 0;
+        pthread_mutex_unlock(&actor->mailbox->mutex);
+        if (pending) {
+            actor_schedule(actor);
+        }
+    }
+    return NULL;
+}
+
+// Creates an actor system of workers worker threads for up to max_actors actors, each handling up to batch messages
+// every time it is scheduled
+// Returns NULL if workers, max_actors or batch is 0, or if the workers could not be started
+actor_system_t* actor_system_create(size_t workers, size_t max_actors, size_t batch)
+{
+    if (workers == 0 || max_actors == 0 || batch == 0) {
+        return NULL;
+    }
+    actor_system_t* system = calloc(1, sizeof(actor_system_t));
+    if (!system) {
+        return NULL;
+    }
+    system->batch = batch;
+    system->max_actors = max_actors;
+    system->open = true;
+    system->runnable = channel_create(max_actors);
+    system->actors = calloc(max_actors, sizeof(actor_t*));
+    system->workers = calloc(workers, sizeof(pthread_t));
+    if (!system->runnable || !system->actors || !system->workers) {
+        if (system->runnable) {
+            channel_close(system->runnable);
+            channel_destroy(system->runnable);
+        }
+        free(system->actors);
+        free(system->workers);
+        free(system);
+        return NULL;
+    }
+    pthread_mutex_init(&system->mutex, NULL);
+    for (size_t i = 0; i < workers; i++) {
+        if (pthread_create(&system->workers[i], NULL, actor_worker, system) != 0) {
+            actor_system_close(system);
+            actor_system_destroy(system);
+            return NULL;
+        }
+        system->num_workers++;
+    }
+    return system;
+}
+
+// Creates an actor whose mailbox buffers up to mailbox_size messages, handled by handler
+// Returns NULL if mailbox_size is 0, or if the system is full or closed
+actor_t* actor_spawn(actor_system_t* system, size_t mailbox_size, actor_handler_fn handler, void* context)
+{
+    if (mailbox_size == 0) {
+        return NULL;
+    }
+    actor_t* actor = calloc(1, sizeof(actor_t));
+    if (!actor) {
+        return NULL;
+    }
+    actor->mailbox = channel_create(mailbox_size);
+    if (!actor->mailbox) {
+        free(actor);
+        return NULL;
+    }
+    actor->system = system;
+    actor->handler = handler;
+    actor->context = context;
+    actor->watcher.callback = actor_mailbox_changed;
+    actor->watcher.context = actor;
+    pthread_mutex_lock(&system->mutex);
+    if (!system->open || system->num_actors == system->max_actors) {
+        pthread_mutex_unlock(&system->mutex);
+        channel_close(actor->mailbox);
+        channel_destroy(actor->mailbox);
+        free(actor);
+        return NULL;
+    }
+    system->actors[system->num_actors++] = actor;
+    pthread_mutex_unlock(&system->mutex);
+    channel_watch(actor->mailbox, &actor->watcher);
+    return actor;
+}
+
+// Returns the mailbox of the actor, any send on it (channel_send, channel_select...) schedules the actor
+// The mailbox must not be closed or destroyed directly
+chan_t* actor_mailbox(actor_t* actor)
+{
+    return actor->mailbox;
+}
+
+// Sends a message to the actor, returns like channel_send
+// A handler must not block on the mailbox of an actor of the same system: all the workers could end up waiting on
+// actors that only they can run
+enum chan_status actor_send(actor_t* actor, void* message, bool blocking)
+{
+    return channel_send(actor->mailbox, message, blocking);
+}
+
+// Closes the system: the workers stop after their current batch, the messages still in the mailboxes are not handled
+// and sends to the actors return CLOSED_ERROR
+// Returns SUCCESS if close is successful, and
+// CLOSED_ERROR if the system is already closed
+enum chan_status actor_system_close(actor_system_t* system)
+{
+    pthread_mutex_lock(&system->mutex);
+    if (!system->open) {
+        pthread_mutex_unlock(&system->mutex);
+        return CLOSED_ERROR;
+    }
+    system->open = false;
+    pthread_mutex_unlock(&system->mutex);
+    channel_close(system->runnable);
+    for (size_t i = 0; i < system->num_actors; i++) {
+        channel_close(system->actors[i]->mailbox);
+    }
+    return SUCCESS;
+}
+
+// Waits for the workers and frees the system and its actors, the system must be closed and every sender stopped
+// Returns SUCCESS if destroy is successful, and
+// DESTROY_ERROR if the system is still open
+enum chan_status actor_system_destroy(actor_system_t* system)
+{
+    if (system->open) {
+        return DESTROY_ERROR;
+    }
+    for (size_t i = 0; i < system->num_workers; i++) {
+        pthread_join(system->workers[i], NULL);
+    }
+    for (size_t i = 0; i < system->num_actors; i++) {
+        actor_t* actor = system->actors[i];
+        channel_unwatch(actor->mailbox, &actor->watcher);
+        channel_destroy(actor->mailbox);
+        free(actor);
+    }
+    channel_destroy(system->runnable);
+    pthread_mutex_destroy(&system->mutex);
+    free(system->actors);
+    free(system->workers);
+    free(system);
+    return SUCCESS;
+}
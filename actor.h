@@ -0,0 +1,49 @@
+#ifndef ACTOR_H
+#define ACTOR_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "channel.h"
+
+// Defines an actor, a mailbox channel and the handler of its messages
+typedef struct actor actor_t;
+
+// Defines an actor system, a fixed pool of worker threads that runs the handlers of its actors
+// An actor is scheduled on the pool when its mailbox gets a message, and handles at most batch messages before it gives
+// the worker to the next runnable actor, so an idle actor costs nothing but its mailbox and never holds a thread
+typedef struct actor_system actor_system_t;
+
+// Defines the handler of an actor, run on a worker for every message of its mailbox, never for two messages at once
+typedef void (*actor_handler_fn)(actor_t* self, void* message, void* context);
+
+// Creates an actor system of workers worker threads for up to max_actors actors, each handling up to batch messages
+// every time it is scheduled
+// Returns NULL if workers, max_actors or batch is 0, or if the workers could not be started
+actor_system_t* actor_system_create(size_t workers, size_t max_actors, size_t batch);
+
+// Creates an actor whose mailbox buffers up to mailbox_size messages, handled by handler
+// Returns NULL if mailbox_size is 0, or if the system is full or closed
+actor_t* actor_spawn(actor_system_t* system, size_t mailbox_size, actor_handler_fn handler, void* context);
+
+// Returns the mailbox of the actor, any send on it (channel_send, channel_select...) schedules the actor
+// The mailbox must not be closed or destroyed directly
+chan_t* actor_mailbox(actor_t* actor);
+
+// Sends a message to the actor, returns like channel_send
+// A handler must not block on the mailbox of an actor of the same system: all the workers could end up waiting on
+// actors that only they can run
+enum chan_status actor_send(actor_t* actor, void* message, bool blocking);
+
+// Closes the system: the workers stop after their current batch, the messages still in the mailboxes are not handled
+// and sends to the actors return CLOSED_ERROR
+// Returns SUCCESS if close is successful, and
+// CLOSED_ERROR if the system is already closed
+enum chan_status actor_system_close(actor_system_t* system);
+
+// Waits for the workers and frees the system and its actors, the system must be closed and every sender stopped
+// Returns SUCCESS if destroy is successful, and
+// DESTROY_ERROR if the system is still open
+enum chan_status actor_system_destroy(actor_system_t* system);
+
+#endif // ACTOR_H
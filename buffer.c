@@ -1,14 +1,18 @@
 #include "buffer.h"
 
 // Creates a buffer with the given capacity
+// The storage for the values is not allocated until the first value is added
+// Returns NULL on allocation failure
 buffer_t* buffer_create(size_t capacity)
 {
     buffer_t* buffer = (buffer_t*) malloc(sizeof(buffer_t));
-    void** data  = (void**) malloc(capacity * sizeof(void*));
+    if (!buffer) {
+        return NULL;
+    }
     buffer->size = 0;
     buffer->next = 0;
     buffer->capacity = capacity;
-    buffer->data = data;
+    buffer->data = NULL;
     return buffer;
 }
 
@@ -20,6 +24,12 @@ bool buffer_add(void* data, buffer_t* buffer)
     if (buffer->size >= buffer->capacity) {
         return false;
     }
+    if (buffer->data == NULL) {
+        buffer->data = (void**) malloc(buffer->capacity * sizeof(void*));
+        if (buffer->data == NULL) {
+            return false;
+        }
+    }
     size_t pos = buffer->next + buffer->size;
     if (pos >= buffer->capacity) {
         pos -= buffer->capacity;
@@ -29,6 +39,23 @@ bool buffer_add(void* data, buffer_t* buffer)
     return true;
 }
 
+// Adds the value into the buffer, evicting the oldest value if the buffer is full
+// Returns 'true' if an old value was overwritten to make room
+// Returns 'false' otherwise
+bool buffer_add_overwrite(void* data, buffer_t* buffer)
+{
+    if (buffer->size < buffer->capacity) {
+        return !buffer_add(data, buffer);
+    }
+    // the slot at next holds the oldest value, reuse it and advance next
+    buffer->data[buffer->next] = data;
+    buffer->next++;
+    if (buffer->next >= buffer->capacity) {
+        buffer->next -= buffer->capacity;
+    }
+    return true;
+}
+
 // Removes the value from the buffer in FIFO order and stores it in data
 // Returns a value if the buffer is not empty and the value was removed
 // Returns BUFFER_EMPTY otherwise
@@ -46,6 +73,20 @@ void *buffer_remove(buffer_t* buffer)
     return BUFFER_EMPTY;
 }
 
+// Releases the storage for the values if the buffer is empty, it is allocated again by the next add
+// Returns 'true' if the storage was released
+// Returns 'false' otherwise
+bool buffer_release(buffer_t* buffer)
+{
+    if (buffer->size > 0 || buffer->data == NULL) {
+        return false;
+    }
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->next = 0;
+    return true;
+}
+
 // Frees the memory allocated to the buffer
 void buffer_free(buffer_t *buffer)
 {
@@ -14,6 +14,8 @@ typedef struct {
 #define BUFFER_EMPTY	((void *) -1L)
 
 // Creates a buffer with the given capacity
+// The storage for the values is not allocated until the first value is added
+// Returns NULL on allocation failure
 buffer_t* buffer_create(size_t capacity);
 
 // Adds the value into the buffer
@@ -21,11 +23,21 @@ buffer_t* buffer_create(size_t capacity);
 // Returns 'false' otherwise
 bool buffer_add(void* data, buffer_t* buffer);
 
+// Adds the value into the buffer, evicting the oldest value if the buffer is full
+// Returns 'true' if an old value was overwritten to make room
+// Returns 'false' otherwise
+bool buffer_add_overwrite(void* data, buffer_t* buffer);
+
 // Removes the value from the buffer in FIFO order and stores it in data
 // Returns a value if the buffer is not empty and the value was removed
 // Returns BUFFER_EMPTY otherwise
 void *buffer_remove(buffer_t* buffer);
 
+// Releases the storage for the values if the buffer is empty, it is allocated again by the next add
+// Returns 'true' if the storage was released
+// Returns 'false' otherwise
+bool buffer_release(buffer_t* buffer);
+
 // Frees the memory allocated to the buffer
 void buffer_free(buffer_t* buffer);
 
@@ -1,7 +1,770 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <linux/membarrier.h>
+#include "cpu_relax.h"
 #include "channel.h"
+#include "recorder.h"
+
+// Producers add to the per-CPU lanes with restartable sequences on x86-64 when the C library registers them
+// The thread sanitizer cannot see the stores made inside the sequences, so its builds use the per-lane spinlocks
+#if defined(__x86_64__) && !defined(__SANITIZE_THREAD__) && defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#define CHANNEL_HAVE_RSEQ 1
+#endif
+#endif
+
+#define NS_PER_SEC 1000000000ull
+#define NS_PER_USEC 1000ull
+
+// States of a parked waiter: still waiting, woken up to check the channel again, or told that the channel is closed
+#define CHANNEL_WAITER_WAITING 0
+#define CHANNEL_WAITER_WOKEN 1
+#define CHANNEL_WAITER_CLOSED 2
+
+// Lowest bit of poll_state, set once the channel is closed, the occupancy is kept in the other bits
+#define CHANNEL_POLL_CLOSED 1ul
+
+// Number of checks made by the fixed spin and yield strategies before parking
+#define CHANNEL_SPIN_CHECKS 4096
+#define CHANNEL_YIELD_CHECKS 16
+// Bounds of the adaptive spin budget
+#define CHANNEL_SPIN_BUDGET_MIN 64
+#define CHANNEL_SPIN_BUDGET_MAX 16384
+
+// Defines the lane of a CPU, a ring of messages added by the producers running on that CPU and drained by the consumers
+// The producer end (tail) and the consumer end (head) sit on separate cache lines
+// The restartable sequence depends on this layout: tail at offset 0, slots at 8, head at 64, and 128 bytes per lane
+typedef struct {
+    size_t tail;
+    void** slots;
+    int lock;
+    size_t head __attribute__((aligned(64)));
+} channel_lane_t;
+
+_Static_assert(sizeof(channel_lane_t) == 128, "the restartable sequence indexes lanes by cpu << 7");
+_Static_assert(offsetof(channel_lane_t, slots) == 8 && offsetof(channel_lane_t, head) == 64, "lane layout");
+
+struct channel_lanes {
+    channel_lane_t* lane;
+    size_t count;
+    size_t capacity;
+    size_t mask;
+    // Whether producers add with restartable sequences, otherwise they take the spinlock of the lane
+    bool rseq;
+    // Number of parked receivers, waiting select calls and asynchronous receives, which producers must wake up
+    // Only changed with the channel mutex held
+    size_t sleepers;
+};
+
+// Number of CPUs the process may run on, read once per process since channels are created by the million
+static pthread_once_t channel_cpus_once = PTHREAD_ONCE_INIT;
+static uint32_t channel_cpus;
+
+// Whether the process could register for expedited membarrier, which lets sleepers fence against the producers
+// instead of every producer fencing after every add, and the number of lanes of per-CPU channels (one per configured
+// CPU, since lanes are indexed by CPU number), both read once per process
+static pthread_once_t channel_lanes_once = PTHREAD_ONCE_INIT;
+static bool channel_lanes_membarrier;
+static size_t channel_lanes_count;
+#ifdef __SANITIZE_THREAD__
+// The thread sanitizer does not support fences, its builds order through a read-modify-write of this word instead
+static size_t channel_lanes_fence_word;
+#endif
+
+// Returns the current CLOCK_MONOTONIC time in nanoseconds
+static uint64_t channel_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * NS_PER_SEC + (uint64_t)now.tv_nsec;
+}
+
+// Records the time at which the channel became empty, only tracked when an idle timeout is set
+// Must be called with the channel mutex held
+static void channel_mark_idle(chan_t* channel)
+{
+    if(channel->idle_timeout && !buffer_current_size(channel->buffer)){
+        channel->idle_since = channel_now();
+    }
+}
+
+// Releases the buffer storage if the channel has been empty for at least its idle timeout
+// Must be called with the channel mutex held
+static bool channel_release_if_idle(chan_t* channel)
+{
+    if(!channel->idle_timeout || buffer_current_size(channel->buffer)){
+        return false;
+    }
+    if(channel_now() - channel->idle_since < channel->idle_timeout){
+        return false;
+    }
+    return buffer_release(channel->buffer);
+}
+
+// Reports a watermark crossing and arms the opposite watermark
+// Must be called with the channel mutex held
+static void channel_cross_watermark(chan_t* channel, bool high)
+{
+    channel->high_watermark_trigger = high ? SIZE_MAX : channel->high_watermark;
+    channel->low_watermark_trigger = high ? channel->low_watermark : SIZE_MAX;
+    channel->watermark_callback(channel->watermark_context, high);
+}
+
+// Checks the high watermark after a message was added, a single compare unless the watermark was crossed
+// Occupancy grows by one per add, so equality is enough to detect the crossing
+// Must be called with the channel mutex held
+static inline void channel_check_high_watermark(chan_t* channel)
+{
+    if(buffer_current_size(channel->buffer) == channel->high_watermark_trigger){
+        channel_cross_watermark(channel, true);
+    }
+}
+
+// Checks the low watermark after a message was removed, a single compare unless the watermark was crossed
+// Must be called with the channel mutex held
+static inline void channel_check_low_watermark(chan_t* channel)
+{
+    if(buffer_current_size(channel->buffer) == channel->low_watermark_trigger){
+        channel_cross_watermark(channel, false);
+    }
+}
+
+// Unlinks a waiter from its queue, must be called with the channel mutex held
+static void channel_waitq_remove(channel_waitq_t* queue, channel_waiter_t* waiter)
+{
+    if(waiter->prev){
+        waiter->prev->next = waiter->next;
+    }
+    else{
+        queue->head = waiter->next;
+    }
+    if(waiter->next){
+        waiter->next->prev = waiter->prev;
+    }
+    else{
+        queue->tail = waiter->prev;
+    }
+}
+
+// Parks the caller on a queue of the channel until it is woken up, the deadline (CLOCK_MONOTONIC, in nanoseconds, none
+// if 0) passes, or the channel is closed
+// Must be called with the channel mutex held, which is released while parked
+// Returns CHANNEL_WAITER_WOKEN after a wake-up and CHANNEL_WAITER_WAITING after the deadline, with the mutex held again
+// so that the caller checks the channel, and CHANNEL_WAITER_CLOSED once the channel is closed, with the mutex released
+static uint32_t channel_park(chan_t* channel, channel_waitq_t* queue, uint64_t deadline)
+{
+    channel_waiter_t waiter = {NULL, queue->tail, CHANNEL_WAITER_WAITING};
+    if(queue->tail){
+        queue->tail->next = &waiter;
+    }
+    else{
+        queue->head = &waiter;
+    }
+    queue->tail = &waiter;
+    pthread_mutex_unlock(&channel->mutex);
+
+    struct timespec abstime;
+    abstime.tv_sec = (time_t)(deadline / NS_PER_SEC);
+    abstime.tv_nsec = (long)(deadline % NS_PER_SEC);
+    uint32_t state;
+    while((state = __atomic_load_n(&waiter.state, __ATOMIC_ACQUIRE)) == CHANNEL_WAITER_WAITING){
+        if(syscall(SYS_futex, &waiter.state, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG, CHANNEL_WAITER_WAITING,
+                   deadline ? &abstime : NULL, NULL, FUTEX_BITSET_MATCH_ANY) < 0 && errno == ETIMEDOUT){
+            break;
+        }
+    }
+    if(state == CHANNEL_WAITER_CLOSED){
+        // close already unlinked the waiter, there is nothing left to do with the channel
+        return CHANNEL_WAITER_CLOSED;
+    }
+    pthread_mutex_lock(&channel->mutex);
+    state = __atomic_load_n(&waiter.state, __ATOMIC_ACQUIRE);
+    if(state == CHANNEL_WAITER_WAITING){
+        channel_waitq_remove(queue, &waiter);
+        return CHANNEL_WAITER_WAITING;
+    }
+    // woken up or closed while timing out, the waiter is unlinked and the caller sees the channel as it is now
+    return CHANNEL_WAITER_WOKEN;
+}
+
+// Hands a new state to a waiter unlinked from its queue and wakes it up
+static void channel_waiter_post(channel_waiter_t* waiter, uint32_t state)
+{
+    __atomic_store_n(&waiter->state, state, __ATOMIC_RELEASE);
+    // a closed waiter may return as soon as it sees its state, the wake-up only passes the address to the kernel
+    syscall(SYS_futex, &waiter->state, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL, NULL, 0);
+}
+
+// Wakes up the oldest waiter of a queue, if any, must be called with the channel mutex held
+static void channel_wake_one(channel_waitq_t* queue)
+{
+    channel_waiter_t* waiter = queue->head;
+    if(waiter){
+        channel_waitq_remove(queue, waiter);
+        channel_waiter_post(waiter, CHANNEL_WAITER_WOKEN);
+    }
+}
+
+// Wakes up every waiter of a queue with the given state, must be called with the channel mutex held
+static void channel_wake_all(channel_waitq_t* queue, uint32_t state)
+{
+    channel_waiter_t* waiter = queue->head;
+    queue->head = NULL;
+    queue->tail = NULL;
+    while(waiter){
+        // read before the post, after which the waiter may be gone
+        channel_waiter_t* next = waiter->next;
+        channel_waiter_post(waiter, state);
+        waiter = next;
+    }
+}
+
+// Waits for the channel to receive data, or until deadline (CLOCK_MONOTONIC, in nanoseconds) unless it is 0
+// With an idle timeout set, the wait is bounded so that the waiter can release the storage of an idle channel
+// Must be called with the channel mutex held
+// Returns true once the channel is closed, with the mutex released
+static bool channel_wait_recv(chan_t* channel, uint64_t deadline)
+{
+    uint64_t idle_deadline = channel->idle_timeout && channel->buffer->data ? channel->idle_since + channel->idle_timeout : 0;
+    uint64_t wake = !deadline || (idle_deadline && idle_deadline < deadline) ? idle_deadline : deadline;
+    uint32_t state = channel_park(channel, &channel->recv, wake);
+    if(state == CHANNEL_WAITER_CLOSED){
+        return true;
+    }
+    if(state == CHANNEL_WAITER_WAITING){
+        channel_release_if_idle(channel);
+    }
+    return false;
+}
+
+// Returns whether any lane holds a message, without locking the channel
+static bool channel_lanes_pending(chan_t* channel)
+{
+    channel_lanes_t* lanes = channel->lanes;
+    if(!lanes){
+        return false;
+    }
+    for(size_t i = 0; i < lanes->count; i++){
+        channel_lane_t* lane = &lanes->lane[i];
+        if(__atomic_load_n(&lane->tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&lane->head, __ATOMIC_RELAXED)){
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns whether the published state lets a send (or a receive) go ahead, a closed channel always does, and so does
+// a send on a lossy channel, which drops the oldest message when full
+static inline bool channel_poll_ready(chan_t* channel, bool send)
+{
+    size_t state = __atomic_load_n(&channel->poll_state, __ATOMIC_ACQUIRE);
+    if(state & CHANNEL_POLL_CLOSED){
+        return true;
+    }
+    return send ? (state >> 1) < buffer_capacity(channel->buffer) || channel->lossy : (state >> 1) > 0 || channel_lanes_pending(channel);
+}
+
+// Waits, without the channel mutex, for a send (or a receive) to be able to go ahead, following the channel's wait
+// strategy, the caller then takes the mutex and parks if the channel is still not ready
+static void channel_spin_wait(chan_t* channel, bool send)
+{
+    int strategy = __atomic_load_n(&channel->wait_strategy, __ATOMIC_RELAXED);
+    if(strategy == CHANNEL_WAIT_PARK || channel_poll_ready(channel, send)){
+        return;
+    }
+    if(strategy == CHANNEL_WAIT_SPIN || strategy == CHANNEL_WAIT_YIELD){
+        size_t checks = strategy == CHANNEL_WAIT_SPIN ? CHANNEL_SPIN_CHECKS : CHANNEL_YIELD_CHECKS;
+        for(size_t i = 0; i < checks && !channel_poll_ready(channel, send); i++){
+            if(strategy == CHANNEL_WAIT_SPIN){
+                cpu_relax();
+            }
+            else{
+                sched_yield();
+            }
+        }
+        return;
+    }
+
+    // adaptive: a spinner only helps if the thread it waits for can run meanwhile, so keep one CPU free of spinners
+    // and give the CPU to that thread instead when the spinners would fill every CPU or spinning has been failing
+    uint32_t spinners = __atomic_add_fetch(&channel->spinners, 1, __ATOMIC_RELAXED);
+    uint32_t budget = __atomic_load_n(&channel->spin_budget, __ATOMIC_RELAXED);
+    bool yield = spinners >= channel_cpu_count() || budget < CHANNEL_SPIN_BUDGET_MIN;
+    size_t checks = yield ? CHANNEL_YIELD_CHECKS : budget;
+    bool ready = false;
+    for(size_t i = 0; i < checks && !ready; i++){
+        if(yield){
+            sched_yield();
+        }
+        else{
+            cpu_relax();
+        }
+        ready = channel_poll_ready(channel, send);
+    }
+    __atomic_sub_fetch(&channel->spinners, 1, __ATOMIC_RELAXED);
+    if(yield && spinners >= channel_cpu_count()){
+        // the outcome says nothing about spinning
+        return;
+    }
+    if(ready){
+        budget = budget < CHANNEL_SPIN_BUDGET_MIN ? CHANNEL_SPIN_BUDGET_MIN : budget * 2;
+        budget = budget > CHANNEL_SPIN_BUDGET_MAX ? CHANNEL_SPIN_BUDGET_MAX : budget;
+    }
+    else{
+        budget /= 2;
+    }
+    __atomic_store_n(&channel->spin_budget, budget, __ATOMIC_RELAXED);
+}
+
+// Publishes the occupancy of the channel to busy pollers, and wakes up the select calls waiting on the channel
+// so that they check it again
+// Must be called with the channel mutex held, after every change of state
+static void channel_notify_state(chan_t* channel)
+{
+    size_t state = buffer_current_size(channel->buffer) << 1 | (channel->open ? 0 : CHANNEL_POLL_CLOSED);
+    __atomic_store_n(&channel->poll_state, state, __ATOMIC_RELEASE);
+    for(list_node_t* node = list_begin(&channel->selectors); node; node = list_next(node)){
+        sem_post((sem_t*)list_data(node));
+    }
+    for(list_node_t* node = list_begin(&channel->watchers); node; node = list_next(node)){
+        channel_watcher_t* watcher = list_data(node);
+        watcher->callback(watcher->context);
+    }
+}
+
+// Appends an asynchronous operation to a wait list
+static void channel_pending_push(channel_pending_t** head, channel_pending_t** tail, channel_pending_t* pending)
+{
+    pending->next = NULL;
+    if(*tail){
+        (*tail)->next = pending;
+    }
+    else{
+        *head = pending;
+    }
+    *tail = pending;
+}
+
+// Puts an asynchronous operation back at the front of a wait list, ahead of the ones queued after it
+static void channel_pending_push_front(channel_pending_t** head, channel_pending_t** tail, channel_pending_t* pending)
+{
+    pending->next = *head;
+    if(!*tail){
+        *tail = pending;
+    }
+    *head = pending;
+}
+
+// Removes the oldest asynchronous operation from a wait list
+static channel_pending_t* channel_pending_pop(channel_pending_t** head, channel_pending_t** tail)
+{
+    channel_pending_t* pending = *head;
+    *head = pending->next;
+    if(!*head){
+        *tail = NULL;
+    }
+    return pending;
+}
+
+// Returns whether the item can be sent on the channel, which is any item except on a work-set channel tracking small ids
+// in a bitmap, where it must be below max_id
+// Sends check this up front, so that an item that can never be queued fails right away instead of waiting for room
+static bool channel_valid_item(chan_t* channel, void* data)
+{
+    return !channel->set || !channel->set->bitmap || (uintptr_t)data < channel->set->max_id;
+}
+
+// Adds a message to the buffer, recording the item as queued on a work-set channel
+// Returns false if the buffer is full, its storage could not be allocated, or the item is not a valid id of the set
+// Must be called with the channel mutex held
+static bool channel_buffer_add(chan_t* channel, void* data)
+{
+    if(!channel_valid_item(channel, data)){
+        return false;
+    }
+    if(!buffer_add(data, channel->buffer)){
+        return false;
+    }
+    if(channel->set){
+        item_set_insert(channel->set, data);
+    }
+    return true;
+}
+
+// Removes the oldest message from the buffer, which makes the item eligible again on a work-set channel
+// Must be called with the channel mutex held
+static void* channel_buffer_remove(chan_t* channel)
+{
+    void* data = buffer_remove(channel->buffer);
+    if(channel->set && data != BUFFER_EMPTY){
+        item_set_remove(channel->set, data);
+    }
+    return data;
+}
+
+// Returns whether the item is already queued on a work-set channel, in which case a send of it changes nothing
+// Must be called with the channel mutex held
+static bool channel_already_queued(chan_t* channel, void* data)
+{
+    return channel->set && item_set_contains(channel->set, data);
+}
+
+// Hands the oldest buffered message to the oldest waiting asynchronous receive, if there is one
+// Returns the receive to complete once the mutex is released, or NULL
+// Must be called with the channel mutex held
+static channel_pending_t* channel_hand_to_pending_receive(chan_t* channel)
+{
+    if(!channel->pending_receives || !buffer_current_size(channel->buffer)){
+        return NULL;
+    }
+    channel_pending_t* pending = channel_pending_pop(&channel->pending_receives, &channel->pending_receives_tail);
+    pending->data = channel_buffer_remove(channel);
+    channel_mark_idle(channel);
+    channel_check_low_watermark(channel);
+    if(channel->lanes){
+        // the receive no longer needs waking up
+        __atomic_store_n(&channel->lanes->sleepers, channel->lanes->sleepers - 1, __ATOMIC_RELAXED);
+    }
+    return pending;
+}
+
+// Adds the message of the oldest waiting asynchronous send to the buffer, if there is one and the buffer has room
+// On a work-set channel, the waiting sends of items already queued before it complete without taking room
+// Returns the sends to complete once the mutex is released (linked through next, see channel_complete_all), or NULL
+// Must be called with the channel mutex held
+static channel_pending_t* channel_fill_from_pending_send(chan_t* channel)
+{
+    channel_pending_t* completed = NULL;
+    while(channel->pending_sends && buffer_current_size(channel->buffer) < buffer_capacity(channel->buffer)){
+        channel_pending_t* pending = channel_pending_pop(&channel->pending_sends, &channel->pending_sends_tail);
+        if(channel_already_queued(channel, pending->data)){
+            pending->next = completed;
+            completed = pending;
+            continue;
+        }
+        if(!channel_buffer_add(channel, pending->data)){
+            // storage could not be allocated, leave the send waiting where it was
+            channel_pending_push_front(&channel->pending_sends, &channel->pending_sends_tail, pending);
+            break;
+        }
+        channel->sent++;
+        channel_check_high_watermark(channel);
+        pending->next = completed;
+        completed = pending;
+        break;
+    }
+    return completed;
+}
+
+// Invokes and frees a completed asynchronous operation, must be called without the channel mutex held
+static void channel_complete(channel_pending_t* pending, enum chan_status status)
+{
+    if(pending){
+        pending->callback(pending->context, status, pending->data);
+        free(pending);
+    }
+}
+
+// Invokes and frees a list of completed asynchronous operations linked through next, must be called without the
+// channel mutex held
+static void channel_complete_all(channel_pending_t* pending, enum chan_status status)
+{
+    while(pending){
+        channel_pending_t* next = pending->next;
+        channel_complete(pending, status);
+        pending = next;
+    }
+}
+
+// Reads the number of CPUs the process may run on from its affinity mask, once per process
+static void channel_cpus_read()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    int count = sched_getaffinity(0, sizeof(allowed), &allowed) == 0 ? CPU_COUNT(&allowed) : 0;
+    if(count <= 0){
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        count = online > 0 ? (int)online : 1;
+    }
+    channel_cpus = (uint32_t)count;
+}
+
+// Returns the number of CPUs the process may run on, as allowed by its affinity mask on the first call
+uint32_t channel_cpu_count()
+{
+    pthread_once(&channel_cpus_once, channel_cpus_read);
+    return channel_cpus;
+}
+
+// Registers for expedited membarrier and reads the number of configured CPUs, once per process
+static void channel_lanes_register()
+{
+    channel_lanes_membarrier = syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+    long num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+    channel_lanes_count = num_cpus > 0 ? (size_t)num_cpus : 1;
+}
+
+// Issues a full memory barrier on the calling thread
+static inline void channel_full_fence()
+{
+#ifdef __SANITIZE_THREAD__
+    __atomic_fetch_add(&channel_lanes_fence_word, 0, __ATOMIC_SEQ_CST);
+#else
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+// Issues a full memory barrier on every running thread of the process, or only on the calling thread (in which case
+// producers fence after every add)
+// A sleeper calls it between registering and looking at the lanes one last time: any message it then misses was added
+// by a producer that will see the registration
+static void channel_lanes_fence()
+{
+    if(channel_lanes_membarrier){
+        syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+    }
+    else{
+        channel_full_fence();
+    }
+}
+
+// Moves the messages of the lanes into the buffer, lane by lane and as far as the buffer has room
+// Returns true if the lanes are empty afterwards
+// Must be called with the channel mutex held
+static bool channel_harvest_lanes(chan_t* channel)
+{
+    channel_lanes_t* lanes = channel->lanes;
+    if(!lanes){
+        return true;
+    }
+    bool moved = false;
+    bool drained = true;
+    for(size_t i = 0; i < lanes->count; i++){
+        channel_lane_t* lane = &lanes->lane[i];
+        size_t head = lane->head;
+        size_t tail = __atomic_load_n(&lane->tail, __ATOMIC_ACQUIRE);
+        while(head != tail && buffer_current_size(channel->buffer) < buffer_capacity(channel->buffer)){
+            if(!buffer_add(lane->slots[head & lanes->mask], channel->buffer)){
+                break;
+            }
+            head++;
+            channel->sent++;
+            channel_check_high_watermark(channel);
+            moved = true;
+        }
+        drained = drained && head == tail;
+        __atomic_store_n(&lane->head, head, __ATOMIC_RELEASE);
+    }
+    if(moved){
+        channel_notify_state(channel);
+    }
+    return drained;
+}
+
+// Registers the caller as a sleeper, which producers wake up through the channel mutex, and drains the lanes again
+// so that no message added before the registration became visible is missed
+// Must be called with the channel mutex held
+static void channel_lanes_sleep(chan_t* channel)
+{
+    __atomic_store_n(&channel->lanes->sleepers, channel->lanes->sleepers + 1, __ATOMIC_RELAXED);
+    channel_lanes_fence();
+    channel_harvest_lanes(channel);
+}
+
+// Unregisters a sleeper
+// Must be called with the channel mutex held
+static void channel_lanes_wake(chan_t* channel)
+{
+    __atomic_store_n(&channel->lanes->sleepers, channel->lanes->sleepers - 1, __ATOMIC_RELAXED);
+}
+
+// Wakes up the sleepers after a producer added to a lane: drains the lanes, completes waiting asynchronous receives
+// and signals the parked receivers (the select calls are posted when the lanes are drained)
+static void channel_lanes_wake_sleepers(chan_t* channel)
+{
+    channel_pending_t* completed = NULL;
+    pthread_mutex_lock(&channel->mutex);
+    channel_harvest_lanes(channel);
+    channel_pending_t* completion;
+    while((completion = channel_hand_to_pending_receive(channel))){
+        completion->next = completed;
+        completed = completion;
+    }
+    channel_notify_state(channel);
+    channel_wake_all(&channel->recv, CHANNEL_WAITER_WOKEN);
+    pthread_mutex_unlock(&channel->mutex);
+    while(completed){
+        channel_pending_t* next = completed->next;
+        channel_complete(completed, SUCCESS);
+        completed = next;
+    }
+}
+
+#ifdef CHANNEL_HAVE_RSEQ
+// Outcomes of channel_lane_push_rseq
+#define CHANNEL_LANE_ADDED 1
+#define CHANNEL_LANE_FULL 0
+#define CHANNEL_LANE_UNAVAILABLE -1
+#define CHANNEL_LANE_RESTART -2
+
+// Adds data to the lane of the current CPU inside a restartable sequence: the kernel aborts the sequence if the thread
+// is preempted, migrated or signaled before the final store publishes the message, so the producers of a CPU never
+// interleave and the add is a handful of plain loads and stores
+// Returns CHANNEL_LANE_RESTART if the sequence was aborted, and CHANNEL_LANE_UNAVAILABLE if the thread has no
+// registered restartable sequence (or runs on a CPU beyond the lanes)
+static int channel_lane_push_rseq(channel_lanes_t* lanes, void* data)
+{
+    struct rseq* rs = (struct rseq*)((char*)__builtin_thread_pointer() + __rseq_offset);
+    __asm__ __volatile__ goto(
+        // critical section descriptor: version, flags, start, length up to the commit, abort handler
+        ".pushsection __rseq_cs, \"aw\"\n\t"
+        ".balign 32\n\t"
+        "3:\n\t"
+        ".long 0x0, 0x0\n\t"
+        ".quad 1f, (2f - 1f), 4f\n\t"
+        ".popsection\n\t"
+        "leaq 3b(%%rip), %%rax\n\t"
+        "movq %%rax, %[rseq_cs]\n\t"
+        "1:\n\t"
+        // lane = &lanes->lane[cpu_id]
+        "movl %[cpu_id], %%eax\n\t"
+        "cmpq %[count], %%rax\n\t"
+        "jae %l[unavailable]\n\t"
+        "shlq $7, %%rax\n\t"
+        "addq %[lane], %%rax\n\t"
+        // full when tail - head reached the capacity
+        "movq (%%rax), %%rcx\n\t"
+        "movq %%rcx, %%rdx\n\t"
+        "subq 64(%%rax), %%rdx\n\t"
+        "cmpq %[capacity], %%rdx\n\t"
+        "jae %l[full]\n\t"
+        // slots[tail & mask] = data
+        "movq %%rcx, %%rdx\n\t"
+        "andq %[mask], %%rdx\n\t"
+        "shlq $3, %%rdx\n\t"
+        "addq 8(%%rax), %%rdx\n\t"
+        "movq %[data], (%%rdx)\n\t"
+        // commit: tail + 1
+        "addq $1, %%rcx\n\t"
+        "movq %%rcx, (%%rax)\n\t"
+        "2:\n\t"
+        // abort handler, preceded by the signature the C library registered
+        ".pushsection __rseq_failure, \"ax\"\n\t"
+        ".byte 0x0f, 0xb9, 0x3d\n\t"
+        ".long %c[signature]\n\t"
+        "4:\n\t"
+        "jmp %l[restart]\n\t"
+        ".popsection\n\t"
+        :
+        : [rseq_cs] "m"(rs->rseq_cs), [cpu_id] "m"(rs->cpu_id), [count] "r"(lanes->count), [lane] "r"(lanes->lane),
+          [capacity] "r"(lanes->capacity), [mask] "r"(lanes->mask), [data] "r"(data), [signature] "i"(RSEQ_SIG)
+        : "rax", "rcx", "rdx", "memory", "cc"
+        : restart, full, unavailable);
+    return CHANNEL_LANE_ADDED;
+restart:
+    return CHANNEL_LANE_RESTART;
+full:
+    return CHANNEL_LANE_FULL;
+unavailable:
+    return CHANNEL_LANE_UNAVAILABLE;
+}
+#endif
+
+// Adds data to the lane of the current CPU, under the spinlock of the lane
+// Returns true if the data was added and false if the lane is full
+static bool channel_lane_push_locked(channel_lanes_t* lanes, void* data)
+{
+    int cpu = sched_getcpu();
+    channel_lane_t* lane = &lanes->lane[(size_t)(cpu < 0 ? 0 : cpu) % lanes->count];
+    while(__atomic_exchange_n(&lane->lock, 1, __ATOMIC_ACQUIRE)){
+        cpu_relax();
+    }
+    size_t tail = lane->tail;
+    bool added = tail - __atomic_load_n(&lane->head, __ATOMIC_ACQUIRE) < lanes->capacity;
+    if(added){
+        lane->slots[tail & lanes->mask] = data;
+        __atomic_store_n(&lane->tail, tail + 1, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&lane->lock, 0, __ATOMIC_RELEASE);
+    return added;
+}
+
+// Adds data to the lane of the current CPU
+// Returns true if the data was added and false if the lane is full or the thread has no usable lane
+static bool channel_lane_push(channel_lanes_t* lanes, void* data)
+{
+#ifdef CHANNEL_HAVE_RSEQ
+    if(lanes->rseq){
+        int outcome;
+        while((outcome = channel_lane_push_rseq(lanes, data)) == CHANNEL_LANE_RESTART){
+        }
+        return outcome == CHANNEL_LANE_ADDED;
+    }
+#endif
+    return channel_lane_push_locked(lanes, data);
+}
+
+// Sends data through the buffer of a channel with lanes, once the lanes have been drained into it so that the message
+// does not overtake the messages its producer left on a lane
+// Sets retry (and returns WOULDBLOCK) when draining made room on the lanes, the caller then adds to its lane again
+static enum chan_status channel_send_drained(chan_t* channel, void* data, bool blocking, bool* retry)
+{
+    *retry = false;
+    pthread_mutex_lock(&channel->mutex);
+    while(true){
+        if(!channel->open){
+            pthread_mutex_unlock(&channel->mutex);
+            return CLOSED_ERROR;
+        }
+        size_t sent = channel->sent;
+        if(channel_harvest_lanes(channel) && buffer_current_size(channel->buffer) < buffer_capacity(channel->buffer)){
+            break;
+        }
+        if(channel->sent != sent){
+            pthread_mutex_unlock(&channel->mutex);
+            *retry = true;
+            return WOULDBLOCK;
+        }
+        if(!blocking){
+            pthread_mutex_unlock(&channel->mutex);
+            return WOULDBLOCK;
+        }
+        if(channel_park(channel, &channel->send, 0) == CHANNEL_WAITER_CLOSED){
+            return CLOSED_ERROR;
+        }
+    }
+    if(!buffer_add(data, channel->buffer)){
+        pthread_mutex_unlock(&channel->mutex);
+        return OTHER_ERROR;
+    }
+    channel->sent++;
+    channel_check_high_watermark(channel);
+    channel_pending_t* completion = channel_hand_to_pending_receive(channel);
+    channel_notify_state(channel);
+    channel_wake_one(&channel->recv);
+    pthread_mutex_unlock(&channel->mutex);
+    channel_complete(completion, SUCCESS);
+    return SUCCESS;
+}
+
+// Logs a completed operation to the channel's recorder
+// The occupancy is read from the state published by the operation rather than under the mutex, so that recording
+// does not contend with the operations being recorded
+static void channel_record(chan_t* channel, enum record_op op, bool blocking, enum chan_status status, uint64_t start)
+{
+    size_t size = __atomic_load_n(&channel->poll_state, __ATOMIC_ACQUIRE) >> 1;
+    recorder_log(channel->recorder, channel->recorder_id, op, blocking, status, size, start, channel_now());
+}
 
 // Creates a new channel with the provided size and returns it to the caller
 // A 0 size indicates an unbuffered channel, whereas a positive size indicates a buffered channel
+// Returns NULL on allocation failure
 chan_t* channel_create(size_t size)
 {   
     if (size == 0) {
@@ -9,32 +772,210 @@ chan_t* channel_create(size_t size)
     }
 
     buffer_t* buffer = buffer_create(size);
+    if (!buffer) {
+        return NULL;
+    }
     chan_t* channel = (chan_t*) malloc(sizeof(chan_t));
+    if (!channel) {
+        buffer_free(buffer);
+        return NULL;
+    }
     channel->buffer = buffer;
-    channel->semaphore = NULL;
+    channel->selectors.head = NULL;
+    channel->selectors.count = 0;
+    channel->watchers.head = NULL;
+    channel->watchers.count = 0;
     channel->open = 1;
-    pthread_cond_init(&channel->recv, NULL);
-    pthread_cond_init(&channel->send, NULL);
+    channel->lossy = false;
+    channel->sent = 0;
+    channel->dropped = 0;
+    channel->idle_timeout = 0;
+    channel->idle_since = 0;
+    channel->high_watermark_trigger = SIZE_MAX;
+    channel->low_watermark_trigger = SIZE_MAX;
+    channel->high_watermark = 0;
+    channel->low_watermark = 0;
+    channel->watermark_callback = NULL;
+    channel->watermark_context = NULL;
+    channel->recorder = NULL;
+    channel->recorder_id = 0;
+    channel->poll_state = 0;
+    channel->pending_sends = NULL;
+    channel->pending_sends_tail = NULL;
+    channel->pending_receives = NULL;
+    channel->pending_receives_tail = NULL;
+    channel->lanes = NULL;
+    channel->set = NULL;
+    channel->wait_strategy = CHANNEL_WAIT_PARK;
+    channel->spin_budget = CHANNEL_SPIN_BUDGET_MIN;
+    channel->spinners = 0;
+    channel->send.head = NULL;
+    channel->send.tail = NULL;
+    channel->recv.head = NULL;
+    channel->recv.tail = NULL;
     pthread_mutex_init(&channel->mutex, NULL);
     
     return channel;
 }
 
-// Writes data to the given channel
-// This can be both a blocking call i.e., the function only returns on a successful completion of send (blocking = true), and
-// a non-blocking call i.e., the function simply returns if the channel is full (blocking = false)
-// In case of the blocking call when the channel is full, the function waits till the channel has space to write the new data
-// Returns SUCCESS for successfully writing data to the channel,
-// WOULDBLOCK if the channel is full and the data was not added to the buffer (non-blocking calls only),
-// CLOSED_ERROR if the channel is closed, and
-// OTHER_ERROR on encountering any other generic error of any sort
-enum chan_status channel_send(chan_t *channel, void* data, bool blocking)
+// Creates a new lossy channel with the provided size and returns it to the caller
+// Sends on a lossy channel never block: when the buffer is full the oldest message is overwritten and counted as dropped
+// Receivers can detect the resulting gaps through the sequence numbers returned by channel_receive_seq
+chan_t* channel_create_lossy(size_t size)
+{
+    chan_t* channel = channel_create(size);
+    if (channel) {
+        channel->lossy = true;
+    }
+    return channel;
+}
+
+// Creates a new work-set channel with the provided size and returns it to the caller
+// A work-set channel queues each item at most once: sending an item that is already queued succeeds without adding it
+// again (nor waiting for room), and receiving an item makes it eligible again, so the channel never holds more messages
+// than there are distinct items, and a worker is woken up once per item however many times it was sent
+// Items are hashed by pointer when max_id is 0, or are small integer ids below max_id (cast to pointers) tracked in a
+// bitmap otherwise, in which case sends of other values fail with OTHER_ERROR
+chan_t* channel_create_set(size_t size, size_t max_id)
+{
+    chan_t* channel = channel_create(size);
+    if (channel) {
+        channel->set = item_set_create(size, max_id);
+        if (!channel->set) {
+            channel_close(channel);
+            channel_destroy(channel);
+            return NULL;
+        }
+    }
+    return channel;
+}
+
+// Creates a new channel with the provided size and a lane of lane_size messages (rounded up to a power of two) for every
+// CPU, and returns it to the caller
+// channel_send_percpu adds messages to the lane of the CPU it runs on without locks or atomic instructions (with
+// restartable sequences where the kernel and C library provide them, a per-lane spinlock otherwise), and the lanes are
+// drained into the buffer by the receiving calls, so the channel holds up to size messages plus lane_size per CPU
+// Messages keep their order within a lane, the messages of a producer that migrates between CPUs may be reordered
+chan_t* channel_create_percpu(size_t size, size_t lane_size)
+{
+    if (lane_size == 0) {
+        return NULL;
+    }
+    chan_t* channel = channel_create(size);
+    if (!channel) {
+        return NULL;
+    }
+    pthread_once(&channel_lanes_once, channel_lanes_register);
+    channel_lanes_t* lanes = malloc(sizeof(channel_lanes_t));
+    if (!lanes) {
+        channel_close(channel);
+        channel_destroy(channel);
+        return NULL;
+    }
+    lanes->count = channel_lanes_count;
+    // a power of two, so that the sequence finds the slot with a mask
+    lanes->capacity = 1;
+    while (lanes->capacity < lane_size) {
+        lanes->capacity *= 2;
+    }
+    lanes->mask = lanes->capacity - 1;
+    lanes->sleepers = 0;
+#ifdef CHANNEL_HAVE_RSEQ
+    lanes->rseq = __rseq_size > 0;
+#else
+    lanes->rseq = false;
+#endif
+    lanes->lane = aligned_alloc(sizeof(channel_lane_t), sizeof(channel_lane_t) * lanes->count);
+    if (!lanes->lane) {
+        lanes->count = 0;
+    }
+    else {
+        memset(lanes->lane, 0, sizeof(channel_lane_t) * lanes->count);
+    }
+    // from here on, a failed allocation is cleaned up by channel_destroy
+    channel->lanes = lanes;
+    bool allocated = lanes->lane != NULL;
+    for (size_t i = 0; i < lanes->count && allocated; i++) {
+        lanes->lane[i].slots = malloc(sizeof(void*) * lanes->capacity);
+        allocated = lanes->lane[i].slots != NULL;
+    }
+    if (!allocated) {
+        channel_close(channel);
+        channel_destroy(channel);
+        return NULL;
+    }
+    return channel;
+}
+
+// Writes data to the lane of the current CPU of a channel created with channel_create_percpu (or behaves like
+// channel_send on other channels)
+// When the lane is full, the data goes to the buffer like channel_send does once the lanes have been drained into it
+// Consumers that are parked are woken up through the channel mutex, so producers only save the lock while the
+// consumers keep up (for instance with channel_receive_busy)
+// A send racing with channel_close may succeed without its message ever being received
+// Returns like channel_send
+enum chan_status channel_send_percpu(chan_t* channel, void* data, bool blocking)
+{
+    channel_lanes_t* lanes = channel->lanes;
+    if(!lanes){
+        return channel_send(channel, data, blocking);
+    }
+    if(__atomic_load_n(&channel->poll_state, __ATOMIC_ACQUIRE) & CHANNEL_POLL_CLOSED){
+        return CLOSED_ERROR;
+    }
+    while(!channel_lane_push(lanes, data)){
+        bool retry;
+        enum chan_status status = channel_send_drained(channel, data, blocking, &retry);
+        if(!retry){
+            return status;
+        }
+    }
+    if(!channel_lanes_membarrier){
+        channel_full_fence();
+    }
+    if(__atomic_load_n(&lanes->sleepers, __ATOMIC_RELAXED)){
+        channel_lanes_wake_sleepers(channel);
+    }
+    return SUCCESS;
+}
+
+// Performs channel_send without recording it
+static enum chan_status channel_send_unrecorded(chan_t *channel, void* data, bool blocking)
 {
+    if(blocking && !channel->lossy){
+        channel_spin_wait(channel, true);
+    }
     pthread_mutex_lock(&channel->mutex);
     if(!channel->open){
         pthread_mutex_unlock(&channel->mutex);
         return CLOSED_ERROR;
     }
+    if(!channel_valid_item(channel, data)){
+        pthread_mutex_unlock(&channel->mutex);
+        return OTHER_ERROR;
+    }
+    if(channel_already_queued(channel, data)){
+        pthread_mutex_unlock(&channel->mutex);
+        return SUCCESS;
+    }
+
+    //HANDLES THE CASE OF LOSSY CHANNELS, THE SENDER NEVER WAITS FOR SPACE
+    if(channel->lossy){
+        if(buffer_add_overwrite(data, channel->buffer)){
+            channel->dropped++;
+        }
+        channel->sent++;
+        channel_check_high_watermark(channel);
+        channel_pending_t* completion = channel_hand_to_pending_receive(channel);
+        channel_notify_state(channel);
+        channel_wake_one(&channel->recv);
+        pthread_mutex_unlock(&channel->mutex);
+        channel_complete(completion, SUCCESS);
+        return SUCCESS;
+    }
+
+    // asynchronous receive completed by this send
+    channel_pending_t* completion = NULL;
 
     //HANDLES THE CASE OF BLOCKING
     if(blocking){
@@ -43,19 +984,27 @@ enum chan_status channel_send(chan_t *channel, void* data, bool blocking)
                 pthread_mutex_unlock(&channel->mutex);
                 return CLOSED_ERROR;
             }
-            pthread_cond_wait(&channel->send, &channel->mutex);
+            if(channel_park(channel, &channel->send, 0) == CHANNEL_WAITER_CLOSED){
+                return CLOSED_ERROR;
+            }
+            // another sender may have queued the item meanwhile
+            if(channel_already_queued(channel, data)){
+                pthread_mutex_unlock(&channel->mutex);
+                return SUCCESS;
+            }
         }
 
         if (channel->open){
-            if(!buffer_add(data, channel->buffer)){
+            if(!channel_buffer_add(channel, data)){
                 pthread_mutex_unlock(&channel->mutex);
                 return OTHER_ERROR;
             }
+            channel->sent++;
+            channel_check_high_watermark(channel);
+            completion = channel_hand_to_pending_receive(channel);
         }
 
-        if(channel->semaphore){
-            sem_post(channel->semaphore);
-        }
+        channel_notify_state(channel);
     }
     //HANDLES THE CASE OF NON-BLOCKING
     else {
@@ -65,21 +1014,42 @@ enum chan_status channel_send(chan_t *channel, void* data, bool blocking)
         }
 
         if(channel->open){
-            if(!buffer_add(data, channel->buffer)){
+            if(!channel_buffer_add(channel, data)){
                 pthread_mutex_unlock(&channel->mutex);
                 return OTHER_ERROR;
             }
+            channel->sent++;
+            channel_check_high_watermark(channel);
+            completion = channel_hand_to_pending_receive(channel);
         }
 
-        if(channel->semaphore){
-            sem_post(channel->semaphore);
-        }
+        channel_notify_state(channel);
     }
-    pthread_cond_signal(&channel->recv);
+    channel_wake_one(&channel->recv);
     pthread_mutex_unlock(&channel->mutex);
+    channel_complete(completion, SUCCESS);
     return SUCCESS;
 }
 
+// Writes data to the given channel
+// This can be both a blocking call i.e., the function only returns on a successful completion of send (blocking = true), and
+// a non-blocking call i.e., the function simply returns if the channel is full (blocking = false)
+// In case of the blocking call when the channel is full, the function waits till the channel has space to write the new data
+// Returns SUCCESS for successfully writing data to the channel,
+// WOULDBLOCK if the channel is full and the data was not added to the buffer (non-blocking calls only),
+// CLOSED_ERROR if the channel is closed, and
+// OTHER_ERROR on encountering any other generic error of any sort
+enum chan_status channel_send(chan_t *channel, void* data, bool blocking)
+{
+    if(!channel->recorder){
+        return channel_send_unrecorded(channel, data, blocking);
+    }
+    uint64_t start = channel_now();
+    enum chan_status status = channel_send_unrecorded(channel, data, blocking);
+    channel_record(channel, RECORD_SEND, blocking, status, start);
+    return status;
+}
+
 // Reads data from the given channel and stores it in the function’s input parameter, data (Note that it is a double pointer).
 // This can be both a blocking call i.e., the function only returns on a successful completion of receive (blocking = true), and
 // a non-blocking call i.e., the function simply returns if the channel is empty (blocking = false)
@@ -90,31 +1060,76 @@ enum chan_status channel_send(chan_t *channel, void* data, bool blocking)
 // OTHER_ERROR on encountering any other generic error of any sort
 enum chan_status channel_receive(chan_t* channel, void** data, bool blocking)
 {
+    return channel_receive_seq(channel, data, NULL, blocking);
+}
+
+// Performs channel_receive_seq without recording it
+static enum chan_status channel_receive_unrecorded(chan_t* channel, void** data, size_t* seq, bool blocking, uint64_t deadline)
+{
+    if(blocking){
+        channel_spin_wait(channel, false);
+    }
     pthread_mutex_lock(&channel->mutex);
     if(!channel->open){
         pthread_mutex_unlock(&channel->mutex);
         return CLOSED_ERROR;
     }
+    channel_harvest_lanes(channel);
+
+    // asynchronous send completed by this receive
+    channel_pending_t* completion = NULL;
 
     //HANDLES THE CASE OF BLOCKING
     if(blocking){
+        bool sleeping = false;
         while(!buffer_current_size(channel->buffer)){
             if(!channel->open){
+                if(sleeping){
+                    channel_lanes_wake(channel);
+                }
                 pthread_mutex_unlock(&channel->mutex);
                 return CLOSED_ERROR;
             }
-            pthread_cond_wait(&channel->recv, &channel->mutex);
+            if(channel->lanes && !sleeping){
+                // producers on the lanes only take the mutex to wake up registered sleepers
+                channel_lanes_sleep(channel);
+                sleeping = true;
+                continue;
+            }
+            if(deadline && channel_now() >= deadline){
+                if(sleeping){
+                    channel_lanes_wake(channel);
+                }
+                pthread_mutex_unlock(&channel->mutex);
+                return WOULDBLOCK;
+            }
+            if(channel_wait_recv(channel, deadline)){
+                if(sleeping){
+                    pthread_mutex_lock(&channel->mutex);
+                    channel_lanes_wake(channel);
+                    pthread_mutex_unlock(&channel->mutex);
+                }
+                return CLOSED_ERROR;
+            }
+            channel_harvest_lanes(channel);
+        }
+        if(sleeping){
+            channel_lanes_wake(channel);
         }
         if (channel->open){
-            *data = buffer_remove(channel->buffer);
+            if(seq){
+                *seq = channel->sent - buffer_current_size(channel->buffer);
+            }
+            *data = channel_buffer_remove(channel);
             if(!data){
                 pthread_mutex_unlock(&channel->mutex);
                 return OTHER_ERROR;
             }
+            channel_mark_idle(channel);
+            channel_check_low_watermark(channel);
+            completion = channel_fill_from_pending_send(channel);
         }
-        if(channel->semaphore){
-            sem_post(channel->semaphore);
-        }
+        channel_notify_state(channel);
     }
 
     //HANDLES THE CASE OF NON BLOCKING
@@ -124,30 +1139,298 @@ enum chan_status channel_receive(chan_t* channel, void** data, bool blocking)
             return WOULDBLOCK;
         }
         if(channel->open){
-            *data = buffer_remove(channel->buffer);
+            if(seq){
+                *seq = channel->sent - buffer_current_size(channel->buffer);
+            }
+            *data = channel_buffer_remove(channel);
             if(!data){
                 pthread_mutex_unlock(&channel->mutex);
                 return OTHER_ERROR;
             }
+            channel_mark_idle(channel);
+            channel_check_low_watermark(channel);
+            completion = channel_fill_from_pending_send(channel);
         }
-        if(channel->semaphore){
-            sem_post(channel->semaphore);
-        }
+        channel_notify_state(channel);
     }
 
-    pthread_cond_signal(&channel->send);
+    channel_wake_one(&channel->send);
     pthread_mutex_unlock(&channel->mutex);
+    channel_complete_all(completion, SUCCESS);
     return SUCCESS;
     
 }
 
+// Same as channel_receive, but also stores the sequence number of the received message in seq (if seq is not NULL)
+// Messages are numbered from 0 in the order they were sent, so a jump in consecutive sequence numbers means
+// that the messages in between were overwritten on a lossy channel
+enum chan_status channel_receive_seq(chan_t* channel, void** data, size_t* seq, bool blocking)
+{
+    if(!channel->recorder){
+        return channel_receive_unrecorded(channel, data, seq, blocking, 0);
+    }
+    uint64_t start = channel_now();
+    enum chan_status status = channel_receive_unrecorded(channel, data, seq, blocking, 0);
+    channel_record(channel, RECORD_RECEIVE, blocking, status, start);
+    return status;
+}
 
-// Closes the channel and informs all the blocking send/receive/select calls to return with CLOSED_ERROR
-// Once the channel is closed, send/receive/select operations will cease to function and just return CLOSED_ERROR
-// Returns SUCCESS if close is successful,
-// CLOSED_ERROR if the channel is already closed, and
-// OTHER_ERROR in any other error case
-enum chan_status channel_close(chan_t* channel)
+// Same as a blocking channel_receive, but gives up once timeout_usec microseconds have passed without a message
+// Returns SUCCESS for successful retrieval of data,
+// WOULDBLOCK if no message arrived before the timeout,
+// CLOSED_ERROR if the channel is closed, and
+// OTHER_ERROR on encountering any other generic error of any sort
+enum chan_status channel_receive_timed(chan_t* channel, void** data, uint64_t timeout_usec)
+{
+    uint64_t start = channel_now();
+    // a deadline of 0 means none, so a zero timeout still waits for 1 nanosecond
+    enum chan_status status = channel_receive_unrecorded(channel, data, NULL, true, start + timeout_usec * NS_PER_USEC + 1);
+    if(channel->recorder){
+        // a receive that timed out is replayed as a non-blocking one
+        channel_record(channel, RECORD_RECEIVE, status != WOULDBLOCK, status, start);
+    }
+    return status;
+}
+
+// Sends data on the channel without blocking the caller, for event loops that cannot wait in channel_send
+// If the channel has room, the data is added and callback is invoked right away on the calling thread
+// Otherwise a one-shot registration is queued on the channel, and callback is invoked on the thread of the receive that
+// makes room for the data (or of the close) once the data has been added
+// Returns SUCCESS if the data was sent (callback already invoked),
+// WOULDBLOCK if the send was registered (callback invoked later),
+// CLOSED_ERROR if the channel is closed (callback not invoked), and
+// OTHER_ERROR on encountering any other generic error of any sort (callback not invoked)
+enum chan_status channel_send_async(chan_t* channel, void* data, channel_completion_fn callback, void* context)
+{
+    channel_pending_t* pending = malloc(sizeof(channel_pending_t));
+    if(!pending){
+        return OTHER_ERROR;
+    }
+    pending->callback = callback;
+    pending->context = context;
+    pending->data = data;
+    pthread_mutex_lock(&channel->mutex);
+    if(!channel->open){
+        pthread_mutex_unlock(&channel->mutex);
+        free(pending);
+        return CLOSED_ERROR;
+    }
+    if(!channel_valid_item(channel, data)){
+        pthread_mutex_unlock(&channel->mutex);
+        free(pending);
+        return OTHER_ERROR;
+    }
+    if(channel_already_queued(channel, data)){
+        pthread_mutex_unlock(&channel->mutex);
+        channel_complete(pending, SUCCESS);
+        return SUCCESS;
+    }
+    // earlier sends keep their turn
+    bool full = !channel->lossy && buffer_current_size(channel->buffer) == buffer_capacity(channel->buffer);
+    if(full || channel->pending_sends){
+        channel_pending_push(&channel->pending_sends, &channel->pending_sends_tail, pending);
+        pthread_mutex_unlock(&channel->mutex);
+        return WOULDBLOCK;
+    }
+    if(channel->lossy){
+        if(buffer_add_overwrite(data, channel->buffer)){
+            channel->dropped++;
+        }
+    }
+    else if(!channel_buffer_add(channel, data)){
+        pthread_mutex_unlock(&channel->mutex);
+        free(pending);
+        return OTHER_ERROR;
+    }
+    channel->sent++;
+    channel_check_high_watermark(channel);
+    channel_pending_t* completion = channel_hand_to_pending_receive(channel);
+    channel_notify_state(channel);
+    channel_wake_one(&channel->recv);
+    pthread_mutex_unlock(&channel->mutex);
+    channel_complete(completion, SUCCESS);
+    channel_complete(pending, SUCCESS);
+    return SUCCESS;
+}
+
+// Receives a message from the channel without blocking the caller, for event loops that cannot wait in channel_receive
+// If a message is waiting, it is taken and callback is invoked right away on the calling thread
+// Otherwise a one-shot registration is queued on the channel, and callback is invoked on the thread of the send that
+// delivers the message (or of the close)
+// Returns SUCCESS if a message was received (callback already invoked),
+// WOULDBLOCK if the receive was registered (callback invoked later),
+// CLOSED_ERROR if the channel is closed (callback not invoked), and
+// OTHER_ERROR on encountering any other generic error of any sort (callback not invoked)
+enum chan_status channel_receive_async(chan_t* channel, channel_completion_fn callback, void* context)
+{
+    channel_pending_t* pending = malloc(sizeof(channel_pending_t));
+    if(!pending){
+        return OTHER_ERROR;
+    }
+    pending->callback = callback;
+    pending->context = context;
+    pending->data = NULL;
+    pthread_mutex_lock(&channel->mutex);
+    if(!channel->open){
+        pthread_mutex_unlock(&channel->mutex);
+        free(pending);
+        return CLOSED_ERROR;
+    }
+    channel_harvest_lanes(channel);
+    // earlier receives keep their turn
+    if(!buffer_current_size(channel->buffer) || channel->pending_receives){
+        if(channel->lanes){
+            // stays registered as a sleeper until the receive is completed
+            channel_lanes_sleep(channel);
+        }
+        channel_pending_push(&channel->pending_receives, &channel->pending_receives_tail, pending);
+        // the last look at the lanes may have found a message for it
+        channel_pending_t* completion = channel_hand_to_pending_receive(channel);
+        pthread_mutex_unlock(&channel->mutex);
+        if(completion == pending){
+            channel_complete(completion, SUCCESS);
+            return SUCCESS;
+        }
+        channel_complete(completion, SUCCESS);
+        return WOULDBLOCK;
+    }
+    pending->data = channel_buffer_remove(channel);
+    channel_mark_idle(channel);
+    channel_check_low_watermark(channel);
+    channel_pending_t* completion = channel_fill_from_pending_send(channel);
+    channel_notify_state(channel);
+    channel_wake_one(&channel->send);
+    pthread_mutex_unlock(&channel->mutex);
+    channel_complete_all(completion, SUCCESS);
+    channel_complete(pending, SUCCESS);
+    return SUCCESS;
+}
+
+// Returns the number of messages that were overwritten before being received
+// This is always 0 for channels that are not lossy
+size_t channel_dropped(chan_t* channel)
+{
+    pthread_mutex_lock(&channel->mutex);
+    size_t dropped = channel->dropped;
+    pthread_mutex_unlock(&channel->mutex);
+    return dropped;
+}
+
+// Sets how long (in microseconds) the channel must stay empty before its buffer storage is released
+// The storage is allocated again transparently by the next send, and a timeout of 0 (the default) never releases it
+// A receiver blocked on an idle channel releases the storage itself once the timeout expires
+void channel_set_idle_timeout(chan_t* channel, uint64_t timeout_usec)
+{
+    pthread_mutex_lock(&channel->mutex);
+    channel->idle_timeout = timeout_usec * NS_PER_USEC;
+    channel->idle_since = channel_now();
+    // wake receivers so that they start bounding their waits
+    channel_wake_all(&channel->recv, CHANNEL_WAITER_WOKEN);
+    pthread_mutex_unlock(&channel->mutex);
+}
+
+// Releases the buffer storage of the channel if it has been empty for longer than its idle timeout
+// This lets a maintenance thread reclaim memory from idle channels that nobody is blocked on
+// Returns true if the storage was released and false otherwise
+bool channel_reclaim_idle(chan_t* channel)
+{
+    pthread_mutex_lock(&channel->mutex);
+    bool released = channel_release_if_idle(channel);
+    pthread_mutex_unlock(&channel->mutex);
+    return released;
+}
+
+// Sets how blocking sends and receives on the channel wait before parking (see enum chan_wait)
+// Spinning only pays off while the waiters have a CPU to themselves, CHANNEL_WAIT_ADAPTIVE keeps it from collapsing
+// throughput when there are more threads than CPUs
+void channel_set_wait_strategy(chan_t* channel, enum chan_wait strategy)
+{
+    __atomic_store_n(&channel->wait_strategy, (int)strategy, __ATOMIC_RELAXED);
+}
+
+// Configures occupancy watermarks on the channel
+// callback is invoked with high = true once the number of buffered messages rises to high, and is not invoked again
+// until the occupancy has fallen to low, at which point it is invoked with high = false (and vice versa)
+// The callback runs on the sending/receiving thread while the channel is locked, so it must not block or use this channel
+// A NULL callback disables the watermarks
+// Returns SUCCESS if the watermarks were set, and
+// OTHER_ERROR if low < high <= capacity does not hold
+enum chan_status channel_set_watermarks(chan_t* channel, size_t high, size_t low, channel_watermark_fn callback, void* context)
+{
+    if(callback && (low >= high || high > buffer_capacity(channel->buffer))){
+        return OTHER_ERROR;
+    }
+    pthread_mutex_lock(&channel->mutex);
+    channel->high_watermark = high;
+    channel->low_watermark = low;
+    channel->watermark_callback = callback;
+    channel->watermark_context = context;
+    if(!callback){
+        channel->high_watermark_trigger = SIZE_MAX;
+        channel->low_watermark_trigger = SIZE_MAX;
+    }
+    else if(buffer_current_size(channel->buffer) >= high){
+        // already above the high watermark, wait for the occupancy to drain to low
+        channel->high_watermark_trigger = SIZE_MAX;
+        channel->low_watermark_trigger = low;
+    }
+    else{
+        channel->high_watermark_trigger = high;
+        channel->low_watermark_trigger = SIZE_MAX;
+    }
+    pthread_mutex_unlock(&channel->mutex);
+    return SUCCESS;
+}
+
+// Watermark callback that forwards crossings to a notification channel, given as the context
+// It sends CHANNEL_WATERMARK_HIGH or CHANNEL_WATERMARK_LOW without blocking, so the notification channel should be
+// lossy (see channel_create_lossy) to never lose the most recent crossing
+void channel_watermark_notify(void* context, bool high)
+{
+    channel_send((chan_t*)context, high ? CHANNEL_WATERMARK_HIGH : CHANNEL_WATERMARK_LOW, false);
+}
+
+// Registers a watcher on the channel, its callback is invoked on every change of state of the channel (a message added or
+// removed, or the channel closed) until channel_unwatch, this is how callers that cannot block in channel_select (such as
+// coroutines) learn when to retry their non-blocking operations
+// The callback runs on the thread that changed the state while the channel is locked, so it must not block or use this
+// channel
+void channel_watch(chan_t* channel, channel_watcher_t* watcher)
+{
+    pthread_mutex_lock(&channel->mutex);
+    list_insert(&channel->watchers, watcher);
+    if(channel->lanes){
+        // producers on the lanes only take the mutex (and report changes) while someone sleeps on them
+        channel_lanes_sleep(channel);
+    }
+    pthread_mutex_unlock(&channel->mutex);
+}
+
+// Unregisters a watcher, its callback is not invoked anymore once this returns
+void channel_unwatch(chan_t* channel, channel_watcher_t* watcher)
+{
+    pthread_mutex_lock(&channel->mutex);
+    list_node_t* node = list_find(&channel->watchers, watcher);
+    if(node){
+        list_remove(&channel->watchers, node);
+        if(channel->lanes){
+            channel_lanes_wake(channel);
+        }
+    }
+    pthread_mutex_unlock(&channel->mutex);
+}
+
+// Returns whether a send (or a receive) on the channel would go ahead without blocking, a closed channel always does,
+// and so does a send on a lossy channel
+// This reads the state published to busy pollers without locking the channel, so it is only a hint that may be stale
+// by the time the caller acts on it, unless called from a watcher callback
+bool channel_ready(chan_t* channel, bool send)
+{
+    return channel_poll_ready(channel, send);
+}
+
+// Performs channel_close without recording it
+static enum chan_status channel_close_unrecorded(chan_t* channel)
 {
    pthread_mutex_lock(&channel->mutex);
 
@@ -157,19 +1440,60 @@ enum chan_status channel_close(chan_t* channel)
     }
     else{
         channel->open = false;
-        pthread_cond_broadcast(&channel->send);
-        pthread_cond_broadcast(&channel->recv);
+        // the waiters learn about the close from their own futex word, and return without taking the mutex again
+        channel_wake_all(&channel->send, CHANNEL_WAITER_CLOSED);
+        channel_wake_all(&channel->recv, CHANNEL_WAITER_CLOSED);
 
-        if(channel->semaphore){
-            sem_post(channel->semaphore);
+        channel_notify_state(channel);
+        channel_pending_t* sends = channel->pending_sends;
+        channel_pending_t* receives = channel->pending_receives;
+        for(channel_pending_t* pending = receives; pending && channel->lanes; pending = pending->next){
+            channel_lanes_wake(channel);
         }
+        channel->pending_sends = channel->pending_sends_tail = NULL;
+        channel->pending_receives = channel->pending_receives_tail = NULL;
         pthread_mutex_unlock(&channel->mutex);
+        // the waiting asynchronous operations fail, on the closing thread
+        while(sends){
+            channel_pending_t* next = sends->next;
+            channel_complete(sends, CLOSED_ERROR);
+            sends = next;
+        }
+        while(receives){
+            channel_pending_t* next = receives->next;
+            channel_complete(receives, CLOSED_ERROR);
+            receives = next;
+        }
         return SUCCESS;
     }
     pthread_mutex_unlock(&channel->mutex);
     return OTHER_ERROR;
 }
 
+// Closes the channel and informs all the blocking send/receive/select calls to return with CLOSED_ERROR
+// Once the channel is closed, send/receive/select operations will cease to function and just return CLOSED_ERROR
+// Returns SUCCESS if close is successful,
+// CLOSED_ERROR if the channel is already closed, and
+// OTHER_ERROR in any other error case
+enum chan_status channel_close(chan_t* channel)
+{
+    if(!channel->recorder){
+        return channel_close_unrecorded(channel);
+    }
+    uint64_t start = channel_now();
+    enum chan_status status = channel_close_unrecorded(channel);
+    channel_record(channel, RECORD_CLOSE, false, status, start);
+    return status;
+}
+
+// Frees the nodes of a list embedded in the channel, which should already be empty once every select and watcher is gone
+static void channel_list_clear(list_t* list)
+{
+    while(list->head){
+        list_remove(list, list->head);
+    }
+}
+
 // Frees all the memory allocated to the channel
 // The caller is responsible for calling channel_close and waiting for all threads to finish their tasks before calling channel_destroy
 // Returns SUCCESS if destroy is successful,
@@ -183,8 +1507,18 @@ enum chan_status channel_destroy(chan_t* channel)
 
     else{
         buffer_free(channel->buffer);
-        pthread_cond_destroy(&channel->recv);
-        pthread_cond_destroy(&channel->send);
+        if(channel->set){
+            item_set_free(channel->set);
+        }
+        channel_list_clear(&channel->selectors);
+        channel_list_clear(&channel->watchers);
+        if(channel->lanes){
+            for(size_t i = 0; i < channel->lanes->count; i++){
+                free(channel->lanes->lane[i].slots);
+            }
+            free(channel->lanes->lane);
+            free(channel->lanes);
+        }
         pthread_mutex_destroy(&channel->mutex);
         free(channel);
         return SUCCESS;
@@ -202,36 +1536,101 @@ enum chan_status channel_destroy(chan_t* channel)
 // Additionally, selected_index is set to the index of the channel that generated the error
 enum chan_status channel_select(size_t channel_count, select_t* channel_list, size_t* selected_index)
 {
-    sem_t *semaphore = (sem_t*)malloc(sizeof(sem_t));
-    sem_init(semaphore, 1, 0);
+    sem_t semaphore;
+    sem_init(&semaphore, 0, 0);
 
-    for(int i = 0; i < channel_count; i++){
-        pthread_mutex_lock(&(channel_list[i].channel->mutex));
-        channel_list[i].channel->semaphore = semaphore;
-        pthread_mutex_unlock(&(channel_list[i].channel->mutex));
+    // register before the first pass so that no change of state after the pass can be missed
+    for(size_t i = 0; i < channel_count; i++){
+        pthread_mutex_lock(&channel_list[i].channel->mutex);
+        list_insert(&channel_list[i].channel->selectors, &semaphore);
+        if(channel_list[i].channel->lanes && !channel_list[i].is_send){
+            channel_lanes_sleep(channel_list[i].channel);
+        }
+        pthread_mutex_unlock(&channel_list[i].channel->mutex);
     }
 
-    while(true){ //check if valid
-        for(int i = 0; i < channel_count; i++){
+    enum chan_status status = WOULDBLOCK;
+    while(status == WOULDBLOCK){
+        for(size_t i = 0; i < channel_count; i++){
             if(channel_list[i].is_send){
-                pthread_mutex_lock(&(channel_list[i].channel->mutex));
-                if(buffer_capacity(channel_list[i].channel->buffer) > buffer_current_size(channel_list[i].channel->buffer)){
-                    *selected_index = (size_t)i;
-                    pthread_mutex_unlock(&(channel_list[i].channel->mutex));
-                    return channel_send(channel_list[i].channel, &channel_list[i].data, true);
-                }
+                status = channel_send(channel_list[i].channel, channel_list[i].data, false);
             }
             else{
-                pthread_mutex_lock(&(channel_list[i].channel->mutex));
-                if(buffer_current_size(channel_list[i].channel->buffer)){
-                    *selected_index = (size_t)i;
-                    pthread_mutex_unlock(&(channel_list[i].channel->mutex));
-                    return channel_receive(channel_list[i].channel, &channel_list[i].data, true);
-                }
+                status = channel_receive(channel_list[i].channel, &channel_list[i].data, false);
             }
+            if(status != WOULDBLOCK){
+                *selected_index = i;
+                break;
+            }
+        }
+        if(status == WOULDBLOCK){
+            sem_wait(&semaphore);
         }
-        sem_wait(semaphore);
     }
 
-    return OTHER_ERROR;
-}
\ No newline at end of file
+    for(size_t i = 0; i < channel_count; i++){
+        pthread_mutex_lock(&channel_list[i].channel->mutex);
+        list_remove(&channel_list[i].channel->selectors, list_find(&channel_list[i].channel->selectors, &semaphore));
+        if(channel_list[i].channel->lanes && !channel_list[i].is_send){
+            channel_lanes_wake(channel_list[i].channel);
+        }
+        pthread_mutex_unlock(&channel_list[i].channel->mutex);
+    }
+    sem_destroy(&semaphore);
+    return status;
+}
+
+// Busy-polling version of a blocking channel_receive, for consumers that own a dedicated core
+// Spins on the occupancy published by the channel (with a pause instruction) instead of sleeping on a condition
+// variable, and only locks the channel to take a message once one has been published
+// Returns SUCCESS for successful retrieval of data,
+// CLOSED_ERROR if the channel is closed, and
+// OTHER_ERROR on encountering any other generic error of any sort
+enum chan_status channel_receive_busy(chan_t* channel, void** data)
+{
+    while(true){
+        size_t state = __atomic_load_n(&channel->poll_state, __ATOMIC_ACQUIRE);
+        if(state & CHANNEL_POLL_CLOSED){
+            return CLOSED_ERROR;
+        }
+        if(state >> 1 || channel_lanes_pending(channel)){
+            enum chan_status status = channel_receive(channel, data, false);
+            // another consumer may have taken the message first
+            if(status != WOULDBLOCK){
+                return status;
+            }
+        }
+        cpu_relax();
+    }
+}
+
+// Busy-polling version of channel_select, for callers that own a dedicated core
+// Spins over the occupancy published by every channel (with a pause instruction) instead of waiting on a semaphore,
+// and only locks a channel to perform the operation once the channel looks ready for it
+// Returns like channel_select
+enum chan_status channel_select_busy(size_t channel_count, select_t* channel_list, size_t* selected_index)
+{
+    while(true){
+        for(size_t i = 0; i < channel_count; i++){
+            chan_t* channel = channel_list[i].channel;
+            size_t state = __atomic_load_n(&channel->poll_state, __ATOMIC_ACQUIRE);
+            size_t size = state >> 1;
+            bool ready = (state & CHANNEL_POLL_CLOSED) || (channel_list[i].is_send ? size < buffer_capacity(channel->buffer) || channel->lossy : size > 0 || channel_lanes_pending(channel));
+            if(!ready){
+                continue;
+            }
+            enum chan_status status;
+            if(channel_list[i].is_send){
+                status = channel_send(channel, channel_list[i].data, false);
+            }
+            else{
+                status = channel_receive(channel, &channel_list[i].data, false);
+            }
+            if(status != WOULDBLOCK){
+                *selected_index = i;
+                return status;
+            }
+        }
+        cpu_relax();
+    }
+}
@@ -6,9 +6,11 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include "buffer.h"
+#include "item_set.h"
 #include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "linked_list.h"
 
 // Defines possible return values from channel functions
@@ -20,16 +22,121 @@ enum chan_status {
     DESTROY_ERROR = -3
 };
 
+// Defines the callback completing an asynchronous send or receive
+// status is SUCCESS once the operation went through and CLOSED_ERROR if the channel was closed first, data is the
+// received message (receives), or the message that was (or could not be) sent (sends)
+typedef void (*channel_completion_fn)(void* context, enum chan_status status, void* data);
+
+// Defines an asynchronous operation registered on a channel, waiting for the channel to become ready
+typedef struct channel_pending {
+    channel_completion_fn callback;
+    void* context;
+    void* data;
+    struct channel_pending* next;
+} channel_pending_t;
+
+// Defines a thread parked in a blocking send or receive, linked on the channel until it is woken up
+// Each waiter sleeps on its own futex word, so a send wakes exactly one waiter, and close hands CLOSED_ERROR to every
+// waiter through its word without them having to take the channel mutex again
+typedef struct channel_waiter {
+    struct channel_waiter* next;
+    struct channel_waiter* prev;
+    uint32_t state;
+} channel_waiter_t;
+
+// Defines the parked senders or receivers of a channel, oldest first
+typedef struct {
+    channel_waiter_t* head;
+    channel_waiter_t* tail;
+} channel_waitq_t;
+
+// Defines how blocking sends and receives wait for the channel to become ready before parking on it
+enum chan_wait {
+    // Park right away (the default)
+    CHANNEL_WAIT_PARK = 0,
+    // Spin with a pause instruction for a fixed number of checks, then park
+    CHANNEL_WAIT_SPIN = 1,
+    // Call sched_yield for a fixed number of checks, then park
+    CHANNEL_WAIT_YIELD = 2,
+    // Spin for a budget that grows when spinning succeeds and shrinks when it fails, and yield for a few checks instead
+    // once the budget is exhausted or when the waiters already spinning would fill every CPU, then park
+    CHANNEL_WAIT_ADAPTIVE = 3
+};
+
+// Defines the per-CPU lanes of a channel created with channel_create_percpu
+typedef struct channel_lanes channel_lanes_t;
+
+// Defines the recorder that channel operations can be logged to (see recorder.h)
+typedef struct recorder recorder_t;
+
+// Defines a watcher of the state of a channel (see channel_watch), owned by the caller
+typedef struct {
+    void (*callback)(void* context);
+    void* context;
+} channel_watcher_t;
+
+// Defines the callback invoked when a channel crosses one of its watermarks
+// high is true when the occupancy rose to the high watermark and false when it fell back to the low watermark
+typedef void (*channel_watermark_fn)(void* context, bool high);
+
+// Messages sent on a notification channel by channel_watermark_notify
+#define CHANNEL_WATERMARK_HIGH  ((void *) 1L)
+#define CHANNEL_WATERMARK_LOW   ((void *) 2L)
+
 // Defines channel object
 typedef struct {
     // DO NOT REMOVE buffer (OR CHANGE ITS NAME) FROM THE STRUCT
     // YOU MUST USE buffer TO STORE YOUR BUFFERED CHANNEL MESSAGES
     buffer_t* buffer;
     int open;
-    sem_t* semaphore;
+    // Lossy channels overwrite the oldest message instead of blocking the sender
+    bool lossy;
+    // Number of messages ever added to the buffer, used to sequence messages
+    size_t sent;
+    // Number of messages overwritten before being received (lossy channels only)
+    size_t dropped;
+    // Items queued on a work-set channel (see channel_create_set), NULL for other channels
+    item_set_t* set;
+    // How long (in nanoseconds) the channel must stay empty before its buffer storage is released, 0 never releases it
+    uint64_t idle_timeout;
+    // Time (CLOCK_MONOTONIC, in nanoseconds) at which the channel last became empty
+    uint64_t idle_since;
+    // Occupancy at which the next watermark crossing is reported, SIZE_MAX when there is nothing to report
+    // Only one of the two is armed at a time, which gives the watermarks their hysteresis
+    size_t high_watermark_trigger;
+    size_t low_watermark_trigger;
+    size_t high_watermark;
+    size_t low_watermark;
+    channel_watermark_fn watermark_callback;
+    void* watermark_context;
+    // Recorder logging the operations on this channel (NULL when not recorded), and the channel's id within it
+    recorder_t* recorder;
+    uint32_t recorder_id;
+    // Semaphores of the select calls currently waiting on this channel, posted on every change of state
+    // Both lists are embedded so that a channel that is never selected on or watched costs no allocation for them
+    list_t selectors;
+    // Watchers registered with channel_watch, invoked on every change of state
+    list_t watchers;
+    // Occupancy (shifted left by one) and closed flag (lowest bit) published after every change of state, so that busy
+    // pollers can watch the channel without locking it
+    size_t poll_state;
+    // Wait strategy of blocking calls (enum chan_wait), the adaptive spin budget, and the number of callers currently
+    // spinning
+    int wait_strategy;
+    uint32_t spin_budget;
+    uint32_t spinners;
+    // Asynchronous sends and receives still waiting, oldest first
+    channel_pending_t* pending_sends;
+    channel_pending_t* pending_sends_tail;
+    channel_pending_t* pending_receives;
+    channel_pending_t* pending_receives_tail;
+    // Per-CPU lanes that channel_send_percpu adds to without locking, drained into the buffer by the consumers
+    // (NULL for other channels)
+    channel_lanes_t* lanes;
     pthread_mutex_t mutex;
-    pthread_cond_t send;
-    pthread_cond_t recv;
+    // Parked blocking senders and receivers
+    channel_waitq_t send;
+    channel_waitq_t recv;
 } chan_t;
 
 typedef struct {
@@ -44,8 +151,39 @@ typedef struct {
 
 // Creates a new channel with the provided size and returns it to the caller
 // A 0 size indicates an unbuffered channel, whereas a positive size indicates a buffered channel
+// Returns NULL on allocation failure
 chan_t* channel_create(size_t size);
 
+// Creates a new lossy channel with the provided size and returns it to the caller
+// Sends on a lossy channel never block: when the buffer is full the oldest message is overwritten and counted as dropped
+// Receivers can detect the resulting gaps through the sequence numbers returned by channel_receive_seq
+chan_t* channel_create_lossy(size_t size);
+
+// Creates a new work-set channel with the provided size and returns it to the caller
+// A work-set channel queues each item at most once: sending an item that is already queued succeeds without adding it
+// again (nor waiting for room), and receiving an item makes it eligible again, so the channel never holds more messages
+// than there are distinct items, and a worker is woken up once per item however many times it was sent
+// Items are hashed by pointer when max_id is 0, or are small integer ids below max_id (cast to pointers) tracked in a
+// bitmap otherwise, in which case sends of other values fail with OTHER_ERROR
+chan_t* channel_create_set(size_t size, size_t max_id);
+
+// Creates a new channel with the provided size and a lane of lane_size messages (rounded up to a power of two) for every
+// CPU, and returns it to the caller
+// channel_send_percpu adds messages to the lane of the CPU it runs on without locks or atomic instructions (with
+// restartable sequences where the kernel and C library provide them, a per-lane spinlock otherwise), and the lanes are
+// drained into the buffer by the receiving calls, so the channel holds up to size messages plus lane_size per CPU
+// Messages keep their order within a lane, the messages of a producer that migrates between CPUs may be reordered
+chan_t* channel_create_percpu(size_t size, size_t lane_size);
+
+// Writes data to the lane of the current CPU of a channel created with channel_create_percpu (or behaves like
+// channel_send on other channels)
+// When the lane is full, the data goes to the buffer like channel_send does once the lanes have been drained into it
+// Consumers that are parked are woken up through the channel mutex, so producers only save the lock while the
+// consumers keep up (for instance with channel_receive_busy)
+// A send racing with channel_close may succeed without its message ever being received
+// Returns like channel_send
+enum chan_status channel_send_percpu(chan_t* channel, void* data, bool blocking);
+
 // Writes data to the given channel
 // This can be both a blocking call i.e., the function only returns on a successful completion of send (blocking = true), and
 // a non-blocking call i.e., the function simply returns if the channel is full (blocking = false)
@@ -66,6 +204,91 @@ enum chan_status channel_send(chan_t* channel, void* data, bool blocking);
 // OTHER_ERROR on encountering any other generic error of any sort
 enum chan_status channel_receive(chan_t* channel, void** data, bool blocking);
 
+// Same as channel_receive, but also stores the sequence number of the received message in seq (if seq is not NULL)
+// Messages are numbered from 0 in the order they were sent, so a jump in consecutive sequence numbers means
+// that the messages in between were overwritten on a lossy channel
+enum chan_status channel_receive_seq(chan_t* channel, void** data, size_t* seq, bool blocking);
+
+// Same as a blocking channel_receive, but gives up once timeout_usec microseconds have passed without a message
+// Returns SUCCESS for successful retrieval of data,
+// WOULDBLOCK if no message arrived before the timeout,
+// CLOSED_ERROR if the channel is closed, and
+// OTHER_ERROR on encountering any other generic error of any sort
+enum chan_status channel_receive_timed(chan_t* channel, void** data, uint64_t timeout_usec);
+
+// Sends data on the channel without blocking the caller, for event loops that cannot wait in channel_send
+// If the channel has room, the data is added and callback is invoked right away on the calling thread
+// Otherwise a one-shot registration is queued on the channel, and callback is invoked on the thread of the receive that
+// makes room for the data (or of the close) once the data has been added
+// Returns SUCCESS if the data was sent (callback already invoked),
+// WOULDBLOCK if the send was registered (callback invoked later),
+// CLOSED_ERROR if the channel is closed (callback not invoked), and
+// OTHER_ERROR on encountering any other generic error of any sort (callback not invoked)
+enum chan_status channel_send_async(chan_t* channel, void* data, channel_completion_fn callback, void* context);
+
+// Receives a message from the channel without blocking the caller, for event loops that cannot wait in channel_receive
+// If a message is waiting, it is taken and callback is invoked right away on the calling thread
+// Otherwise a one-shot registration is queued on the channel, and callback is invoked on the thread of the send that
+// delivers the message (or of the close)
+// Returns SUCCESS if a message was received (callback already invoked),
+// WOULDBLOCK if the receive was registered (callback invoked later),
+// CLOSED_ERROR if the channel is closed (callback not invoked), and
+// OTHER_ERROR on encountering any other generic error of any sort (callback not invoked)
+enum chan_status channel_receive_async(chan_t* channel, channel_completion_fn callback, void* context);
+
+// Returns the number of messages that were overwritten before being received
+// This is always 0 for channels that are not lossy
+size_t channel_dropped(chan_t* channel);
+
+// Sets how long (in microseconds) the channel must stay empty before its buffer storage is released
+// The storage is allocated again transparently by the next send, and a timeout of 0 (the default) never releases it
+// A receiver blocked on an idle channel releases the storage itself once the timeout expires
+void channel_set_idle_timeout(chan_t* channel, uint64_t timeout_usec);
+
+// Releases the buffer storage of the channel if it has been empty for longer than its idle timeout
+// This lets a maintenance thread reclaim memory from idle channels that nobody is blocked on
+// Returns true if the storage was released and false otherwise
+bool channel_reclaim_idle(chan_t* channel);
+
+// Sets how blocking sends and receives on the channel wait before parking (see enum chan_wait)
+// Spinning only pays off while the waiters have a CPU to themselves, CHANNEL_WAIT_ADAPTIVE keeps it from collapsing
+// throughput when there are more threads than CPUs
+void channel_set_wait_strategy(chan_t* channel, enum chan_wait strategy);
+
+// Returns the number of CPUs the process may run on, as allowed by its affinity mask on the first call
+// Adaptive waits keep the number of spinners below it
+uint32_t channel_cpu_count();
+
+// Configures occupancy watermarks on the channel
+// callback is invoked with high = true once the number of buffered messages rises to high, and is not invoked again
+// until the occupancy has fallen to low, at which point it is invoked with high = false (and vice versa)
+// The callback runs on the sending/receiving thread while the channel is locked, so it must not block or use this channel
+// A NULL callback disables the watermarks
+// Returns SUCCESS if the watermarks were set, and
+// OTHER_ERROR if low < high <= capacity does not hold
+enum chan_status channel_set_watermarks(chan_t* channel, size_t high, size_t low, channel_watermark_fn callback, void* context);
+
+// Watermark callback that forwards crossings to a notification channel, given as the context
+// It sends CHANNEL_WATERMARK_HIGH or CHANNEL_WATERMARK_LOW without blocking, so the notification channel should be
+// lossy (see channel_create_lossy) to never lose the most recent crossing
+void channel_watermark_notify(void* context, bool high);
+
+// Registers a watcher on the channel, its callback is invoked on every change of state of the channel (a message added or
+// removed, or the channel closed) until channel_unwatch, this is how callers that cannot block in channel_select (such as
+// coroutines) learn when to retry their non-blocking operations
+// The callback runs on the thread that changed the state while the channel is locked, so it must not block or use this
+// channel
+void channel_watch(chan_t* channel, channel_watcher_t* watcher);
+
+// Unregisters a watcher, its callback is not invoked anymore once this returns
+void channel_unwatch(chan_t* channel, channel_watcher_t* watcher);
+
+// Returns whether a send (or a receive) on the channel would go ahead without blocking, a closed channel always does,
+// and so does a send on a lossy channel
+// This reads the state published to busy pollers without locking the channel, so it is only a hint that may be stale
+// by the time the caller acts on it, unless called from a watcher callback
+bool channel_ready(chan_t* channel, bool send);
+
 // Closes the channel and informs all the blocking send/receive/select calls to return with CLOSED_ERROR
 // Once the channel is closed, send/receive/select operations will cease to function and just return CLOSED_ERROR
 // Returns SUCCESS if close is successful,
@@ -89,4 +312,18 @@ enum chan_status channel_destroy(chan_t* channel);
 // Additionally, selected_index is set to the index of the channel that generated the error
 enum chan_status channel_select(size_t channel_count, select_t* channel_list, size_t* selected_index);
 
+// Busy-polling version of a blocking channel_receive, for consumers that own a dedicated core
+// Spins on the occupancy published by the channel (with a pause instruction) instead of sleeping on a condition
+// variable, and only locks the channel to take a message once one has been published
+// Returns SUCCESS for successful retrieval of data,
+// CLOSED_ERROR if the channel is closed, and
+// OTHER_ERROR on encountering any other generic error of any sort
+enum chan_status channel_receive_busy(chan_t* channel, void** data);
+
+// Busy-polling version of channel_select, for callers that own a dedicated core
+// Spins over the occupancy published by every channel (with a pause instruction) instead of waiting on a semaphore,
+// and only locks a channel to perform the operation once the channel looks ready for it
+// Returns like channel_select
+enum chan_status channel_select_busy(size_t channel_count, select_t* channel_list, size_t* selected_index);
+
 #endif // CHANNEL_H
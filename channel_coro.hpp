@@ -0,0 +1,321 @@
+#ifndef CHANNEL_CORO_HPP
+#define CHANNEL_CORO_HPP
+
+// C++20 coroutine awaitables over chan_t
+//
+//     channel_coro::channel ch(chan);
+//     enum chan_status status = co_await ch.send(message);
+//     channel_coro::result received = co_await ch.receive();
+//     channel_coro::select_result selected = co_await channel_coro::select(exec, list, count);
+//
+// A suspended send or receive is registered on the channel as an asynchronous operation (see channel_send_async), so
+// a waiting coroutine costs its frame and one registration instead of a thread, and the peer operation resumes it
+// either inline on the peer's thread or on an executor
+// A suspended select watches its channels (see channel_watch) and retries on an executor whenever one of them changes
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+
+extern "C" {
+#include "channel.h"
+}
+
+namespace channel_coro {
+
+// Defines a unit of work run by an executor
+struct task {
+    void (*run)(task* self);
+};
+
+// Defines an executor, which runs posted tasks on the threads that call run
+// The tasks are passed through a channel, posting never blocks: once the channel is full the tasks wait on it as
+// asynchronous sends
+class executor {
+public:
+    explicit executor(size_t size) : queue(channel_create(size)) {}
+
+    ~executor()
+    {
+        channel_close(queue);
+        channel_destroy(queue);
+    }
+
+    executor(const executor&) = delete;
+    executor& operator=(const executor&) = delete;
+
+    // Queues the task, it is run by one of the threads in run
+    // Posting is allowed while a channel is locked (from a watcher or completion callback)
+    void post(task* work)
+    {
+        channel_send_async(queue, work, ignore, nullptr);
+    }
+
+    // Runs tasks until the executor is closed, several threads may run the same executor
+    void run()
+    {
+        void* data = nullptr;
+        while (channel_receive(queue, &data, true) == SUCCESS) {
+            task* work = static_cast<task*>(data);
+            work->run(work);
+        }
+    }
+
+    // Stops the threads in run once they finish their current task, the tasks still queued are dropped
+    void close()
+    {
+        channel_close(queue);
+    }
+
+private:
+    static void ignore(void*, enum chan_status, void*) {}
+
+    chan_t* queue;
+};
+
+// Defines the outcome of an awaited receive
+struct result {
+    enum chan_status status;
+    void* data;
+};
+
+// Defines the outcome of an awaited select, index is the entry that completed (or failed)
+struct select_result {
+    enum chan_status status;
+    size_t index;
+};
+
+namespace detail {
+
+// States of a suspending operation: started, suspended (a completion must resume the coroutine), or done
+enum : int { STARTED, SUSPENDED, DONE };
+
+// Shared part of the send and receive awaitables, which wait on a single asynchronous operation
+class operation : public task {
+protected:
+    operation(chan_t* channel, executor* exec) : channel(channel), exec(exec)
+    {
+        run = resume_task;
+    }
+
+    // Completion callback of the asynchronous operation, resumes the coroutine if it already suspended
+    static void complete(void* context, enum chan_status status, void* data)
+    {
+        operation* self = static_cast<operation*>(context);
+        self->outcome = {status, data};
+        if (self->state.exchange(DONE, std::memory_order_acq_rel) == SUSPENDED) {
+            if (self->exec) {
+                self->exec->post(self);
+            } else {
+                self->handle.resume();
+            }
+        }
+    }
+
+    // Decides whether to suspend once the operation has been issued and returned status
+    bool suspend(enum chan_status status)
+    {
+        if (status != WOULDBLOCK) {
+            // completed on the caller's thread, or failed without invoking the callback
+            if (status != SUCCESS) {
+                outcome.status = status;
+            }
+            return false;
+        }
+        // the operation may have completed on another thread since it was registered
+        int expected = STARTED;
+        return state.compare_exchange_strong(expected, SUSPENDED, std::memory_order_acq_rel);
+    }
+
+    static void resume_task(task* work)
+    {
+        static_cast<operation*>(work)->handle.resume();
+    }
+
+    chan_t* channel;
+    executor* exec;
+    std::coroutine_handle<> handle;
+    std::atomic<int> state{STARTED};
+    result outcome{WOULDBLOCK, nullptr};
+};
+
+} // namespace detail
+
+// Awaitable sending a message, co_await returns the status of the send
+class send_awaitable : detail::operation {
+public:
+    send_awaitable(chan_t* channel, void* data, executor* exec) : operation(channel, exec), data(data) {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> awaiting)
+    {
+        handle = awaiting;
+        return suspend(channel_send_async(channel, data, complete, this));
+    }
+
+    enum chan_status await_resume() const noexcept
+    {
+        return outcome.status;
+    }
+
+private:
+    void* data;
+};
+
+// Awaitable receiving a message, co_await returns the status of the receive and the message
+class receive_awaitable : detail::operation {
+public:
+    receive_awaitable(chan_t* channel, executor* exec) : operation(channel, exec) {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> awaiting)
+    {
+        handle = awaiting;
+        return suspend(channel_receive_async(channel, complete, this));
+    }
+
+    result await_resume() const noexcept
+    {
+        return outcome;
+    }
+};
+
+// Defines a channel as seen from coroutines, it does not own the channel
+// Without an executor, suspended coroutines are resumed inline on the thread of the peer operation (or of the close)
+class channel {
+public:
+    explicit channel(chan_t* channel, executor* exec = nullptr) : chan(channel), exec(exec) {}
+
+    send_awaitable send(void* data) const
+    {
+        return send_awaitable(chan, data, exec);
+    }
+
+    receive_awaitable receive() const
+    {
+        return receive_awaitable(chan, exec);
+    }
+
+    chan_t* get() const
+    {
+        return chan;
+    }
+
+private:
+    chan_t* chan;
+    executor* exec;
+};
+
+// Awaitable performing the first operation of the list that can go ahead, with the semantics of channel_select
+// While none can, the channels of the list are watched and every change of state retries the list on the executor,
+// the coroutine is resumed on the executor once an operation went through
+class select_awaitable : public task {
+public:
+    select_awaitable(executor& exec, select_t* list, size_t count) : exec(exec), list(list), count(count)
+    {
+        run = retry_task;
+    }
+
+    bool await_ready()
+    {
+        return attempt();
+    }
+
+    bool await_suspend(std::coroutine_handle<> awaiting)
+    {
+        handle = awaiting;
+        watchers = std::make_unique<channel_watcher_t[]>(count);
+        for (size_t i = 0; i < count; i++) {
+            watchers[i] = {changed, this};
+            channel_watch(list[i].channel, &watchers[i]);
+        }
+        return !poll();
+    }
+
+    select_result await_resume() const noexcept
+    {
+        return outcome;
+    }
+
+private:
+    // States of a suspended select: retrying the list, waiting for a change, or changed while retrying
+    enum : int { RETRYING, WAITING, CHANGED };
+
+    // Tries every entry once without blocking
+    // Returns true if one of them completed (or failed)
+    bool attempt()
+    {
+        for (size_t i = 0; i < count; i++) {
+            enum chan_status status = list[i].is_send ? channel_send(list[i].channel, list[i].data, false)
+                                                      : channel_receive(list[i].channel, &list[i].data, false);
+            if (status != WOULDBLOCK) {
+                outcome = {status, i};
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Retries the list until an entry completes or no change happened during the attempt
+    // Returns true once an entry completed, the watchers are then removed
+    bool poll()
+    {
+        while (true) {
+            state.store(RETRYING, std::memory_order_release);
+            if (attempt()) {
+                for (size_t i = 0; i < count; i++) {
+                    channel_unwatch(list[i].channel, &watchers[i]);
+                }
+                return true;
+            }
+            int expected = RETRYING;
+            if (state.compare_exchange_strong(expected, WAITING, std::memory_order_acq_rel)) {
+                return false;
+            }
+        }
+    }
+
+    // Watcher callback, runs with the changed channel locked so the retry is left to the executor
+    static void changed(void* context)
+    {
+        select_awaitable* self = static_cast<select_awaitable*>(context);
+        if (self->state.exchange(CHANGED, std::memory_order_acq_rel) == WAITING) {
+            self->exec.post(self);
+        }
+    }
+
+    static void retry_task(task* work)
+    {
+        select_awaitable* self = static_cast<select_awaitable*>(work);
+        if (self->poll()) {
+            self->handle.resume();
+        }
+    }
+
+    executor& exec;
+    select_t* list;
+    size_t count;
+    std::unique_ptr<channel_watcher_t[]> watchers;
+    std::coroutine_handle<> handle;
+    std::atomic<int> state{RETRYING};
+    select_result outcome{WOULDBLOCK, 0};
+};
+
+// Returns an awaitable selecting over the list (see select_awaitable)
+inline select_awaitable select(executor& exec, select_t* list, size_t count)
+{
+    return select_awaitable(exec, list, count);
+}
+
+} // namespace channel_coro
+
+#endif // CHANNEL_CORO_HPP
@@ -0,0 +1,165 @@
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "compact_channel.h"
+
+// Sleeps on the futex word as long as it still holds the expected value
+static void futex_wait(uint32_t* word, uint32_t expected)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+// Wakes up to count threads sleeping on the futex word
+static void futex_wake(uint32_t* word, int count)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+// Acquires the channel lock
+// Uncontended locking is a single compare-and-swap, the futex is only used once the lock is contended
+static void compact_lock(compact_channel_t* channel)
+{
+    uint32_t state = 0;
+    if (__atomic_compare_exchange_n(&channel->lock, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    if (state != 2) {
+        state = __atomic_exchange_n(&channel->lock, 2, __ATOMIC_ACQUIRE);
+    }
+    while (state != 0) {
+        futex_wait(&channel->lock, 2);
+        state = __atomic_exchange_n(&channel->lock, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+// Releases the channel lock, waking one waiter if the lock was contended
+static void compact_unlock(compact_channel_t* channel)
+{
+    if (__atomic_fetch_sub(&channel->lock, 1, __ATOMIC_RELEASE) != 1) {
+        __atomic_store_n(&channel->lock, 0, __ATOMIC_RELEASE);
+        futex_wake(&channel->lock, 1);
+    }
+}
+
+// Waits for the event counter to change
+// Must be called with the lock held, and returns with the lock held
+static void compact_wait(compact_channel_t* channel, uint32_t* event, uint32_t* waiters)
+{
+    uint32_t seen = __atomic_load_n(event, __ATOMIC_RELAXED);
+    (*waiters)++;
+    compact_unlock(channel);
+    futex_wait(event, seen);
+    compact_lock(channel);
+    (*waiters)--;
+}
+
+// Bumps the event counter and wakes up to count of its waiters
+// Must be called with the lock held
+static void compact_notify(uint32_t* event, uint32_t waiters, int count)
+{
+    __atomic_fetch_add(event, 1, __ATOMIC_RELAXED);
+    if (waiters) {
+        futex_wake(event, count);
+    }
+}
+
+// Creates a new compact channel with the provided size and returns it to the caller
+// A 0 size is not supported and returns NULL, as does a size that does not fit in 32 bits
+compact_channel_t* compact_channel_create(size_t size)
+{
+    if (size == 0 || size > UINT32_MAX) {
+        return NULL;
+    }
+    compact_channel_t* channel = (compact_channel_t*) malloc(sizeof(compact_channel_t) + size * sizeof(void*));
+    if (!channel) {
+        return NULL;
+    }
+    channel->lock = 0;
+    channel->recv_event = 0;
+    channel->send_event = 0;
+    channel->recv_waiters = 0;
+    channel->send_waiters = 0;
+    channel->capacity = (uint32_t)size;
+    channel->next = 0;
+    channel->size = 0;
+    channel->open = 1;
+    return channel;
+}
+
+// Writes data to the given compact channel, with the same semantics and return values as channel_send
+enum chan_status compact_channel_send(compact_channel_t* channel, void* data, bool blocking)
+{
+    compact_lock(channel);
+    while (channel->open && channel->size == channel->capacity) {
+        if (!blocking) {
+            compact_unlock(channel);
+            return WOULDBLOCK;
+        }
+        compact_wait(channel, &channel->send_event, &channel->send_waiters);
+    }
+    if (!channel->open) {
+        compact_unlock(channel);
+        return CLOSED_ERROR;
+    }
+    uint32_t pos = channel->next + channel->size;
+    if (pos >= channel->capacity) {
+        pos -= channel->capacity;
+    }
+    channel->data[pos] = data;
+    channel->size++;
+    compact_notify(&channel->recv_event, channel->recv_waiters, 1);
+    compact_unlock(channel);
+    return SUCCESS;
+}
+
+// Reads data from the given compact channel, with the same semantics and return values as channel_receive
+enum chan_status compact_channel_receive(compact_channel_t* channel, void** data, bool blocking)
+{
+    compact_lock(channel);
+    while (channel->open && channel->size == 0) {
+        if (!blocking) {
+            compact_unlock(channel);
+            return WOULDBLOCK;
+        }
+        compact_wait(channel, &channel->recv_event, &channel->recv_waiters);
+    }
+    if (!channel->open) {
+        compact_unlock(channel);
+        return CLOSED_ERROR;
+    }
+    *data = channel->data[channel->next];
+    channel->size--;
+    channel->next++;
+    if (channel->next >= channel->capacity) {
+        channel->next -= channel->capacity;
+    }
+    compact_notify(&channel->send_event, channel->send_waiters, 1);
+    compact_unlock(channel);
+    return SUCCESS;
+}
+
+// Closes the compact channel, with the same semantics and return values as channel_close
+enum chan_status compact_channel_close(compact_channel_t* channel)
+{
+    compact_lock(channel);
+    if (!channel->open) {
+        compact_unlock(channel);
+        return CLOSED_ERROR;
+    }
+    channel->open = 0;
+    compact_notify(&channel->recv_event, channel->recv_waiters, INT_MAX);
+    compact_notify(&channel->send_event, channel->send_waiters, INT_MAX);
+    compact_unlock(channel);
+    return SUCCESS;
+}
+
+// Frees the compact channel, with the same semantics and return values as channel_destroy
+enum chan_status compact_channel_destroy(compact_channel_t* channel)
+{
+    if (__atomic_load_n(&channel->open, __ATOMIC_ACQUIRE)) {
+        return DESTROY_ERROR;
+    }
+    free(channel);
+    return SUCCESS;
+}
@@ -0,0 +1,46 @@
+#ifndef COMPACT_CHANNEL_H
+#define COMPACT_CHANNEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "channel.h"
+
+// Defines a compact channel object
+// All of the synchronization state lives in three 32-bit futex words and the ring is stored inline after the
+// control block, so a channel is a single allocation with sizeof(compact_channel_t) bytes of overhead
+// This is meant for programs with millions of mostly idle channels, where a pthread mutex and two condition
+// variables per channel would dominate memory usage
+typedef struct {
+    // Futex protecting the rest of the struct: 0 = unlocked, 1 = locked, 2 = locked with waiters
+    uint32_t lock;
+    // Event counters that blocked receivers and senders sleep on, bumped on every state change they care about
+    uint32_t recv_event;
+    uint32_t send_event;
+    // Number of threads sleeping on each event counter, so wakeups cost nothing when nobody is waiting
+    uint32_t recv_waiters;
+    uint32_t send_waiters;
+    uint32_t capacity;
+    uint32_t next;
+    uint32_t size;
+    uint32_t open;
+    void* data[];
+} compact_channel_t;
+
+// Creates a new compact channel with the provided size and returns it to the caller
+// A 0 size is not supported and returns NULL, as does a size that does not fit in 32 bits
+compact_channel_t* compact_channel_create(size_t size);
+
+// Writes data to the given compact channel, with the same semantics and return values as channel_send
+enum chan_status compact_channel_send(compact_channel_t* channel, void* data, bool blocking);
+
+// Reads data from the given compact channel, with the same semantics and return values as channel_receive
+enum chan_status compact_channel_receive(compact_channel_t* channel, void** data, bool blocking);
+
+// Closes the compact channel, with the same semantics and return values as channel_close
+enum chan_status compact_channel_close(compact_channel_t* channel);
+
+// Frees the compact channel, with the same semantics and return values as channel_destroy
+enum chan_status compact_channel_destroy(compact_channel_t* channel);
+
+#endif // COMPACT_CHANNEL_H
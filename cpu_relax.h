@@ -0,0 +1,16 @@
+#ifndef CPU_RELAX_H
+#define CPU_RELAX_H
+
+// Internal helper shared by the spin-wait loops of the library, not part of its interface
+
+// Tells the CPU that this is a spin-wait loop, which saves power and lets a sibling hyperthread run
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+#endif // CPU_RELAX_H
@@ -0,0 +1,577 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "file_stage.h"
+
+// Defines an io_uring instance, driven through the raw system calls
+typedef struct {
+    int fd;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned to_submit;
+} file_ring_t;
+
+// Defines the engine moving blocks between memory and the file: an io_uring, or a pool of threads calling pread/pwrite
+// Both take queued blocks and hand them back one completion at a time, in whatever order they finish
+typedef struct {
+    bool uring;
+    file_ring_t ring;
+    chan_t* requests;
+    chan_t* completions;
+    pthread_t workers[FILE_STAGE_MAX_DEPTH];
+    size_t num_workers;
+    size_t syscalls;
+} file_engine_t;
+
+struct file_stage {
+    chan_t* channel;
+    file_pool_t* pool;
+    int fd;
+    size_t depth;
+    file_engine_t engine;
+    pthread_t thread;
+    file_stage_stats_t stats;
+};
+
+// Rounds length up to the next multiple of FILE_STAGE_ALIGNMENT
+static size_t file_align_up(size_t length)
+{
+    return (length + FILE_STAGE_ALIGNMENT - 1) / FILE_STAGE_ALIGNMENT * FILE_STAGE_ALIGNMENT;
+}
+
+// Releases the mappings and the descriptor of the ring
+static void file_ring_teardown(file_ring_t* ring)
+{
+    if (ring->sqes && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring && ring->cq_ring != MAP_FAILED) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    close(ring->fd);
+}
+
+// Sets up a ring with room for entries submissions, and checks that the kernel supports plain reads and writes
+// Returns false if io_uring is unavailable (old kernel, or the system call is filtered out)
+static bool file_ring_setup(file_ring_t* ring, unsigned entries)
+{
+    memset(ring, 0, sizeof(file_ring_t));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    long fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+        return false;
+    }
+    ring->fd = (int)fd;
+
+    size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, probe_size);
+    bool supported = probe && syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+                     probe->last_op >= IORING_OP_WRITE && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+                     (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    if (!supported) {
+        close(ring->fd);
+        return false;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        file_ring_teardown(ring);
+        return false;
+    }
+    char* sq = ring->sq_ring;
+    char* cq = ring->cq_ring;
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return true;
+}
+
+// Calls io_uring_enter, retrying when interrupted
+static int file_ring_enter(file_engine_t* engine, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    long result;
+    do {
+        result = syscall(__NR_io_uring_enter, engine->ring.fd, to_submit, min_complete, flags, NULL, 0);
+        __atomic_add_fetch(&engine->syscalls, 1, __ATOMIC_RELAXED);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0) {
+        return -errno;
+    }
+    engine->ring.to_submit -= (unsigned)result;
+    return 0;
+}
+
+// Body of the threads of the fallback engine
+static void* file_worker(void* arg)
+{
+    file_engine_t* engine = arg;
+    void* data = NULL;
+    while (channel_receive(engine->requests, &data, true) == SUCCESS && data) {
+        file_block_t* block = data;
+        char* memory = block->data + block->done;
+        size_t length = block->requested - block->done;
+        off_t offset = block->offset + (off_t)block->done;
+        ssize_t result = block->write ? pwrite(block->fd, memory, length, offset) : pread(block->fd, memory, length, offset);
+        __atomic_add_fetch(&engine->syscalls, 1, __ATOMIC_RELAXED);
+        block->result = result < 0 ? -errno : result;
+        channel_send(engine->completions, block, true);
+    }
+    return NULL;
+}
+
+// Stops the worker threads of the fallback engine and frees its channels
+static void file_engine_stop_workers(file_engine_t* engine)
+{
+    for (size_t i = 0; i < engine->num_workers; i++) {
+        channel_send(engine->requests, NULL, true);
+    }
+    for (size_t i = 0; i < engine->num_workers; i++) {
+        pthread_join(engine->workers[i], NULL);
+    }
+    channel_close(engine->requests);
+    channel_close(engine->completions);
+    channel_destroy(engine->requests);
+    channel_destroy(engine->completions);
+}
+
+// Starts an engine that keeps up to depth blocks in flight, io_uring unless fallback is set or it is unavailable
+static bool file_engine_start(file_engine_t* engine, size_t depth, bool fallback)
+{
+    engine->syscalls = 0;
+    engine->num_workers = 0;
+    engine->uring = !fallback && file_ring_setup(&engine->ring, (unsigned)depth);
+    if (engine->uring) {
+        return true;
+    }
+    engine->requests = channel_create(depth);
+    engine->completions = channel_create(depth);
+    if (!engine->requests || !engine->completions) {
+        if (engine->requests) {
+            channel_close(engine->requests);
+            channel_destroy(engine->requests);
+        }
+        if (engine->completions) {
+            channel_close(engine->completions);
+            channel_destroy(engine->completions);
+        }
+        return false;
+    }
+    for (; engine->num_workers < depth; engine->num_workers++) {
+        if (pthread_create(&engine->workers[engine->num_workers], NULL, file_worker, engine) != 0) {
+            file_engine_stop_workers(engine);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Stops the engine, every queued block must have completed
+static void file_engine_stop(file_engine_t* engine)
+{
+    if (engine->uring) {
+        file_ring_teardown(&engine->ring);
+    } else {
+        file_engine_stop_workers(engine);
+    }
+}
+
+// Queues the transfer of the rest of the block (from block->done to block->requested)
+// With io_uring, link chains the transfer to the next queued one, which then starts only once this one has completed
+static void file_engine_queue(file_engine_t* engine, file_block_t* block, bool link)
+{
+    if (!engine->uring) {
+        channel_send(engine->requests, block, true);
+        return;
+    }
+    file_ring_t* ring = &engine->ring;
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = block->write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->flags = link ? IOSQE_IO_LINK : 0;
+    sqe->fd = block->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(block->data + block->done);
+    sqe->len = (uint32_t)(block->requested - block->done);
+    sqe->off = (uint64_t)block->offset + block->done;
+    sqe->user_data = (uint64_t)(uintptr_t)block;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+}
+
+// Submits the queued transfers with a single system call
+// Returns 0, or -errno if the ring failed
+static int file_engine_submit(file_engine_t* engine)
+{
+    if (!engine->uring || !engine->ring.to_submit) {
+        return 0;
+    }
+    return file_ring_enter(engine, engine->ring.to_submit, 0, 0);
+}
+
+// Waits for a queued transfer to complete, and returns its block with the outcome in block->result
+// Returns NULL if the ring failed
+static file_block_t* file_engine_complete(file_engine_t* engine)
+{
+    if (!engine->uring) {
+        void* data = NULL;
+        channel_receive(engine->completions, &data, true);
+        return data;
+    }
+    file_ring_t* ring = &engine->ring;
+    while (true) {
+        unsigned head = *ring->cq_head;
+        if (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+            file_block_t* block = (file_block_t*)(uintptr_t)cqe->user_data;
+            block->result = cqe->res;
+            __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+            return block;
+        }
+        if (file_ring_enter(engine, ring->to_submit, 1, IORING_ENTER_GETEVENTS) < 0) {
+            return NULL;
+        }
+    }
+}
+
+// Accounts for a completed transfer
+// Returns 0 once the block is complete, 1 if the rest of the block (or a transfer cancelled by a broken link chain)
+// must be queued again, and -errno if the transfer failed
+static int file_block_advance(file_block_t* block)
+{
+    if (block->result == -EINTR || block->result == -EAGAIN || block->result == -ECANCELED) {
+        return 1;
+    }
+    if (block->result < 0) {
+        return (int)block->result;
+    }
+    if (block->result == 0) {
+        return -EIO;
+    }
+    block->done += (size_t)block->result;
+    // reads may ask for more than the valid bytes (aligned length), and stop at the end of the file
+    size_t target = block->write ? block->requested : block->length;
+    return block->done >= target ? 0 : 1;
+}
+
+// Body of the source stage thread
+static void* file_source(void* arg)
+{
+    file_stage_t* stage = arg;
+    file_engine_t* engine = &stage->engine;
+    int error = 0;
+    struct stat st;
+    size_t size = 0;
+    if (fstat(stage->fd, &st) == 0) {
+        size = (size_t)st.st_size;
+    } else {
+        error = errno;
+    }
+    // blocks that have been read but not sent yet, indexed by their sequence number, so they are sent in file order
+    file_block_t* window[FILE_STAGE_MAX_DEPTH] = {NULL};
+    size_t next_seq = 0;
+    size_t next_send = 0;
+    size_t offset = 0;
+    while (next_seq > next_send || (!error && offset < size)) {
+        while (!error && next_seq - next_send < stage->depth && offset < size) {
+            file_block_t* block = NULL;
+            if (next_seq == next_send) {
+                block = file_pool_get(stage->pool);
+            } else if (channel_receive(stage->pool->free, (void**)&block, false) != SUCCESS) {
+                break;
+            }
+            block->fd = stage->fd;
+            block->write = false;
+            block->offset = (off_t)offset;
+            block->length = size - offset < stage->pool->block_size ? size - offset : stage->pool->block_size;
+            block->requested = stage->stats.direct ? file_align_up(block->length) : block->length;
+            block->done = 0;
+            block->seq = next_seq++;
+            file_engine_queue(engine, block, false);
+            offset += block->length;
+        }
+        int status = file_engine_submit(engine);
+        file_block_t* block = status < 0 ? NULL : file_engine_complete(engine);
+        if (!block) {
+            // the ring itself failed, the blocks still in flight are lost to the pool
+            error = status < 0 ? -status : EIO;
+            break;
+        }
+        status = file_block_advance(block);
+        if (status > 0) {
+            file_engine_queue(engine, block, false);
+            continue;
+        }
+        if (status < 0 && !error) {
+            error = -status;
+        }
+        window[block->seq % stage->depth] = block;
+        while (window[next_send % stage->depth]) {
+            block = window[next_send % stage->depth];
+            window[next_send % stage->depth] = NULL;
+            next_send++;
+            if (error) {
+                file_pool_put(stage->pool, block);
+            } else if (channel_send(stage->channel, block, true) == SUCCESS) {
+                stage->stats.blocks++;
+                stage->stats.bytes += block->length;
+            } else {
+                file_pool_put(stage->pool, block);
+                error = EPIPE;
+            }
+        }
+    }
+    stage->stats.error = error;
+    channel_send(stage->channel, NULL, true);
+    return NULL;
+}
+
+// Body of the sink stage thread
+static void* file_sink(void* arg)
+{
+    file_stage_t* stage = arg;
+    file_engine_t* engine = &stage->engine;
+    int error = 0;
+    size_t end = 0;
+    file_block_t* batch[FILE_STAGE_MAX_DEPTH];
+    bool done = false;
+    while (!done) {
+        size_t count = 0;
+        void* data = NULL;
+        if (channel_receive(stage->channel, &data, true) != SUCCESS || !data) {
+            break;
+        }
+        batch[count++] = data;
+        // gather whatever else is already waiting, up to the depth
+        while (count < stage->depth && channel_receive(stage->channel, &data, false) == SUCCESS) {
+            if (!data) {
+                done = true;
+                break;
+            }
+            batch[count++] = data;
+        }
+        if (error) {
+            // keep draining the channel so the upstream stages are not blocked
+            for (size_t i = 0; i < count; i++) {
+                file_pool_put(stage->pool, batch[i]);
+            }
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            file_block_t* block = batch[i];
+            block->fd = stage->fd;
+            block->write = true;
+            // direct writes are padded to the alignment, the file is truncated back to its length at the end
+            block->requested = stage->stats.direct ? file_align_up(block->length) : block->length;
+            block->done = 0;
+            file_engine_queue(engine, block, i + 1 < count);
+        }
+        size_t pending = count;
+        while (pending > 0) {
+            int status = file_engine_submit(engine);
+            file_block_t* block = status < 0 ? NULL : file_engine_complete(engine);
+            if (!block) {
+                error = status < 0 ? -status : EIO;
+                done = true;
+                break;
+            }
+            status = file_block_advance(block);
+            if (status > 0) {
+                file_engine_queue(engine, block, false);
+                continue;
+            }
+            if (status < 0 && !error) {
+                error = -status;
+            } else if (status == 0) {
+                stage->stats.blocks++;
+                stage->stats.bytes += block->length;
+                if ((size_t)block->offset + block->length > end) {
+                    end = (size_t)block->offset + block->length;
+                }
+            }
+            file_pool_put(stage->pool, block);
+            pending--;
+        }
+    }
+    if (stage->stats.direct && ftruncate(stage->fd, (off_t)end) != 0 && !error) {
+        error = errno;
+    }
+    stage->stats.error = error;
+    return NULL;
+}
+
+// Opens the file, with O_DIRECT if asked for and supported by the file system
+// Returns the descriptor, or -1 if the file could not be opened
+static int file_stage_open(const char* path, int flags, bool* direct)
+{
+    if (*direct) {
+        int fd = open(path, flags | O_DIRECT, 0644);
+        if (fd >= 0 || errno != EINVAL) {
+            return fd;
+        }
+        *direct = false;
+    }
+    return open(path, flags, 0644);
+}
+
+// Opens the file and starts the stage thread running the given body
+static file_stage_t* file_stage_start(chan_t* channel, const char* path, int flags, file_pool_t* pool,
+                                      const file_stage_options_t* options, void* (*body)(void*))
+{
+    if (options->depth == 0 || options->depth > FILE_STAGE_MAX_DEPTH) {
+        return NULL;
+    }
+    file_stage_t* stage = malloc(sizeof(file_stage_t));
+    if (!stage) {
+        return NULL;
+    }
+    memset(&stage->stats, 0, sizeof(file_stage_stats_t));
+    stage->channel = channel;
+    stage->pool = pool;
+    stage->depth = options->depth;
+    stage->stats.direct = options->direct;
+    stage->fd = file_stage_open(path, flags, &stage->stats.direct);
+    if (stage->fd < 0) {
+        free(stage);
+        return NULL;
+    }
+    if (!file_engine_start(&stage->engine, stage->depth, options->fallback)) {
+        close(stage->fd);
+        free(stage);
+        return NULL;
+    }
+    stage->stats.uring = stage->engine.uring;
+    if (pthread_create(&stage->thread, NULL, body, stage) != 0) {
+        file_engine_stop(&stage->engine);
+        close(stage->fd);
+        free(stage);
+        return NULL;
+    }
+    return stage;
+}
+
+// Creates a pool of count blocks of block_size bytes each
+// Returns NULL if block_size is not a multiple of FILE_STAGE_ALIGNMENT or on allocation failure
+file_pool_t* file_pool_create(size_t count, size_t block_size)
+{
+    if (count == 0 || block_size == 0 || block_size % FILE_STAGE_ALIGNMENT != 0) {
+        return NULL;
+    }
+    file_pool_t* pool = malloc(sizeof(file_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    pool->count = count;
+    pool->block_size = block_size;
+    pool->blocks = calloc(count, sizeof(file_block_t));
+    pool->free = channel_create(count);
+    void* memory = NULL;
+    if (!pool->blocks || !pool->free || posix_memalign(&memory, FILE_STAGE_ALIGNMENT, count * block_size) != 0) {
+        free(pool->blocks);
+        if (pool->free) {
+            channel_close(pool->free);
+            channel_destroy(pool->free);
+        }
+        free(pool);
+        return NULL;
+    }
+    // padding of direct writes goes to the file before being truncated away, never write uninitialized memory
+    memset(memory, 0, count * block_size);
+    pool->memory = memory;
+    for (size_t i = 0; i < count; i++) {
+        pool->blocks[i].data = pool->memory + i * block_size;
+        channel_send(pool->free, &pool->blocks[i], true);
+    }
+    return pool;
+}
+
+// Takes a free block from the pool, waiting for one to be returned if the pool is empty
+file_block_t* file_pool_get(file_pool_t* pool)
+{
+    void* data = NULL;
+    channel_receive(pool->free, &data, true);
+    return data;
+}
+
+// Returns a block to the pool
+void file_pool_put(file_pool_t* pool, file_block_t* block)
+{
+    channel_send(pool->free, block, true);
+}
+
+// Frees the pool, every block must have been returned
+void file_pool_destroy(file_pool_t* pool)
+{
+    channel_close(pool->free);
+    channel_destroy(pool->free);
+    free(pool->memory);
+    free(pool->blocks);
+    free(pool);
+}
+
+// Starts a stage that reads the file in blocks of the pool and sends them on the channel in file order
+// Reads are issued in batches through io_uring, or by a pread thread pool when io_uring is unavailable
+// The stage stops after sending the end of stream (a NULL block), also sent when the file could not be read
+// Returns NULL if the file could not be opened or the stage thread could not be started
+file_stage_t* file_source_start(chan_t* channel, const char* path, file_pool_t* pool, const file_stage_options_t* options)
+{
+    return file_stage_start(channel, path, O_RDONLY, pool, options, file_source);
+}
+
+// Starts a stage that receives blocks from the channel, writes each one at its offset in the file, and returns it to
+// the pool, the file is created (or truncated) first
+// The blocks already waiting on the channel are written with a single chain of linked io_uring writes, or by a pwrite
+// thread pool when io_uring is unavailable
+// With O_DIRECT, block offsets must be multiples of FILE_STAGE_ALIGNMENT (as they are for blocks read by a source)
+// The stage stops after the end of stream (a NULL block), or when the channel is closed
+// Returns NULL if the file could not be created or the stage thread could not be started
+file_stage_t* file_sink_start(chan_t* channel, const char* path, file_pool_t* pool, const file_stage_options_t* options)
+{
+    return file_stage_start(channel, path, O_WRONLY | O_CREAT | O_TRUNC, pool, options, file_sink);
+}
+
+// Waits for the stage to stop, stores its counters in stats (if stats is not NULL), closes the file and frees the stage
+void file_stage_join(file_stage_t* stage, file_stage_stats_t* stats)
+{
+    pthread_join(stage->thread, NULL);
+    file_engine_stop(&stage->engine);
+    close(stage->fd);
+    stage->stats.syscalls = stage->engine.syscalls;
+    if (stats) {
+        *stats = stage->stats;
+    }
+    free(stage);
+}
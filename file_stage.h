@@ -0,0 +1,101 @@
+#ifndef FILE_STAGE_H
+#define FILE_STAGE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "channel.h"
+
+// Alignment of the block memory and of the block size, as required by O_DIRECT
+#define FILE_STAGE_ALIGNMENT    4096
+// Largest number of reads or writes a stage keeps in flight
+#define FILE_STAGE_MAX_DEPTH    64
+
+// Defines a block of file data, the message carried by the channels of file stages
+// Blocks belong to a pool and ownership moves with the message: the source takes blocks from the pool and fills them,
+// and whoever receives a block returns it to the pool (the sink does so once the block has been written)
+// A NULL block marks the end of the stream
+typedef struct {
+    // Block memory, FILE_STAGE_ALIGNMENT aligned and holding up to the block size of the pool
+    char* data;
+    // Number of valid bytes, and their position in the file
+    size_t length;
+    off_t offset;
+    // Used by the stages while the block is in flight
+    int fd;
+    bool write;
+    size_t requested;
+    size_t done;
+    ssize_t result;
+    size_t seq;
+} file_block_t;
+
+// Defines a pool of blocks, the free blocks are kept on a channel
+typedef struct {
+    chan_t* free;
+    size_t count;
+    size_t block_size;
+    file_block_t* blocks;
+    char* memory;
+} file_pool_t;
+
+// Defines the options of a file stage
+typedef struct {
+    // Number of reads or writes kept in flight, up to FILE_STAGE_MAX_DEPTH
+    size_t depth;
+    // Opens the file with O_DIRECT, the stage quietly uses the page cache when the file system does not support it
+    bool direct;
+    // Uses the pread/pwrite thread pool even when io_uring is available
+    bool fallback;
+} file_stage_options_t;
+
+// Defines the counters reported by a file stage once it has finished
+typedef struct {
+    // Number of blocks and bytes moved between the file and the channel, not counting the end of stream
+    size_t blocks;
+    size_t bytes;
+    // Number of system calls issued to move them (io_uring_enter, or pread/pwrite)
+    size_t syscalls;
+    // Whether io_uring and O_DIRECT were used
+    bool uring;
+    bool direct;
+    // errno of the first failure, 0 if the whole file was moved
+    int error;
+} file_stage_stats_t;
+
+// Defines a file stage object, which moves blocks between a channel and a local file on its own thread
+typedef struct file_stage file_stage_t;
+
+// Creates a pool of count blocks of block_size bytes each
+// Returns NULL if block_size is not a multiple of FILE_STAGE_ALIGNMENT or on allocation failure
+file_pool_t* file_pool_create(size_t count, size_t block_size);
+
+// Takes a free block from the pool, waiting for one to be returned if the pool is empty
+file_block_t* file_pool_get(file_pool_t* pool);
+
+// Returns a block to the pool
+void file_pool_put(file_pool_t* pool, file_block_t* block);
+
+// Frees the pool, every block must have been returned
+void file_pool_destroy(file_pool_t* pool);
+
+// Starts a stage that reads the file in blocks of the pool and sends them on the channel in file order
+// Reads are issued in batches through io_uring, or by a pread thread pool when io_uring is unavailable
+// The stage stops after sending the end of stream (a NULL block), also sent when the file could not be read
+// Returns NULL if the file could not be opened or the stage thread could not be started
+file_stage_t* file_source_start(chan_t* channel, const char* path, file_pool_t* pool, const file_stage_options_t* options);
+
+// Starts a stage that receives blocks from the channel, writes each one at its offset in the file, and returns it to
+// the pool, the file is created (or truncated) first
+// The blocks already waiting on the channel are written with a single chain of linked io_uring writes, or by a pwrite
+// thread pool when io_uring is unavailable
+// With O_DIRECT, block offsets must be multiples of FILE_STAGE_ALIGNMENT (as they are for blocks read by a source)
+// The stage stops after the end of stream (a NULL block), or when the channel is closed
+// Returns NULL if the file could not be created or the stage thread could not be started
+file_stage_t* file_sink_start(chan_t* channel, const char* path, file_pool_t* pool, const file_stage_options_t* options);
+
+// Waits for the stage to stop, stores its counters in stats (if stats is not NULL), closes the file and frees the stage
+void file_stage_join(file_stage_t* stage, file_stage_stats_t* stats);
+
+#endif // FILE_STAGE_H
@@ -75,6 +75,7 @@ add_test_cases("test_select_with_select_buffered", iters_slow)
 add_test_cases("test_select_with_same_channel_buffered")
 add_test_cases("test_select_with_send_receive_on_same_channel_buffered")
 add_test_cases("test_select_with_duplicate_channel_buffered", iters_slow)
+add_test_cases("test_select_with_concurrent_selects_buffered", iters_slow)
 add_test_case_channel("test_stress_buffered", iters_one, timeout_channel * 5)
 add_test_case_sanitize("test_stress_buffered", iters_one, timeout_sanitize * 5)
 add_test_case_valgrind("test_stress_buffered", iters_one, timeout_valgrind * 5)
@@ -82,6 +83,60 @@ add_test_cases("test_select_response_time", iters_one, timeout_response_time)
 add_test_cases("test_cpu_utilization_select", iters_one, timeout_cpu_utilization)
 add_test_cases("test_for_basic_global_declaration", iters_one, timeout_basic_global_declaration)
 add_test_cases("test_for_too_many_wakeups", iters_one, timeout_too_many_wakeups)
+add_test_cases("test_lossy_channel")
+add_test_cases("test_compact_channel", iters_slow)
+add_test_cases("test_idle_reclaim", iters_slow)
+add_test_cases("test_watermarks")
+add_test_cases("test_socket_bridge", iters_slow)
+add_test_cases("test_stress_bridge", iters_one, timeout_stress_send_recv)
+add_test_case_channel("test_record_replay", iters_one)
+add_test_case_sanitize("test_record_replay", iters_one)
+add_test_case_valgrind("test_record_replay", iters_one, timeout_valgrind * 2)
+add_test_cases("test_partition")
+add_test_case_channel("test_stress_partitioned", iters_one, timeout_channel * 5)
+add_test_case_sanitize("test_stress_partitioned", iters_one, timeout_sanitize * 5)
+add_test_case_valgrind("test_stress_partitioned", iters_one, timeout_valgrind * 5)
+add_test_case_channel("test_stress_prioritized", iters_one, timeout_channel * 5)
+add_test_case_sanitize("test_stress_prioritized", iters_one, timeout_sanitize * 5)
+add_test_case_valgrind("test_stress_prioritized", iters_one, timeout_valgrind * 5)
+add_test_case_channel("test_stress_lean_validation", iters_one, timeout_channel * 5)
+add_test_case_sanitize("test_stress_lean_validation", iters_one, timeout_sanitize * 5)
+add_test_case_valgrind("test_stress_lean_validation", iters_one, timeout_valgrind * 5)
+add_test_case_channel("test_stress_snapshot", iters_one, timeout_channel * 5)
+add_test_case_sanitize("test_stress_snapshot", iters_one, timeout_sanitize * 5)
+add_test_case_valgrind("test_stress_snapshot", iters_one, timeout_valgrind * 5)
+add_test_cases("test_busy_poll")
+add_test_cases("test_stress_latency", iters_one, timeout_stress_send_recv)
+add_test_cases("test_stress_oversubscribed", iters_one, timeout_stress_send_recv)
+add_test_cases("test_async", iters_slow)
+add_test_cases("test_file_stage", iters_slow)
+add_test_cases("test_map_stream", iters_slow)
+add_test_case_channel("test_stress_mapped_topology", iters_one, timeout_channel * 5)
+add_test_case_sanitize("test_stress_mapped_topology", iters_one, timeout_sanitize * 5)
+add_test_case_valgrind("test_stress_mapped_topology", iters_one, timeout_valgrind * 5)
+add_test_case_channel("test_percpu_channel", iters_slow, timeout_channel * 2)
+add_test_case_sanitize("test_percpu_channel", iters_slow, timeout_sanitize * 5)
+add_test_case_valgrind("test_percpu_channel", iters_slow, timeout_valgrind * 5)
+add_test_cases("test_channel_watch")
+add_test_case_channel("test_pipeline_ring", iters_slow, timeout_channel * 2)
+add_test_case_sanitize("test_pipeline_ring", iters_slow, timeout_sanitize * 3)
+add_test_case_valgrind("test_pipeline_ring", iters_slow, timeout_valgrind * 3)
+add_test_cases("test_stress_pipeline", iters_one, timeout_stress_send_recv)
+add_test_cases("test_keyed_channel", iters_slow)
+add_test_cases("test_stress_keyed", iters_one, timeout_stress_send_recv)
+add_test_case_channel("test_rpc", iters_slow, timeout_channel * 3)
+add_test_case_sanitize("test_rpc", iters_slow, timeout_sanitize * 4)
+add_test_case_valgrind("test_rpc", iters_slow, timeout_valgrind * 5)
+add_test_cases("test_actor", iters_slow)
+add_test_case_channel("test_stress_actor", iters_one, timeout_stress_send_recv)
+add_test_case_sanitize("test_stress_actor", iters_one, timeout_stress_send_recv * 4)
+add_test_case_valgrind("test_stress_actor", iters_one, timeout_stress_send_recv * 6)
+add_test_case_channel("test_state_cell", iters_slow)
+add_test_case_sanitize("test_state_cell", iters_slow, timeout_sanitize * 3)
+add_test_case_valgrind("test_state_cell", iters_slow, timeout_valgrind * 3)
+add_test_cases("test_waitset", iters_slow)
+add_test_cases("test_close_many_waiters", iters_one)
+add_test_cases("test_work_set", iters_slow)
 
 # Score distribution
 point_breakdown = [
@@ -0,0 +1,155 @@
+#include "item_set.h"
+
+// Returns the home slot of an item, the top bits of its product with the golden ratio (Fibonacci hashing)
+static size_t item_set_home(item_set_t* set, void* item)
+{
+    return (size_t)(((uint64_t)(uintptr_t)item * 0x9e3779b97f4a7c15ull) >> (64 - set->bits));
+}
+
+// Returns the slot holding the item, or the empty slot that ends its probe sequence
+static size_t item_set_find(item_set_t* set, void* item)
+{
+    size_t mask = ((size_t)1 << set->bits) - 1;
+    size_t slot = item_set_home(set, item);
+    while (set->slots[slot] && set->slots[slot] != item) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Creates a set for up to capacity members, hashed when max_id is 0, or a bitmap for the ids below max_id otherwise
+// Returns NULL if capacity is 0 (hashed mode)
+item_set_t* item_set_create(size_t capacity, size_t max_id)
+{
+    if (capacity == 0 && max_id == 0) {
+        return NULL;
+    }
+    item_set_t* set = (item_set_t*) calloc(1, sizeof(item_set_t));
+    if (!set) {
+        return NULL;
+    }
+    set->max_id = max_id;
+    if (max_id) {
+        set->bitmap = (uint64_t*) calloc((max_id + 63) / 64, sizeof(uint64_t));
+        if (!set->bitmap) {
+            free(set);
+            return NULL;
+        }
+        return set;
+    }
+    // at most half full, so that probe sequences stay short
+    set->bits = 1;
+    while (((size_t)1 << set->bits) < capacity * 2) {
+        set->bits++;
+    }
+    set->slots = (void**) calloc((size_t)1 << set->bits, sizeof(void*));
+    if (!set->slots) {
+        free(set);
+        return NULL;
+    }
+    return set;
+}
+
+// Adds an item to the set
+// Returns 'true' if the item was added
+// Returns 'false' if it was already a member, or if it is not a valid id in bitmap mode
+bool item_set_insert(item_set_t* set, void* item)
+{
+    if (set->bitmap) {
+        size_t id = (size_t)(uintptr_t)item;
+        if (id >= set->max_id || (set->bitmap[id / 64] & (1ull << (id % 64)))) {
+            return false;
+        }
+        set->bitmap[id / 64] |= 1ull << (id % 64);
+        set->count++;
+        return true;
+    }
+    if (!item) {
+        if (set->has_null) {
+            return false;
+        }
+        set->has_null = true;
+        set->count++;
+        return true;
+    }
+    size_t slot = item_set_find(set, item);
+    if (set->slots[slot]) {
+        return false;
+    }
+    set->slots[slot] = item;
+    set->count++;
+    return true;
+}
+
+// Returns whether the item is a member of the set
+bool item_set_contains(item_set_t* set, void* item)
+{
+    if (set->bitmap) {
+        size_t id = (size_t)(uintptr_t)item;
+        return id < set->max_id && (set->bitmap[id / 64] & (1ull << (id % 64)));
+    }
+    if (!item) {
+        return set->has_null;
+    }
+    return set->slots[item_set_find(set, item)] != NULL;
+}
+
+// Removes an item from the set
+// Returns 'true' if the item was a member
+bool item_set_remove(item_set_t* set, void* item)
+{
+    if (set->bitmap) {
+        if (!item_set_contains(set, item)) {
+            return false;
+        }
+        size_t id = (size_t)(uintptr_t)item;
+        set->bitmap[id / 64] &= ~(1ull << (id % 64));
+        set->count--;
+        return true;
+    }
+    if (!item) {
+        if (!set->has_null) {
+            return false;
+        }
+        set->has_null = false;
+        set->count--;
+        return true;
+    }
+    size_t mask = ((size_t)1 << set->bits) - 1;
+    size_t hole = item_set_find(set, item);
+    if (!set->slots[hole]) {
+        return false;
+    }
+    // shifts back the items after the hole that probed past it, so that no tombstone is needed
+    size_t slot = hole;
+    while (true) {
+        slot = (slot + 1) & mask;
+        void* next = set->slots[slot];
+        if (!next) {
+            break;
+        }
+        size_t home = item_set_home(set, next);
+        // the item can fill the hole if its home is not cyclically within (hole, slot]
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            set->slots[hole] = next;
+            hole = slot;
+        }
+    }
+    set->slots[hole] = NULL;
+    set->count--;
+    return true;
+}
+
+// Returns the number of members
+size_t item_set_count(item_set_t* set)
+{
+    return set->count;
+}
+
+// Frees the memory allocated to the set
+void item_set_free(item_set_t* set)
+{
+    free(set->slots);
+    free(set->bitmap);
+    free(set);
+}
@@ -0,0 +1,47 @@
+#ifndef ITEM_SET_H
+#define ITEM_SET_H
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Defines a set of items (pointers), sized up front for a bounded number of members
+// Items are hashed into an open-addressing table, or, when the items are small integer ids cast to pointers, tracked
+// in a bitmap of one bit per id
+// The set has no locking of its own, its owner serializes the calls
+typedef struct {
+    // Table of 2^bits slots (NULL when empty) for hashed items, NULL in bitmap mode
+    void** slots;
+    unsigned bits;
+    // Whether NULL, which marks the empty slots, is a member
+    bool has_null;
+    // Bitmap of max_id bits for small ids, NULL in hashed mode
+    uint64_t* bitmap;
+    size_t max_id;
+    size_t count;
+} item_set_t;
+
+// Creates a set for up to capacity members, hashed when max_id is 0, or a bitmap for the ids below max_id otherwise
+// Returns NULL if capacity is 0 (hashed mode)
+item_set_t* item_set_create(size_t capacity, size_t max_id);
+
+// Adds an item to the set
+// Returns 'true' if the item was added
+// Returns 'false' if it was already a member, or if it is not a valid id in bitmap mode
+bool item_set_insert(item_set_t* set, void* item);
+
+// Returns whether the item is a member of the set
+bool item_set_contains(item_set_t* set, void* item);
+
+// Removes an item from the set
+// Returns 'true' if the item was a member
+bool item_set_remove(item_set_t* set, void* item);
+
+// Returns the number of members
+size_t item_set_count(item_set_t* set);
+
+// Frees the memory allocated to the set
+void item_set_free(item_set_t* set);
+
+#endif // ITEM_SET_H
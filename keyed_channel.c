@@ -0,0 +1,246 @@
+#include "keyed_channel.h"
+
+// Defines the arguments of a worker thread
+typedef struct {
+    keyed_channel_t* keyed;
+    size_t partition;
+} keyed_worker_t;
+
+struct keyed_channel {
+    size_t partitions;
+    chan_t** channels;
+    bool open;
+    // Workers, one per partition, while started
+    bool started;
+    keyed_channel_handler_fn handler;
+    void* context;
+    pthread_t* threads;
+    keyed_worker_t* workers;
+    // Number of end of stream markers sent to every partition, left out of the counters
+    // Counted before the send, so a marker is never seen in sent without its count here
+    // Updated and read with the mutex of the partition's channel held
+    size_t* ends;
+};
+
+// Message marking the end of stream for the workers
+static char keyed_channel_end;
+
+// Mixes the bits of the key, so that keys differing in any bit spread over the partitions (splitmix64 finalizer)
+static uint64_t keyed_channel_hash(uint64_t key)
+{
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return key;
+}
+
+// Body of a worker thread
+static void* keyed_channel_worker(void* arg)
+{
+    keyed_worker_t* worker = arg;
+    keyed_channel_t* keyed = worker->keyed;
+    void* data = NULL;
+    while (channel_receive(keyed->channels[worker->partition], &data, true) == SUCCESS && data != &keyed_channel_end) {
+        keyed->handler(keyed->context, worker->partition, data);
+    }
+    return NULL;
+}
+
+// Sends an end of stream behind the messages of a partition, and counts it so that the counters leave it out
+// Returns true if the end of stream was sent
+static bool keyed_channel_send_end(keyed_channel_t* keyed, size_t partition)
+{
+    chan_t* channel = keyed->channels[partition];
+    pthread_mutex_lock(&channel->mutex);
+    keyed->ends[partition]++;
+    pthread_mutex_unlock(&channel->mutex);
+    if (channel_send(channel, &keyed_channel_end, true) != SUCCESS) {
+        pthread_mutex_lock(&channel->mutex);
+        keyed->ends[partition]--;
+        pthread_mutex_unlock(&channel->mutex);
+        return false;
+    }
+    return true;
+}
+
+// Waits for the workers to stop
+static void keyed_channel_wait_workers(keyed_channel_t* keyed)
+{
+    for (size_t i = 0; i < keyed->partitions; i++) {
+        pthread_join(keyed->threads[i], NULL);
+    }
+    free(keyed->threads);
+    free(keyed->workers);
+    keyed->started = false;
+}
+
+// Creates a keyed channel of partitions partitions, each buffering up to size messages
+// Returns NULL if partitions or size is 0
+keyed_channel_t* keyed_channel_create(size_t partitions, size_t size)
+{
+    if (partitions == 0 || size == 0) {
+        return NULL;
+    }
+    keyed_channel_t* keyed = calloc(1, sizeof(keyed_channel_t));
+    if (!keyed) {
+        return NULL;
+    }
+    keyed->channels = calloc(partitions, sizeof(chan_t*));
+    keyed->ends = calloc(partitions, sizeof(size_t));
+    if (!keyed->channels || !keyed->ends) {
+        free(keyed->channels);
+        free(keyed->ends);
+        free(keyed);
+        return NULL;
+    }
+    keyed->partitions = partitions;
+    keyed->open = true;
+    for (size_t i = 0; i < partitions; i++) {
+        keyed->channels[i] = channel_create(size);
+        if (!keyed->channels[i]) {
+            keyed_channel_close(keyed);
+            keyed_channel_destroy(keyed);
+            return NULL;
+        }
+    }
+    return keyed;
+}
+
+// Returns the number of partitions, and the partition that the messages of the key go to
+size_t keyed_channel_partitions(keyed_channel_t* keyed)
+{
+    return keyed->partitions;
+}
+
+size_t keyed_channel_partition(keyed_channel_t* keyed, uint64_t key)
+{
+    // maps the hash onto the partitions with a multiplication instead of a division
+    return (size_t)(((unsigned __int128)keyed_channel_hash(key) * keyed->partitions) >> 64);
+}
+
+// Returns the channel of a partition, so that it can be part of a channel_select list like any other channel
+// The channel must not be closed or destroyed directly
+chan_t* keyed_channel_get(keyed_channel_t* keyed, size_t partition)
+{
+    return keyed->channels[partition];
+}
+
+// Sends data to the partition of the key, returns like channel_send
+enum chan_status keyed_channel_send(keyed_channel_t* keyed, uint64_t key, void* data, bool blocking)
+{
+    return channel_send(keyed->channels[keyed_channel_partition(keyed, key)], data, blocking);
+}
+
+// Receives a message from a partition, returns like channel_receive
+enum chan_status keyed_channel_receive(keyed_channel_t* keyed, size_t partition, void** data, bool blocking)
+{
+    return channel_receive(keyed->channels[partition], data, blocking);
+}
+
+// Stores the counters of a partition, or the sum over all of them when partition is KEYED_CHANNEL_ALL, in stats
+void keyed_channel_stats(keyed_channel_t* keyed, size_t partition, keyed_channel_stats_t* stats)
+{
+    stats->sent = 0;
+    stats->queued = 0;
+    for (size_t i = 0; i < keyed->partitions; i++) {
+        if (partition != KEYED_CHANNEL_ALL && partition != i) {
+            continue;
+        }
+        chan_t* channel = keyed->channels[i];
+        pthread_mutex_lock(&channel->mutex);
+        // a marker still waiting for room is counted in ends but not yet in sent, so sent may read one short until it goes in
+        size_t ends = keyed->ends[i];
+        stats->sent += channel->sent > ends ? channel->sent - ends : 0;
+        stats->queued += buffer_current_size(channel->buffer);
+        pthread_mutex_unlock(&channel->mutex);
+    }
+}
+
+// Starts one worker thread per partition, which receives the messages of its partition and passes them to handler
+// Returns false if the workers were already started or could not be started
+bool keyed_channel_start(keyed_channel_t* keyed, keyed_channel_handler_fn handler, void* context)
+{
+    if (keyed->started || !keyed->open) {
+        return false;
+    }
+    keyed->handler = handler;
+    keyed->context = context;
+    keyed->threads = malloc(sizeof(pthread_t) * keyed->partitions);
+    keyed->workers = malloc(sizeof(keyed_worker_t) * keyed->partitions);
+    if (!keyed->threads || !keyed->workers) {
+        free(keyed->threads);
+        free(keyed->workers);
+        return false;
+    }
+    for (size_t i = 0; i < keyed->partitions; i++) {
+        keyed->workers[i].keyed = keyed;
+        keyed->workers[i].partition = i;
+        if (pthread_create(&keyed->threads[i], NULL, keyed_channel_worker, &keyed->workers[i]) != 0) {
+            // stops the workers already running
+            for (size_t j = 0; j < i; j++) {
+                keyed_channel_send_end(keyed, j);
+                pthread_join(keyed->threads[j], NULL);
+            }
+            free(keyed->threads);
+            free(keyed->workers);
+            return false;
+        }
+    }
+    keyed->started = true;
+    return true;
+}
+
+// Sends an end of stream behind the messages of every partition and waits for the workers to handle every message
+// before it, the keyed channel is open again for another keyed_channel_start afterwards
+// Sends made while joining may not be handled
+void keyed_channel_join(keyed_channel_t* keyed)
+{
+    if (!keyed->started) {
+        return;
+    }
+    for (size_t i = 0; i < keyed->partitions; i++) {
+        keyed_channel_send_end(keyed, i);
+    }
+    keyed_channel_wait_workers(keyed);
+}
+
+// Closes every partition, see channel_close (workers stop without handling the messages still queued)
+// Returns SUCCESS if close is successful, and
+// CLOSED_ERROR if the keyed channel is already closed
+enum chan_status keyed_channel_close(keyed_channel_t* keyed)
+{
+    if (!keyed->open) {
+        return CLOSED_ERROR;
+    }
+    keyed->open = false;
+    for (size_t i = 0; i < keyed->partitions; i++) {
+        if (keyed->channels[i]) {
+            channel_close(keyed->channels[i]);
+        }
+    }
+    return SUCCESS;
+}
+
+// Waits for the workers (if started) and frees the keyed channel, which must be closed
+// Returns SUCCESS if destroy is successful, and
+// DESTROY_ERROR if the keyed channel is still open
+enum chan_status keyed_channel_destroy(keyed_channel_t* keyed)
+{
+    if (keyed->open) {
+        return DESTROY_ERROR;
+    }
+    if (keyed->started) {
+        keyed_channel_wait_workers(keyed);
+    }
+    for (size_t i = 0; i < keyed->partitions; i++) {
+        if (keyed->channels[i]) {
+            channel_destroy(keyed->channels[i]);
+        }
+    }
+    free(keyed->channels);
+    free(keyed->ends);
+    free(keyed);
+    return SUCCESS;
+}
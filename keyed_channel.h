@@ -0,0 +1,68 @@
+#ifndef KEYED_CHANNEL_H
+#define KEYED_CHANNEL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "channel.h"
+
+// Partition index that stands for every partition in keyed_channel_stats
+#define KEYED_CHANNEL_ALL SIZE_MAX
+
+// Defines the handler run by the workers of a keyed channel for every message of their partition
+typedef void (*keyed_channel_handler_fn)(void* context, size_t partition, void* data);
+
+// Defines the counters of a partition (or of all of them)
+typedef struct {
+    // Number of messages ever sent to the partition, and number still waiting in it
+    size_t sent;
+    size_t queued;
+} keyed_channel_stats_t;
+
+// Defines a keyed channel, a set of partitions (each a regular channel) that sends are spread over by key
+// Every message sent with the same key goes to the same partition, so a single consumer per partition receives the
+// messages of each key in the order they were sent, while the partitions are consumed in parallel
+typedef struct keyed_channel keyed_channel_t;
+
+// Creates a keyed channel of partitions partitions, each buffering up to size messages
+// Returns NULL if partitions or size is 0
+keyed_channel_t* keyed_channel_create(size_t partitions, size_t size);
+
+// Returns the number of partitions, and the partition that the messages of the key go to
+size_t keyed_channel_partitions(keyed_channel_t* keyed);
+size_t keyed_channel_partition(keyed_channel_t* keyed, uint64_t key);
+
+// Returns the channel of a partition, so that it can be part of a channel_select list like any other channel
+// The channel must not be closed or destroyed directly
+chan_t* keyed_channel_get(keyed_channel_t* keyed, size_t partition);
+
+// Sends data to the partition of the key, returns like channel_send
+enum chan_status keyed_channel_send(keyed_channel_t* keyed, uint64_t key, void* data, bool blocking);
+
+// Receives a message from a partition, returns like channel_receive
+enum chan_status keyed_channel_receive(keyed_channel_t* keyed, size_t partition, void** data, bool blocking);
+
+// Stores the counters of a partition, or the sum over all of them when partition is KEYED_CHANNEL_ALL, in stats
+void keyed_channel_stats(keyed_channel_t* keyed, size_t partition, keyed_channel_stats_t* stats);
+
+// Starts one worker thread per partition, which receives the messages of its partition and passes them to handler
+// Returns false if the workers were already started or could not be started
+bool keyed_channel_start(keyed_channel_t* keyed, keyed_channel_handler_fn handler, void* context);
+
+// Sends an end of stream behind the messages of every partition and waits for the workers to handle every message
+// before it, the keyed channel is open again for another keyed_channel_start afterwards
+// Sends made while joining may not be handled
+void keyed_channel_join(keyed_channel_t* keyed);
+
+// Closes every partition, see channel_close (workers stop without handling the messages still queued)
+// Returns SUCCESS if close is successful, and
+// CLOSED_ERROR if the keyed channel is already closed
+enum chan_status keyed_channel_close(keyed_channel_t* keyed);
+
+// Waits for the workers (if started) and frees the keyed channel, which must be closed
+// Returns SUCCESS if destroy is successful, and
+// DESTROY_ERROR if the keyed channel is still open
+enum chan_status keyed_channel_destroy(keyed_channel_t* keyed);
+
+#endif // KEYED_CHANNEL_H
@@ -3,66 +3,95 @@
 // Creates and returns a new list
 list_t* list_create()
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    return NULL;
+    list_t* list = (list_t*) malloc(sizeof(list_t));
+    if (list) {
+        list->head = NULL;
+        list->count = 0;
+    }
+    return list;
 }
 
 // Destroys a list
 void list_destroy(list_t* list)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
+    list_node_t* node = list->head;
+    while (node) {
+        list_node_t* next = node->next;
+        free(node);
+        node = next;
+    }
+    free(list);
 }
 
 // Returns beginning of the list
 list_node_t* list_begin(list_t* list)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    return NULL;
+    return list->head;
 }
 
 // Returns next element in the list
 list_node_t* list_next(list_node_t* node)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    return NULL;
+    return node->next;
 }
 
 // Returns data in the given list node
 void* list_data(list_node_t* node)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    return NULL;
+    return node->data;
 }
 
 // Returns the number of elements in the list
 size_t list_count(list_t* list)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
-    return 0;
+    return list->count;
 }
 
 // Finds the first node in the list with the given data
 // Returns NULL if data could not be found
 list_node_t* list_find(list_t* list, void* data)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
+    for (list_node_t* node = list->head; node; node = node->next) {
+        if (node->data == data) {
+            return node;
+        }
+    }
     return NULL;
 }
 
 // Inserts a new node in the list with the given data
 void list_insert(list_t* list, void* data)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
+    list_node_t* node = (list_node_t*) malloc(sizeof(list_node_t));
+    node->data = data;
+    node->prev = NULL;
+    node->next = list->head;
+    if (list->head) {
+        list->head->prev = node;
+    }
+    list->head = node;
+    list->count++;
 }
 
 // Removes a node from the list and frees the node resources
 void list_remove(list_t* list, list_node_t* node)
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        list->head = node->next;
+    }
+    if (node->next) {
+        node->next->prev = node->prev;
+    }
+    list->count--;
+    free(node);
 }
 
 // Executes a function for each element in the list
 void list_foreach(list_t* list, void (*func)(void* data))
 {
-    /* IMPLEMENT THIS IF YOU WANT TO USE LINKED LISTS */
+    for (list_node_t* node = list->head; node; node = node->next) {
+        func(node->data);
+    }
 }
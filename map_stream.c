@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "map_stream.h"
+
+struct map_stream {
+    int fd;
+    const char* data;
+    size_t size;
+    size_t page_size;
+    map_stream_options_t options;
+    chan_t* channel;
+    size_t consumers;
+    bool started;
+    pthread_t thread;
+    // Chunk descriptors, the free ones are kept on a channel so that at most window chunks are handed out
+    map_chunk_t* chunks;
+    chan_t* free;
+    // Released chunks that wait for the chunks before them, indexed by their sequence number
+    pthread_mutex_t mutex;
+    map_chunk_t** released;
+    size_t next_release;
+    size_t dropped;
+    map_stream_stats_t stats;
+};
+
+// Rounds offset down to the start of its page
+static size_t map_page_down(map_stream_t* stream, size_t offset)
+{
+    return offset / stream->page_size * stream->page_size;
+}
+
+// Counts the delimiters in data[0..length)
+static size_t map_count_records(const char* data, size_t length, int delimiter)
+{
+    size_t count = 0;
+    const char* end = data + length;
+    while ((data = memchr(data, delimiter, (size_t)(end - data)))) {
+        count++;
+        data++;
+    }
+    return count;
+}
+
+// Body of the stream thread
+static void* map_streamer(void* arg)
+{
+    map_stream_t* stream = arg;
+    size_t chunk_size = stream->options.chunk_size;
+    size_t offset = 0;
+    size_t records = 0;
+    size_t prefetched = 0;
+    size_t seq = 0;
+    while (offset < stream->size) {
+        void* data = NULL;
+        channel_receive(stream->free, &data, true);
+        map_chunk_t* chunk = data;
+        size_t end = offset + chunk_size < stream->size ? offset + chunk_size : stream->size;
+        if (stream->options.delimiter >= 0 && end < stream->size) {
+            const char* next = memchr(stream->data + end - 1, stream->options.delimiter, stream->size - end + 1);
+            end = next ? (size_t)(next - stream->data) + 1 : stream->size;
+        }
+        // keep the kernel reading ahead of the consumers
+        size_t ahead = end + stream->options.prefetch * chunk_size;
+        ahead = ahead < stream->size ? ahead : stream->size;
+        if (ahead > prefetched) {
+            size_t start = map_page_down(stream, prefetched > end ? prefetched : end);
+            if (ahead > start) {
+                madvise((void*)(stream->data + start), ahead - start, MADV_WILLNEED);
+            }
+            prefetched = ahead;
+        }
+        chunk->data = stream->data + offset;
+        chunk->offset = offset;
+        chunk->length = end - offset;
+        chunk->first_record = records;
+        chunk->seq = seq++;
+        if (stream->options.delimiter >= 0) {
+            records += map_count_records(chunk->data, chunk->length, stream->options.delimiter);
+        }
+        stream->stats.chunks++;
+        stream->stats.bytes += chunk->length;
+        size_t outstanding = seq - __atomic_load_n(&stream->next_release, __ATOMIC_RELAXED);
+        if (outstanding > stream->stats.peak_chunks) {
+            stream->stats.peak_chunks = outstanding;
+        }
+        offset = end;
+        channel_send(stream->channel, chunk, true);
+    }
+    for (size_t i = 0; i < stream->consumers; i++) {
+        channel_send(stream->channel, NULL, true);
+    }
+    return NULL;
+}
+
+// Frees whatever the stream holds, the stream thread must have stopped
+static void map_stream_free(map_stream_t* stream)
+{
+    if (stream->free) {
+        channel_close(stream->free);
+        channel_destroy(stream->free);
+    }
+    pthread_mutex_destroy(&stream->mutex);
+    free(stream->released);
+    free(stream->chunks);
+    if (stream->data) {
+        munmap((void*)stream->data, stream->size);
+    }
+    if (stream->fd >= 0) {
+        close(stream->fd);
+    }
+    free(stream);
+}
+
+// Maps the file read-only for sequential access
+// Returns NULL if the file could not be opened or mapped, or the options are invalid
+map_stream_t* map_stream_open(const char* path, const map_stream_options_t* options)
+{
+    if (options->chunk_size == 0 || options->window == 0) {
+        return NULL;
+    }
+    map_stream_t* stream = calloc(1, sizeof(map_stream_t));
+    if (!stream) {
+        return NULL;
+    }
+    pthread_mutex_init(&stream->mutex, NULL);
+    stream->options = *options;
+    stream->page_size = (size_t)sysconf(_SC_PAGESIZE);
+    stream->fd = open(path, O_RDONLY);
+    struct stat st;
+    if (stream->fd < 0 || fstat(stream->fd, &st) != 0) {
+        map_stream_free(stream);
+        return NULL;
+    }
+    stream->size = (size_t)st.st_size;
+    if (stream->size > 0) {
+        void* data = mmap(NULL, stream->size, PROT_READ, MAP_PRIVATE, stream->fd, 0);
+        if (data == MAP_FAILED) {
+            map_stream_free(stream);
+            return NULL;
+        }
+        stream->data = data;
+        madvise(data, stream->size, MADV_SEQUENTIAL);
+    }
+    stream->chunks = calloc(options->window, sizeof(map_chunk_t));
+    stream->released = calloc(options->window, sizeof(map_chunk_t*));
+    stream->free = channel_create(options->window);
+    if (!stream->chunks || !stream->released || !stream->free) {
+        map_stream_free(stream);
+        return NULL;
+    }
+    for (size_t i = 0; i < options->window; i++) {
+        channel_send(stream->free, &stream->chunks[i], true);
+    }
+    return stream;
+}
+
+// Returns the mapping of the file, and its length
+const char* map_stream_data(map_stream_t* stream)
+{
+    return stream->data;
+}
+
+size_t map_stream_size(map_stream_t* stream)
+{
+    return stream->size;
+}
+
+// Starts sending the chunks of the file on the channel, in file order, followed by one end of stream per consumer
+// A stream can only be started once
+// Returns false if the stream thread could not be started
+bool map_stream_start(map_stream_t* stream, chan_t* channel, size_t consumers)
+{
+    if (stream->started) {
+        return false;
+    }
+    stream->channel = channel;
+    stream->consumers = consumers;
+    stream->started = pthread_create(&stream->thread, NULL, map_streamer, stream) == 0;
+    return stream->started;
+}
+
+// Hands a chunk back to the stream, chunks may be released in any order
+// The pages only covered by chunks that have all been released are dropped from the mapping
+void map_stream_release(map_stream_t* stream, map_chunk_t* chunk)
+{
+    size_t window = stream->options.window;
+    pthread_mutex_lock(&stream->mutex);
+    stream->released[chunk->seq % window] = chunk;
+    size_t consumed = stream->dropped;
+    while (stream->released[stream->next_release % window]) {
+        map_chunk_t* next = stream->released[stream->next_release % window];
+        stream->released[stream->next_release % window] = NULL;
+        consumed = next->offset + next->length;
+        __atomic_store_n(&stream->next_release, stream->next_release + 1, __ATOMIC_RELAXED);
+        // never blocks, the free channel has room for every descriptor
+        channel_send(stream->free, next, true);
+    }
+    // the page holding the end of the consumed range may still be read by the next chunk
+    size_t drop = consumed == stream->size ? consumed : map_page_down(stream, consumed);
+    if (drop > stream->dropped) {
+        size_t start = map_page_down(stream, stream->dropped);
+        madvise((void*)(stream->data + start), drop - start, MADV_DONTNEED);
+        stream->stats.released_bytes += drop - stream->dropped;
+        stream->dropped = drop;
+    }
+    pthread_mutex_unlock(&stream->mutex);
+}
+
+// Waits for the stream to send every chunk, stores its counters in stats (if stats is not NULL), unmaps the file and
+// frees the stream, every chunk must have been released
+void map_stream_close(map_stream_t* stream, map_stream_stats_t* stats)
+{
+    if (stream->started) {
+        pthread_join(stream->thread, NULL);
+    }
+    if (stats) {
+        *stats = stream->stats;
+    }
+    map_stream_free(stream);
+}
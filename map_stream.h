@@ -0,0 +1,70 @@
+#ifndef MAP_STREAM_H
+#define MAP_STREAM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "channel.h"
+
+// Defines a chunk of a mapped file, the message carried by the channel of a map stream
+// The chunk points into the mapping, nothing is copied: consumers parse data[0..length) in place and hand the chunk
+// back with map_stream_release once they are done with it
+// A NULL chunk marks the end of the stream, one is sent for every consumer
+typedef struct {
+    const char* data;
+    // Position and length of the chunk in the file
+    size_t offset;
+    size_t length;
+    // Number of delimiters in the file before the chunk (its first line number, when the delimiter is '\n')
+    size_t first_record;
+    // Position of the chunk in the stream
+    size_t seq;
+} map_chunk_t;
+
+// Defines the options of a map stream
+typedef struct {
+    // Length of a chunk, a chunk is extended to end just after the next delimiter so records are never split
+    size_t chunk_size;
+    // Largest number of chunks handed out and not released yet, which bounds the resident part of the mapping
+    size_t window;
+    // Number of chunks past the last one handed out that are prefetched with MADV_WILLNEED
+    size_t prefetch;
+    // Byte that ends a record, or -1 to cut chunks at chunk_size exactly
+    int delimiter;
+} map_stream_options_t;
+
+// Defines the counters reported by a map stream once it has finished
+typedef struct {
+    size_t chunks;
+    size_t bytes;
+    // Number of bytes dropped from the mapping with MADV_DONTNEED once every chunk covering them was released
+    size_t released_bytes;
+    // Largest number of chunks that were handed out and not released at the same time
+    size_t peak_chunks;
+} map_stream_stats_t;
+
+// Defines a map stream object, which hands out the chunks of a memory-mapped file on its own thread
+typedef struct map_stream map_stream_t;
+
+// Maps the file read-only for sequential access
+// Returns NULL if the file could not be opened or mapped, or the options are invalid
+map_stream_t* map_stream_open(const char* path, const map_stream_options_t* options);
+
+// Returns the mapping of the file, and its length
+const char* map_stream_data(map_stream_t* stream);
+size_t map_stream_size(map_stream_t* stream);
+
+// Starts sending the chunks of the file on the channel, in file order, followed by one end of stream per consumer
+// A stream can only be started once
+// Returns false if the stream thread could not be started
+bool map_stream_start(map_stream_t* stream, chan_t* channel, size_t consumers);
+
+// Hands a chunk back to the stream, chunks may be released in any order
+// The pages only covered by chunks that have all been released are dropped from the mapping
+void map_stream_release(map_stream_t* stream, map_chunk_t* chunk);
+
+// Waits for the stream to send every chunk, stores its counters in stats (if stats is not NULL), unmaps the file and
+// frees the stream, every chunk must have been released
+void map_stream_close(map_stream_t* stream, map_stream_stats_t* stats);
+
+#endif // MAP_STREAM_H
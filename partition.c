@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "partition.h"
+
+// Maximum number of label propagation passes over the vertices
+#define PARTITION_MAX_PASSES 32
+
+// Splits a subset of the vertices of an undirected graph into num_parts balanced parts, trying to minimize the
+// number of edges between parts
+// The graph is given in compressed sparse row form: the neighbors of vertex v are neighbors[offsets[v]] up to
+// neighbors[offsets[v + 1]], and edges leading outside the subset are ignored
+// The part (0 to num_parts - 1) of each vertex in vertices[0] up to vertices[count - 1] is stored in parts[vertex],
+// the other entries of parts are left untouched
+// Vertices start in contiguous chunks of a breadth-first ordering and are then refined by size-constrained label
+// propagation, which moves a vertex to the part holding most of its neighbors while that part has room
+void partition_graph(size_t num_vertices, const size_t* offsets, const size_t* neighbors,
+                     const size_t* vertices, size_t count, size_t num_parts, size_t* parts)
+{
+    if (count == 0 || num_parts == 0) {
+        return;
+    }
+    bool* member = calloc(num_vertices, sizeof(bool));
+    bool* visited = calloc(num_vertices, sizeof(bool));
+    size_t* order = malloc(sizeof(size_t) * count);
+    size_t* part_size = calloc(num_parts, sizeof(size_t));
+    size_t* links = calloc(num_parts, sizeof(size_t));
+    for (size_t i = 0; i < count; i++) {
+        member[vertices[i]] = true;
+    }
+
+    // breadth-first ordering keeps neighbors close together, so contiguous chunks are a good starting point
+    size_t ordered = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (visited[vertices[i]]) {
+            continue;
+        }
+        size_t head = ordered;
+        order[ordered++] = vertices[i];
+        visited[vertices[i]] = true;
+        while (head < ordered) {
+            size_t vertex = order[head++];
+            for (size_t e = offsets[vertex]; e < offsets[vertex + 1]; e++) {
+                size_t neighbor = neighbors[e];
+                if (member[neighbor] && !visited[neighbor]) {
+                    visited[neighbor] = true;
+                    order[ordered++] = neighbor;
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        size_t part = i * num_parts / count;
+        parts[order[i]] = part;
+        part_size[part]++;
+    }
+
+    // allow parts to grow a little beyond an even split, otherwise no vertex could ever move
+    size_t max_size = (count + num_parts - 1) / num_parts;
+    max_size += max_size / 20 + 1;
+    for (size_t pass = 0; pass < PARTITION_MAX_PASSES; pass++) {
+        bool moved = false;
+        for (size_t i = 0; i < count; i++) {
+            size_t vertex = order[i];
+            size_t current = parts[vertex];
+            for (size_t e = offsets[vertex]; e < offsets[vertex + 1]; e++) {
+                if (member[neighbors[e]]) {
+                    links[parts[neighbors[e]]]++;
+                }
+            }
+            size_t best = current;
+            for (size_t e = offsets[vertex]; e < offsets[vertex + 1]; e++) {
+                if (!member[neighbors[e]]) {
+                    continue;
+                }
+                size_t part = parts[neighbors[e]];
+                if (links[part] > links[best] && part_size[part] < max_size) {
+                    best = part;
+                }
+            }
+            // never empty a part, the caller expects every part to get some work
+            if (best != current && part_size[current] > 1) {
+                parts[vertex] = best;
+                part_size[current]--;
+                part_size[best]++;
+                moved = true;
+            }
+            for (size_t e = offsets[vertex]; e < offsets[vertex + 1]; e++) {
+                if (member[neighbors[e]]) {
+                    links[parts[neighbors[e]]] = 0;
+                }
+            }
+            links[current] = 0;
+        }
+        if (!moved) {
+            break;
+        }
+    }
+
+    free(member);
+    free(visited);
+    free(order);
+    free(part_size);
+    free(links);
+}
+
+// Returns the number of edges (counted once per direction) between vertices of different parts, among the subset
+size_t partition_cut(size_t num_vertices, const size_t* offsets, const size_t* neighbors,
+                     const size_t* vertices, size_t count, const size_t* parts)
+{
+    bool* member = calloc(num_vertices, sizeof(bool));
+    for (size_t i = 0; i < count; i++) {
+        member[vertices[i]] = true;
+    }
+    size_t cut = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t vertex = vertices[i];
+        for (size_t e = offsets[vertex]; e < offsets[vertex + 1]; e++) {
+            if (member[neighbors[e]] && parts[neighbors[e]] != parts[vertex]) {
+                cut++;
+            }
+        }
+    }
+    free(member);
+    return cut;
+}
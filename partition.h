@@ -0,0 +1,21 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <stddef.h>
+
+// Splits a subset of the vertices of an undirected graph into num_parts balanced parts, trying to minimize the
+// number of edges between parts
+// The graph is given in compressed sparse row form: the neighbors of vertex v are neighbors[offsets[v]] up to
+// neighbors[offsets[v + 1]], and edges leading outside the subset are ignored
+// The part (0 to num_parts - 1) of each vertex in vertices[0] up to vertices[count - 1] is stored in parts[vertex],
+// the other entries of parts are left untouched
+// Vertices start in contiguous chunks of a breadth-first ordering and are then refined by size-constrained label
+// propagation, which moves a vertex to the part holding most of its neighbors while that part has room
+void partition_graph(size_t num_vertices, const size_t* offsets, const size_t* neighbors,
+                     const size_t* vertices, size_t count, size_t num_parts, size_t* parts);
+
+// Returns the number of edges (counted once per direction) between vertices of different parts, among the subset
+size_t partition_cut(size_t num_vertices, const size_t* offsets, const size_t* neighbors,
+                     const size_t* vertices, size_t count, const size_t* parts);
+
+#endif // PARTITION_H
@@ -0,0 +1,236 @@
+#include <sched.h>
+#include <unistd.h>
+#include "cpu_relax.h"
+#include "pipeline_ring.h"
+
+// Number of checks made by the spin and yield strategies before parking
+#define PIPELINE_RING_SPIN_CHECKS 4096
+#define PIPELINE_RING_YIELD_CHECKS 16
+
+// Highest bit of the claim cursor, set once the ring is closed
+#define PIPELINE_RING_CLOSED ((size_t)1 << (sizeof(size_t) * 8 - 1))
+
+// Defines a cursor, alone on its cache line so that the stages do not slow each other down
+typedef struct {
+    size_t value;
+} __attribute__((aligned(64))) pipeline_cursor_t;
+
+struct pipeline_ring {
+    void** slots;
+    // Sequence + 1 of the message in each slot once it is published, so the first stage can tell which of the claimed
+    // sequences the producers have filled
+    size_t* published;
+    size_t size;
+    size_t mask;
+    size_t stages;
+    // Number of spin and yield checks made before parking
+    size_t spins;
+    size_t yields;
+    // Next sequence to claim, with PIPELINE_RING_CLOSED set once the ring is closed
+    pipeline_cursor_t claim;
+    // Cursor of every stage
+    pipeline_cursor_t* cursors;
+    // Parked producers and stages, woken up by every publish and release while there are any
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    size_t sleepers;
+};
+
+// Returns the sequence up to which (excluded) messages are available to the stage, starting from next
+static size_t pipeline_ring_available(pipeline_ring_t* ring, size_t stage, size_t next)
+{
+    if (stage > 0) {
+        return __atomic_load_n(&ring->cursors[stage - 1].value, __ATOMIC_SEQ_CST);
+    }
+    // the producers may fill their claimed slots in any order, the stage only goes as far as they are contiguous
+    size_t end = next;
+    while (end - next < ring->size && __atomic_load_n(&ring->published[end & ring->mask], __ATOMIC_SEQ_CST) == end + 1) {
+        end++;
+    }
+    return end;
+}
+
+// Returns whether a producer holding the sequence can fill its slot (stage == stages), or whether the stage has a
+// message at the sequence or has nothing left to wait for
+static bool pipeline_ring_ready(pipeline_ring_t* ring, size_t stage, size_t sequence)
+{
+    if (stage == ring->stages) {
+        return sequence - __atomic_load_n(&ring->cursors[ring->stages - 1].value, __ATOMIC_SEQ_CST) < ring->size;
+    }
+    if (stage > 0 ? __atomic_load_n(&ring->cursors[stage - 1].value, __ATOMIC_SEQ_CST) != sequence
+                  : __atomic_load_n(&ring->published[sequence & ring->mask], __ATOMIC_SEQ_CST) == sequence + 1) {
+        return true;
+    }
+    size_t claim = __atomic_load_n(&ring->claim.value, __ATOMIC_SEQ_CST);
+    return (claim & PIPELINE_RING_CLOSED) && sequence == (claim & ~PIPELINE_RING_CLOSED);
+}
+
+// Waits, following the wait strategy of the ring, until pipeline_ring_ready holds
+static void pipeline_ring_wait(pipeline_ring_t* ring, size_t stage, size_t sequence)
+{
+    for (size_t i = 0; i < ring->spins; i++) {
+        if (pipeline_ring_ready(ring, stage, sequence)) {
+            return;
+        }
+        cpu_relax();
+    }
+    for (size_t i = 0; i < ring->yields; i++) {
+        if (pipeline_ring_ready(ring, stage, sequence)) {
+            return;
+        }
+        sched_yield();
+    }
+    pthread_mutex_lock(&ring->mutex);
+    // registered before the last check, so that whoever makes the ring ready afterwards sees the sleeper
+    __atomic_add_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+    while (!pipeline_ring_ready(ring, stage, sequence)) {
+        pthread_cond_wait(&ring->cond, &ring->mutex);
+    }
+    __atomic_sub_fetch(&ring->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&ring->mutex);
+}
+
+// Wakes up the parked producers and stages after a cursor moved, they wait on different cursors so all of them are woken
+static void pipeline_ring_wake(pipeline_ring_t* ring)
+{
+    if (__atomic_load_n(&ring->sleepers, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&ring->mutex);
+        pthread_cond_broadcast(&ring->cond);
+        pthread_mutex_unlock(&ring->mutex);
+    }
+}
+
+// Creates a ring of size slots (rounded up to a power of two) for a pipeline of stages stages, whose producers and
+// consumers wait following the given strategy (see enum chan_wait)
+// Returns NULL if size or stages is 0
+pipeline_ring_t* pipeline_ring_create(size_t size, size_t stages, enum chan_wait wait)
+{
+    if (size == 0 || stages == 0) {
+        return NULL;
+    }
+    pipeline_ring_t* ring = aligned_alloc(_Alignof(pipeline_ring_t), sizeof(pipeline_ring_t));
+    if (!ring) {
+        return NULL;
+    }
+    ring->size = 1;
+    while (ring->size < size) {
+        ring->size *= 2;
+    }
+    ring->mask = ring->size - 1;
+    ring->stages = stages;
+    // adaptive waits only spin when the stage before has a CPU of its own to make progress on
+    bool spin = wait == CHANNEL_WAIT_SPIN || (wait == CHANNEL_WAIT_ADAPTIVE && channel_cpu_count() > 1);
+    ring->spins = spin ? PIPELINE_RING_SPIN_CHECKS : 0;
+    ring->yields = wait == CHANNEL_WAIT_YIELD || wait == CHANNEL_WAIT_ADAPTIVE ? PIPELINE_RING_YIELD_CHECKS : 0;
+    ring->claim.value = 0;
+    ring->sleepers = 0;
+    ring->slots = calloc(ring->size, sizeof(void*));
+    ring->published = calloc(ring->size, sizeof(size_t));
+    ring->cursors = aligned_alloc(sizeof(pipeline_cursor_t), sizeof(pipeline_cursor_t) * stages);
+    if (!ring->slots || !ring->published || !ring->cursors) {
+        free(ring->slots);
+        free(ring->published);
+        free(ring->cursors);
+        free(ring);
+        return NULL;
+    }
+    for (size_t i = 0; i < stages; i++) {
+        ring->cursors[i].value = 0;
+    }
+    pthread_mutex_init(&ring->mutex, NULL);
+    pthread_cond_init(&ring->cond, NULL);
+    return ring;
+}
+
+// Publishes data to the first stage, waiting for a free slot when the ring is full (blocking = true)
+// Any number of threads may publish on the same ring
+// Returns SUCCESS once the data is published,
+// WOULDBLOCK if the ring is full (non-blocking calls only), and
+// CLOSED_ERROR if the ring is closed
+enum chan_status pipeline_ring_publish(pipeline_ring_t* ring, void* data, bool blocking)
+{
+    size_t sequence = __atomic_load_n(&ring->claim.value, __ATOMIC_RELAXED);
+    do {
+        if (sequence & PIPELINE_RING_CLOSED) {
+            return CLOSED_ERROR;
+        }
+        if (!blocking && !pipeline_ring_ready(ring, ring->stages, sequence)) {
+            return WOULDBLOCK;
+        }
+    } while (!__atomic_compare_exchange_n(&ring->claim.value, &sequence, sequence + 1, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    // a claimed sequence is always published, so that the stages can drain the ring once it is closed
+    if (!pipeline_ring_ready(ring, ring->stages, sequence)) {
+        pipeline_ring_wait(ring, ring->stages, sequence);
+    }
+    ring->slots[sequence & ring->mask] = data;
+    __atomic_store_n(&ring->published[sequence & ring->mask], sequence + 1, __ATOMIC_SEQ_CST);
+    pipeline_ring_wake(ring);
+    return SUCCESS;
+}
+
+// Takes the messages available to a stage: stores the sequence of the first one in first and their number (at most max)
+// in count, waiting for the stage before it (or the producers) when none is available (blocking = true)
+// The messages are read, and may be replaced, through pipeline_ring_slot until they are released
+// Returns SUCCESS if at least one message was taken,
+// WOULDBLOCK if none is available (non-blocking calls only), and
+// CLOSED_ERROR once the ring is closed and the stage has released every message published before the close
+enum chan_status pipeline_ring_acquire(pipeline_ring_t* ring, size_t stage, size_t max, size_t* first, size_t* count,
+                                       bool blocking)
+{
+    size_t next = __atomic_load_n(&ring->cursors[stage].value, __ATOMIC_RELAXED);
+    size_t end = pipeline_ring_available(ring, stage, next);
+    if (end == next) {
+        if (!pipeline_ring_ready(ring, stage, next)) {
+            if (!blocking) {
+                return WOULDBLOCK;
+            }
+            pipeline_ring_wait(ring, stage, next);
+        }
+        end = pipeline_ring_available(ring, stage, next);
+        if (end == next) {
+            return CLOSED_ERROR;
+        }
+    }
+    *first = next;
+    *count = end - next < max ? end - next : max;
+    return SUCCESS;
+}
+
+// Returns the slot holding the message at the given sequence
+void** pipeline_ring_slot(pipeline_ring_t* ring, size_t sequence)
+{
+    return &ring->slots[sequence & ring->mask];
+}
+
+// Hands the first count messages taken by a stage to the next stage (or frees their slots, for the last stage)
+void pipeline_ring_release(pipeline_ring_t* ring, size_t stage, size_t count)
+{
+    size_t next = __atomic_load_n(&ring->cursors[stage].value, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->cursors[stage].value, next + count, __ATOMIC_SEQ_CST);
+    pipeline_ring_wake(ring);
+}
+
+// Closes the ring: publishing fails from then on, while the stages still drain the messages already published
+// Returns SUCCESS if close is successful, and
+// CLOSED_ERROR if the ring is already closed
+enum chan_status pipeline_ring_close(pipeline_ring_t* ring)
+{
+    if (__atomic_fetch_or(&ring->claim.value, PIPELINE_RING_CLOSED, __ATOMIC_SEQ_CST) & PIPELINE_RING_CLOSED) {
+        return CLOSED_ERROR;
+    }
+    pthread_mutex_lock(&ring->mutex);
+    pthread_cond_broadcast(&ring->cond);
+    pthread_mutex_unlock(&ring->mutex);
+    return SUCCESS;
+}
+
+// Frees the ring, every producer and stage must have stopped
+void pipeline_ring_destroy(pipeline_ring_t* ring)
+{
+    pthread_mutex_destroy(&ring->mutex);
+    pthread_cond_destroy(&ring->cond);
+    free(ring->slots);
+    free(ring->published);
+    free(ring->cursors);
+    free(ring);
+}
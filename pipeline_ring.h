@@ -0,0 +1,51 @@
+#ifndef PIPELINE_RING_H
+#define PIPELINE_RING_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "channel.h"
+
+// Defines a pipeline ring, a single ring of messages shared by every stage of a pipeline
+// Producers publish messages at increasing sequence numbers, and each stage owns a cursor (the sequence of the next
+// message it has not finished) and only sees the messages the stage before it has finished, so messages flow through all
+// the stages without being copied from ring to ring, and the producers wait for the last stage to free a slot
+// Every stage is run by a single consumer, which takes the messages available to it in batches
+typedef struct pipeline_ring pipeline_ring_t;
+
+// Creates a ring of size slots (rounded up to a power of two) for a pipeline of stages stages, whose producers and
+// consumers wait following the given strategy (see enum chan_wait)
+// Returns NULL if size or stages is 0
+pipeline_ring_t* pipeline_ring_create(size_t size, size_t stages, enum chan_wait wait);
+
+// Publishes data to the first stage, waiting for a free slot when the ring is full (blocking = true)
+// Any number of threads may publish on the same ring
+// Returns SUCCESS once the data is published,
+// WOULDBLOCK if the ring is full (non-blocking calls only), and
+// CLOSED_ERROR if the ring is closed
+enum chan_status pipeline_ring_publish(pipeline_ring_t* ring, void* data, bool blocking);
+
+// Takes the messages available to a stage: stores the sequence of the first one in first and their number (at most max)
+// in count, waiting for the stage before it (or the producers) when none is available (blocking = true)
+// The messages are read, and may be replaced, through pipeline_ring_slot until they are released
+// Returns SUCCESS if at least one message was taken,
+// WOULDBLOCK if none is available (non-blocking calls only), and
+// CLOSED_ERROR once the ring is closed and the stage has released every message published before the close
+enum chan_status pipeline_ring_acquire(pipeline_ring_t* ring, size_t stage, size_t max, size_t* first, size_t* count,
+                                       bool blocking);
+
+// Returns the slot holding the message at the given sequence
+void** pipeline_ring_slot(pipeline_ring_t* ring, size_t sequence);
+
+// Hands the first count messages taken by a stage to the next stage (or frees their slots, for the last stage)
+void pipeline_ring_release(pipeline_ring_t* ring, size_t stage, size_t count);
+
+// Closes the ring: publishing fails from then on, while the stages still drain the messages already published
+// Returns SUCCESS if close is successful, and
+// CLOSED_ERROR if the ring is already closed
+enum chan_status pipeline_ring_close(pipeline_ring_t* ring);
+
+// Frees the ring, every producer and stage must have stopped
+void pipeline_ring_destroy(pipeline_ring_t* ring);
+
+#endif // PIPELINE_RING_H
@@ -0,0 +1,551 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "compact_channel.h"
+#include "recorder.h"
+
+#define NS_PER_SEC 1000000000ull
+#define NS_PER_USEC 1000ull
+
+// Identifies trace files, followed by the format version
+static const char trace_magic[8] = {'C', 'H', 'T', 'R', 'A', 'C', 'E', '1'};
+
+// Source of recorder generations, 0 is never handed out so that it can mean "no recorder yet"
+static uint64_t next_generation = 1;
+
+// Identifier of the calling thread within the recorder that assigned it
+// The recorder is identified by its generation rather than its address, which a later recorder may reuse
+static __thread uint64_t thread_generation;
+static __thread uint32_t thread_id;
+
+// Defines the header at the start of a trace file, followed by the channel capacities and the records
+typedef struct {
+    char magic[8];
+    uint64_t num_channels;
+    uint64_t num_records;
+} trace_header_t;
+
+static uint64_t now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * NS_PER_SEC + (uint64_t)t.tv_nsec;
+}
+
+static void wait_until(uint64_t deadline)
+{
+    struct timespec t;
+    t.tv_sec = (time_t)(deadline / NS_PER_SEC);
+    t.tv_nsec = (long)(deadline % NS_PER_SEC);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR);
+}
+
+// Creates a recorder that keeps up to max_records operations on up to max_channels channels
+// Operations beyond max_records are not recorded, and are reported by recorder_dropped
+recorder_t* recorder_create(size_t max_records, size_t max_channels)
+{
+    recorder_t* recorder = malloc(sizeof(recorder_t));
+    if (!recorder) {
+        return NULL;
+    }
+    recorder->records = malloc(sizeof(record_t) * max_records);
+    recorder->capacities = malloc(sizeof(size_t) * max_channels);
+    if (!recorder->records || !recorder->capacities) {
+        free(recorder->records);
+        free(recorder->capacities);
+        free(recorder);
+        return NULL;
+    }
+    recorder->max_records = max_records;
+    recorder->next_record = 0;
+    recorder->num_channels = 0;
+    recorder->max_channels = max_channels;
+    recorder->next_thread = 0;
+    recorder->generation = __atomic_fetch_add(&next_generation, 1, __ATOMIC_RELAXED);
+    return recorder;
+}
+
+// Starts recording the operations on the channel, must be called before the channel is used by other threads
+// Returns SUCCESS if the channel was attached, and
+// OTHER_ERROR if the recorder already holds max_channels channels
+enum chan_status recorder_attach(recorder_t* recorder, chan_t* channel)
+{
+    if (recorder->num_channels >= recorder->max_channels) {
+        return OTHER_ERROR;
+    }
+    recorder->capacities[recorder->num_channels] = buffer_capacity(channel->buffer);
+    pthread_mutex_lock(&channel->mutex);
+    channel->recorder_id = (uint32_t)recorder->num_channels;
+    channel->recorder = recorder;
+    pthread_mutex_unlock(&channel->mutex);
+    recorder->num_channels++;
+    return SUCCESS;
+}
+
+// Appends an operation to the recorder, called by the channel functions of attached channels
+void recorder_log(recorder_t* recorder, uint32_t channel, enum record_op op, bool blocking, enum chan_status status, size_t size, uint64_t start, uint64_t end)
+{
+    size_t index = __atomic_fetch_add(&recorder->next_record, 1, __ATOMIC_RELAXED);
+    if (index >= recorder->max_records) {
+        return;
+    }
+    // threads only get an id along with a kept record, so every thread id of a trace is below its number of records
+    if (thread_generation != recorder->generation) {
+        thread_generation = recorder->generation;
+        thread_id = __atomic_fetch_add(&recorder->next_thread, 1, __ATOMIC_RELAXED);
+    }
+    record_t* record = &recorder->records[index];
+    record->start = start;
+    record->end = end;
+    record->thread = thread_id;
+    record->channel = channel;
+    record->op = (uint8_t)op;
+    record->blocking = blocking;
+    record->status = (int8_t)status;
+    record->reserved = 0;
+    record->size = (uint32_t)size;
+}
+
+// Returns the number of operations that did not fit in the recorder
+size_t recorder_dropped(recorder_t* recorder)
+{
+    size_t count = __atomic_load_n(&recorder->next_record, __ATOMIC_RELAXED);
+    return count > recorder->max_records ? count - recorder->max_records : 0;
+}
+
+// Writes the recorded operations to the trace file and frees the recorder
+// The attached channels must no longer be used (or must have been destroyed) by the time this is called
+// Returns true if the trace file was written
+bool recorder_finish(recorder_t* recorder, const char* filename)
+{
+    size_t count = __atomic_load_n(&recorder->next_record, __ATOMIC_ACQUIRE);
+    if (count > recorder->max_records) {
+        count = recorder->max_records;
+    }
+    bool written = false;
+    FILE* file = fopen(filename, "wb");
+    if (file) {
+        trace_header_t header;
+        memcpy(header.magic, trace_magic, sizeof(trace_magic));
+        header.num_channels = recorder->num_channels;
+        header.num_records = count;
+        written = fwrite(&header, sizeof(header), 1, file) == 1;
+        for (size_t i = 0; written && i < recorder->num_channels; i++) {
+            uint64_t capacity = recorder->capacities[i];
+            written = fwrite(&capacity, sizeof(capacity), 1, file) == 1;
+        }
+        written = written && fwrite(recorder->records, sizeof(record_t), count, file) == count;
+        written = (fclose(file) == 0) && written;
+    }
+    free(recorder->records);
+    free(recorder->capacities);
+    free(recorder);
+    return written;
+}
+
+// Loads a trace file
+// Returns NULL if the file could not be read or is not a trace file
+trace_t* trace_load(const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return NULL;
+    }
+    trace_header_t header;
+    long file_size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        file_size = ftell(file);
+    }
+    if (file_size < (long)sizeof(header) || fseek(file, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, trace_magic, sizeof(trace_magic)) != 0) {
+        fclose(file);
+        return NULL;
+    }
+    // the counts must fit in the file, so that a corrupted header cannot make us allocate without bound
+    uint64_t body_size = (uint64_t)file_size - sizeof(header);
+    if (header.num_channels > body_size / sizeof(uint64_t) ||
+        header.num_records > (body_size - header.num_channels * sizeof(uint64_t)) / sizeof(record_t)) {
+        fclose(file);
+        return NULL;
+    }
+    trace_t* trace = calloc(1, sizeof(trace_t));
+    if (!trace) {
+        fclose(file);
+        return NULL;
+    }
+    trace->num_channels = (size_t)header.num_channels;
+    trace->num_records = (size_t)header.num_records;
+    trace->capacities = malloc(sizeof(size_t) * (trace->num_channels ? trace->num_channels : 1));
+    trace->records = malloc(sizeof(record_t) * (trace->num_records ? trace->num_records : 1));
+    bool valid = trace->capacities && trace->records;
+    for (size_t i = 0; valid && i < trace->num_channels; i++) {
+        uint64_t capacity;
+        // every replay backend needs a buffered channel
+        valid = fread(&capacity, sizeof(capacity), 1, file) == 1 && capacity > 0;
+        trace->capacities[i] = (size_t)capacity;
+    }
+    valid = valid && fread(trace->records, sizeof(record_t), trace->num_records, file) == trace->num_records;
+    for (size_t i = 0; valid && i < trace->num_records; i++) {
+        // replay_trace starts one thread per thread id, and recorders hand out fewer ids than they keep records
+        valid = trace->records[i].channel < trace->num_channels && trace->records[i].op <= RECORD_CLOSE &&
+                trace->records[i].thread < trace->num_records;
+    }
+    fclose(file);
+    if (!valid) {
+        trace_free(trace);
+        return NULL;
+    }
+    return trace;
+}
+
+// Frees a loaded trace
+void trace_free(trace_t* trace)
+{
+    free(trace->capacities);
+    free(trace->records);
+    free(trace);
+}
+
+static void* replay_channel_create(size_t size)
+{
+    return channel_create(size);
+}
+
+static enum chan_status replay_channel_send(void* channel, void* data, bool blocking)
+{
+    return channel_send(channel, data, blocking);
+}
+
+static enum chan_status replay_channel_receive(void* channel, void** data, bool blocking)
+{
+    return channel_receive(channel, data, blocking);
+}
+
+static enum chan_status replay_channel_close(void* channel)
+{
+    return channel_close(channel);
+}
+
+static enum chan_status replay_channel_destroy(void* channel)
+{
+    return channel_destroy(channel);
+}
+
+static void* replay_compact_channel_create(size_t size)
+{
+    return compact_channel_create(size);
+}
+
+static enum chan_status replay_compact_channel_send(void* channel, void* data, bool blocking)
+{
+    return compact_channel_send(channel, data, blocking);
+}
+
+static enum chan_status replay_compact_channel_receive(void* channel, void** data, bool blocking)
+{
+    return compact_channel_receive(channel, data, blocking);
+}
+
+static enum chan_status replay_compact_channel_close(void* channel)
+{
+    return compact_channel_close(channel);
+}
+
+static enum chan_status replay_compact_channel_destroy(void* channel)
+{
+    return compact_channel_destroy(channel);
+}
+
+const replay_backend_t replay_channel_backend = {
+    replay_channel_create,
+    replay_channel_send,
+    replay_channel_receive,
+    replay_channel_close,
+    replay_channel_destroy
+};
+
+const replay_backend_t replay_compact_channel_backend = {
+    replay_compact_channel_create,
+    replay_compact_channel_send,
+    replay_compact_channel_receive,
+    replay_compact_channel_close,
+    replay_compact_channel_destroy
+};
+
+// Defines the state shared by the replay threads
+typedef struct {
+    const trace_t* trace;
+    const replay_backend_t* backend;
+    void** channels;
+    bool timed;
+    uint64_t trace_start;
+    uint64_t replay_start;
+    pthread_mutex_t mutex;
+    pthread_cond_t finished;
+    size_t running;
+    // Operations are ranked by the time they returned in the trace, and completed marks the ranks replayed so far
+    // An operation is only issued once every operation that had returned before it was called (the first
+    // needed[i] ranks) has completed, which preserves the recorded happens-before order between threads
+    size_t* rank;
+    size_t* needed;
+    bool* completed;
+    size_t completed_prefix;
+    pthread_cond_t progress;
+    // Set when the replay could not start all of its threads, the started ones then stop without waiting for the others
+    bool aborted;
+} replay_state_t;
+
+// Defines the schedule of a single replay thread
+typedef struct {
+    replay_state_t* state;
+    const record_t** schedule;
+    size_t length;
+    size_t operations;
+    size_t mismatches;
+    uint64_t busy_time;
+} replay_thread_t;
+
+static void* replay_thread(void* arg)
+{
+    replay_thread_t* thread = arg;
+    replay_state_t* state = thread->state;
+    for (size_t i = 0; i < thread->length; i++) {
+        const record_t* record = thread->schedule[i];
+        size_t index = (size_t)(record - state->trace->records);
+        if (state->timed) {
+            wait_until(state->replay_start + (record->start - state->trace_start));
+        }
+        pthread_mutex_lock(&state->mutex);
+        while (!state->aborted && state->completed_prefix < state->needed[index]) {
+            pthread_cond_wait(&state->progress, &state->mutex);
+        }
+        bool aborted = state->aborted;
+        pthread_mutex_unlock(&state->mutex);
+        if (aborted) {
+            break;
+        }
+        void* channel = state->channels[record->channel];
+        void* data = (void*)(uintptr_t)(i + 1);
+        uint64_t start = now();
+        enum chan_status status = OTHER_ERROR;
+        if (record->op == RECORD_SEND) {
+            status = state->backend->send(channel, data, record->blocking);
+        } else if (record->op == RECORD_RECEIVE) {
+            status = state->backend->receive(channel, &data, record->blocking);
+        } else {
+            status = state->backend->close(channel);
+        }
+        thread->busy_time += now() - start;
+        thread->operations++;
+        if (status != record->status) {
+            thread->mismatches++;
+        }
+        pthread_mutex_lock(&state->mutex);
+        state->completed[state->rank[index]] = true;
+        while (state->completed_prefix < state->trace->num_records && state->completed[state->completed_prefix]) {
+            state->completed_prefix++;
+        }
+        pthread_cond_broadcast(&state->progress);
+        pthread_mutex_unlock(&state->mutex);
+    }
+    pthread_mutex_lock(&state->mutex);
+    state->running--;
+    pthread_cond_signal(&state->finished);
+    pthread_mutex_unlock(&state->mutex);
+    return NULL;
+}
+
+// Orders records by start time, keeping the recorded order of records that started at the same time
+static int compare_records(const void* a, const void* b)
+{
+    const record_t* first = *(const record_t* const*)a;
+    const record_t* second = *(const record_t* const*)b;
+    if (first->start != second->start) {
+        return first->start < second->start ? -1 : 1;
+    }
+    return first < second ? -1 : (first > second);
+}
+
+// Orders records by end time
+static int compare_record_ends(const void* a, const void* b)
+{
+    const record_t* first = *(const record_t* const*)a;
+    const record_t* second = *(const record_t* const*)b;
+    if (first->end != second->end) {
+        return first->end < second->end ? -1 : 1;
+    }
+    return first < second ? -1 : (first > second);
+}
+
+// Computes the rank of every record by end time, and how many ranks must complete before each record is issued
+// Returns false on allocation failure
+static bool replay_order(const trace_t* trace, size_t* rank, size_t* needed)
+{
+    const record_t** by_end = malloc(sizeof(record_t*) * trace->num_records);
+    if (!by_end) {
+        return false;
+    }
+    for (size_t i = 0; i < trace->num_records; i++) {
+        by_end[i] = &trace->records[i];
+    }
+    qsort(by_end, trace->num_records, sizeof(record_t*), compare_record_ends);
+    for (size_t i = 0; i < trace->num_records; i++) {
+        rank[by_end[i] - trace->records] = i;
+    }
+    for (size_t i = 0; i < trace->num_records; i++) {
+        // number of records that returned strictly before this one was called
+        size_t low = 0;
+        size_t high = trace->num_records;
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (by_end[middle]->end < trace->records[i].start) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        needed[i] = low;
+    }
+    free(by_end);
+    return true;
+}
+
+// Re-issues the operations of the trace against the backend, one thread per recorded thread
+// Each thread issues its operations in the recorded order, and when timed is true also waits until each
+// operation's recorded start time (relative to the start of the trace) before issuing it
+// Threads still blocked once grace_usec has passed after the end of the schedule are released by closing the channels
+// Returns the outcome of the replay in result, and
+// false if the replay could not be set up (a channel or a thread could not be created, or an allocation failed)
+bool replay_trace(const trace_t* trace, const replay_backend_t* backend, bool timed, uint64_t grace_usec, replay_result_t* result)
+{
+    result->operations = 0;
+    result->mismatches = 0;
+    result->busy_time = 0;
+    result->elapsed_time = 0;
+
+    // split the records into one schedule per thread
+    size_t num_threads = 0;
+    uint64_t trace_start = UINT64_MAX;
+    uint64_t trace_end = 0;
+    for (size_t i = 0; i < trace->num_records; i++) {
+        const record_t* record = &trace->records[i];
+        num_threads = record->thread >= num_threads ? record->thread + 1 : num_threads;
+        trace_start = record->start < trace_start ? record->start : trace_start;
+        trace_end = record->start > trace_end ? record->start : trace_end;
+    }
+    if (num_threads == 0) {
+        return true;
+    }
+    replay_state_t state;
+    const record_t** schedules = malloc(sizeof(record_t*) * trace->num_records);
+    replay_thread_t* threads = calloc(num_threads, sizeof(replay_thread_t));
+    pthread_t* pids = malloc(sizeof(pthread_t) * num_threads);
+    state.channels = calloc(trace->num_channels ? trace->num_channels : 1, sizeof(void*));
+    state.rank = malloc(sizeof(size_t) * trace->num_records);
+    state.needed = malloc(sizeof(size_t) * trace->num_records);
+    state.completed = calloc(trace->num_records, sizeof(bool));
+    if (!schedules || !threads || !pids || !state.channels || !state.rank || !state.needed || !state.completed ||
+        !replay_order(trace, state.rank, state.needed)) {
+        free(state.rank);
+        free(state.needed);
+        free(state.completed);
+        free(state.channels);
+        free(pids);
+        free(threads);
+        free(schedules);
+        return false;
+    }
+    for (size_t i = 0; i < trace->num_records; i++) {
+        threads[trace->records[i].thread].length++;
+    }
+    size_t offset = 0;
+    for (size_t i = 0; i < num_threads; i++) {
+        threads[i].schedule = &schedules[offset];
+        offset += threads[i].length;
+        threads[i].length = 0;
+    }
+    for (size_t i = 0; i < trace->num_records; i++) {
+        replay_thread_t* thread = &threads[trace->records[i].thread];
+        thread->schedule[thread->length++] = &trace->records[i];
+    }
+
+    state.trace = trace;
+    state.backend = backend;
+    state.timed = timed;
+    state.trace_start = trace_start;
+    state.running = num_threads;
+    pthread_mutex_init(&state.mutex, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&state.finished, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&state.progress, NULL);
+    state.completed_prefix = 0;
+    state.aborted = false;
+    bool created = true;
+    for (size_t i = 0; created && i < trace->num_channels; i++) {
+        state.channels[i] = backend->create(trace->capacities[i]);
+        created = state.channels[i] != NULL;
+    }
+
+    state.replay_start = now();
+    size_t started = 0;
+    while (created && started < num_threads) {
+        threads[started].state = &state;
+        qsort(threads[started].schedule, threads[started].length, sizeof(record_t*), compare_records);
+        created = pthread_create(&pids[started], NULL, replay_thread, &threads[started]) == 0;
+        started += created;
+    }
+
+    if (created) {
+        // wait for the schedule to complete, then release any thread that is still blocked
+        uint64_t deadline = (timed ? state.replay_start + (trace_end - trace_start) : now()) + grace_usec * NS_PER_USEC;
+        struct timespec abstime;
+        pthread_mutex_lock(&state.mutex);
+        while (state.running > 0) {
+            if (!timed) {
+                // untimed replays have no schedule end, so the grace period restarts whenever a thread finishes
+                deadline = now() + grace_usec * NS_PER_USEC;
+            }
+            abstime.tv_sec = (time_t)(deadline / NS_PER_SEC);
+            abstime.tv_nsec = (long)(deadline % NS_PER_SEC);
+            if (pthread_cond_timedwait(&state.finished, &state.mutex, &abstime) == ETIMEDOUT) {
+                break;
+            }
+        }
+        pthread_mutex_unlock(&state.mutex);
+    } else {
+        // stops the threads already running, before or after their current operation
+        pthread_mutex_lock(&state.mutex);
+        state.aborted = true;
+        pthread_cond_broadcast(&state.progress);
+        pthread_mutex_unlock(&state.mutex);
+    }
+    for (size_t i = 0; i < trace->num_channels && state.channels[i]; i++) {
+        backend->close(state.channels[i]);
+    }
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(pids[i], NULL);
+        result->operations += threads[i].operations;
+        result->mismatches += threads[i].mismatches;
+        result->busy_time += threads[i].busy_time;
+    }
+    result->elapsed_time = now() - state.replay_start;
+
+    for (size_t i = 0; i < trace->num_channels && state.channels[i]; i++) {
+        backend->destroy(state.channels[i]);
+    }
+    pthread_cond_destroy(&state.progress);
+    pthread_cond_destroy(&state.finished);
+    free(state.rank);
+    free(state.needed);
+    free(state.completed);
+    pthread_mutex_destroy(&state.mutex);
+    free(state.channels);
+    free(pids);
+    free(threads);
+    free(schedules);
+    return created;
+}
@@ -0,0 +1,116 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "channel.h"
+
+// Defines the channel operations that are recorded
+enum record_op {
+    RECORD_SEND = 0,
+    RECORD_RECEIVE = 1,
+    RECORD_CLOSE = 2
+};
+
+// Defines a single recorded operation, as stored in the trace file
+typedef struct {
+    // CLOCK_MONOTONIC time (in nanoseconds) at which the operation was called and returned
+    uint64_t start;
+    uint64_t end;
+    // Recorder-assigned identifiers of the calling thread and of the channel
+    uint32_t thread;
+    uint32_t channel;
+    // Operation (enum record_op), whether it was a blocking call, and the returned enum chan_status
+    uint8_t op;
+    uint8_t blocking;
+    int8_t status;
+    uint8_t reserved;
+    // Number of messages buffered in the channel once the operation completed
+    uint32_t size;
+} record_t;
+
+// Defines a recorder object, which collects the operations of its attached channels in memory
+// Operations are appended without locks, and written to a trace file only by recorder_finish
+struct recorder {
+    record_t* records;
+    size_t max_records;
+    size_t next_record;
+    size_t num_channels;
+    size_t max_channels;
+    size_t* capacities;
+    uint32_t next_thread;
+    // Unique among the recorders of the process, identifies the recorder in the thread ids cached by recorder_log
+    uint64_t generation;
+};
+
+// Defines a recorded trace, as loaded from a trace file
+typedef struct {
+    size_t num_channels;
+    size_t* capacities;
+    size_t num_records;
+    record_t* records;
+} trace_t;
+
+// Defines the channel implementation that a trace is replayed against
+typedef struct {
+    void* (*create)(size_t size);
+    enum chan_status (*send)(void* channel, void* data, bool blocking);
+    enum chan_status (*receive)(void* channel, void** data, bool blocking);
+    enum chan_status (*close)(void* channel);
+    enum chan_status (*destroy)(void* channel);
+} replay_backend_t;
+
+// Backends for channel_t and compact_channel_t
+extern const replay_backend_t replay_channel_backend;
+extern const replay_backend_t replay_compact_channel_backend;
+
+// Defines the outcome of a replay
+typedef struct {
+    // Number of operations issued
+    size_t operations;
+    // Number of operations whose status differed from the recorded one
+    size_t mismatches;
+    // Total time spent inside the backend operations, and wall clock time of the whole replay (in nanoseconds)
+    uint64_t busy_time;
+    uint64_t elapsed_time;
+} replay_result_t;
+
+// Creates a recorder that keeps up to max_records operations on up to max_channels channels
+// Operations beyond max_records are not recorded, and are reported by recorder_dropped
+recorder_t* recorder_create(size_t max_records, size_t max_channels);
+
+// Starts recording the operations on the channel, must be called before the channel is used by other threads
+// Returns SUCCESS if the channel was attached, and
+// OTHER_ERROR if the recorder already holds max_channels channels
+enum chan_status recorder_attach(recorder_t* recorder, chan_t* channel);
+
+// Appends an operation to the recorder, called by the channel functions of attached channels
+void recorder_log(recorder_t* recorder, uint32_t channel, enum record_op op, bool blocking, enum chan_status status, size_t size, uint64_t start, uint64_t end);
+
+// Returns the number of operations that did not fit in the recorder
+size_t recorder_dropped(recorder_t* recorder);
+
+// Writes the recorded operations to the trace file and frees the recorder
+// The attached channels must no longer be used (or must have been destroyed) by the time this is called
+// Returns true if the trace file was written
+bool recorder_finish(recorder_t* recorder, const char* filename);
+
+// Loads a trace file
+// Returns NULL if the file could not be read or is not a trace file
+trace_t* trace_load(const char* filename);
+
+// Frees a loaded trace
+void trace_free(trace_t* trace);
+
+// Re-issues the operations of the trace against the backend, one thread per recorded thread
+// Each thread issues its operations in the recorded order, and when timed is true also waits until each
+// operation's recorded start time (relative to the start of the trace) before issuing it
+// Across threads, an operation is never issued before every operation that had returned before it was called in
+// the trace has completed, so the replay keeps the recorded interleaving even when the backend is slower
+// Threads still blocked once grace_usec has passed after the end of the schedule are released by closing the channels
+// Returns the outcome of the replay in result, and
+// false if the replay could not be set up (a channel or a thread could not be created, or an allocation failed)
+bool replay_trace(const trace_t* trace, const replay_backend_t* backend, bool timed, uint64_t grace_usec, replay_result_t* result);
+
+#endif // RECORDER_H
@@ -0,0 +1,218 @@
+#include <sched.h>
+#include "rpc.h"
+
+// States of a call
+#define RPC_CALL_FREE 0
+#define RPC_CALL_WAITING 1
+#define RPC_CALL_REPLYING 2
+#define RPC_CALL_REPLIED 3
+#define RPC_CALL_ABANDONED 4
+
+struct rpc {
+    chan_t* requests;
+    // Free calls, kept on a channel so that clients can wait for one
+    chan_t* free;
+    rpc_call_t* calls;
+    size_t count;
+    uint64_t next_id;
+    bool open;
+};
+
+// Hands a call back to the pool, never blocks since the free channel has room for every call
+static void rpc_release(rpc_t* rpc, rpc_call_t* call)
+{
+    // the server may still be marking the call as replied, after the client received the reply
+    while (__atomic_load_n(&call->state, __ATOMIC_ACQUIRE) == RPC_CALL_REPLYING) {
+        sched_yield();
+    }
+    __atomic_store_n(&call->state, RPC_CALL_FREE, __ATOMIC_RELAXED);
+    channel_send(rpc->free, call, false);
+}
+
+// Creates an rpc object with calls calls in its pool (the largest number of calls in progress) and a request channel
+// of queue_size messages
+// Returns NULL if calls or queue_size is 0
+rpc_t* rpc_create(size_t calls, size_t queue_size)
+{
+    if (calls == 0 || queue_size == 0) {
+        return NULL;
+    }
+    rpc_t* rpc = calloc(1, sizeof(rpc_t));
+    if (!rpc) {
+        return NULL;
+    }
+    rpc->count = calls;
+    rpc->open = true;
+    rpc->requests = channel_create(queue_size);
+    rpc->free = channel_create(calls);
+    rpc->calls = calloc(calls, sizeof(rpc_call_t));
+    if (!rpc->requests || !rpc->free || !rpc->calls) {
+        rpc_close(rpc);
+        rpc_destroy(rpc);
+        return NULL;
+    }
+    for (size_t i = 0; i < calls; i++) {
+        rpc->calls[i].reply = channel_create(1);
+        if (!rpc->calls[i].reply) {
+            rpc_close(rpc);
+            rpc_destroy(rpc);
+            return NULL;
+        }
+        channel_send(rpc->free, &rpc->calls[i], false);
+    }
+    return rpc;
+}
+
+// Takes a call from the pool and sends the request to the servers, stores the call in call
+// blocking tells whether to wait for a call to be free and for room on the request channel
+// Returns like channel_send, SUCCESS meaning that the request was sent
+enum chan_status rpc_start(rpc_t* rpc, void* request, rpc_call_t** call, bool blocking)
+{
+    void* data = NULL;
+    enum chan_status status = channel_receive(rpc->free, &data, blocking);
+    if (status != SUCCESS) {
+        return status;
+    }
+    rpc_call_t* taken = data;
+    taken->id = __atomic_fetch_add(&rpc->next_id, 1, __ATOMIC_RELAXED);
+    taken->request = request;
+    __atomic_store_n(&taken->state, RPC_CALL_WAITING, __ATOMIC_RELAXED);
+    status = channel_send(rpc->requests, taken, blocking);
+    if (status != SUCCESS) {
+        rpc_release(rpc, taken);
+        return status;
+    }
+    *call = taken;
+    return SUCCESS;
+}
+
+// Waits for the reply of a call started with rpc_start, up to timeout_usec microseconds (forever if 0), stores it in
+// reply and hands the call back to the pool
+// A call that timed out is given up: the call goes back to the pool once the server replies
+// Returns SUCCESS if the reply was received,
+// WOULDBLOCK if the call timed out, and
+// CLOSED_ERROR if the rpc object is closed
+enum chan_status rpc_wait(rpc_t* rpc, rpc_call_t* call, void** reply, uint64_t timeout_usec)
+{
+    enum chan_status status = timeout_usec ? channel_receive_timed(call->reply, reply, timeout_usec)
+                                           : channel_receive(call->reply, reply, true);
+    if (status == WOULDBLOCK) {
+        int expected = RPC_CALL_WAITING;
+        if (__atomic_compare_exchange_n(&call->state, &expected, RPC_CALL_ABANDONED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return WOULDBLOCK;
+        }
+        // the reply is on its way
+        status = channel_receive(call->reply, reply, true);
+    }
+    if (status == SUCCESS) {
+        rpc_release(rpc, call);
+    }
+    return status;
+}
+
+// Hands a call back to the pool once its reply has been received through its reply channel (with channel_select), or
+// gives the call up if the reply has not been received
+void rpc_finish(rpc_t* rpc, rpc_call_t* call)
+{
+    int expected = RPC_CALL_WAITING;
+    if (__atomic_compare_exchange_n(&call->state, &expected, RPC_CALL_ABANDONED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    // drops a reply that was not received, the server is done sending it once the call is marked as replied
+    while (__atomic_load_n(&call->state, __ATOMIC_ACQUIRE) == RPC_CALL_REPLYING) {
+        sched_yield();
+    }
+    void* reply = NULL;
+    channel_receive(call->reply, &reply, false);
+    rpc_release(rpc, call);
+}
+
+// Starts a call and waits for its reply, see rpc_start and rpc_wait
+enum chan_status rpc_call(rpc_t* rpc, void* request, void** reply, uint64_t timeout_usec)
+{
+    rpc_call_t* call = NULL;
+    enum chan_status status = rpc_start(rpc, request, &call, true);
+    if (status != SUCCESS) {
+        return status;
+    }
+    return rpc_wait(rpc, call, reply, timeout_usec);
+}
+
+// Returns the request channel, so that servers can make it part of a channel_select list (its messages are calls)
+chan_t* rpc_requests(rpc_t* rpc)
+{
+    return rpc->requests;
+}
+
+// Receives the next call for a server, returns like channel_receive
+enum chan_status rpc_receive(rpc_t* rpc, rpc_call_t** call, bool blocking)
+{
+    void* data = NULL;
+    enum chan_status status = channel_receive(rpc->requests, &data, blocking);
+    if (status == SUCCESS) {
+        *call = data;
+    }
+    return status;
+}
+
+// Sends the reply of a call to its client, never blocks
+// Returns SUCCESS if the reply was delivered, and
+// CLOSED_ERROR if the client gave up on the call or the rpc object is closed
+enum chan_status rpc_reply(rpc_t* rpc, rpc_call_t* call, void* reply)
+{
+    int expected = RPC_CALL_WAITING;
+    if (!__atomic_compare_exchange_n(&call->state, &expected, RPC_CALL_REPLYING, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        // nobody waits for the reply anymore
+        rpc_release(rpc, call);
+        return CLOSED_ERROR;
+    }
+    enum chan_status status = channel_send(call->reply, reply, false);
+    __atomic_store_n(&call->state, RPC_CALL_REPLIED, __ATOMIC_RELEASE);
+    return status;
+}
+
+// Closes the rpc object, the clients and servers waiting return CLOSED_ERROR
+// Returns SUCCESS if close is successful, and
+// CLOSED_ERROR if the rpc object is already closed
+enum chan_status rpc_close(rpc_t* rpc)
+{
+    if (!__atomic_exchange_n(&rpc->open, false, __ATOMIC_ACQ_REL)) {
+        return CLOSED_ERROR;
+    }
+    if (rpc->requests) {
+        channel_close(rpc->requests);
+    }
+    if (rpc->free) {
+        channel_close(rpc->free);
+    }
+    for (size_t i = 0; rpc->calls && i < rpc->count; i++) {
+        if (rpc->calls[i].reply) {
+            channel_close(rpc->calls[i].reply);
+        }
+    }
+    return SUCCESS;
+}
+
+// Frees the rpc object, which must be closed, once every client and server has stopped
+// Returns SUCCESS if destroy is successful, and
+// DESTROY_ERROR if the rpc object is still open
+enum chan_status rpc_destroy(rpc_t* rpc)
+{
+    if (rpc->open) {
+        return DESTROY_ERROR;
+    }
+    if (rpc->requests) {
+        channel_destroy(rpc->requests);
+    }
+    if (rpc->free) {
+        channel_destroy(rpc->free);
+    }
+    for (size_t i = 0; rpc->calls && i < rpc->count; i++) {
+        if (rpc->calls[i].reply) {
+            channel_destroy(rpc->calls[i].reply);
+        }
+    }
+    free(rpc->calls);
+    free(rpc);
+    return SUCCESS;
+}
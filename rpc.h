@@ -0,0 +1,73 @@
+#ifndef RPC_H
+#define RPC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "channel.h"
+
+// Defines a call, the message carried by the request channel of an rpc object
+// Calls are taken from the pool of the rpc object and handed back once the client is done with them, so a round trip
+// allocates nothing: the request goes to the servers through the request channel, and the reply comes back through the
+// reply channel of the call
+typedef struct {
+    // Number of the call, unique within the rpc object, so that servers can correlate their logs with the clients
+    uint64_t id;
+    void* request;
+    // Receives the reply, it can be part of a channel_select list until the reply has been received
+    chan_t* reply;
+    // Used by the rpc object, whether the client is waiting, the server replied, or the client gave up
+    int state;
+} rpc_call_t;
+
+// Defines an rpc object, which carries requests from any number of clients to any number of servers
+typedef struct rpc rpc_t;
+
+// Creates an rpc object with calls calls in its pool (the largest number of calls in progress) and a request channel
+// of queue_size messages
+// Returns NULL if calls or queue_size is 0
+rpc_t* rpc_create(size_t calls, size_t queue_size);
+
+// Takes a call from the pool and sends the request to the servers, stores the call in call
+// blocking tells whether to wait for a call to be free and for room on the request channel
+// Returns like channel_send, SUCCESS meaning that the request was sent
+enum chan_status rpc_start(rpc_t* rpc, void* request, rpc_call_t** call, bool blocking);
+
+// Waits for the reply of a call started with rpc_start, up to timeout_usec microseconds (forever if 0), stores it in
+// reply and hands the call back to the pool
+// A call that timed out is given up: the call goes back to the pool once the server replies
+// Returns SUCCESS if the reply was received,
+// WOULDBLOCK if the call timed out, and
+// CLOSED_ERROR if the rpc object is closed
+enum chan_status rpc_wait(rpc_t* rpc, rpc_call_t* call, void** reply, uint64_t timeout_usec);
+
+// Hands a call back to the pool once its reply has been received through its reply channel (with channel_select), or
+// gives the call up if the reply has not been received
+void rpc_finish(rpc_t* rpc, rpc_call_t* call);
+
+// Starts a call and waits for its reply, see rpc_start and rpc_wait
+enum chan_status rpc_call(rpc_t* rpc, void* request, void** reply, uint64_t timeout_usec);
+
+// Returns the request channel, so that servers can make it part of a channel_select list (its messages are calls)
+chan_t* rpc_requests(rpc_t* rpc);
+
+// Receives the next call for a server, returns like channel_receive
+enum chan_status rpc_receive(rpc_t* rpc, rpc_call_t** call, bool blocking);
+
+// Sends the reply of a call to its client, never blocks
+// Returns SUCCESS if the reply was delivered, and
+// CLOSED_ERROR if the client gave up on the call or the rpc object is closed
+enum chan_status rpc_reply(rpc_t* rpc, rpc_call_t* call, void* reply);
+
+// Closes the rpc object, the clients and servers waiting return CLOSED_ERROR
+// Returns SUCCESS if close is successful, and
+// CLOSED_ERROR if the rpc object is already closed
+enum chan_status rpc_close(rpc_t* rpc);
+
+// Frees the rpc object, which must be closed, once every client and server has stopped
+// Returns SUCCESS if destroy is successful, and
+// DESTROY_ERROR if the rpc object is still open
+enum chan_status rpc_destroy(rpc_t* rpc);
+
+#endif // RPC_H
@@ -0,0 +1,243 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "socket_bridge.h"
+
+// Adapts the batch limit to the last batch (which holds at least one message): a full batch doubles the limit
+// and a mostly empty one halves it
+// This keeps the per-call arrays small under light load while letting bursts be moved in as few calls as possible
+static size_t bridge_adapt_limit(size_t limit, size_t count)
+{
+    if (count == limit && limit < BRIDGE_MAX_BATCH) {
+        return limit * 2 > BRIDGE_MAX_BATCH ? BRIDGE_MAX_BATCH : limit * 2;
+    }
+    if (count < limit / 2) {
+        return limit / 2;
+    }
+    return limit;
+}
+
+// Writes count messages to the socket, returns false if the socket failed
+// A NULL message is written as an empty datagram
+static bool bridge_write(bridge_t* bridge, bridge_msg_t** msgs, size_t count)
+{
+    struct iovec iov[BRIDGE_MAX_BATCH];
+    struct mmsghdr hdr[BRIDGE_MAX_BATCH];
+    memset(hdr, 0, sizeof(struct mmsghdr) * count);
+    for (size_t i = 0; i < count; i++) {
+        iov[i].iov_base = msgs[i] ? msgs[i]->data : NULL;
+        iov[i].iov_len = msgs[i] ? msgs[i]->length : 0;
+        hdr[i].msg_hdr.msg_iov = &iov[i];
+        hdr[i].msg_hdr.msg_iovlen = 1;
+    }
+    size_t done = 0;
+    while (done < count) {
+        ssize_t result;
+        if (bridge->batched) {
+            result = sendmmsg(bridge->fd, &hdr[done], (unsigned int)(count - done), 0);
+        } else {
+            result = send(bridge->fd, iov[done].iov_base, iov[done].iov_len, 0) < 0 ? -1 : 1;
+        }
+        bridge->stats.syscalls++;
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        done += (size_t)result;
+    }
+    return true;
+}
+
+// Body of the sending bridge thread
+static void* bridge_sender(void* arg)
+{
+    bridge_t* bridge = arg;
+    bridge_msg_t* msgs[BRIDGE_MAX_BATCH];
+    size_t limit = 1;
+    bool done = false;
+    while (!done) {
+        // waits for the first message, then gathers whatever else is already waiting, up to the current limit
+        size_t count = 0;
+        while (!done && count < limit) {
+            void* data = NULL;
+            if (channel_receive(bridge->channel, &data, count == 0) != SUCCESS) {
+                if (count > 0) {
+                    break;
+                }
+                // closed channel, still let the other side know that the stream is over
+                data = NULL;
+            }
+            bridge_msg_t* msg = data;
+            if (msg && msg->length == 0) {
+                // an empty datagram would end the stream on the other side
+                free(msg);
+                bridge->stats.dropped++;
+                continue;
+            }
+            msgs[count++] = msg;
+            done = (msg == NULL);
+        }
+        bool written = bridge_write(bridge, msgs, count);
+        for (size_t i = 0; i < count; i++) {
+            if (msgs[i]) {
+                if (written) {
+                    bridge->stats.messages++;
+                }
+                free(msgs[i]);
+            }
+        }
+        if (!written) {
+            break;
+        }
+        if (bridge->batched) {
+            limit = bridge_adapt_limit(limit, count);
+        }
+    }
+    return NULL;
+}
+
+// Body of the receiving bridge thread
+static void* bridge_receiver(void* arg)
+{
+    bridge_t* bridge = arg;
+    char* payloads = malloc((size_t)BRIDGE_MAX_BATCH * BRIDGE_MAX_PAYLOAD);
+    struct iovec iov[BRIDGE_MAX_BATCH];
+    struct mmsghdr hdr[BRIDGE_MAX_BATCH];
+    size_t limit = 1;
+    // set once the end of stream has been forwarded, or the channel has refused a message
+    bool done = false;
+    while (!done && payloads) {
+        memset(hdr, 0, sizeof(struct mmsghdr) * limit);
+        for (size_t i = 0; i < limit; i++) {
+            iov[i].iov_base = payloads + i * BRIDGE_MAX_PAYLOAD;
+            iov[i].iov_len = BRIDGE_MAX_PAYLOAD;
+            hdr[i].msg_hdr.msg_iov = &iov[i];
+            hdr[i].msg_hdr.msg_iovlen = 1;
+        }
+        ssize_t result;
+        if (bridge->batched) {
+            result = recvmmsg(bridge->fd, hdr, (unsigned int)limit, MSG_WAITFORONE, NULL);
+        } else {
+            result = recvmsg(bridge->fd, &hdr[0].msg_hdr, 0);
+            if (result >= 0) {
+                hdr[0].msg_len = (unsigned int)result;
+                result = 1;
+            }
+        }
+        bridge->stats.syscalls++;
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        size_t count = (size_t)result;
+        for (size_t i = 0; i < count && !done; i++) {
+            bridge_msg_t* msg = NULL;
+            if (hdr[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                // longer than BRIDGE_MAX_PAYLOAD, dropped rather than delivered cut short
+                bridge->stats.dropped++;
+                continue;
+            }
+            if (hdr[i].msg_len > 0) {
+                msg = bridge_msg_create(iov[i].iov_base, hdr[i].msg_len);
+                if (!msg) {
+                    // out of memory, dropped rather than passed on as a NULL that would end the stream
+                    bridge->stats.dropped++;
+                    continue;
+                }
+            } else {
+                done = true;
+            }
+            if (channel_send(bridge->channel, msg, true) != SUCCESS) {
+                free(msg);
+                done = true;
+            } else if (msg) {
+                bridge->stats.messages++;
+            }
+        }
+        if (bridge->batched) {
+            limit = bridge_adapt_limit(limit, count);
+        }
+    }
+    if (!done) {
+        // the socket failed (or the payloads could not be allocated), still let the consumer know that the stream is over
+        channel_send(bridge->channel, NULL, true);
+    }
+    free(payloads);
+    return NULL;
+}
+
+// Starts the bridge thread running the given body
+static bridge_t* bridge_start(chan_t* channel, int fd, bool batched, void* (*body)(void*))
+{
+    bridge_t* bridge = malloc(sizeof(bridge_t));
+    if (!bridge) {
+        return NULL;
+    }
+    bridge->channel = channel;
+    bridge->fd = fd;
+    bridge->batched = batched;
+    bridge->stats.messages = 0;
+    bridge->stats.syscalls = 0;
+    bridge->stats.dropped = 0;
+    if (pthread_create(&bridge->thread, NULL, body, bridge) != 0) {
+        free(bridge);
+        return NULL;
+    }
+    return bridge;
+}
+
+// Creates a bridge message holding a copy of the given payload
+// Returns NULL if the payload is empty (an empty datagram marks the end of the stream) or longer than
+// BRIDGE_MAX_PAYLOAD, or on allocation failure
+bridge_msg_t* bridge_msg_create(const void* data, size_t length)
+{
+    if (length == 0 || length > BRIDGE_MAX_PAYLOAD) {
+        return NULL;
+    }
+    bridge_msg_t* msg = malloc(sizeof(bridge_msg_t) + length);
+    if (!msg) {
+        return NULL;
+    }
+    msg->length = length;
+    memcpy(msg->data, data, length);
+    return msg;
+}
+
+// Starts a bridge that receives messages from the channel and writes each one as a datagram to the socket
+// When batched is true, all messages already waiting on the channel are written with a single sendmmsg call,
+// otherwise each message costs one send call
+// Messages with an empty payload are dropped, since the receiving side would take them for the end of stream
+// The bridge stops after forwarding the end of stream (a NULL message), or when the channel is closed
+// Returns NULL if the bridge thread could not be started
+bridge_t* bridge_start_sender(chan_t* channel, int fd, bool batched)
+{
+    return bridge_start(channel, fd, batched, bridge_sender);
+}
+
+// Starts a bridge that reads datagrams from the socket and sends each one as a message on the channel
+// When batched is true, datagrams are read with recvmmsg calls that return as soon as one datagram is available,
+// otherwise each datagram costs one recv call
+// Datagrams longer than BRIDGE_MAX_PAYLOAD, or that cannot be copied for lack of memory, are dropped
+// The bridge stops after forwarding the end of stream (an empty datagram), or when the channel is closed
+// If the socket fails, the bridge stops and puts an end of stream on the channel
+// Returns NULL if the bridge thread could not be started
+bridge_t* bridge_start_receiver(chan_t* channel, int fd, bool batched)
+{
+    return bridge_start(channel, fd, batched, bridge_receiver);
+}
+
+// Waits for the bridge to stop, stores its counters in stats (if stats is not NULL) and frees the bridge
+// The socket is not closed, it still belongs to the caller
+void bridge_join(bridge_t* bridge, bridge_stats_t* stats)
+{
+    pthread_join(bridge->thread, NULL);
+    if (stats) {
+        *stats = bridge->stats;
+    }
+    free(bridge);
+}
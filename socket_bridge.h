@@ -0,0 +1,69 @@
+#ifndef SOCKET_BRIDGE_H
+#define SOCKET_BRIDGE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "channel.h"
+
+// Largest payload carried by a single datagram, longer datagrams are dropped by the receiving bridge
+#define BRIDGE_MAX_PAYLOAD  2048
+// Largest number of datagrams moved by a single sendmmsg/recvmmsg call
+#define BRIDGE_MAX_BATCH    64
+
+// Defines the message carried by bridged channels
+// Messages are heap allocated with bridge_msg_create, and ownership moves with the message: the sending bridge frees
+// the messages it has written to the socket, and the receiving bridge allocates the messages it puts on its channel
+// A NULL message marks the end of the stream and travels across the socket as an empty datagram
+typedef struct {
+    size_t length;
+    char data[];
+} bridge_msg_t;
+
+// Defines the counters reported by a bridge once it has finished
+typedef struct {
+    // Number of messages moved across the socket, not counting the end of stream
+    size_t messages;
+    // Number of send/receive system calls issued
+    size_t syscalls;
+    // Number of messages dropped: empty messages on the sending side, datagrams longer than BRIDGE_MAX_PAYLOAD (or that
+    // could not be copied) on the receiving side
+    size_t dropped;
+} bridge_stats_t;
+
+// Defines a bridge object, which moves messages between a channel and a datagram socket on its own thread
+typedef struct {
+    chan_t* channel;
+    int fd;
+    bool batched;
+    pthread_t thread;
+    bridge_stats_t stats;
+} bridge_t;
+
+// Creates a bridge message holding a copy of the given payload
+// Returns NULL if the payload is empty (an empty datagram marks the end of the stream) or longer than
+// BRIDGE_MAX_PAYLOAD, or on allocation failure
+bridge_msg_t* bridge_msg_create(const void* data, size_t length);
+
+// Starts a bridge that receives messages from the channel and writes each one as a datagram to the socket
+// When batched is true, all messages already waiting on the channel are written with a single sendmmsg call,
+// otherwise each message costs one send call
+// Messages with an empty payload are dropped, since the receiving side would take them for the end of stream
+// The bridge stops after forwarding the end of stream (a NULL message), or when the channel is closed
+// Returns NULL if the bridge thread could not be started
+bridge_t* bridge_start_sender(chan_t* channel, int fd, bool batched);
+
+// Starts a bridge that reads datagrams from the socket and sends each one as a message on the channel
+// When batched is true, datagrams are read with recvmmsg calls that return as soon as one datagram is available,
+// otherwise each datagram costs one recv call
+// Datagrams longer than BRIDGE_MAX_PAYLOAD, or that cannot be copied for lack of memory, are dropped
+// The bridge stops after forwarding the end of stream (an empty datagram), or when the channel is closed
+// If the socket fails, the bridge stops and puts an end of stream on the channel
+// Returns NULL if the bridge thread could not be started
+bridge_t* bridge_start_receiver(chan_t* channel, int fd, bool batched);
+
+// Waits for the bridge to stop, stores its counters in stats (if stats is not NULL) and frees the bridge
+// The socket is not closed, it still belongs to the caller
+void bridge_join(bridge_t* bridge, bridge_stats_t* stats);
+
+#endif // SOCKET_BRIDGE_H
@@ -0,0 +1,216 @@
+#include <sched.h>
+#include <string.h>
+#include "linked_list.h"
+#include "cpu_relax.h"
+#include "state_cell.h"
+
+// Number of spins of a reader on a publish in progress before it yields to the writer
+#define STATE_CELL_SPINS 64
+
+struct state_cell {
+    // Twice the version of the latest snapshot, odd while a publish is in progress
+    uint64_t sequence;
+    // Snapshot, copied a word at a time so that a copy overlapping a publish is caught rather than torn silently
+    uint64_t* words;
+    size_t size;
+    size_t num_words;
+    // Readers blocked in state_cell_wait and subscriptions, kept apart from the sequence so that they do not disturb
+    // the readers polling it
+    pthread_mutex_t mutex __attribute__((aligned(64)));
+    pthread_cond_t cond;
+    size_t waiters;
+    list_t* subscriptions;
+    size_t num_subscriptions;
+    bool open;
+};
+
+// Creates a state cell holding snapshots of size bytes, zeroed until the first publish
+// Returns NULL if size is 0
+state_cell_t* state_cell_create(size_t size)
+{
+    if (size == 0) {
+        return NULL;
+    }
+    state_cell_t* cell = aligned_alloc(_Alignof(state_cell_t), sizeof(state_cell_t));
+    if (!cell) {
+        return NULL;
+    }
+    cell->num_words = (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    cell->words = calloc(cell->num_words, sizeof(uint64_t));
+    cell->subscriptions = list_create();
+    if (!cell->words || !cell->subscriptions) {
+        free(cell->words);
+        if (cell->subscriptions) {
+            list_destroy(cell->subscriptions);
+        }
+        free(cell);
+        return NULL;
+    }
+    cell->sequence = 0;
+    cell->size = size;
+    cell->waiters = 0;
+    cell->num_subscriptions = 0;
+    cell->open = true;
+    pthread_mutex_init(&cell->mutex, NULL);
+    pthread_cond_init(&cell->cond, NULL);
+    return cell;
+}
+
+// Publishes a snapshot, copied from data, wakes up the waiting readers and notifies the subscribers
+// Only one thread may publish on a cell
+// Returns the version of the snapshot
+uint64_t state_cell_publish(state_cell_t* cell, const void* data)
+{
+    uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&cell->sequence, sequence + 1, __ATOMIC_RELAXED);
+    const char* bytes = data;
+    for (size_t i = 0; i < cell->num_words; i++) {
+        uint64_t word = 0;
+        size_t offset = i * sizeof(uint64_t);
+        memcpy(&word, bytes + offset, cell->size - offset < sizeof(uint64_t) ? cell->size - offset : sizeof(uint64_t));
+        // release keeps the odd sequence visible before any word of the new snapshot
+        __atomic_store_n(&cell->words[i], word, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&cell->sequence, sequence + 2, __ATOMIC_SEQ_CST);
+    uint64_t version = (sequence + 2) / 2;
+
+    if (__atomic_load_n(&cell->waiters, __ATOMIC_SEQ_CST) || __atomic_load_n(&cell->num_subscriptions, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&cell->mutex);
+        pthread_cond_broadcast(&cell->cond);
+        for (list_node_t* node = list_begin(cell->subscriptions); node; node = list_next(node)) {
+            channel_send(list_data(node), (void*)(uintptr_t)version, false);
+        }
+        pthread_mutex_unlock(&cell->mutex);
+    }
+    return version;
+}
+
+// Copies the latest snapshot to data, retrying while a publish overlaps the copy
+// Returns the version of the snapshot
+uint64_t state_cell_read(state_cell_t* cell, void* data)
+{
+    char* bytes = data;
+    size_t spins = 0;
+    while (true) {
+        uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1) {
+            if (++spins < STATE_CELL_SPINS) {
+                cpu_relax();
+            }
+            else {
+                sched_yield();
+            }
+            continue;
+        }
+        for (size_t i = 0; i < cell->num_words; i++) {
+            // acquire keeps the check of the sequence below after every word
+            uint64_t word = __atomic_load_n(&cell->words[i], __ATOMIC_ACQUIRE);
+            size_t offset = i * sizeof(uint64_t);
+            memcpy(bytes + offset, &word, cell->size - offset < sizeof(uint64_t) ? cell->size - offset : sizeof(uint64_t));
+        }
+        if (__atomic_load_n(&cell->sequence, __ATOMIC_RELAXED) == sequence) {
+            return sequence / 2;
+        }
+    }
+}
+
+// Returns the version of the latest snapshot
+uint64_t state_cell_version(state_cell_t* cell)
+{
+    return __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) / 2;
+}
+
+// Waits for a snapshot newer than *version, copies it to data and stores its version in version
+// Returns SUCCESS once a newer snapshot is copied, and
+// CLOSED_ERROR if the cell is closed
+enum chan_status state_cell_wait(state_cell_t* cell, uint64_t* version, void* data)
+{
+    if (state_cell_version(cell) == *version) {
+        pthread_mutex_lock(&cell->mutex);
+        // registered before checking the version again, so that a publish made afterwards sees the waiter
+        __atomic_add_fetch(&cell->waiters, 1, __ATOMIC_SEQ_CST);
+        while (cell->open && __atomic_load_n(&cell->sequence, __ATOMIC_SEQ_CST) / 2 == *version) {
+            pthread_cond_wait(&cell->cond, &cell->mutex);
+        }
+        __atomic_sub_fetch(&cell->waiters, 1, __ATOMIC_SEQ_CST);
+        bool open = cell->open;
+        pthread_mutex_unlock(&cell->mutex);
+        if (!open) {
+            return CLOSED_ERROR;
+        }
+    }
+    *version = state_cell_read(cell, data);
+    return SUCCESS;
+}
+
+// Returns a channel that gets the version of every later snapshot, so that a reader can wait for changes in
+// channel_select; the channel is lossy with room for one message, so it only holds the latest version, and the
+// reader copies the snapshot itself with state_cell_read
+// Returns NULL if the cell is closed
+chan_t* state_cell_subscribe(state_cell_t* cell)
+{
+    chan_t* channel = channel_create_lossy(1);
+    if (!channel) {
+        return NULL;
+    }
+    pthread_mutex_lock(&cell->mutex);
+    if (!cell->open) {
+        pthread_mutex_unlock(&cell->mutex);
+        channel_close(channel);
+        channel_destroy(channel);
+        return NULL;
+    }
+    list_insert(cell->subscriptions, channel);
+    __atomic_add_fetch(&cell->num_subscriptions, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&cell->mutex);
+    return channel;
+}
+
+// Stops the notifications of a channel returned by state_cell_subscribe and destroys it
+void state_cell_unsubscribe(state_cell_t* cell, chan_t* channel)
+{
+    pthread_mutex_lock(&cell->mutex);
+    list_node_t* node = list_find(cell->subscriptions, channel);
+    if (node) {
+        list_remove(cell->subscriptions, node);
+        __atomic_sub_fetch(&cell->num_subscriptions, 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&cell->mutex);
+    channel_close(channel);
+    channel_destroy(channel);
+}
+
+// Closes the cell: waiting readers return CLOSED_ERROR and the subscriptions are closed, while the latest snapshot can
+// still be read
+// Returns SUCCESS if close is successful, and
+// CLOSED_ERROR if the cell is already closed
+enum chan_status state_cell_close(state_cell_t* cell)
+{
+    pthread_mutex_lock(&cell->mutex);
+    if (!cell->open) {
+        pthread_mutex_unlock(&cell->mutex);
+        return CLOSED_ERROR;
+    }
+    cell->open = false;
+    pthread_cond_broadcast(&cell->cond);
+    for (list_node_t* node = list_begin(cell->subscriptions); node; node = list_next(node)) {
+        channel_close(list_data(node));
+    }
+    pthread_mutex_unlock(&cell->mutex);
+    return SUCCESS;
+}
+
+// Frees the cell and its remaining subscriptions, once every reader and the writer have stopped
+void state_cell_destroy(state_cell_t* cell)
+{
+    for (list_node_t* node = list_begin(cell->subscriptions); node; node = list_next(node)) {
+        chan_t* channel = list_data(node);
+        channel_close(channel);
+        channel_destroy(channel);
+    }
+    list_destroy(cell->subscriptions);
+    pthread_mutex_destroy(&cell->mutex);
+    pthread_cond_destroy(&cell->cond);
+    free(cell->words);
+    free(cell);
+}
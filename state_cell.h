@@ -0,0 +1,55 @@
+#ifndef STATE_CELL_H
+#define STATE_CELL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "channel.h"
+
+// Defines a state cell, which holds the latest snapshot of a fixed-size state published by a single writer
+// Snapshots are guarded by a sequence lock: readers copy the state and check that no publish overlapped the copy, so
+// they never write to the cell and any number of them can read without slowing the writer or each other down
+// Each snapshot has a version, counting the publishes from 1 (0 until the first publish)
+typedef struct state_cell state_cell_t;
+
+// Creates a state cell holding snapshots of size bytes, zeroed until the first publish
+// Returns NULL if size is 0
+state_cell_t* state_cell_create(size_t size);
+
+// Publishes a snapshot, copied from data, wakes up the waiting readers and notifies the subscribers
+// Only one thread may publish on a cell
+// Returns the version of the snapshot
+uint64_t state_cell_publish(state_cell_t* cell, const void* data);
+
+// Copies the latest snapshot to data, retrying while a publish overlaps the copy
+// Returns the version of the snapshot
+uint64_t state_cell_read(state_cell_t* cell, void* data);
+
+// Returns the version of the latest snapshot
+uint64_t state_cell_version(state_cell_t* cell);
+
+// Waits for a snapshot newer than *version, copies it to data and stores its version in version
+// Returns SUCCESS once a newer snapshot is copied, and
+// CLOSED_ERROR if the cell is closed
+enum chan_status state_cell_wait(state_cell_t* cell, uint64_t* version, void* data);
+
+// Returns a channel that gets the version of every later snapshot, so that a reader can wait for changes in
+// channel_select; the channel is lossy with room for one message, so it only holds the latest version, and the
+// reader copies the snapshot itself with state_cell_read
+// Returns NULL if the cell is closed
+chan_t* state_cell_subscribe(state_cell_t* cell);
+
+// Stops the notifications of a channel returned by state_cell_subscribe and destroys it
+void state_cell_unsubscribe(state_cell_t* cell, chan_t* channel);
+
+// Closes the cell: waiting readers return CLOSED_ERROR and the subscriptions are closed, while the latest snapshot can
+// still be read
+// Returns SUCCESS if close is successful, and
+// CLOSED_ERROR if the cell is already closed
+enum chan_status state_cell_close(state_cell_t* cell);
+
+// Frees the cell and its remaining subscriptions, once every reader and the writer have stopped
+void state_cell_destroy(state_cell_t* cell);
+
+#endif // STATE_CELL_H
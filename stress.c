@@ -1,10 +1,19 @@
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #include <assert.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "channel.h"
 #include "stress.h"
+#include "partition.h"
+#include "map_stream.h"
 
 typedef unsigned int distance_t;
 typedef struct {
@@ -13,15 +22,88 @@ typedef struct {
     distance_t dist[0];
 } distance_vector_t;
 
+#define SNAPSHOT_MAGIC      0x72747372 // "rstr"
+#define SNAPSHOT_VERSION    1
+
+// Defines the header of a snapshot file, which is followed by the epoch of every router (uint64_t), the link row
+// offsets (uint64_t, num_routers + 1 of them), the vector of every router (distance_t, num_routers per router), and
+// the destination (uint32_t) and distance (distance_t) of every link of the topology the snapshot was taken on
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t num_routers;
+    uint64_t num_links;
+} snapshot_header_t;
+
+// Defines where each array of a snapshot file starts (in bytes)
+typedef struct {
+    size_t epochs;
+    size_t offsets;
+    size_t dist;
+    size_t targets;
+    size_t distances;
+    size_t size;
+} snapshot_layout_t;
+
+// Defines an entry of a restored vector that may depend on a dearer link, with the distance it held in the snapshot
+typedef struct {
+    size_t src;
+    size_t dst;
+    distance_t distance;
+    bool kept;
+} snapshot_reset_t;
+
 static const distance_t inf_distance = 0x7fffffff;
 static distance_t* topology;
 static distance_t* solution;
+// sparse topology (rows sorted by destination), used instead of topology and solution by lean validation
+static size_t* link_offsets;
+static size_t* link_targets;
+static distance_t* link_distances;
+static size_t validate_next_source;
+// rows of a sparse topology parsed from a mapped stream, assembled into the arrays above once every row is parsed
+static size_t* parsed_row_links;
+static size_t** parsed_row_targets;
+static distance_t** parsed_row_distances;
+static size_t parsed_rows;
+// router state restored from a snapshot (NULL on a cold start), and which routers have to broadcast it again
+static void* snapshot_map;
+static size_t snapshot_map_size;
+static distance_t* warm_dist;
+static const uint64_t* warm_epoch;
+static bool* router_affected;
 static size_t num_channel;
 static chan_t** channels;
 static chan_t* done_channel;
 static chan_t* completed_channel;
+static size_t* router_core;
+static size_t* router_messages;
+static size_t* router_cross_core_messages;
+static size_t* router_relaxations;
+static stress_order_t router_order;
+static chan_t** grant_channels;
+static pthread_mutex_t worklist_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t* worklist_heap;
+static size_t* worklist_position;
+static uint64_t* worklist_key;
+static size_t worklist_size;
+static size_t worklist_active;
+static size_t worklist_slots;
 
 distance_t get_link_distance(size_t src, size_t dst) {
+    if (topology == NULL) {
+        size_t low = link_offsets[src];
+        size_t high = link_offsets[src + 1];
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (link_targets[mid] < dst) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return (low < link_offsets[src + 1] && link_targets[low] == dst) ? link_distances[low] : inf_distance;
+    }
     return topology[src * num_channel + dst];
 }
 
@@ -83,8 +165,227 @@ void print_solution()
     }
 }
 
-bool create_topology(const char* filename)
+// Reads the topology file keeping only the finite links, so that memory grows with the number of links
+void create_sparse_topology(FILE* file)
+{
+    size_t capacity = num_channel;
+    link_offsets = malloc(sizeof(size_t) * (num_channel + 1));
+    assert(link_offsets != NULL);
+    link_targets = malloc(sizeof(size_t) * capacity);
+    assert(link_targets != NULL);
+    link_distances = malloc(sizeof(distance_t) * capacity);
+    assert(link_distances != NULL);
+    size_t num_links = 0;
+    for (size_t src = 0; src < num_channel; src++) {
+        link_offsets[src] = num_links;
+        for (size_t dst = 0; dst < num_channel; dst++) {
+            int distance;
+            int num_scanned = fscanf(file, "%d", &distance);
+            assert(num_scanned == 1);
+            // negative values are inf_distance, which is not stored
+            if (distance < 0) {
+                continue;
+            }
+            if (num_links == capacity) {
+                capacity *= 2;
+                link_targets = realloc(link_targets, sizeof(size_t) * capacity);
+                assert(link_targets != NULL);
+                link_distances = realloc(link_distances, sizeof(distance_t) * capacity);
+                assert(link_distances != NULL);
+            }
+            link_targets[num_links] = dst;
+            link_distances[num_links] = (distance_t)distance;
+            num_links++;
+        }
+    }
+    link_offsets[num_channel] = num_links;
+}
+
+// Parses the next distance of the line data[*position..length), skipping the blanks before it
+// Returns false if the line has no distance left
+bool parse_distance(const char* data, size_t length, size_t* position, int* distance)
+{
+    size_t i = *position;
+    while (i < length && (data[i] == ' ' || data[i] == '\t' || data[i] == '\r')) {
+        i++;
+    }
+    if (i == length || data[i] == '\n') {
+        *position = i;
+        return false;
+    }
+    bool negative = data[i] == '-';
+    if (negative || data[i] == '+') {
+        i++;
+    }
+    size_t start = i;
+    long value = 0;
+    while (i < length && data[i] >= '0' && data[i] <= '9') {
+        value = value * 10 + (data[i] - '0');
+        i++;
+    }
+    assert(i > start);
+    *distance = (int)(negative ? -value : value);
+    *position = i;
+    return true;
+}
+
+// Parses row src of the topology from its line
+void parse_topology_row(size_t src, const char* data, size_t length, bool sparse)
+{
+    size_t position = 0;
+    size_t num_links = 0;
+    size_t capacity = 0;
+    size_t* targets = NULL;
+    distance_t* distances = NULL;
+    for (size_t dst = 0; dst < num_channel; dst++) {
+        int distance;
+        bool parsed = parse_distance(data, length, &position, &distance);
+        assert(parsed);
+        if (!sparse) {
+            // negative values get converted to inf_distance
+            set_link_distance(src, dst, (distance_t)distance > inf_distance ? inf_distance : (distance_t)distance);
+            continue;
+        }
+        // negative values are inf_distance, which is not stored
+        if (distance < 0) {
+            continue;
+        }
+        if (num_links == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            targets = realloc(targets, sizeof(size_t) * capacity);
+            assert(targets != NULL);
+            distances = realloc(distances, sizeof(distance_t) * capacity);
+            assert(distances != NULL);
+        }
+        targets[num_links] = dst;
+        distances[num_links] = (distance_t)distance;
+        num_links++;
+    }
+    if (sparse) {
+        parsed_row_links[src] = num_links;
+        parsed_row_targets[src] = targets;
+        parsed_row_distances[src] = distances;
+    }
+    __atomic_add_fetch(&parsed_rows, 1, __ATOMIC_RELAXED);
+}
+
+// Defines the arguments of a thread parsing a mapped topology
+typedef struct {
+    map_stream_t* stream;
+    chan_t* chunks;
+    bool sparse;
+} topology_parser_t;
+
+// Body of the threads parsing a mapped topology, chunks hold whole lines and line i + 1 of the file is row i
+void* parse_topology_chunks(void* arg)
+{
+    topology_parser_t* parser = arg;
+    void* data = NULL;
+    while (channel_receive(parser->chunks, &data, true) == SUCCESS && data) {
+        map_chunk_t* chunk = data;
+        size_t line = chunk->first_record;
+        size_t start = 0;
+        while (start < chunk->length) {
+            const char* newline = memchr(chunk->data + start, '\n', chunk->length - start);
+            size_t end = newline ? (size_t)(newline - chunk->data) : chunk->length;
+            if (line >= 1 && line <= num_channel) {
+                parse_topology_row(line - 1, chunk->data + start, end - start, parser->sparse);
+            }
+            line++;
+            start = end + 1;
+        }
+        map_stream_release(parser->stream, chunk);
+    }
+    return NULL;
+}
+
+// Reads the topology file like create_topology, with num_threads threads parsing the rows in place from the mapping
+// Only a window of chunks is resident at a time, so large topology files are parsed without being copied or held
+bool create_mapped_topology(const char* filename, bool sparse, size_t num_threads)
 {
+    map_stream_options_t options = {1 << 20, 4 * num_threads, 2, '\n'};
+    map_stream_t* stream = map_stream_open(filename, &options);
+    if (stream == NULL) {
+        printf("Could not open topology file: %s\n", filename);
+        return false;
+    }
+    size_t position = 0;
+    int routers;
+    bool parsed = parse_distance(map_stream_data(stream), map_stream_size(stream), &position, &routers);
+    assert(parsed);
+    assert(routers > 0);
+    num_channel = (size_t)routers;
+    if (sparse) {
+        parsed_row_links = calloc(num_channel, sizeof(size_t));
+        assert(parsed_row_links != NULL);
+        parsed_row_targets = calloc(num_channel, sizeof(size_t*));
+        assert(parsed_row_targets != NULL);
+        parsed_row_distances = calloc(num_channel, sizeof(distance_t*));
+        assert(parsed_row_distances != NULL);
+    } else {
+        topology = malloc(sizeof(distance_t) * num_channel * num_channel);
+        assert(topology != NULL);
+        solution = malloc(sizeof(distance_t) * num_channel * num_channel);
+        assert(solution != NULL);
+    }
+    parsed_rows = 0;
+
+    chan_t* chunks = channel_create(num_threads);
+    assert(chunks != NULL);
+    topology_parser_t parser = {stream, chunks, sparse};
+    pthread_t* threads = malloc(sizeof(pthread_t) * num_threads);
+    assert(threads != NULL);
+    for (size_t i = 0; i < num_threads; i++) {
+        pthread_create(&threads[i], NULL, parse_topology_chunks, &parser);
+    }
+    bool started = map_stream_start(stream, chunks, num_threads);
+    assert(started);
+    for (size_t i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    map_stream_close(stream, NULL);
+    channel_close(chunks);
+    channel_destroy(chunks);
+    assert(parsed_rows == num_channel);
+
+    if (!sparse) {
+        // calculate solution using Floyd-Warshall algorithm
+        floyd_warshall();
+        return true;
+    }
+    link_offsets = malloc(sizeof(size_t) * (num_channel + 1));
+    assert(link_offsets != NULL);
+    size_t num_links = 0;
+    for (size_t src = 0; src < num_channel; src++) {
+        link_offsets[src] = num_links;
+        num_links += parsed_row_links[src];
+    }
+    link_offsets[num_channel] = num_links;
+    link_targets = malloc(sizeof(size_t) * (num_links ? num_links : 1));
+    assert(link_targets != NULL);
+    link_distances = malloc(sizeof(distance_t) * (num_links ? num_links : 1));
+    assert(link_distances != NULL);
+    for (size_t src = 0; src < num_channel; src++) {
+        memcpy(&link_targets[link_offsets[src]], parsed_row_targets[src], sizeof(size_t) * parsed_row_links[src]);
+        memcpy(&link_distances[link_offsets[src]], parsed_row_distances[src], sizeof(distance_t) * parsed_row_links[src]);
+        free(parsed_row_targets[src]);
+        free(parsed_row_distances[src]);
+    }
+    free(parsed_row_links);
+    free(parsed_row_targets);
+    free(parsed_row_distances);
+    parsed_row_links = NULL;
+    parsed_row_targets = NULL;
+    parsed_row_distances = NULL;
+    return true;
+}
+
+bool create_topology(const char* filename, bool sparse, size_t parse_threads)
+{
+    if (parse_threads > 0) {
+        return create_mapped_topology(filename, sparse, parse_threads);
+    }
     FILE* file = fopen(filename, "r");
     if (file == NULL) {
         printf("Could not open topology file: %s\n", filename);
@@ -93,6 +394,11 @@ bool create_topology(const char* filename)
     int num_scanned = fscanf(file, "%zu", &num_channel);
     assert(num_scanned == 1);
     assert(num_channel > 0);
+    if (sparse) {
+        create_sparse_topology(file);
+        fclose(file);
+        return true;
+    }
     topology = malloc(sizeof(distance_t) * num_channel * num_channel);
     assert(topology != NULL);
     solution = malloc(sizeof(distance_t) * num_channel * num_channel);
@@ -120,11 +426,253 @@ void destroy_topology()
 {
     free(topology);
     free(solution);
+    free(link_offsets);
+    free(link_targets);
+    free(link_distances);
+    topology = NULL;
+    solution = NULL;
+    link_offsets = NULL;
+    link_targets = NULL;
+    link_distances = NULL;
+}
+
+// Returns the number of bytes held by the topology and its solution
+size_t topology_bytes()
+{
+    if (topology == NULL) {
+        size_t num_links = link_offsets[num_channel];
+        return sizeof(size_t) * (num_channel + 1) + (sizeof(size_t) + sizeof(distance_t)) * num_links;
+    }
+    return 2 * sizeof(distance_t) * num_channel * num_channel;
+}
+
+// Moves the entry at position up the validation heap, which is ordered by smallest tentative distance
+void validate_sift_up(size_t* heap, size_t* position, const distance_t* dist, size_t index)
+{
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (dist[heap[parent]] <= dist[heap[index]]) {
+            break;
+        }
+        size_t vertex = heap[parent];
+        heap[parent] = heap[index];
+        heap[index] = vertex;
+        position[heap[parent]] = parent;
+        position[heap[index]] = index;
+        index = parent;
+    }
+}
+
+// Moves the entry at position down the validation heap
+void validate_sift_down(size_t* heap, size_t* position, const distance_t* dist, size_t size, size_t index)
+{
+    while (true) {
+        size_t smallest = index;
+        for (size_t child = 2 * index + 1; child <= 2 * index + 2 && child < size; child++) {
+            if (dist[heap[child]] < dist[heap[smallest]]) {
+                smallest = child;
+            }
+        }
+        if (smallest == index) {
+            break;
+        }
+        size_t vertex = heap[smallest];
+        heap[smallest] = heap[index];
+        heap[index] = vertex;
+        position[heap[smallest]] = smallest;
+        position[heap[index]] = index;
+        index = smallest;
+    }
+}
+
+// Body of a validation thread: takes sources one at a time, computes their shortest paths over the sparse topology
+// with Dijkstra's algorithm and compares them with the converged vectors
+// Returns the number of wrong distances found (cast to a pointer)
+void* validate_sources(void* arg)
+{
+    distance_vector_t** completed = arg;
+    size_t mismatches = 0;
+    distance_t* dist = malloc(sizeof(distance_t) * num_channel);
+    assert(dist != NULL);
+    size_t* heap = malloc(sizeof(size_t) * num_channel);
+    assert(heap != NULL);
+    // SIZE_MAX while a vertex is not on the heap
+    size_t* position = malloc(sizeof(size_t) * num_channel);
+    assert(position != NULL);
+    while (true) {
+        size_t src = __atomic_fetch_add(&validate_next_source, 1, __ATOMIC_RELAXED);
+        if (src >= num_channel) {
+            break;
+        }
+        for (size_t i = 0; i < num_channel; i++) {
+            dist[i] = inf_distance;
+            position[i] = SIZE_MAX;
+        }
+        // start from the links of the source, so that dist[src] ends up as its shortest cycle (or its own link)
+        size_t size = 0;
+        size_t vertex = src;
+        distance_t base = 0;
+        while (true) {
+            for (size_t e = link_offsets[vertex]; e < link_offsets[vertex + 1]; e++) {
+                size_t next = link_targets[e];
+                distance_t next_dist = base + link_distances[e];
+                if (next_dist >= dist[next]) {
+                    continue;
+                }
+                if (position[next] == SIZE_MAX) {
+                    heap[size] = next;
+                    position[next] = size++;
+                }
+                dist[next] = next_dist;
+                validate_sift_up(heap, position, dist, position[next]);
+            }
+            if (size == 0) {
+                break;
+            }
+            vertex = heap[0];
+            base = dist[vertex];
+            heap[0] = heap[--size];
+            position[heap[0]] = 0;
+            position[vertex] = SIZE_MAX;
+            validate_sift_down(heap, position, dist, size, 0);
+        }
+        for (size_t dst = 0; dst < num_channel; dst++) {
+            if (completed[src]->dist[dst] != dist[dst]) {
+                mismatches++;
+            }
+        }
+    }
+    free(dist);
+    free(heap);
+    free(position);
+    return (void*)mismatches;
+}
+
+// Checks the converged vectors against shortest paths computed on demand by one thread per CPU
+// Returns the number of wrong distances found
+size_t validate_sparse(distance_vector_t** completed)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    size_t num_threads = (size_t)CPU_COUNT(&allowed);
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+    pthread_t* threads = malloc(sizeof(pthread_t) * num_threads);
+    assert(threads != NULL);
+    validate_next_source = 0;
+    for (size_t i = 0; i < num_threads; i++) {
+        int pthread_status = pthread_create(&threads[i], NULL, validate_sources, completed);
+        assert(pthread_status == 0);
+    }
+    size_t mismatches = 0;
+    for (size_t i = 0; i < num_threads; i++) {
+        void* result;
+        pthread_join(threads[i], &result);
+        mismatches += (size_t)result;
+    }
+    free(threads);
+    return mismatches;
+}
+
+void worklist_swap(size_t a, size_t b)
+{
+    size_t router = worklist_heap[a];
+    worklist_heap[a] = worklist_heap[b];
+    worklist_heap[b] = router;
+    worklist_position[worklist_heap[a]] = a;
+    worklist_position[worklist_heap[b]] = b;
+}
+
+void worklist_sift_up(size_t position)
+{
+    while (position > 0) {
+        size_t parent = (position - 1) / 2;
+        if (worklist_key[worklist_heap[parent]] >= worklist_key[worklist_heap[position]]) {
+            break;
+        }
+        worklist_swap(parent, position);
+        position = parent;
+    }
+}
+
+void worklist_sift_down(size_t position)
+{
+    while (true) {
+        size_t largest = position;
+        for (size_t child = 2 * position + 1; child <= 2 * position + 2 && child < worklist_size; child++) {
+            if (worklist_key[worklist_heap[child]] > worklist_key[worklist_heap[largest]]) {
+                largest = child;
+            }
+        }
+        if (largest == position) {
+            break;
+        }
+        worklist_swap(largest, position);
+        position = largest;
+    }
+}
+
+// Combines two priorities of the same router, according to the order of the run
+uint64_t worklist_combine(uint64_t key, uint64_t other)
+{
+    if (router_order == STRESS_ORDER_IMPROVEMENT) {
+        return key + other;
+    }
+    return key > other ? key : other;
+}
+
+// Raises the priority of a router that is waiting on the worklist, does nothing if it has already been granted
+void worklist_raise(size_t router, uint64_t key)
+{
+    pthread_mutex_lock(&worklist_mutex);
+    size_t position = worklist_position[router];
+    if (position != SIZE_MAX) {
+        worklist_key[router] = worklist_combine(worklist_key[router], key);
+        worklist_sift_up(position);
+    }
+    pthread_mutex_unlock(&worklist_mutex);
+}
+
+// Adds a changed router (when key is not 0) and/or releases the broadcast slot of a router that has finished
+// broadcasting, then grants free slots to the routers with the highest priority
+void worklist_update(size_t router, uint64_t key, bool finished)
+{
+    pthread_mutex_lock(&worklist_mutex);
+    if (finished) {
+        worklist_active--;
+    }
+    if (key) {
+        worklist_key[router] = key;
+        worklist_heap[worklist_size] = router;
+        worklist_position[router] = worklist_size;
+        worklist_sift_up(worklist_size++);
+    }
+    while (worklist_active < worklist_slots && worklist_size > 0) {
+        size_t granted = worklist_heap[0];
+        worklist_swap(0, --worklist_size);
+        worklist_position[granted] = SIZE_MAX;
+        worklist_sift_down(0);
+        worklist_active++;
+        // a router holds at most one grant, so this never blocks
+        enum chan_status status = channel_send(grant_channels[granted], NULL, false);
+        assert(status == SUCCESS);
+    }
+    pthread_mutex_unlock(&worklist_mutex);
 }
 
 void* router(void* arg)
 {
     bool changed = false;
+    bool prioritized = router_order != STRESS_ORDER_FREE;
+    // select entries before first_send are receives, the worklist grant comes right after the own channel
+    size_t first_send = prioritized ? 3 : 2;
+    size_t grant_index = 2;
+    // every router broadcasts its links right away, the worklist only orders the later broadcasts
+    bool granted = false;
+    bool queued = false;
+    uint64_t pending_key = 0;
     size_t index = (size_t)arg;
     size_t selected_index;
     distance_vector_t* prev_prev_state = malloc(sizeof(distance_vector_t) + sizeof(distance_t) * num_channel);
@@ -139,17 +687,19 @@ void* router(void* arg)
     prev_state->src = index;
     curr_state->src = index;
     next_state->src = index;
-    prev_prev_state->epoch = 0;
-    prev_state->epoch = 1;
-    curr_state->epoch = 2;
-    next_state->epoch = 3;
+    size_t epoch = warm_dist ? (size_t)warm_epoch[index] : 0;
+    prev_prev_state->epoch = epoch;
+    prev_state->epoch = epoch + 1;
+    curr_state->epoch = epoch + 2;
+    next_state->epoch = epoch + 3;
     for (size_t i = 0; i < num_channel; i++) {
-        prev_prev_state->dist[i] = get_link_distance(index, i);
-        prev_state->dist[i] = get_link_distance(index, i);
-        curr_state->dist[i] = get_link_distance(index, i);
-        next_state->dist[i] = get_link_distance(index, i);
+        distance_t distance = warm_dist ? warm_dist[index * num_channel + i] : get_link_distance(index, i);
+        prev_prev_state->dist[i] = distance;
+        prev_state->dist[i] = distance;
+        curr_state->dist[i] = distance;
+        next_state->dist[i] = distance;
     }
-    size_t total_select_count = 2;
+    size_t total_select_count = first_send;
     for (size_t i = 0; i < num_channel; i++) {
         if ((i != index) && get_link_distance(index, i) != inf_distance) {
             total_select_count++;
@@ -157,6 +707,9 @@ void* router(void* arg)
     }
     select_t* select_list = malloc(sizeof(select_t) * total_select_count);
     assert(select_list != NULL);
+    // router index behind each select entry, to tell which core a message went to
+    size_t* neighbor_list = malloc(sizeof(size_t) * total_select_count);
+    assert(neighbor_list != NULL);
     size_t select_count = 0;
     select_list[select_count].channel = done_channel;
     select_list[select_count].is_send = false;
@@ -166,14 +719,25 @@ void* router(void* arg)
     select_list[select_count].is_send = false;
     select_list[select_count].data = NULL;
     select_count++;
+    if (prioritized) {
+        select_list[select_count].channel = grant_channels[index];
+        select_list[select_count].is_send = false;
+        select_list[select_count].data = NULL;
+        select_count++;
+    }
     for (size_t i = 0; i < num_channel; i++) {
         if ((i != index) && get_link_distance(index, i) != inf_distance) {
             select_list[select_count].channel = channels[i];
             select_list[select_count].is_send = true;
             select_list[select_count].data = curr_state;
+            neighbor_list[select_count] = i;
             select_count++;
         }
     }
+    if (warm_dist && !router_affected[index]) {
+        // the restored vector is still valid and every neighbour already has it
+        select_count = first_send;
+    }
     while (true) {
         enum chan_status status = channel_select(select_count, select_list, &selected_index);
         if (status == SUCCESS) {
@@ -184,28 +748,79 @@ void* router(void* arg)
                     distance_vector_t* neighbor_state = select_list[selected_index].data;
                     distance_t neighbor_dist = get_link_distance(index, neighbor_state->src);
                     assert(neighbor_dist != inf_distance);
+                    size_t improved = 0;
+                    distance_t closest = inf_distance;
                     for (size_t i = 0; i < num_channel; i++) {
                         distance_t new_dist = neighbor_dist + neighbor_state->dist[i];
                         if (new_dist < next_state->dist[i]) {
                             next_state->dist[i] = new_dist;
                             changed = true;
+                            improved++;
+                            if (new_dist < closest) {
+                                closest = new_dist;
+                            }
+                        }
+                    }
+                    router_relaxations[index] += improved;
+                    if (prioritized && improved) {
+                        uint64_t key = router_order == STRESS_ORDER_IMPROVEMENT ? improved : (uint64_t)(inf_distance - closest) + 1;
+                        if (queued) {
+                            worklist_raise(index, key);
+                        } else {
+                            pending_key = worklist_combine(pending_key, key);
                         }
                     }
                 } else {
                     // special message sent to test convergence
-                    bool converged = (select_count == 2) && !changed;
+                    bool converged = (select_count == first_send) && !changed;
                     status = channel_send(completed_channel, converged ? curr_state : NULL, true);
                     assert(status == SUCCESS);
                 }
+            } else if (prioritized && selected_index == grant_index) {
+                // granted by the worklist, broadcast everything merged so far
+                queued = false;
+                granted = true;
+                distance_vector_t* temp_state = curr_state;
+                curr_state = next_state;
+                next_state = prev_prev_state;
+                prev_prev_state = prev_state;
+                prev_state = temp_state;
+                next_state->epoch = curr_state->epoch + 1;
+                for (size_t i = 0; i < num_channel; i++) {
+                    next_state->dist[i] = curr_state->dist[i];
+                }
+                select_count = total_select_count;
+                for (size_t i = first_send; i < select_count; i++) {
+                    select_list[i].data = curr_state;
+                }
+                changed = false;
             } else {
+                router_messages[index]++;
+                if (router_core[neighbor_list[selected_index]] != router_core[index]) {
+                    router_cross_core_messages[index]++;
+                }
                 select_count--;
                 // swap last element and selected element
                 chan_t* temp = select_list[select_count].channel;
                 select_list[select_count].channel = select_list[selected_index].channel;
                 select_list[selected_index].channel = temp;
+                size_t temp_neighbor = neighbor_list[select_count];
+                neighbor_list[select_count] = neighbor_list[selected_index];
+                neighbor_list[selected_index] = temp_neighbor;
             }
             // check if we've sent to everyone
-            if (select_count == 2) {
+            if (select_count == first_send && prioritized) {
+                bool finished = granted;
+                granted = false;
+                if (changed && !queued) {
+                    // wait for the worklist to grant the next broadcast
+                    queued = true;
+                    worklist_update(index, pending_key, finished);
+                    pending_key = 0;
+                } else if (finished) {
+                    worklist_update(index, 0, true);
+                }
+            } else if (select_count == first_send) {
                 // check if we want to reset
                 if (changed) {
                     // cycle triple buffer
@@ -220,7 +835,7 @@ void* router(void* arg)
                     }
                     // reset to broadcast again
                     select_count = total_select_count;
-                    for (size_t i = 2; i < select_count; i++) {
+                    for (size_t i = first_send; i < select_count; i++) {
                         select_list[i].data = curr_state;
                     }
                     changed = false;
@@ -234,6 +849,7 @@ void* router(void* arg)
         }
     }
     free(select_list);
+    free(neighbor_list);
     free(prev_prev_state);
     free(prev_state);
     free(curr_state);
@@ -241,12 +857,11 @@ void* router(void* arg)
     return NULL;
 }
 
-bool check_done()
+// Returns whether the routers have converged, in which case completed holds the vector of every router
+bool check_done(distance_vector_t** completed)
 {
     bool valid = true;
     enum chan_status status;
-    distance_vector_t** completed = malloc(sizeof(distance_vector_t*) * num_channel);
-    assert(completed != NULL);
     // validate by sending special NULL message to flush channels
     for (size_t i = 0; i < num_channel; i++) {
         status = channel_send(channels[i], NULL, true);
@@ -286,7 +901,11 @@ bool check_done()
                 }
             }
         }
-        if (valid) {
+        if (valid && solution == NULL) {
+            // check results without a precomputed solution
+            size_t mismatches = validate_sparse(completed);
+            assert(mismatches == 0);
+        } else if (valid) {
             // check results
             for (size_t src = 0; src < num_channel; src++) {
                 for (size_t dst = 0; dst < num_channel; dst++) {
@@ -295,18 +914,428 @@ bool check_done()
             }
         }
     }
-    free(completed);
     return valid;
 }
 
+// Returns where each array of a snapshot of the given size starts
+snapshot_layout_t snapshot_layout(size_t num_routers, size_t num_links)
+{
+    snapshot_layout_t layout;
+    layout.epochs = sizeof(snapshot_header_t);
+    layout.offsets = layout.epochs + sizeof(uint64_t) * num_routers;
+    layout.dist = layout.offsets + sizeof(uint64_t) * (num_routers + 1);
+    layout.targets = layout.dist + sizeof(distance_t) * num_routers * num_routers;
+    layout.distances = layout.targets + sizeof(uint32_t) * num_links;
+    layout.size = layout.distances + sizeof(distance_t) * num_links;
+    return layout;
+}
+
+// Writes the converged vectors and the current topology to a snapshot file
+// Returns true if the snapshot was written
+bool save_snapshot(const char* filename, distance_vector_t** completed)
+{
+    size_t num_links = 0;
+    for (size_t src = 0; src < num_channel; src++) {
+        for (size_t dst = 0; dst < num_channel; dst++) {
+            if (get_link_distance(src, dst) != inf_distance) {
+                num_links++;
+            }
+        }
+    }
+    snapshot_layout_t layout = snapshot_layout(num_channel, num_links);
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, (off_t)layout.size) != 0) {
+        close(fd);
+        return false;
+    }
+    char* map = mmap(NULL, layout.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    snapshot_header_t* header = (snapshot_header_t*)map;
+    header->magic = SNAPSHOT_MAGIC;
+    header->version = SNAPSHOT_VERSION;
+    header->num_routers = num_channel;
+    header->num_links = num_links;
+    uint64_t* epochs = (uint64_t*)(map + layout.epochs);
+    uint64_t* offsets = (uint64_t*)(map + layout.offsets);
+    distance_t* dist = (distance_t*)(map + layout.dist);
+    uint32_t* targets = (uint32_t*)(map + layout.targets);
+    distance_t* distances = (distance_t*)(map + layout.distances);
+    size_t link = 0;
+    for (size_t src = 0; src < num_channel; src++) {
+        epochs[src] = completed[src]->epoch;
+        memcpy(&dist[src * num_channel], completed[src]->dist, sizeof(distance_t) * num_channel);
+        offsets[src] = link;
+        for (size_t dst = 0; dst < num_channel; dst++) {
+            distance_t distance = get_link_distance(src, dst);
+            if (distance != inf_distance) {
+                targets[link] = (uint32_t)dst;
+                distances[link] = distance;
+                link++;
+            }
+        }
+    }
+    offsets[num_channel] = link;
+    munmap(map, layout.size);
+    return true;
+}
+
+// Returns the distance of a link in the topology a snapshot was taken on
+distance_t snapshot_link_distance(const uint64_t* offsets, const uint32_t* targets, const distance_t* distances,
+                                  size_t src, size_t dst)
+{
+    size_t low = offsets[src];
+    size_t high = offsets[src + 1];
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (targets[mid] < dst) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return (low < offsets[src + 1] && targets[low] == dst) ? distances[low] : inf_distance;
+}
+
+// Steps through the links from src to the other routers in the current topology, with cursor starting at 0
+// Returns false once every link has been visited
+static bool next_link(size_t src, size_t* cursor, size_t* dst, distance_t* distance)
+{
+    if (topology == NULL) {
+        while (link_offsets[src] + *cursor < link_offsets[src + 1]) {
+            size_t link = link_offsets[src] + (*cursor)++;
+            if (link_targets[link] != src) {
+                *dst = link_targets[link];
+                *distance = link_distances[link];
+                return true;
+            }
+        }
+        return false;
+    }
+    while (*cursor < num_channel) {
+        size_t next = (*cursor)++;
+        if (next != src && topology[src * num_channel + next] != inf_distance) {
+            *dst = next;
+            *distance = topology[src * num_channel + next];
+            return true;
+        }
+    }
+    return false;
+}
+
+// Orders snapshot resets by router, then by destination
+static int compare_snapshot_resets(const void* a, const void* b)
+{
+    const snapshot_reset_t* first = a;
+    const snapshot_reset_t* second = b;
+    if (first->src != second->src) {
+        return first->src < second->src ? -1 : 1;
+    }
+    return first->dst < second->dst ? -1 : (first->dst > second->dst);
+}
+
+// Maps a snapshot file as the starting state of the routers, and works out which routers have to re-converge after
+// the differences between the snapshot topology and the current one
+// Cheaper or new links keep every vector valid, only their two ends have to broadcast again
+// For dearer or removed links, every entry that some shortest path through the link may have produced, and that no
+// equally short path without it still supports, is reset to the direct link, and the routers holding such entries and
+// their neighbours have to broadcast again
+// Returns false if the file is not a snapshot of as many routers as the current topology
+bool load_snapshot(const char* filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(snapshot_header_t)) {
+        close(fd);
+        return false;
+    }
+    // private mapping, so that the entries reset below are copied on write and the file stays untouched
+    char* map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    const snapshot_header_t* header = (const snapshot_header_t*)map;
+    snapshot_layout_t layout = snapshot_layout(num_channel, header->num_links);
+    if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION || header->num_routers != num_channel ||
+        layout.size != (size_t)st.st_size) {
+        munmap(map, (size_t)st.st_size);
+        return false;
+    }
+    snapshot_map = map;
+    snapshot_map_size = layout.size;
+    warm_epoch = (const uint64_t*)(map + layout.epochs);
+    warm_dist = (distance_t*)(map + layout.dist);
+    const uint64_t* offsets = (const uint64_t*)(map + layout.offsets);
+    const uint32_t* targets = (const uint32_t*)(map + layout.targets);
+    const distance_t* distances = (const distance_t*)(map + layout.distances);
+    router_affected = calloc(num_channel, sizeof(bool));
+    assert(router_affected != NULL);
+
+    // find the entries that may depend on a dearer link, before any entry is changed
+    // only the links of the snapshot are walked, and only the entries found are kept, so that the work and memory
+    // follow the links and the entries that changed rather than the square of the number of routers
+    size_t num_resets = 0;
+    size_t reset_capacity = num_channel;
+    snapshot_reset_t* resets = malloc(sizeof(snapshot_reset_t) * reset_capacity);
+    assert(resets != NULL);
+    for (size_t u = 0; u < num_channel; u++) {
+        for (size_t e = offsets[u]; e < offsets[u + 1]; e++) {
+            size_t v = targets[e];
+            distance_t old_distance = distances[e];
+            if (get_link_distance(u, v) <= old_distance) {
+                continue;
+            }
+            for (size_t src = 0; src < num_channel; src++) {
+                distance_t to_link = warm_dist[src * num_channel + u];
+                if (to_link == inf_distance) {
+                    continue;
+                }
+                for (size_t dst = 0; dst < num_channel; dst++) {
+                    distance_t from_link = warm_dist[v * num_channel + dst];
+                    distance_t distance = warm_dist[src * num_channel + dst];
+                    if (from_link == inf_distance || (uint64_t)to_link + old_distance + from_link != distance) {
+                        continue;
+                    }
+                    if (num_resets == reset_capacity) {
+                        reset_capacity *= 2;
+                        resets = realloc(resets, sizeof(snapshot_reset_t) * reset_capacity);
+                        assert(resets != NULL);
+                    }
+                    resets[num_resets++] = (snapshot_reset_t){src, dst, distance, false};
+                }
+            }
+        }
+    }
+    // an entry found through several dearer links is reset once, and the entries of a router end up next to each other
+    qsort(resets, num_resets, sizeof(snapshot_reset_t), compare_snapshot_resets);
+    size_t unique = 0;
+    for (size_t i = 0; i < num_resets; i++) {
+        if (unique == 0 || resets[i].src != resets[unique - 1].src || resets[i].dst != resets[unique - 1].dst) {
+            resets[unique++] = resets[i];
+        }
+    }
+    num_resets = unique;
+    // a reset entry reads as infinite until it is kept, so that it cannot support another entry
+    for (size_t i = 0; i < num_resets; i++) {
+        warm_dist[resets[i].src * num_channel + resets[i].dst] = inf_distance;
+    }
+    // keep the entries that are still reached at the same distance through a link and a neighbour entry that are
+    // both valid, which with ties between paths is most of them
+    bool rescued = true;
+    while (rescued) {
+        rescued = false;
+        for (size_t i = 0; i < num_resets; i++) {
+            snapshot_reset_t* reset = &resets[i];
+            if (reset->kept) {
+                continue;
+            }
+            bool supported = get_link_distance(reset->src, reset->dst) == reset->distance;
+            size_t cursor = 0;
+            size_t neighbor;
+            distance_t link;
+            while (!supported && next_link(reset->src, &cursor, &neighbor, &link)) {
+                distance_t rest = warm_dist[neighbor * num_channel + reset->dst];
+                supported = rest != inf_distance && (uint64_t)link + rest == reset->distance;
+            }
+            if (supported) {
+                warm_dist[reset->src * num_channel + reset->dst] = reset->distance;
+                reset->kept = true;
+                rescued = true;
+            }
+        }
+    }
+    size_t last_changed = num_channel;
+    for (size_t i = 0; i < num_resets; i++) {
+        size_t src = resets[i].src;
+        if (resets[i].kept) {
+            continue;
+        }
+        warm_dist[src * num_channel + resets[i].dst] = get_link_distance(src, resets[i].dst);
+        if (src != last_changed) {
+            last_changed = src;
+            router_affected[src] = true;
+            // the neighbours sending to src have to offer their vectors again
+            for (size_t neighbor = 0; neighbor < num_channel; neighbor++) {
+                if (neighbor != src && get_link_distance(neighbor, src) != inf_distance) {
+                    router_affected[neighbor] = true;
+                }
+            }
+        }
+    }
+    free(resets);
+
+    // cheaper links only lower the vectors
+    for (size_t u = 0; u < num_channel; u++) {
+        size_t cursor = 0;
+        size_t v;
+        distance_t new_distance;
+        while (next_link(u, &cursor, &v, &new_distance)) {
+            if (new_distance >= snapshot_link_distance(offsets, targets, distances, u, v)) {
+                continue;
+            }
+            if (new_distance < warm_dist[u * num_channel + v]) {
+                warm_dist[u * num_channel + v] = new_distance;
+            }
+            router_affected[u] = true;
+            router_affected[v] = true;
+        }
+    }
+    return true;
+}
+
+// Unmaps the snapshot loaded by load_snapshot
+void unload_snapshot()
+{
+    munmap(snapshot_map, snapshot_map_size);
+    free(router_affected);
+    snapshot_map = NULL;
+    warm_dist = NULL;
+    warm_epoch = NULL;
+    router_affected = NULL;
+}
+
+// Returns the NUMA node of the CPU, or 0 if it cannot be determined
+size_t cpu_numa_node(size_t cpu)
+{
+    char path[128];
+    for (int node = 0; node < 1024; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/node%d", cpu, node);
+        if (access(path, F_OK) == 0) {
+            return (size_t)node;
+        }
+    }
+    return 0;
+}
+
+// Assigns every router to one of num_cores cores according to the schedule, and returns the CPU backing each core
+// Partitioned schedules first split the routers between NUMA nodes and then between the cores of each node
+size_t* assign_cores(stress_schedule_t schedule, size_t num_cores, const size_t* cpus, size_t num_cpus)
+{
+    size_t* core_cpu = malloc(sizeof(size_t) * num_cores);
+    assert(core_cpu != NULL);
+    for (size_t core = 0; core < num_cores; core++) {
+        core_cpu[core] = cpus[core % num_cpus];
+    }
+    if (schedule != STRESS_SCHEDULE_PARTITIONED) {
+        for (size_t i = 0; i < num_channel; i++) {
+            router_core[i] = (schedule == STRESS_SCHEDULE_FREE) ? i : i % num_cores;
+        }
+        return core_cpu;
+    }
+
+    // links are used in both directions, so the partitioner sees them as undirected edges
+    size_t* offsets = calloc(num_channel + 1, sizeof(size_t));
+    assert(offsets != NULL);
+    for (size_t src = 0; src < num_channel; src++) {
+        for (size_t dst = 0; dst < num_channel; dst++) {
+            if (src != dst && (get_link_distance(src, dst) != inf_distance || get_link_distance(dst, src) != inf_distance)) {
+                offsets[src + 1]++;
+            }
+        }
+        offsets[src + 1] += offsets[src];
+    }
+    size_t* neighbors = malloc(sizeof(size_t) * (offsets[num_channel] + 1));
+    assert(neighbors != NULL);
+    for (size_t src = 0, e = 0; src < num_channel; src++) {
+        for (size_t dst = 0; dst < num_channel; dst++) {
+            if (src != dst && (get_link_distance(src, dst) != inf_distance || get_link_distance(dst, src) != inf_distance)) {
+                neighbors[e++] = dst;
+            }
+        }
+    }
+
+    // group the cores by NUMA node
+    size_t num_nodes = 0;
+    size_t* core_node = malloc(sizeof(size_t) * num_cores);
+    assert(core_node != NULL);
+    size_t* node_ids = malloc(sizeof(size_t) * num_cores);
+    assert(node_ids != NULL);
+    for (size_t core = 0; core < num_cores; core++) {
+        size_t node = cpu_numa_node(core_cpu[core]);
+        size_t n = 0;
+        while (n < num_nodes && node_ids[n] != node) {
+            n++;
+        }
+        if (n == num_nodes) {
+            node_ids[num_nodes++] = node;
+        }
+        core_node[core] = n;
+    }
+
+    size_t* all_routers = malloc(sizeof(size_t) * num_channel);
+    assert(all_routers != NULL);
+    size_t* router_node = malloc(sizeof(size_t) * num_channel);
+    assert(router_node != NULL);
+    for (size_t i = 0; i < num_channel; i++) {
+        all_routers[i] = i;
+    }
+    partition_graph(num_channel, offsets, neighbors, all_routers, num_channel, num_nodes, router_node);
+
+    size_t* node_routers = malloc(sizeof(size_t) * num_channel);
+    assert(node_routers != NULL);
+    size_t* node_cores = malloc(sizeof(size_t) * num_cores);
+    assert(node_cores != NULL);
+    for (size_t node = 0; node < num_nodes; node++) {
+        size_t count = 0;
+        size_t cores = 0;
+        for (size_t i = 0; i < num_channel; i++) {
+            if (router_node[i] == node) {
+                node_routers[count++] = i;
+            }
+        }
+        for (size_t core = 0; core < num_cores; core++) {
+            if (core_node[core] == node) {
+                node_cores[cores++] = core;
+            }
+        }
+        partition_graph(num_channel, offsets, neighbors, node_routers, count, cores, router_core);
+        for (size_t i = 0; i < count; i++) {
+            router_core[node_routers[i]] = node_cores[router_core[node_routers[i]]];
+        }
+    }
+
+    free(offsets);
+    free(neighbors);
+    free(core_node);
+    free(node_ids);
+    free(all_routers);
+    free(router_node);
+    free(node_routers);
+    free(node_cores);
+    return core_cpu;
+}
+
 void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename)
 {
+    run_stress_with_options(main_buffer_size, secondary_buffer_size, filename, NULL, NULL);
+}
+
+void run_stress_with_options(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename,
+                             const stress_options_t* options, stress_stats_t* stats)
+{
+    stress_options_t default_options = {STRESS_SCHEDULE_FREE, 0, STRESS_ORDER_FREE, 0, false, NULL, NULL, 0};
+    if (options == NULL) {
+        options = &default_options;
+    }
     assert(main_buffer_size <= 1); // only support up to a buffer size of 1
     assert(secondary_buffer_size <= 1); // only support up to a buffer size of 1
     int pthread_status;
     enum chan_status status;
-    bool initialized = create_topology(filename);
+    bool initialized = create_topology(filename, options->lean_validation, options->parse_threads);
     assert(initialized);
+    if (options->load_snapshot) {
+        bool loaded = load_snapshot(options->load_snapshot);
+        assert(loaded);
+    }
     channels = malloc(sizeof(chan_t*) * num_channel);
     assert(channels != NULL);
     for (size_t i = 0; i < num_channel; i++) {
@@ -318,17 +1347,84 @@ void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const cha
     completed_channel = channel_create(secondary_buffer_size);
     assert(completed_channel != NULL);
 
+    // place routers on cores
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    size_t num_cpus = 0;
+    size_t cpus[CPU_SETSIZE];
+    for (size_t cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            cpus[num_cpus++] = cpu;
+        }
+    }
+    assert(num_cpus > 0);
+    size_t num_cores = options->num_cores ? options->num_cores : num_cpus;
+    router_core = malloc(sizeof(size_t) * num_channel);
+    assert(router_core != NULL);
+    router_messages = calloc(num_channel, sizeof(size_t));
+    assert(router_messages != NULL);
+    router_cross_core_messages = calloc(num_channel, sizeof(size_t));
+    assert(router_cross_core_messages != NULL);
+    router_relaxations = calloc(num_channel, sizeof(size_t));
+    assert(router_relaxations != NULL);
+    size_t* core_cpu = assign_cores(options->schedule, num_cores, cpus, num_cpus);
+
+    // set up the worklist that orders broadcasts
+    router_order = options->order;
+    if (router_order != STRESS_ORDER_FREE) {
+        grant_channels = malloc(sizeof(chan_t*) * num_channel);
+        assert(grant_channels != NULL);
+        for (size_t i = 0; i < num_channel; i++) {
+            grant_channels[i] = channel_create(1);
+            assert(grant_channels[i] != NULL);
+        }
+        worklist_heap = malloc(sizeof(size_t) * num_channel);
+        assert(worklist_heap != NULL);
+        worklist_position = malloc(sizeof(size_t) * num_channel);
+        assert(worklist_position != NULL);
+        worklist_key = malloc(sizeof(uint64_t) * num_channel);
+        assert(worklist_key != NULL);
+        for (size_t i = 0; i < num_channel; i++) {
+            worklist_position[i] = SIZE_MAX;
+        }
+        worklist_size = 0;
+        worklist_active = 0;
+        worklist_slots = options->max_broadcasts ? options->max_broadcasts : num_cores;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
     pthread_t* pid = malloc(sizeof(pthread_t) * num_channel);
     assert(pid != NULL);
     for (size_t i = 0; i < num_channel; i++) {
-        pthread_status = pthread_create(&pid[i], NULL, router, (void*)i);
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (options->schedule != STRESS_SCHEDULE_FREE) {
+            cpu_set_t cpu;
+            CPU_ZERO(&cpu);
+            CPU_SET(core_cpu[router_core[i]], &cpu);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpu), &cpu);
+        }
+        pthread_status = pthread_create(&pid[i], &attr, router, (void*)i);
         assert(pthread_status == 0);
+        pthread_attr_destroy(&attr);
     }
 
     // wait for convergence
-    while (!check_done()) {
+    distance_vector_t** completed = malloc(sizeof(distance_vector_t*) * num_channel);
+    assert(completed != NULL);
+    while (!check_done(completed)) {
         usleep(1000);
     }
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (options->save_snapshot) {
+        // the routers keep their vectors until they are stopped
+        bool saved = save_snapshot(options->save_snapshot, completed);
+        assert(saved);
+    }
+    free(completed);
 
     // stop threads
     status = channel_close(done_channel);
@@ -350,6 +1446,51 @@ void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const cha
         status = channel_destroy(channels[i]);
         assert(status == SUCCESS);
     }
+    if (router_order != STRESS_ORDER_FREE) {
+        for (size_t i = 0; i < num_channel; i++) {
+            status = channel_close(grant_channels[i]);
+            assert(status == SUCCESS);
+            status = channel_destroy(grant_channels[i]);
+            assert(status == SUCCESS);
+        }
+        free(grant_channels);
+        free(worklist_heap);
+        free(worklist_position);
+        free(worklist_key);
+    }
+    if (stats) {
+        stats->messages = 0;
+        stats->cross_core_messages = 0;
+        stats->relaxations = 0;
+        stats->cut_links = 0;
+        for (size_t i = 0; i < num_channel; i++) {
+            stats->messages += router_messages[i];
+            stats->cross_core_messages += router_cross_core_messages[i];
+            stats->relaxations += router_relaxations[i];
+            for (size_t j = 0; j < num_channel; j++) {
+                if (i != j && get_link_distance(i, j) != inf_distance && router_core[i] != router_core[j]) {
+                    stats->cut_links++;
+                }
+            }
+        }
+        stats->topology_bytes = topology_bytes();
+        stats->restarted_routers = num_channel;
+        if (warm_dist) {
+            stats->restarted_routers = 0;
+            for (size_t i = 0; i < num_channel; i++) {
+                stats->restarted_routers += router_affected[i];
+            }
+        }
+        stats->convergence_time = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    }
+    free(core_cpu);
+    free(router_core);
+    free(router_messages);
+    free(router_cross_core_messages);
+    free(router_relaxations);
+    if (warm_dist) {
+        unload_snapshot();
+    }
     free(pid);
     free(channels);
     destroy_topology();
@@ -1,6 +1,72 @@
 #ifndef STRESS_H
 #define STRESS_H
 
+#include <stddef.h>
+#include <stdbool.h>
+
+// Defines how router threads are placed on cores
+typedef enum {
+    // Routers are left to the operating system scheduler
+    STRESS_SCHEDULE_FREE = 0,
+    // Router i is pinned to core i modulo the number of cores
+    STRESS_SCHEDULE_ROUND_ROBIN = 1,
+    // Routers are partitioned so that neighbouring routers share a core (and a NUMA node) as much as possible
+    STRESS_SCHEDULE_PARTITIONED = 2
+} stress_schedule_t;
+
+// Defines the order in which routers broadcast their distance vectors
+// Under a worklist order, routers still broadcast their links right away, only the later broadcasts are ordered
+typedef enum {
+    // Every router broadcasts as soon as its vector changes
+    STRESS_ORDER_FREE = 0,
+    // Changed routers wait on a shared worklist, the one that improved the most destinations broadcasts first
+    STRESS_ORDER_IMPROVEMENT = 1,
+    // Changed routers wait on a shared worklist, the one with the smallest improved distance broadcasts first
+    STRESS_ORDER_DISTANCE = 2
+} stress_order_t;
+
+// Defines the options of a stress run
+typedef struct {
+    stress_schedule_t schedule;
+    // Number of cores to spread routers over, 0 uses every CPU the process may run on
+    // When larger than the number of CPUs, cores are mapped onto CPUs round robin
+    size_t num_cores;
+    stress_order_t order;
+    // Number of routers that may broadcast at the same time under a worklist order, 0 uses the number of cores
+    size_t max_broadcasts;
+    // Keeps only the links of the topology and checks the converged routers with on-demand shortest paths, instead of
+    // holding the dense topology and its precomputed solution (two N*N arrays)
+    bool lean_validation;
+    // Snapshot file to start the routers from (NULL for a cold start), which may have been taken on a different
+    // topology with the same number of routers, only the routers affected by the differences then re-converge
+    const char* load_snapshot;
+    // Snapshot file to write the converged routers to (NULL for none)
+    const char* save_snapshot;
+    // Number of threads parsing the topology in place from a memory-mapped stream of chunks, 0 reads it with stdio
+    size_t parse_threads;
+} stress_options_t;
+
+// Defines the statistics reported by a stress run
+typedef struct {
+    // Number of distance vectors sent between routers, and how many of them crossed cores
+    size_t messages;
+    size_t cross_core_messages;
+    // Number of tentative distances lowered by received vectors
+    size_t relaxations;
+    // Number of directed links between routers placed on different cores
+    size_t cut_links;
+    // Number of bytes held by the topology and its solution
+    size_t topology_bytes;
+    // Number of routers that broadcast their vector at start, which is every router on a cold start
+    size_t restarted_routers;
+    // Time (in seconds) from starting the routers until convergence was detected
+    double convergence_time;
+} stress_stats_t;
+
 void run_stress(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename);
 
+// Same as run_stress, with the given options (NULL for the defaults) and reporting statistics in stats (if not NULL)
+void run_stress_with_options(size_t main_buffer_size, size_t secondary_buffer_size, const char* filename,
+                             const stress_options_t* options, stress_stats_t* stats);
+
 #endif // STRESS_H
@@ -0,0 +1,131 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "actor.h"
+#include "stress_actor.h"
+
+// Defines a token, the number of hops it still has to make
+typedef struct {
+    size_t hops;
+} actor_token_t;
+
+typedef struct {
+    size_t num_actors;
+    chan_t** mailboxes;
+    // Receives every token once it made all its hops
+    chan_t* done;
+} actor_ring_t;
+
+// Defines an actor of the ring, or the thread that stands for it
+typedef struct {
+    actor_ring_t* ring;
+    size_t index;
+} actor_ring_member_t;
+
+static uint64_t actor_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// Passes the token on to the next actor of the ring, or reports it done
+void actor_ring_forward(actor_ring_member_t* member, actor_token_t* token)
+{
+    actor_ring_t* ring = member->ring;
+    enum chan_status status;
+    if (--token->hops == 0) {
+        status = channel_send(ring->done, token, true);
+    }
+    else {
+        status = channel_send(ring->mailboxes[(member->index + 1) % ring->num_actors], token, true);
+    }
+    assert(status == SUCCESS);
+    (void)status;
+}
+
+void actor_ring_handler(actor_t* self, void* message, void* context)
+{
+    (void)self;
+    actor_ring_forward(context, message);
+}
+
+void* actor_ring_thread(void* arg)
+{
+    actor_ring_member_t* member = arg;
+    void* message = NULL;
+    while (channel_receive(member->ring->mailboxes[member->index], &message, true) == SUCCESS) {
+        actor_ring_forward(member, message);
+    }
+    return NULL;
+}
+
+double run_stress_actor(size_t num_actors, size_t num_tokens, size_t num_hops, bool pooled, size_t num_workers)
+{
+    // every mailbox has room for every token, so forwarding never blocks a worker
+    actor_ring_t ring = {num_actors, malloc(sizeof(chan_t*) * num_actors), channel_create(num_tokens)};
+    actor_ring_member_t* members = malloc(sizeof(actor_ring_member_t) * num_actors);
+    actor_token_t* tokens = malloc(sizeof(actor_token_t) * num_tokens);
+    pthread_t* pid = malloc(sizeof(pthread_t) * num_actors);
+    assert(ring.mailboxes != NULL && ring.done != NULL && members != NULL && tokens != NULL && pid != NULL);
+
+    actor_system_t* system = NULL;
+    if (pooled) {
+        system = actor_system_create(num_workers, num_actors, 64);
+        assert(system != NULL);
+    }
+    for (size_t i = 0; i < num_actors; i++) {
+        members[i].ring = &ring;
+        members[i].index = i;
+        if (pooled) {
+            actor_t* actor = actor_spawn(system, num_tokens, actor_ring_handler, &members[i]);
+            assert(actor != NULL);
+            ring.mailboxes[i] = actor_mailbox(actor);
+        }
+        else {
+            ring.mailboxes[i] = channel_create(num_tokens);
+            assert(ring.mailboxes[i] != NULL);
+            int rc = pthread_create(&pid[i], NULL, actor_ring_thread, &members[i]);
+            assert(rc == 0);
+            (void)rc;
+        }
+    }
+
+    uint64_t start = actor_now();
+    for (size_t i = 0; i < num_tokens; i++) {
+        tokens[i].hops = num_hops;
+        enum chan_status status = channel_send(ring.mailboxes[i * num_actors / num_tokens], &tokens[i], true);
+        assert(status == SUCCESS);
+        (void)status;
+    }
+    void* token = NULL;
+    for (size_t i = 0; i < num_tokens; i++) {
+        enum chan_status status = channel_receive(ring.done, &token, true);
+        assert(status == SUCCESS);
+        (void)status;
+    }
+    uint64_t elapsed = actor_now() - start;
+
+    if (pooled) {
+        actor_system_close(system);
+        actor_system_destroy(system);
+    }
+    else {
+        for (size_t i = 0; i < num_actors; i++) {
+            channel_close(ring.mailboxes[i]);
+        }
+        for (size_t i = 0; i < num_actors; i++) {
+            pthread_join(pid[i], NULL);
+            channel_destroy(ring.mailboxes[i]);
+        }
+    }
+    channel_close(ring.done);
+    channel_destroy(ring.done);
+    free(ring.mailboxes);
+    free(members);
+    free(tokens);
+    free(pid);
+    return (double)(num_tokens * num_hops) * 1e9 / (double)(elapsed ? elapsed : 1);
+}
@@ -0,0 +1,12 @@
+#ifndef STRESS_ACTOR_H
+#define STRESS_ACTOR_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Passes num_tokens tokens around a ring of num_actors actors, each token making num_hops hops, with the actors run on a
+// pool of num_workers workers (pooled = true) or each on its own thread
+// Returns the number of hops per second
+double run_stress_actor(size_t num_actors, size_t num_tokens, size_t num_hops, bool pooled, size_t num_workers);
+
+#endif // STRESS_ACTOR_H
@@ -0,0 +1,104 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "channel.h"
+#include "socket_bridge.h"
+#include "stress_bridge.h"
+
+typedef struct {
+    chan_t* channel;
+    size_t num_msgs;
+    size_t msg_size;
+} producer_args;
+
+void* bridge_producer(void* arg)
+{
+    producer_args* args = arg;
+    char payload[BRIDGE_MAX_PAYLOAD];
+    for (size_t msg = 0; msg < args->num_msgs; msg++) {
+        // stamp each payload with its index so that order can be checked on the other side
+        memset(payload, (int)(msg & 0x7f), args->msg_size);
+        memcpy(payload, &msg, sizeof(size_t));
+        bridge_msg_t* data = bridge_msg_create(payload, args->msg_size);
+        assert(data != NULL);
+        enum chan_status status = channel_send(args->channel, data, true);
+        assert(status == SUCCESS);
+    }
+    // end of stream
+    enum chan_status status = channel_send(args->channel, NULL, true);
+    assert(status == SUCCESS);
+    return NULL;
+}
+
+double run_stress_bridge(size_t num_msgs, size_t msg_size, bool batched, size_t* syscalls)
+{
+    assert(msg_size >= sizeof(size_t));
+    assert(msg_size <= BRIDGE_MAX_PAYLOAD);
+    enum chan_status status;
+    int fds[2];
+    int result = socketpair(AF_UNIX, SOCK_DGRAM, 0, fds);
+    assert(result == 0);
+    chan_t* in_channel = channel_create(BRIDGE_MAX_BATCH);
+    assert(in_channel != NULL);
+    chan_t* out_channel = channel_create(BRIDGE_MAX_BATCH);
+    assert(out_channel != NULL);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bridge_t* receiver = bridge_start_receiver(out_channel, fds[1], batched);
+    assert(receiver != NULL);
+    bridge_t* sender = bridge_start_sender(in_channel, fds[0], batched);
+    assert(sender != NULL);
+    pthread_t pid;
+    producer_args args = {in_channel, num_msgs, msg_size};
+    result = pthread_create(&pid, NULL, bridge_producer, &args);
+    assert(result == 0);
+
+    for (size_t msg = 0; ; msg++) {
+        void* data = NULL;
+        status = channel_receive(out_channel, &data, true);
+        assert(status == SUCCESS);
+        if (data == NULL) {
+            assert(msg == num_msgs);
+            break;
+        }
+        bridge_msg_t* received = data;
+        size_t index;
+        assert(received->length == msg_size);
+        memcpy(&index, received->data, sizeof(size_t));
+        assert(index == msg);
+        assert(received->data[msg_size - 1] == (char)(msg & 0x7f));
+        free(received);
+    }
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    bridge_stats_t sender_stats;
+    bridge_stats_t receiver_stats;
+    pthread_join(pid, NULL);
+    bridge_join(sender, &sender_stats);
+    bridge_join(receiver, &receiver_stats);
+    assert(sender_stats.messages == num_msgs);
+    assert(receiver_stats.messages == num_msgs);
+    if (syscalls) {
+        *syscalls = sender_stats.syscalls + receiver_stats.syscalls;
+    }
+
+    status = channel_close(in_channel);
+    assert(status == SUCCESS);
+    status = channel_destroy(in_channel);
+    assert(status == SUCCESS);
+    status = channel_close(out_channel);
+    assert(status == SUCCESS);
+    status = channel_destroy(out_channel);
+    assert(status == SUCCESS);
+    close(fds[0]);
+    close(fds[1]);
+
+    double elapsed = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return (double)num_msgs / elapsed;
+}
@@ -0,0 +1,13 @@
+#ifndef STRESS_BRIDGE_H
+#define STRESS_BRIDGE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Pushes num_msgs messages of msg_size bytes through a sending and a receiving socket bridge joined by a
+// datagram socketpair, checking that every message arrives intact and in order
+// Returns the number of messages moved per second, and stores the number of system calls issued by both bridges
+// in syscalls (if syscalls is not NULL)
+double run_stress_bridge(size_t num_msgs, size_t msg_size, bool batched, size_t* syscalls);
+
+#endif // STRESS_BRIDGE_H
@@ -0,0 +1,110 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "keyed_channel.h"
+#include "stress_keyed.h"
+
+// Defines a message, the position of the message among those of its key and producer
+typedef struct {
+    size_t key;
+    size_t producer;
+    size_t seq;
+} keyed_message_t;
+
+typedef struct {
+    keyed_channel_t* keyed;
+    size_t producer;
+    size_t num_keys;
+    size_t num_msgs;
+    keyed_message_t* messages;
+} keyed_producer_args;
+
+typedef struct {
+    size_t num_producers;
+    size_t work_ns;
+    // Next expected position of every key and producer, only touched by the worker of the key's partition
+    size_t* next;
+    size_t handled;
+} keyed_worker_args;
+
+static uint64_t keyed_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+void keyed_handler(void* context, size_t partition, void* data)
+{
+    keyed_worker_args* args = context;
+    keyed_message_t* message = data;
+    (void)partition;
+    size_t* next = &args->next[message->key * args->num_producers + message->producer];
+    assert(message->seq == *next);
+    (*next)++;
+    uint64_t until = keyed_now() + args->work_ns;
+    while (keyed_now() < until) {
+    }
+    __atomic_add_fetch(&args->handled, 1, __ATOMIC_RELAXED);
+}
+
+void* keyed_producer(void* arg)
+{
+    keyed_producer_args* args = arg;
+    size_t* seq = calloc(args->num_keys, sizeof(size_t));
+    assert(seq != NULL);
+    for (size_t msg = 0; msg < args->num_msgs; msg++) {
+        keyed_message_t* message = &args->messages[msg];
+        message->key = (msg * 7 + args->producer) % args->num_keys;
+        message->producer = args->producer;
+        message->seq = seq[message->key]++;
+        enum chan_status status = keyed_channel_send(args->keyed, message->key, message, true);
+        assert(status == SUCCESS);
+    }
+    free(seq);
+    return NULL;
+}
+
+double run_stress_keyed(size_t partitions, size_t num_producers, size_t num_keys, size_t num_msgs, size_t work_ns)
+{
+    keyed_channel_t* keyed = keyed_channel_create(partitions, 64);
+    assert(keyed != NULL);
+    keyed_worker_args worker = {num_producers, work_ns, calloc(num_keys * num_producers, sizeof(size_t)), 0};
+    keyed_producer_args* args = malloc(sizeof(keyed_producer_args) * num_producers);
+    pthread_t* pid = malloc(sizeof(pthread_t) * num_producers);
+    assert(worker.next != NULL && args != NULL && pid != NULL);
+
+    uint64_t start = keyed_now();
+    bool started = keyed_channel_start(keyed, keyed_handler, &worker);
+    assert(started);
+    for (size_t i = 0; i < num_producers; i++) {
+        size_t count = num_msgs / num_producers + (i < num_msgs % num_producers);
+        args[i] = (keyed_producer_args){keyed, i, num_keys, count, malloc(sizeof(keyed_message_t) * count)};
+        assert(args[i].messages != NULL);
+        int result = pthread_create(&pid[i], NULL, keyed_producer, &args[i]);
+        assert(result == 0);
+    }
+    for (size_t i = 0; i < num_producers; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    keyed_channel_join(keyed);
+    uint64_t end = keyed_now();
+    assert(worker.handled == num_msgs);
+
+    keyed_channel_stats_t stats;
+    keyed_channel_stats(keyed, KEYED_CHANNEL_ALL, &stats);
+    assert(stats.sent == num_msgs && stats.queued == 0);
+    enum chan_status status = keyed_channel_close(keyed);
+    assert(status == SUCCESS);
+    status = keyed_channel_destroy(keyed);
+    assert(status == SUCCESS);
+    for (size_t i = 0; i < num_producers; i++) {
+        free(args[i].messages);
+    }
+    free(args);
+    free(pid);
+    free(worker.next);
+    return (double)num_msgs / ((double)(end - start) / 1e9);
+}
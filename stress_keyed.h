@@ -0,0 +1,11 @@
+#ifndef STRESS_KEYED_H
+#define STRESS_KEYED_H
+
+#include <stddef.h>
+
+// Sends num_msgs messages spread over num_keys keys from num_producers threads through a keyed channel of partitions
+// partitions, whose workers spend work_ns nanoseconds on every message and check that each key arrives in order
+// Returns the number of messages handled per second
+double run_stress_keyed(size_t partitions, size_t num_producers, size_t num_keys, size_t num_msgs, size_t work_ns);
+
+#endif // STRESS_KEYED_H
@@ -0,0 +1,147 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "channel.h"
+#include "stress_latency.h"
+
+typedef struct {
+    chan_t* channel;
+    uint64_t* sent;
+    size_t num_msgs;
+    uint64_t gap_usec;
+} latency_producer_args;
+
+typedef struct {
+    chan_t* channel;
+    chan_t* idle_channel;
+    const latency_options_t* options;
+    uint64_t* sent;
+    uint64_t* latencies;
+    size_t num_msgs;
+} latency_consumer_args;
+
+uint64_t latency_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+void* latency_producer(void* arg)
+{
+    latency_producer_args* args = arg;
+    struct timespec gap = {(time_t)(args->gap_usec / 1000000), (long)(args->gap_usec % 1000000) * 1000};
+    for (size_t msg = 0; msg < args->num_msgs; msg++) {
+        // the consumer reads the send time through the message, after the channel has ordered the two threads
+        args->sent[msg] = latency_now();
+        enum chan_status status = channel_send(args->channel, &args->sent[msg], true);
+        assert(status == SUCCESS);
+        nanosleep(&gap, NULL);
+    }
+    // end of stream
+    enum chan_status status = channel_send(args->channel, NULL, true);
+    assert(status == SUCCESS);
+    return NULL;
+}
+
+void* latency_consumer(void* arg)
+{
+    latency_consumer_args* args = arg;
+    select_t select_list[2];
+    select_list[0].channel = args->idle_channel;
+    select_list[0].is_send = false;
+    select_list[1].channel = args->channel;
+    select_list[1].is_send = false;
+    for (size_t msg = 0; ; msg++) {
+        void* data = NULL;
+        enum chan_status status;
+        if (args->options->select) {
+            size_t selected_index = 0;
+            if (args->options->busy) {
+                status = channel_select_busy(2, select_list, &selected_index);
+            } else {
+                status = channel_select(2, select_list, &selected_index);
+            }
+            assert(selected_index == 1);
+            data = select_list[1].data;
+        } else if (args->options->busy) {
+            status = channel_receive_busy(args->channel, &data);
+        } else {
+            status = channel_receive(args->channel, &data, true);
+        }
+        uint64_t received = latency_now();
+        assert(status == SUCCESS);
+        if (data == NULL) {
+            assert(msg == args->num_msgs);
+            break;
+        }
+        args->latencies[msg] = received - *(uint64_t*)data;
+    }
+    return NULL;
+}
+
+int latency_compare(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+void run_stress_latency(size_t num_msgs, uint64_t gap_usec, const latency_options_t* options, latency_percentiles_t* result)
+{
+    assert(num_msgs > 0);
+    int pthread_status;
+    enum chan_status status;
+    chan_t* channel = channel_create(1);
+    assert(channel != NULL);
+    chan_t* idle_channel = channel_create(1);
+    assert(idle_channel != NULL);
+    uint64_t* sent = malloc(sizeof(uint64_t) * num_msgs);
+    assert(sent != NULL);
+    uint64_t* latencies = malloc(sizeof(uint64_t) * num_msgs);
+    assert(latencies != NULL);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (options->num_cpus) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (size_t i = 0; i < options->num_cpus; i++) {
+            CPU_SET(options->cpus[i], &cpus);
+        }
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+    pthread_t consumer;
+    latency_consumer_args consumer_args = {channel, idle_channel, options, sent, latencies, num_msgs};
+    pthread_status = pthread_create(&consumer, &attr, latency_consumer, &consumer_args);
+    assert(pthread_status == 0);
+    pthread_attr_destroy(&attr);
+    pthread_t producer;
+    latency_producer_args producer_args = {channel, sent, num_msgs, gap_usec};
+    pthread_status = pthread_create(&producer, NULL, latency_producer, &producer_args);
+    assert(pthread_status == 0);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    qsort(latencies, num_msgs, sizeof(uint64_t), latency_compare);
+    result->p50 = latencies[num_msgs * 50 / 100];
+    result->p90 = latencies[num_msgs * 90 / 100];
+    result->p99 = latencies[num_msgs * 99 / 100];
+    result->p999 = latencies[num_msgs * 999 / 1000];
+    result->max = latencies[num_msgs - 1];
+
+    status = channel_close(channel);
+    assert(status == SUCCESS);
+    status = channel_destroy(channel);
+    assert(status == SUCCESS);
+    status = channel_close(idle_channel);
+    assert(status == SUCCESS);
+    status = channel_destroy(idle_channel);
+    assert(status == SUCCESS);
+    free(sent);
+    free(latencies);
+}
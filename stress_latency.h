@@ -0,0 +1,32 @@
+#ifndef STRESS_LATENCY_H
+#define STRESS_LATENCY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Defines how the consumer of a latency run waits for messages
+typedef struct {
+    // Spins with channel_receive_busy/channel_select_busy instead of parking in channel_receive/channel_select
+    bool busy;
+    // Waits through a select over the data channel and an idle channel instead of receiving from the data channel
+    bool select;
+    // CPUs the consumer is pinned to, the consumer is not pinned when num_cpus is 0
+    const size_t* cpus;
+    size_t num_cpus;
+} latency_options_t;
+
+// Defines the hand-off latencies (in nanoseconds) measured by a latency run
+typedef struct {
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+} latency_percentiles_t;
+
+// Sends num_msgs timestamped messages, spaced gap_usec apart, from a producer thread to a consumer thread waiting as
+// described by options, and stores the percentiles of the time between each send and its receive in result
+void run_stress_latency(size_t num_msgs, uint64_t gap_usec, const latency_options_t* options, latency_percentiles_t* result);
+
+#endif // STRESS_LATENCY_H
@@ -0,0 +1,76 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "channel.h"
+#include "stress_oversubscribe.h"
+
+typedef struct {
+    chan_t* channel;
+    size_t num_msgs;
+} oversubscribed_args;
+
+void* oversubscribed_sender(void* arg)
+{
+    oversubscribed_args* args = arg;
+    for (size_t msg = 0; msg < args->num_msgs; msg++) {
+        enum chan_status status = channel_send(args->channel, (void*)(msg + 1), true);
+        assert(status == SUCCESS);
+    }
+    return NULL;
+}
+
+void* oversubscribed_receiver(void* arg)
+{
+    oversubscribed_args* args = arg;
+    for (size_t msg = 0; msg < args->num_msgs; msg++) {
+        void* data = NULL;
+        enum chan_status status = channel_receive(args->channel, &data, true);
+        assert(status == SUCCESS);
+        assert(data != NULL);
+    }
+    return NULL;
+}
+
+double run_stress_oversubscribed(size_t oversubscription, enum chan_wait strategy, size_t num_msgs)
+{
+    size_t num_pairs = oversubscription * channel_cpu_count() / 2;
+    if (num_pairs == 0) {
+        num_pairs = 1;
+    }
+    chan_t* channel = channel_create(16);
+    assert(channel != NULL);
+    channel_set_wait_strategy(channel, strategy);
+    pthread_t* pid = malloc(sizeof(pthread_t) * num_pairs * 2);
+    assert(pid != NULL);
+    oversubscribed_args* args = malloc(sizeof(oversubscribed_args) * num_pairs);
+    assert(args != NULL);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < num_pairs; i++) {
+        // each sender is matched by a receiver taking as many messages, so every thread runs to completion
+        args[i].channel = channel;
+        args[i].num_msgs = num_msgs / num_pairs + (i < num_msgs % num_pairs);
+        int result = pthread_create(&pid[2 * i], NULL, oversubscribed_receiver, &args[i]);
+        assert(result == 0);
+        result = pthread_create(&pid[2 * i + 1], NULL, oversubscribed_sender, &args[i]);
+        assert(result == 0);
+    }
+    for (size_t i = 0; i < num_pairs * 2; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    enum chan_status status = channel_close(channel);
+    assert(status == SUCCESS);
+    status = channel_destroy(channel);
+    assert(status == SUCCESS);
+    free(pid);
+    free(args);
+    double elapsed = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return (double)num_msgs / elapsed;
+}
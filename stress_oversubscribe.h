@@ -0,0 +1,12 @@
+#ifndef STRESS_OVERSUBSCRIBE_H
+#define STRESS_OVERSUBSCRIBE_H
+
+#include <stddef.h>
+#include "channel.h"
+
+// Runs oversubscription times as many threads as there are CPUs, half of them sending and half of them receiving
+// num_msgs messages in total over a single channel waiting with the given strategy
+// Returns the number of messages moved per second
+double run_stress_oversubscribed(size_t oversubscription, enum chan_wait strategy, size_t num_msgs);
+
+#endif // STRESS_OVERSUBSCRIBE_H
@@ -0,0 +1,118 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "channel.h"
+#include "pipeline_ring.h"
+#include "stress_pipeline.h"
+
+// Size of the ring, and of every channel of the chain
+#define PIPELINE_CAPACITY 1024
+// Largest batch taken by a stage of the ring
+#define PIPELINE_BATCH 64
+
+typedef struct {
+    size_t stage;
+    size_t stages;
+    size_t num_msgs;
+    chan_t** channels;
+    pipeline_ring_t* ring;
+} pipeline_args;
+
+void* pipeline_channel_stage(void* arg)
+{
+    pipeline_args* args = arg;
+    for (size_t msg = 0; msg < args->num_msgs; msg++) {
+        void* data = NULL;
+        enum chan_status status = channel_receive(args->channels[args->stage], &data, true);
+        assert(status == SUCCESS);
+        data = (void*)((size_t)data + 1);
+        if (args->stage + 1 < args->stages) {
+            status = channel_send(args->channels[args->stage + 1], data, true);
+            assert(status == SUCCESS);
+        }
+        else {
+            assert((size_t)data == msg + 1 + args->stages);
+        }
+    }
+    return NULL;
+}
+
+void* pipeline_ring_stage(void* arg)
+{
+    pipeline_args* args = arg;
+    size_t msg = 0;
+    while (msg < args->num_msgs) {
+        size_t first = 0;
+        size_t count = 0;
+        enum chan_status status = pipeline_ring_acquire(args->ring, args->stage, PIPELINE_BATCH, &first, &count, true);
+        assert(status == SUCCESS);
+        for (size_t i = 0; i < count; i++) {
+            void** slot = pipeline_ring_slot(args->ring, first + i);
+            *slot = (void*)((size_t)*slot + 1);
+            if (args->stage + 1 == args->stages) {
+                assert((size_t)*slot == msg + i + 1 + args->stages);
+            }
+        }
+        pipeline_ring_release(args->ring, args->stage, count);
+        msg += count;
+    }
+    return NULL;
+}
+
+double run_stress_pipeline(size_t stages, size_t num_msgs, bool ring, enum chan_wait strategy)
+{
+    pipeline_args* args = malloc(sizeof(pipeline_args) * stages);
+    pthread_t* pid = malloc(sizeof(pthread_t) * stages);
+    chan_t** channels = NULL;
+    pipeline_ring_t* pipeline = NULL;
+    assert(args != NULL && pid != NULL);
+    if (ring) {
+        pipeline = pipeline_ring_create(PIPELINE_CAPACITY, stages, strategy);
+        assert(pipeline != NULL);
+    }
+    else {
+        channels = malloc(sizeof(chan_t*) * stages);
+        assert(channels != NULL);
+        for (size_t i = 0; i < stages; i++) {
+            channels[i] = channel_create(PIPELINE_CAPACITY);
+            assert(channels[i] != NULL);
+            channel_set_wait_strategy(channels[i], strategy);
+        }
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < stages; i++) {
+        args[i] = (pipeline_args){i, stages, num_msgs, channels, pipeline};
+        int result = pthread_create(&pid[i], NULL, ring ? pipeline_ring_stage : pipeline_channel_stage, &args[i]);
+        assert(result == 0);
+    }
+    for (size_t msg = 0; msg < num_msgs; msg++) {
+        enum chan_status status = ring ? pipeline_ring_publish(pipeline, (void*)(msg + 1), true)
+                                       : channel_send(channels[0], (void*)(msg + 1), true);
+        assert(status == SUCCESS);
+    }
+    for (size_t i = 0; i < stages; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (ring) {
+        pipeline_ring_close(pipeline);
+        pipeline_ring_destroy(pipeline);
+    }
+    else {
+        for (size_t i = 0; i < stages; i++) {
+            channel_close(channels[i]);
+            channel_destroy(channels[i]);
+        }
+        free(channels);
+    }
+    free(args);
+    free(pid);
+    double elapsed = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    return (double)num_msgs / elapsed;
+}
@@ -0,0 +1,13 @@
+#ifndef STRESS_PIPELINE_H
+#define STRESS_PIPELINE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "channel.h"
+
+// Runs num_msgs messages from a producer through a pipeline of stages threads, each stage adding one to every message,
+// either over a chain of channels (one per stage) or over a single pipeline ring, waiting with the given strategy
+// Returns the number of messages moved through the whole pipeline per second
+double run_stress_pipeline(size_t stages, size_t num_msgs, bool ring, enum chan_wait strategy);
+
+#endif // STRESS_PIPELINE_H
@@ -1,8 +1,11 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include "channel.h"
+#include "compact_channel.h"
 #include <assert.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <time.h>
 #include <sys/resource.h>
@@ -10,6 +13,29 @@
 #include <stdbool.h>
 #include "stress.h"
 #include "stress_send_recv.h"
+#include "socket_bridge.h"
+#include "stress_bridge.h"
+#include "recorder.h"
+#include "partition.h"
+#include "stress_latency.h"
+#include "stress_oversubscribe.h"
+#include "stress_pipeline.h"
+#include "pipeline_ring.h"
+#include "keyed_channel.h"
+#include "stress_keyed.h"
+#include "rpc.h"
+#include "actor.h"
+#include "stress_actor.h"
+#include "state_cell.h"
+#include "waitset.h"
+#include "file_stage.h"
+#include "map_stream.h"
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
 
 #define mu_str_(text) #text
 #define mu_str(text) mu_str_(text)
@@ -99,6 +125,14 @@ void* helper_receive(receive_args *myargs) {
     return NULL;
 }
 
+void* helper_receive_busy(receive_args *myargs) {
+    myargs->out = channel_receive_busy(myargs->channel, &myargs->data);
+    if (myargs->done) {
+        sem_post(myargs->done);
+    }
+    return NULL;
+}
+
 void* helper_select(select_args *myargs) {
     myargs->out = channel_select(myargs->list_size, myargs->select_list, &myargs->index);
     if (myargs->done) {
@@ -1816,6 +1850,53 @@ char* test_select_with_duplicate_channel_unbuffered() {
     return test_select_with_duplicate_channel(0);
 }
 
+char* test_select_with_concurrent_selects_buffered() {
+    print_test_details(__func__, "Testing several selects blocked on the same channels: buffered");
+    size_t SELECTS = 8;
+
+    // every select waits on both channels, so each send must wake one of them without the others losing the wake up
+    pthread_t pid[SELECTS];
+    chan_t* channel[2] = {channel_create(1), channel_create(1)};
+    select_t list[SELECTS][2];
+    select_args args[SELECTS];
+    sem_t done;
+    sem_init(&done, 0, 0);
+    for (size_t i = 0; i < SELECTS; i++) {
+        for (size_t j = 0; j < 2; j++) {
+            list[i][j].is_send = false;
+            list[i][j].channel = channel[j];
+            list[i][j].data = (void*)0xdeadbeef;
+        }
+        init_object_for_select_api(&args[i], list[i], 2, &done);
+        pthread_create(&pid[i], NULL, (void *)helper_select, &args[i]);
+    }
+
+    // To wait sometime before we check the selects are blocking now
+    usleep(10000);
+    mu_assert("test_select_with_concurrent_selects: It isn't blocked as expected", sem_trywait(&done) != 0);
+
+    for (size_t i = 0; i < SELECTS; i++) {
+        mu_assert("test_select_with_concurrent_selects: Send failed", channel_send(channel[i % 2], i % 2 ? "Message1" : "Message0", true) == SUCCESS);
+    }
+    size_t received[2] = {0, 0};
+    for (size_t i = 0; i < SELECTS; i++) {
+        pthread_join(pid[i], NULL);
+        mu_assert("test_select_with_concurrent_selects: Failed select", args[i].out == SUCCESS);
+        mu_assert("test_select_with_concurrent_selects: Invalid index", args[i].index < 2);
+        mu_assert("test_select_with_concurrent_selects: Invalid message", string_equal(list[i][args[i].index].data, args[i].index ? "Message1" : "Message0"));
+        mu_assert("test_select_with_concurrent_selects: Overwrote data", list[i][1 - args[i].index].data == (void*)0xdeadbeef);
+        received[args[i].index]++;
+    }
+    mu_assert("test_select_with_concurrent_selects: Lost message", received[0] == SELECTS / 2 && received[1] == SELECTS / 2);
+
+    sem_destroy(&done);
+    for (size_t j = 0; j < 2; j++) {
+        channel_close(channel[j]);
+        channel_destroy(channel[j]);
+    }
+    return NULL;
+}
+
 char* test_select_mixed_buffered_unbuffered() {
     print_test_details(__func__, "Testing select with a mixture of buffered and unbuffered channels");
     size_t CHANNELS = 4;
@@ -2003,6 +2084,2153 @@ char* test_select_mixed_buffered_unbuffered() {
     return NULL;
 }
 
+char* test_lossy_channel() {
+    print_test_details(__func__, "Testing lossy channel overwrites oldest messages");
+
+    /* A lossy channel never blocks the sender; once full, the oldest message is dropped
+     * and receivers can see the gap through the sequence numbers
+     */
+    size_t capacity = 2;
+    chan_t* channel = channel_create_lossy(capacity);
+    mu_assert("test_lossy_channel: Could not create channel", channel != NULL);
+
+    char* messages[] = {"Message0", "Message1", "Message2", "Message3", "Message4"};
+    for (size_t i = 0; i < 5; i++) {
+        // blocking and non-blocking sends must both succeed immediately
+        mu_assert("test_lossy_channel: Send failed", channel_send(channel, messages[i], i % 2 == 0) == SUCCESS);
+    }
+    mu_assert("test_lossy_channel: Buffer size is not as expected", buffer_current_size(channel->buffer) == capacity);
+    mu_assert("test_lossy_channel: Dropped count is not as expected", channel_dropped(channel) == 3);
+    mu_assert("test_lossy_channel: Full lossy channel not ready for a send", channel_ready(channel, true));
+
+    void* data = NULL;
+    size_t seq = 0;
+    mu_assert("test_lossy_channel: Receive failed", channel_receive_seq(channel, &data, &seq, true) == SUCCESS);
+    mu_assert("test_lossy_channel: Received wrong message", string_equal(data, "Message3"));
+    mu_assert("test_lossy_channel: Received wrong sequence", seq == 3);
+    mu_assert("test_lossy_channel: Send failed", channel_send(channel, "Message5", true) == SUCCESS);
+    mu_assert("test_lossy_channel: Receive failed", channel_receive_seq(channel, &data, &seq, false) == SUCCESS);
+    mu_assert("test_lossy_channel: Received wrong message", string_equal(data, "Message4"));
+    mu_assert("test_lossy_channel: Received wrong sequence", seq == 4);
+    mu_assert("test_lossy_channel: Receive failed", channel_receive(channel, &data, false) == SUCCESS);
+    mu_assert("test_lossy_channel: Received wrong message", string_equal(data, "Message5"));
+    mu_assert("test_lossy_channel: Receive should block", channel_receive_seq(channel, &data, &seq, false) == WOULDBLOCK);
+    mu_assert("test_lossy_channel: Dropped count is not as expected", channel_dropped(channel) == 3);
+
+    /* A regular channel never drops */
+    chan_t* regular = channel_create(capacity);
+    mu_assert("test_lossy_channel: Send failed", channel_send(regular, "Message0", false) == SUCCESS);
+    mu_assert("test_lossy_channel: Send failed", channel_send(regular, "Message1", false) == SUCCESS);
+    mu_assert("test_lossy_channel: Send should block", channel_send(regular, "Message2", false) == WOULDBLOCK);
+    mu_assert("test_lossy_channel: Full channel ready for a send", !channel_ready(regular, true));
+    mu_assert("test_lossy_channel: Receive failed", channel_receive_seq(regular, &data, &seq, false) == SUCCESS);
+    mu_assert("test_lossy_channel: Received wrong sequence", seq == 0);
+    mu_assert("test_lossy_channel: Dropped count is not as expected", channel_dropped(regular) == 0);
+
+    channel_close(channel);
+    mu_assert("test_lossy_channel: Send should fail on closed channel", channel_send(channel, "Message6", true) == CLOSED_ERROR);
+    channel_destroy(channel);
+    channel_close(regular);
+    channel_destroy(regular);
+
+    return NULL;
+}
+
+typedef struct {
+    compact_channel_t *channel;
+    void *data;
+    enum chan_status out;
+} compact_args;
+
+void* helper_compact_send(compact_args *myargs) {
+    myargs->out = compact_channel_send(myargs->channel, myargs->data, true);
+    return NULL;
+}
+
+void* helper_compact_receive(compact_args *myargs) {
+    myargs->out = compact_channel_receive(myargs->channel, &myargs->data, true);
+    return NULL;
+}
+
+char* test_compact_channel() {
+    print_test_details(__func__, "Testing compact futex channel");
+
+    /* The compact channel must keep its control block under a cache line and
+     * behave exactly like a regular channel
+     */
+    mu_assert("test_compact_channel: Control block is larger than 64 bytes", sizeof(compact_channel_t) <= 64);
+    mu_assert("test_compact_channel: Unbuffered compact channels are not supported", compact_channel_create(0) == NULL);
+
+    size_t capacity = 2;
+    compact_channel_t* channel = compact_channel_create(capacity);
+    mu_assert("test_compact_channel: Could not create channel", channel != NULL);
+
+    void* data = NULL;
+    mu_assert("test_compact_channel: Receive should block", compact_channel_receive(channel, &data, false) == WOULDBLOCK);
+    mu_assert("test_compact_channel: Send failed", compact_channel_send(channel, "Message1", false) == SUCCESS);
+    mu_assert("test_compact_channel: Send failed", compact_channel_send(channel, "Message2", true) == SUCCESS);
+    mu_assert("test_compact_channel: Send should block", compact_channel_send(channel, "Message3", false) == WOULDBLOCK);
+
+    // blocked sender is released by a receive
+    pthread_t pid;
+    compact_args args = {channel, "Message3", OTHER_ERROR};
+    pthread_create(&pid, NULL, (void *)helper_compact_send, &args);
+    usleep(10000);
+    mu_assert("test_compact_channel: It isn't blocked as expected", args.out == OTHER_ERROR);
+    mu_assert("test_compact_channel: Receive failed", compact_channel_receive(channel, &data, true) == SUCCESS);
+    mu_assert("test_compact_channel: Received wrong message", string_equal(data, "Message1"));
+    pthread_join(pid, NULL);
+    mu_assert("test_compact_channel: Send failed", args.out == SUCCESS);
+    mu_assert("test_compact_channel: Receive failed", compact_channel_receive(channel, &data, false) == SUCCESS);
+    mu_assert("test_compact_channel: Received wrong message", string_equal(data, "Message2"));
+    mu_assert("test_compact_channel: Receive failed", compact_channel_receive(channel, &data, false) == SUCCESS);
+    mu_assert("test_compact_channel: Received wrong message", string_equal(data, "Message3"));
+
+    // blocked receivers are released by close
+    size_t RECEIVERS = 8;
+    pthread_t pids[RECEIVERS];
+    compact_args recv_args[RECEIVERS];
+    for (size_t i = 0; i < RECEIVERS; i++) {
+        recv_args[i].channel = channel;
+        recv_args[i].data = NULL;
+        recv_args[i].out = OTHER_ERROR;
+        pthread_create(&pids[i], NULL, (void *)helper_compact_receive, &recv_args[i]);
+    }
+    usleep(10000);
+    mu_assert("test_compact_channel: Destroy should fail on open channel", compact_channel_destroy(channel) == DESTROY_ERROR);
+    mu_assert("test_compact_channel: Close failed", compact_channel_close(channel) == SUCCESS);
+    for (size_t i = 0; i < RECEIVERS; i++) {
+        pthread_join(pids[i], NULL);
+        mu_assert("test_compact_channel: Receive should fail on closed channel", recv_args[i].out == CLOSED_ERROR);
+    }
+    mu_assert("test_compact_channel: Close should fail on closed channel", compact_channel_close(channel) == CLOSED_ERROR);
+    mu_assert("test_compact_channel: Send should fail on closed channel", compact_channel_send(channel, "Message4", true) == CLOSED_ERROR);
+    mu_assert("test_compact_channel: Destroy failed", compact_channel_destroy(channel) == SUCCESS);
+
+    return NULL;
+}
+
+char* test_idle_reclaim() {
+    print_test_details(__func__, "Testing lazy buffer allocation and idle reclamation");
+
+    /* Buffer storage is only allocated on the first send and released again once
+     * the channel stays empty for longer than its idle timeout
+     */
+    size_t capacity = 4;
+    chan_t* channel = channel_create(capacity);
+    void* data = NULL;
+
+    mu_assert("test_idle_reclaim: Buffer storage allocated before first send", channel->buffer->data == NULL);
+    mu_assert("test_idle_reclaim: Buffer capacity is not as expected", buffer_capacity(channel->buffer) == capacity);
+    mu_assert("test_idle_reclaim: Send failed", channel_send(channel, "Message1", true) == SUCCESS);
+    mu_assert("test_idle_reclaim: Buffer storage not allocated by send", channel->buffer->data != NULL);
+    mu_assert("test_idle_reclaim: Receive failed", channel_receive(channel, &data, true) == SUCCESS);
+    mu_assert("test_idle_reclaim: Received wrong message", string_equal(data, "Message1"));
+
+    // without an idle timeout the storage is kept
+    mu_assert("test_idle_reclaim: Reclaimed without idle timeout", channel_reclaim_idle(channel) == false);
+
+    channel_set_idle_timeout(channel, 5000);
+    mu_assert("test_idle_reclaim: Reclaimed before idle timeout", channel_reclaim_idle(channel) == false);
+    usleep(10000);
+    mu_assert("test_idle_reclaim: Reclaim failed", channel_reclaim_idle(channel) == true);
+    mu_assert("test_idle_reclaim: Buffer storage not released", channel->buffer->data == NULL);
+
+    // non-empty channels are never reclaimed
+    mu_assert("test_idle_reclaim: Send failed", channel_send(channel, "Message2", true) == SUCCESS);
+    usleep(10000);
+    mu_assert("test_idle_reclaim: Reclaimed non-empty channel", channel_reclaim_idle(channel) == false);
+    mu_assert("test_idle_reclaim: Receive failed", channel_receive(channel, &data, true) == SUCCESS);
+    mu_assert("test_idle_reclaim: Received wrong message", string_equal(data, "Message2"));
+
+    // a blocked receiver releases the storage of the idle channel on its own
+    pthread_t pid;
+    receive_args args;
+    init_object_for_receive_api(&args, channel, NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive, &args);
+    usleep(50000);
+    pthread_mutex_lock(&channel->mutex);
+    bool released = channel->buffer->data == NULL;
+    pthread_mutex_unlock(&channel->mutex);
+    mu_assert("test_idle_reclaim: Blocked receiver did not release storage", released);
+    mu_assert("test_idle_reclaim: Send failed", channel_send(channel, "Message3", true) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_idle_reclaim: Receive failed", args.out == SUCCESS);
+    mu_assert("test_idle_reclaim: Received wrong message", string_equal(args.data, "Message3"));
+
+    channel_close(channel);
+    channel_destroy(channel);
+
+    return NULL;
+}
+
+typedef struct {
+    int high;
+    int low;
+} watermark_counts;
+
+void helper_count_watermark(void* context, bool high) {
+    watermark_counts* counts = context;
+    if (high) {
+        counts->high++;
+    } else {
+        counts->low++;
+    }
+}
+
+char* test_watermarks() {
+    print_test_details(__func__, "Testing high/low watermark notifications");
+
+    /* Crossings are reported once per transition: rising to the high watermark
+     * and falling back to the low watermark, with nothing reported in between
+     */
+    size_t capacity = 8;
+    chan_t* channel = channel_create(capacity);
+    watermark_counts counts = {0, 0};
+    void* data = NULL;
+
+    mu_assert("test_watermarks: Invalid watermarks accepted", channel_set_watermarks(channel, 2, 2, helper_count_watermark, &counts) == OTHER_ERROR);
+    mu_assert("test_watermarks: Invalid watermarks accepted", channel_set_watermarks(channel, capacity + 1, 2, helper_count_watermark, &counts) == OTHER_ERROR);
+    mu_assert("test_watermarks: Setting watermarks failed", channel_set_watermarks(channel, 6, 2, helper_count_watermark, &counts) == SUCCESS);
+
+    for (size_t i = 0; i < 5; i++) {
+        mu_assert("test_watermarks: Send failed", channel_send(channel, "Message", true) == SUCCESS);
+    }
+    mu_assert("test_watermarks: Crossed high watermark too early", counts.high == 0);
+    mu_assert("test_watermarks: Send failed", channel_send(channel, "Message", true) == SUCCESS);
+    mu_assert("test_watermarks: High watermark not reported", counts.high == 1);
+
+    // oscillating around the high watermark is not reported again
+    mu_assert("test_watermarks: Receive failed", channel_receive(channel, &data, true) == SUCCESS);
+    mu_assert("test_watermarks: Send failed", channel_send(channel, "Message", true) == SUCCESS);
+    mu_assert("test_watermarks: Send failed", channel_send(channel, "Message", true) == SUCCESS);
+    mu_assert("test_watermarks: High watermark reported twice", counts.high == 1);
+    mu_assert("test_watermarks: Low watermark reported too early", counts.low == 0);
+
+    // drain down to the low watermark
+    for (size_t i = 0; i < 4; i++) {
+        mu_assert("test_watermarks: Receive failed", channel_receive(channel, &data, true) == SUCCESS);
+    }
+    mu_assert("test_watermarks: Low watermark reported too early", counts.low == 0);
+    mu_assert("test_watermarks: Receive failed", channel_receive(channel, &data, true) == SUCCESS);
+    mu_assert("test_watermarks: Low watermark not reported", counts.low == 1);
+    mu_assert("test_watermarks: Receive failed", channel_receive(channel, &data, true) == SUCCESS);
+    mu_assert("test_watermarks: Send failed", channel_send(channel, "Message", true) == SUCCESS);
+    mu_assert("test_watermarks: Low watermark reported twice", counts.low == 1);
+    mu_assert("test_watermarks: High watermark reported twice", counts.high == 1);
+
+    // crossings forwarded to a notification channel
+    while (channel_receive(channel, &data, false) == SUCCESS);
+    chan_t* notify = channel_create_lossy(1);
+    mu_assert("test_watermarks: Setting watermarks failed", channel_set_watermarks(channel, 3, 1, channel_watermark_notify, notify) == SUCCESS);
+    mu_assert("test_watermarks: Send failed", channel_send(channel, "Message", true) == SUCCESS);
+    mu_assert("test_watermarks: Send failed", channel_send(channel, "Message", true) == SUCCESS);
+    mu_assert("test_watermarks: Crossed high watermark too early", channel_receive(notify, &data, false) == WOULDBLOCK);
+    mu_assert("test_watermarks: Send failed", channel_send(channel, "Message", true) == SUCCESS);
+    mu_assert("test_watermarks: Receive failed", channel_receive(notify, &data, true) == SUCCESS);
+    mu_assert("test_watermarks: Wrong notification", data == CHANNEL_WATERMARK_HIGH);
+    mu_assert("test_watermarks: Receive failed", channel_receive(channel, &data, true) == SUCCESS);
+    mu_assert("test_watermarks: Receive failed", channel_receive(channel, &data, true) == SUCCESS);
+    mu_assert("test_watermarks: Receive failed", channel_receive(notify, &data, true) == SUCCESS);
+    mu_assert("test_watermarks: Wrong notification", data == CHANNEL_WATERMARK_LOW);
+
+    // disabled watermarks report nothing
+    mu_assert("test_watermarks: Clearing watermarks failed", channel_set_watermarks(channel, 0, 0, NULL, NULL) == SUCCESS);
+    for (size_t i = 0; i < 4; i++) {
+        mu_assert("test_watermarks: Send failed", channel_send(channel, "Message", true) == SUCCESS);
+    }
+    mu_assert("test_watermarks: Disabled watermark reported", channel_receive(notify, &data, false) == WOULDBLOCK);
+
+    channel_close(notify);
+    channel_destroy(notify);
+    channel_close(channel);
+    channel_destroy(channel);
+
+    return NULL;
+}
+
+char* test_socket_bridge() {
+    print_test_details(__func__, "Testing channel bridging over loopback UDP sockets");
+
+    /* Bridge a channel across two UDP sockets on the loopback interface,
+     * the datagram socketpair case is covered by test_stress_bridge
+     */
+    int fds[2];
+    struct sockaddr_in addr[2];
+    socklen_t len = sizeof(struct sockaddr_in);
+    for (size_t i = 0; i < 2; i++) {
+        fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+        mu_assert("test_socket_bridge: Could not create socket", fds[i] >= 0);
+        memset(&addr[i], 0, sizeof(struct sockaddr_in));
+        addr[i].sin_family = AF_INET;
+        addr[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr[i].sin_port = 0;
+        mu_assert("test_socket_bridge: Could not bind socket", bind(fds[i], (struct sockaddr*)&addr[i], len) == 0);
+        mu_assert("test_socket_bridge: Could not get socket address", getsockname(fds[i], (struct sockaddr*)&addr[i], &len) == 0);
+    }
+    mu_assert("test_socket_bridge: Could not connect socket", connect(fds[0], (struct sockaddr*)&addr[1], len) == 0);
+    mu_assert("test_socket_bridge: Could not connect socket", connect(fds[1], (struct sockaddr*)&addr[0], len) == 0);
+
+    size_t MESSAGES = 100;
+    mu_assert("test_socket_bridge: Created an empty message", bridge_msg_create("", 0) == NULL);
+    chan_t* in_channel = channel_create(MESSAGES + 2);
+    chan_t* out_channel = channel_create(MESSAGES + 1);
+    bridge_t* receiver = bridge_start_receiver(out_channel, fds[1], true);
+    mu_assert("test_socket_bridge: Could not start receiver", receiver != NULL);
+    // a datagram longer than BRIDGE_MAX_PAYLOAD is dropped by the receiver rather than delivered cut short
+    char* oversized = calloc(BRIDGE_MAX_PAYLOAD + 1, 1);
+    mu_assert("test_socket_bridge: Could not allocate payload", oversized != NULL);
+    mu_assert("test_socket_bridge: Could not send datagram", send(fds[0], oversized, BRIDGE_MAX_PAYLOAD + 1, 0) == BRIDGE_MAX_PAYLOAD + 1);
+    free(oversized);
+    char payload[32];
+    for (size_t i = 0; i < MESSAGES; i++) {
+        snprintf(payload, sizeof(payload), "Message%zu", i);
+        mu_assert("test_socket_bridge: Send failed", channel_send(in_channel, bridge_msg_create(payload, strlen(payload) + 1), true) == SUCCESS);
+        if (i == MESSAGES / 2) {
+            // an empty message is dropped by the sender, it would end the stream on the other side
+            bridge_msg_t* empty = malloc(sizeof(bridge_msg_t));
+            mu_assert("test_socket_bridge: Could not allocate message", empty != NULL);
+            empty->length = 0;
+            mu_assert("test_socket_bridge: Send failed", channel_send(in_channel, empty, true) == SUCCESS);
+        }
+    }
+    mu_assert("test_socket_bridge: Send failed", channel_send(in_channel, NULL, true) == SUCCESS);
+    // all messages are already waiting, so the sender moves them in batches
+    bridge_t* sender = bridge_start_sender(in_channel, fds[0], true);
+    mu_assert("test_socket_bridge: Could not start sender", sender != NULL);
+
+    for (size_t i = 0; i < MESSAGES; i++) {
+        void* data = NULL;
+        mu_assert("test_socket_bridge: Receive failed", channel_receive(out_channel, &data, true) == SUCCESS);
+        mu_assert("test_socket_bridge: Received end of stream too early", data != NULL);
+        bridge_msg_t* msg = data;
+        snprintf(payload, sizeof(payload), "Message%zu", i);
+        mu_assert("test_socket_bridge: Received wrong message", msg->length == strlen(payload) + 1 && string_equal(msg->data, payload));
+        free(msg);
+    }
+    void* data = "Message";
+    mu_assert("test_socket_bridge: Receive failed", channel_receive(out_channel, &data, true) == SUCCESS);
+    mu_assert("test_socket_bridge: End of stream not received", data == NULL);
+
+    bridge_stats_t sender_stats;
+    bridge_stats_t receiver_stats;
+    bridge_join(sender, &sender_stats);
+    bridge_join(receiver, &receiver_stats);
+    mu_assert("test_socket_bridge: Wrong sender message count", sender_stats.messages == MESSAGES);
+    mu_assert("test_socket_bridge: Wrong receiver message count", receiver_stats.messages == MESSAGES);
+    mu_assert("test_socket_bridge: Sender did not batch", sender_stats.syscalls < MESSAGES);
+    mu_assert("test_socket_bridge: Empty message not dropped", sender_stats.dropped == 1);
+    mu_assert("test_socket_bridge: Oversized datagram not dropped", receiver_stats.dropped == 1);
+
+    // a receiver whose socket fails still ends the stream, so the consumer is not left waiting
+    receiver = bridge_start_receiver(out_channel, -1, false);
+    mu_assert("test_socket_bridge: Could not start receiver", receiver != NULL);
+    data = "Message";
+    mu_assert("test_socket_bridge: Receive failed", channel_receive(out_channel, &data, true) == SUCCESS);
+    mu_assert("test_socket_bridge: End of stream not received after a socket error", data == NULL);
+    bridge_join(receiver, &receiver_stats);
+
+    channel_close(in_channel);
+    channel_destroy(in_channel);
+    channel_close(out_channel);
+    channel_destroy(out_channel);
+    close(fds[0]);
+    close(fds[1]);
+
+    return NULL;
+}
+
+char* test_stress_bridge() {
+    print_test_details(__func__, "Benchmarking batched and unbatched socket bridges");
+
+    size_t MESSAGES = 20000;
+    size_t MESSAGE_SIZE = 64;
+    size_t single_syscalls = 0;
+    size_t batched_syscalls = 0;
+    double single_rate = run_stress_bridge(MESSAGES, MESSAGE_SIZE, false, &single_syscalls);
+    double batched_rate = run_stress_bridge(MESSAGES, MESSAGE_SIZE, true, &batched_syscalls);
+    printf("one syscall per message: %.0f msgs/sec, %zu syscalls\n", single_rate, single_syscalls);
+    printf("sendmmsg/recvmmsg: %.0f msgs/sec, %zu syscalls\n", batched_rate, batched_syscalls);
+    mu_assert("test_stress_bridge: Unbatched bridge did not use one syscall per message", single_syscalls >= 2 * MESSAGES);
+    mu_assert("test_stress_bridge: Batched bridge did not save syscalls", batched_syscalls < single_syscalls);
+
+    return NULL;
+}
+
+void* helper_replay_create_fail(size_t size) {
+    return NULL;
+}
+
+char* test_record_replay() {
+    print_test_details(__func__, "Testing channel traffic record and replay");
+
+    /* Record a producer/consumer pair, then replay the trace against both channel backends
+     */
+    size_t MESSAGES = 200;
+    size_t capacity = 4;
+    char filename[] = "/tmp/channel_traceXXXXXX";
+    int fd = mkstemp(filename);
+    mu_assert("test_record_replay: Could not create trace file", fd >= 0);
+    close(fd);
+
+    recorder_t* recorder = recorder_create(4 * MESSAGES, 1);
+    mu_assert("test_record_replay: Could not create recorder", recorder != NULL);
+    chan_t* channel = channel_create(capacity);
+    mu_assert("test_record_replay: Could not attach channel", recorder_attach(recorder, channel) == SUCCESS);
+    mu_assert("test_record_replay: Attached too many channels", recorder_attach(recorder, channel) == OTHER_ERROR);
+
+    pthread_t pid;
+    receive_args args[MESSAGES];
+    for (size_t i = 0; i < MESSAGES; i++) {
+        init_object_for_receive_api(&args[i], channel, NULL);
+    }
+    pthread_create(&pid, NULL, (void *)helper_receive, &args[0]);
+    for (size_t i = 0; i < MESSAGES; i++) {
+        mu_assert("test_record_replay: Send failed", channel_send(channel, "Message", true) == SUCCESS);
+        if (i + 1 < MESSAGES) {
+            // the receiver drains on its own thread, one receive per message
+            pthread_join(pid, NULL);
+            pthread_create(&pid, NULL, (void *)helper_receive, &args[i + 1]);
+        }
+    }
+    pthread_join(pid, NULL);
+    mu_assert("test_record_replay: Close failed", channel_close(channel) == SUCCESS);
+    channel_destroy(channel);
+    mu_assert("test_record_replay: Records dropped", recorder_dropped(recorder) == 0);
+    mu_assert("test_record_replay: Could not write trace", recorder_finish(recorder, filename));
+
+    trace_t* trace = trace_load(filename);
+    mu_assert("test_record_replay: Could not load trace", trace != NULL);
+    mu_assert("test_record_replay: Wrong number of channels", trace->num_channels == 1 && trace->capacities[0] == capacity);
+    mu_assert("test_record_replay: Wrong number of records", trace->num_records == 2 * MESSAGES + 1);
+    size_t sends = 0;
+    size_t receives = 0;
+    size_t closes = 0;
+    for (size_t i = 0; i < trace->num_records; i++) {
+        record_t* record = &trace->records[i];
+        mu_assert("test_record_replay: Wrong status", record->status == SUCCESS);
+        mu_assert("test_record_replay: Wrong timing", record->start <= record->end);
+        mu_assert("test_record_replay: Wrong size", record->size <= capacity);
+        sends += record->op == RECORD_SEND;
+        receives += record->op == RECORD_RECEIVE;
+        closes += record->op == RECORD_CLOSE;
+    }
+    mu_assert("test_record_replay: Wrong operations", sends == MESSAGES && receives == MESSAGES && closes == 1);
+
+    replay_result_t result;
+    mu_assert("test_record_replay: Replay failed", replay_trace(trace, &replay_channel_backend, true, 1000000, &result));
+    mu_assert("test_record_replay: Wrong number of replayed operations", result.operations == trace->num_records);
+    mu_assert("test_record_replay: Replay diverged from trace", result.mismatches == 0);
+    mu_assert("test_record_replay: Replay failed", replay_trace(trace, &replay_compact_channel_backend, false, 1000000, &result));
+    mu_assert("test_record_replay: Wrong number of replayed operations", result.operations == trace->num_records);
+    mu_assert("test_record_replay: Replay diverged from trace", result.mismatches == 0);
+    trace_free(trace);
+
+    // a trace whose counts do not fit in the file, or with a thread id beyond its records, is rejected
+    FILE* file = fopen(filename, "r+b");
+    mu_assert("test_record_replay: Could not open trace file", file != NULL);
+    uint64_t num_records = 1000000000;
+    mu_assert("test_record_replay: Could not corrupt trace", fseek(file, 16, SEEK_SET) == 0 && fwrite(&num_records, sizeof(num_records), 1, file) == 1);
+    fclose(file);
+    mu_assert("test_record_replay: Loaded a trace with a corrupted header", trace_load(filename) == NULL);
+    file = fopen(filename, "r+b");
+    mu_assert("test_record_replay: Could not open trace file", file != NULL);
+    num_records = 2 * MESSAGES + 1;
+    uint32_t thread = (uint32_t)num_records;
+    long record_offset = 24 + (long)sizeof(uint64_t) + (long)offsetof(record_t, thread);
+    mu_assert("test_record_replay: Could not corrupt trace", fseek(file, 16, SEEK_SET) == 0 && fwrite(&num_records, sizeof(num_records), 1, file) == 1);
+    mu_assert("test_record_replay: Could not corrupt trace", fseek(file, record_offset, SEEK_SET) == 0 && fwrite(&thread, sizeof(thread), 1, file) == 1);
+    fclose(file);
+    mu_assert("test_record_replay: Loaded a trace with an invalid thread", trace_load(filename) == NULL);
+
+    // a recorder allocated where a freed one was must not inherit the thread ids that the freed one handed out
+    recorder = recorder_create(2, 1);
+    mu_assert("test_record_replay: Could not create recorder", recorder != NULL);
+    channel = channel_create(capacity);
+    mu_assert("test_record_replay: Could not attach channel", recorder_attach(recorder, channel) == SUCCESS);
+    send_args send;
+    init_object_for_send_api(&send, channel, "Message", NULL);
+    pthread_create(&pid, NULL, (void *)helper_send, &send);
+    pthread_join(pid, NULL);
+    void* data = NULL;
+    mu_assert("test_record_replay: Receive failed", channel_receive(channel, &data, true) == SUCCESS);
+    channel_close(channel);
+    channel_destroy(channel);
+    mu_assert("test_record_replay: Could not write trace", recorder_finish(recorder, filename));
+    trace = trace_load(filename);
+    mu_assert("test_record_replay: Could not load trace", trace != NULL && trace->num_records == 2);
+    mu_assert("test_record_replay: Two threads share an id", trace->records[0].thread != trace->records[1].thread);
+    trace_free(trace);
+    recorder = recorder_create(1, 1);
+    mu_assert("test_record_replay: Could not create recorder", recorder != NULL);
+    channel = channel_create(capacity);
+    mu_assert("test_record_replay: Could not attach channel", recorder_attach(recorder, channel) == SUCCESS);
+    mu_assert("test_record_replay: Send failed", channel_send(channel, "Message", true) == SUCCESS);
+    channel_close(channel);
+    channel_destroy(channel);
+    mu_assert("test_record_replay: Could not write trace", recorder_finish(recorder, filename));
+    trace = trace_load(filename);
+    mu_assert("test_record_replay: Could not load trace", trace != NULL && trace->num_records == 1);
+    mu_assert("test_record_replay: Thread id carried over from a freed recorder", trace->records[0].thread == 0);
+
+    // a replay whose channels cannot be created fails without issuing any operation
+    replay_backend_t failing = replay_channel_backend;
+    failing.create = helper_replay_create_fail;
+    mu_assert("test_record_replay: Replay without channels succeeded", !replay_trace(trace, &failing, false, 1000000, &result));
+    mu_assert("test_record_replay: Operations replayed without channels", result.operations == 0);
+    trace_free(trace);
+
+    // a trace with an unbuffered channel is rejected, since no backend can create it
+    file = fopen(filename, "r+b");
+    mu_assert("test_record_replay: Could not open trace file", file != NULL);
+    uint64_t zero_capacity = 0;
+    mu_assert("test_record_replay: Could not corrupt trace", fseek(file, 24, SEEK_SET) == 0 && fwrite(&zero_capacity, sizeof(zero_capacity), 1, file) == 1);
+    fclose(file);
+    mu_assert("test_record_replay: Loaded a trace with an unbuffered channel", trace_load(filename) == NULL);
+
+    unlink(filename);
+    return NULL;
+}
+
+char* test_partition() {
+    print_test_details(__func__, "Testing graph partitioning");
+
+    // two 5-cliques joined by a single edge must be split along that edge
+    size_t VERTICES = 10;
+    size_t offsets[VERTICES + 1];
+    size_t neighbors[VERTICES * VERTICES];
+    size_t vertices[VERTICES];
+    size_t parts[VERTICES];
+    size_t edges = 0;
+    for (size_t v = 0; v < VERTICES; v++) {
+        // interleave the cliques so that the initial breadth-first chunks are not already the answer
+        offsets[v] = edges;
+        vertices[v] = v;
+        for (size_t u = 0; u < VERTICES; u++) {
+            bool same_clique = (u % 2) == (v % 2);
+            bool bridge = (u == 0 && v == 1) || (u == 1 && v == 0);
+            if (u != v && (same_clique || bridge)) {
+                neighbors[edges++] = u;
+            }
+        }
+    }
+    offsets[VERTICES] = edges;
+
+    partition_graph(VERTICES, offsets, neighbors, vertices, VERTICES, 2, parts);
+    mu_assert("test_partition: Wrong cut", partition_cut(VERTICES, offsets, neighbors, vertices, VERTICES, parts) == 2);
+    size_t size = 0;
+    for (size_t v = 0; v < VERTICES; v++) {
+        mu_assert("test_partition: Invalid part", parts[v] < 2);
+        mu_assert("test_partition: Clique was split", parts[v] == parts[v % 2]);
+        size += parts[v];
+    }
+    mu_assert("test_partition: Parts are not balanced", size == VERTICES / 2);
+
+    // a subset only sees its own edges
+    size_t odd[] = {1, 3, 5, 7, 9};
+    partition_graph(VERTICES, offsets, neighbors, odd, 5, 5, parts);
+    mu_assert("test_partition: Wrong cut", partition_cut(VERTICES, offsets, neighbors, odd, 5, parts) == 20);
+
+    return NULL;
+}
+
+char* test_stress_partitioned() {
+    print_test_details(__func__, "Benchmarking partition-aware placement of routers");
+
+    size_t CORES = 4;
+    stress_options_t round_robin = {STRESS_SCHEDULE_ROUND_ROBIN, CORES};
+    stress_options_t partitioned = {STRESS_SCHEDULE_PARTITIONED, CORES};
+    stress_stats_t round_robin_stats;
+    stress_stats_t partitioned_stats;
+    run_stress_with_options(1, 1, "big_graph.txt", &round_robin, &round_robin_stats);
+    run_stress_with_options(1, 1, "big_graph.txt", &partitioned, &partitioned_stats);
+    printf("round robin: %zu cut links, %.3f cross-core messages, converged in %.3f sec\n", round_robin_stats.cut_links,
+           (double)round_robin_stats.cross_core_messages / (double)round_robin_stats.messages, round_robin_stats.convergence_time);
+    printf("partitioned: %zu cut links, %.3f cross-core messages, converged in %.3f sec\n", partitioned_stats.cut_links,
+           (double)partitioned_stats.cross_core_messages / (double)partitioned_stats.messages, partitioned_stats.convergence_time);
+    mu_assert("test_stress_partitioned: Partitioning cut more links than round robin", partitioned_stats.cut_links < round_robin_stats.cut_links);
+
+    return NULL;
+}
+
+char* test_stress_prioritized() {
+    print_test_details(__func__, "Benchmarking worklist-ordered router broadcasts");
+
+    const char* TOPOLOGIES[] = {"topology.txt", "connected_topology.txt", "random_topology.txt", "random_topology_1.txt", "big_graph.txt"};
+    stress_options_t free_running = {STRESS_SCHEDULE_FREE, 0, STRESS_ORDER_FREE, 0};
+    stress_options_t improvement = {STRESS_SCHEDULE_FREE, 0, STRESS_ORDER_IMPROVEMENT, 0};
+    stress_options_t distance = {STRESS_SCHEDULE_FREE, 0, STRESS_ORDER_DISTANCE, 0};
+    // every order must converge to the right solution, which run_stress checks
+    for (size_t i = 0; i < sizeof(TOPOLOGIES) / sizeof(TOPOLOGIES[0]); i++) {
+        run_stress_with_options(1, 1, TOPOLOGIES[i], &improvement, NULL);
+        run_stress_with_options(1, 1, TOPOLOGIES[i], &distance, NULL);
+    }
+
+    stress_stats_t free_stats;
+    stress_stats_t improvement_stats;
+    stress_stats_t distance_stats;
+    run_stress_with_options(1, 1, "big_graph.txt", &free_running, &free_stats);
+    run_stress_with_options(1, 1, "big_graph.txt", &improvement, &improvement_stats);
+    run_stress_with_options(1, 1, "big_graph.txt", &distance, &distance_stats);
+    printf("free running: %zu messages, %zu relaxations, converged in %.3f sec\n", free_stats.messages, free_stats.relaxations,
+           free_stats.convergence_time);
+    printf("by improvement: %zu messages, %zu relaxations, converged in %.3f sec\n", improvement_stats.messages,
+           improvement_stats.relaxations, improvement_stats.convergence_time);
+    printf("by distance: %zu messages, %zu relaxations, converged in %.3f sec\n", distance_stats.messages, distance_stats.relaxations,
+           distance_stats.convergence_time);
+
+    // how many messages the orders save depends on the scheduling of the routers, so only the bounds that hold for any
+    // interleaving are checked: every router sends its vector over each of its links, every distance without a direct
+    // link is lowered at least once, and a vector lowers at most one distance per other router
+    FILE* in = fopen("big_graph.txt", "r");
+    mu_assert("test_stress_prioritized: Could not open topology", in != NULL);
+    size_t n;
+    mu_assert("test_stress_prioritized: Could not read topology", fscanf(in, "%zu", &n) == 1);
+    size_t links = 0;
+    size_t missing = 0;
+    for (size_t i = 0; i < n * n; i++) {
+        int distance;
+        mu_assert("test_stress_prioritized: Could not read topology", fscanf(in, "%d", &distance) == 1);
+        if (i / n != i % n) {
+            links += distance >= 0;
+            missing += distance < 0;
+        }
+    }
+    fclose(in);
+    stress_stats_t* all_stats[] = {&free_stats, &improvement_stats, &distance_stats};
+    for (size_t i = 0; i < 3; i++) {
+        mu_assert("test_stress_prioritized: Fewer messages than links", all_stats[i]->messages >= links);
+        mu_assert("test_stress_prioritized: Distances were not relaxed", all_stats[i]->relaxations >= missing);
+        mu_assert("test_stress_prioritized: Too many relaxations", all_stats[i]->relaxations <= all_stats[i]->messages * (n - 1));
+    }
+
+    return NULL;
+}
+
+char* test_stress_lean_validation() {
+    print_test_details(__func__, "Testing validation without a precomputed solution");
+
+    const char* TOPOLOGIES[] = {"topology.txt", "connected_topology.txt", "random_topology.txt", "random_topology_1.txt", "big_graph.txt"};
+    stress_options_t dense = {STRESS_SCHEDULE_FREE, 0, STRESS_ORDER_FREE, 0, false};
+    stress_options_t lean = {STRESS_SCHEDULE_FREE, 0, STRESS_ORDER_FREE, 0, true};
+    // run_stress asserts that every converged vector matches the shortest paths
+    for (size_t i = 0; i < sizeof(TOPOLOGIES) / sizeof(TOPOLOGIES[0]); i++) {
+        run_stress_with_options(1, 1, TOPOLOGIES[i], &lean, NULL);
+    }
+
+    stress_stats_t dense_stats;
+    stress_stats_t lean_stats;
+    run_stress_with_options(1, 1, "big_graph.txt", &dense, &dense_stats);
+    run_stress_with_options(1, 1, "big_graph.txt", &lean, &lean_stats);
+    printf("dense: %zu topology bytes, converged in %.3f sec\n", dense_stats.topology_bytes, dense_stats.convergence_time);
+    printf("lean: %zu topology bytes, converged in %.3f sec\n", lean_stats.topology_bytes, lean_stats.convergence_time);
+    mu_assert("test_stress_lean_validation: Lean topology is not smaller", lean_stats.topology_bytes < dense_stats.topology_bytes);
+
+    return NULL;
+}
+
+char* test_stress_snapshot() {
+    print_test_details(__func__, "Testing warm starts of routers from a snapshot");
+
+    char snapshot[] = "/tmp/stress_snapshotXXXXXX";
+    char changed[] = "/tmp/stress_topologyXXXXXX";
+    int fd = mkstemp(snapshot);
+    mu_assert("test_stress_snapshot: Could not create snapshot file", fd >= 0);
+    close(fd);
+    fd = mkstemp(changed);
+    mu_assert("test_stress_snapshot: Could not create topology file", fd >= 0);
+    close(fd);
+
+    // the changed topology drops one link and adds another, in both directions
+    FILE* in = fopen("big_graph.txt", "r");
+    mu_assert("test_stress_snapshot: Could not open topology", in != NULL);
+    size_t n;
+    mu_assert("test_stress_snapshot: Could not read topology", fscanf(in, "%zu", &n) == 1);
+    int* links = malloc(sizeof(int) * n * n);
+    mu_assert("test_stress_snapshot: Could not allocate topology", links != NULL);
+    for (size_t i = 0; i < n * n; i++) {
+        mu_assert("test_stress_snapshot: Could not read topology", fscanf(in, "%d", &links[i]) == 1);
+    }
+    fclose(in);
+    bool removed = false;
+    bool added = false;
+    for (size_t src = 0; src < n; src++) {
+        for (size_t dst = src + 1; dst < n; dst++) {
+            if (!removed && links[src * n + dst] >= 0) {
+                links[src * n + dst] = links[dst * n + src] = -1;
+                removed = true;
+            } else if (!added && links[src * n + dst] < 0 && src > n / 2) {
+                links[src * n + dst] = links[dst * n + src] = 1;
+                added = true;
+            }
+        }
+    }
+    FILE* out = fopen(changed, "w");
+    mu_assert("test_stress_snapshot: Could not open topology file", out != NULL);
+    fprintf(out, "%zu\n", n);
+    for (size_t src = 0; src < n; src++) {
+        for (size_t dst = 0; dst < n; dst++) {
+            fprintf(out, " %d", links[src * n + dst]);
+        }
+        fprintf(out, "\n");
+    }
+    fclose(out);
+    free(links);
+
+    stress_options_t save = {STRESS_SCHEDULE_FREE, 0, STRESS_ORDER_FREE, 0, false, NULL, snapshot};
+    stress_options_t cold = {STRESS_SCHEDULE_FREE, 0, STRESS_ORDER_FREE, 0, false, NULL, NULL};
+    stress_options_t warm = {STRESS_SCHEDULE_FREE, 0, STRESS_ORDER_FREE, 0, false, snapshot, NULL};
+    stress_options_t warm_lean = {STRESS_SCHEDULE_FREE, 0, STRESS_ORDER_FREE, 0, true, snapshot, NULL};
+    stress_stats_t cold_stats;
+    stress_stats_t warm_stats;
+    run_stress_with_options(1, 1, "big_graph.txt", &save, NULL);
+
+    // nothing changed, so nothing has to be sent
+    run_stress_with_options(1, 1, "big_graph.txt", &warm, &warm_stats);
+    mu_assert("test_stress_snapshot: Routers restarted without changes", warm_stats.restarted_routers == 0);
+    mu_assert("test_stress_snapshot: Messages sent without changes", warm_stats.messages == 0);
+
+    // run_stress asserts that the warm routers converge to the shortest paths of the changed topology
+    run_stress_with_options(1, 1, changed, &cold, &cold_stats);
+    run_stress_with_options(1, 1, changed, &warm, &warm_stats);
+    printf("cold start: %zu routers, %zu messages, converged in %.3f sec\n", cold_stats.restarted_routers, cold_stats.messages,
+           cold_stats.convergence_time);
+    printf("warm start: %zu routers, %zu messages, converged in %.3f sec\n", warm_stats.restarted_routers, warm_stats.messages,
+           warm_stats.convergence_time);
+    mu_assert("test_stress_snapshot: Every router restarted", warm_stats.restarted_routers < cold_stats.restarted_routers);
+    mu_assert("test_stress_snapshot: Warm start did not save messages", warm_stats.messages < cold_stats.messages);
+    run_stress_with_options(1, 1, changed, &warm_lean, NULL);
+
+    unlink(snapshot);
+    unlink(changed);
+    return NULL;
+}
+
+char* test_stress_latency() {
+    print_test_details(__func__, "Benchmarking busy-poll against parking hand-off latency");
+
+    size_t MESSAGES = 2000;
+    // pin the consumer to the last CPU the process may run on
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    size_t cpu = 0;
+    for (size_t i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &allowed)) {
+            cpu = i;
+        }
+    }
+    const char* NAMES[] = {"parked receive", "busy receive", "parked select", "busy select"};
+    for (size_t mode = 0; mode < 4; mode++) {
+        latency_options_t options = {mode % 2 == 1, mode >= 2, &cpu, 1};
+        latency_percentiles_t result;
+        run_stress_latency(MESSAGES, 20, &options, &result);
+        printf("%s: p50 %" PRIu64 " ns, p90 %" PRIu64 " ns, p99 %" PRIu64 " ns, p99.9 %" PRIu64 " ns, max %" PRIu64 " ns\n", NAMES[mode], result.p50, result.p90,
+               result.p99, result.p999, result.max);
+        mu_assert("test_stress_latency: Percentiles out of order", result.p50 <= result.p90 && result.p90 <= result.p99 &&
+                                                                     result.p99 <= result.p999 && result.p999 <= result.max);
+    }
+
+    return NULL;
+}
+
+char* test_busy_poll() {
+    print_test_details(__func__, "Testing busy-poll receive and select");
+
+    size_t capacity = 4;
+    chan_t* channel = channel_create(capacity);
+    chan_t* other = channel_create(capacity);
+    void* data = NULL;
+    mu_assert("test_busy_poll: Send failed", channel_send(channel, "Message", true) == SUCCESS);
+    mu_assert("test_busy_poll: Busy receive failed", channel_receive_busy(channel, &data) == SUCCESS);
+    mu_assert("test_busy_poll: Wrong message", strcmp(data, "Message") == 0);
+
+    // busy select picks the ready entry only
+    select_t list[2];
+    list[0].channel = other;
+    list[0].is_send = false;
+    list[1].channel = channel;
+    list[1].is_send = true;
+    list[1].data = "Selected";
+    size_t selected_index = 0;
+    mu_assert("test_busy_poll: Busy select failed", channel_select_busy(2, list, &selected_index) == SUCCESS);
+    mu_assert("test_busy_poll: Wrong index", selected_index == 1);
+    mu_assert("test_busy_poll: Receive failed", channel_receive(channel, &data, false) == SUCCESS);
+    mu_assert("test_busy_poll: Wrong message", strcmp(data, "Selected") == 0);
+
+    // a spinning receiver returns once a message arrives, and once the channel is closed
+    pthread_t pid;
+    receive_args args;
+    init_object_for_receive_api(&args, channel, NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive_busy, &args);
+    mu_assert("test_busy_poll: Send failed", channel_send(channel, "Spun", true) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_busy_poll: Busy receive failed", args.out == SUCCESS);
+    mu_assert("test_busy_poll: Wrong message", strcmp(args.data, "Spun") == 0);
+    pthread_create(&pid, NULL, (void *)helper_receive_busy, &args);
+    mu_assert("test_busy_poll: Close failed", channel_close(channel) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_busy_poll: Busy receive did not see the close", args.out == CLOSED_ERROR);
+    mu_assert("test_busy_poll: Busy select did not see the close", channel_select_busy(2, list, &selected_index) == CLOSED_ERROR);
+    mu_assert("test_busy_poll: Wrong index", selected_index == 1);
+
+    channel_destroy(channel);
+    channel_close(other);
+    channel_destroy(other);
+    return NULL;
+}
+
+char* test_stress_oversubscribed() {
+    print_test_details(__func__, "Benchmarking wait strategies with more threads than CPUs");
+
+    size_t MESSAGES = 20000;
+    size_t OVERSUBSCRIPTION[] = {1, 4, 16};
+    enum chan_wait STRATEGIES[] = {CHANNEL_WAIT_PARK, CHANNEL_WAIT_SPIN, CHANNEL_WAIT_YIELD, CHANNEL_WAIT_ADAPTIVE};
+    const char* NAMES[] = {"park", "spin", "yield", "adaptive"};
+    for (size_t i = 0; i < sizeof(OVERSUBSCRIPTION) / sizeof(OVERSUBSCRIPTION[0]); i++) {
+        double park_rate = 0;
+        for (size_t s = 0; s < sizeof(STRATEGIES) / sizeof(STRATEGIES[0]); s++) {
+            double rate = run_stress_oversubscribed(OVERSUBSCRIPTION[i], STRATEGIES[s], MESSAGES);
+            printf("%zux oversubscribed, %s: %.0f messages/sec\n", OVERSUBSCRIPTION[i], NAMES[s], rate);
+            if (STRATEGIES[s] == CHANNEL_WAIT_PARK) {
+                park_rate = rate;
+            }
+            if (STRATEGIES[s] == CHANNEL_WAIT_ADAPTIVE) {
+                mu_assert("test_stress_oversubscribed: Adaptive waits collapsed", rate > park_rate / 4);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+// Records the completion of an asynchronous operation
+typedef struct {
+    enum chan_status status;
+    void* data;
+    size_t calls;
+} async_result_t;
+
+void helper_async_complete(void* context, enum chan_status status, void* data) {
+    async_result_t* result = context;
+    result->status = status;
+    result->data = data;
+    __atomic_add_fetch(&result->calls, 1, __ATOMIC_RELEASE);
+}
+
+// Event loop state of a receiver that re-arms its asynchronous receive from the completion callback
+typedef struct {
+    chan_t* channel;
+    size_t messages;
+    size_t received;
+    size_t closed;
+} async_loop_t;
+
+void helper_async_loop(void* context, enum chan_status status, void* data) {
+    async_loop_t* loop = context;
+    (void)data;
+    if (status != SUCCESS) {
+        __atomic_store_n(&loop->closed, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    __atomic_add_fetch(&loop->received, 1, __ATOMIC_RELEASE);
+    if (channel_receive_async(loop->channel, helper_async_loop, loop) == CLOSED_ERROR) {
+        __atomic_store_n(&loop->closed, 1, __ATOMIC_RELEASE);
+    }
+}
+
+void* helper_async_producer(void* arg) {
+    async_loop_t* loop = arg;
+    for (size_t i = 0; i < loop->messages; i++) {
+        channel_send(loop->channel, "Looped", true);
+    }
+    return NULL;
+}
+
+char* test_async() {
+    print_test_details(__func__, "Testing asynchronous callback-based send and receive");
+
+    chan_t* channel = channel_create(1);
+    async_result_t receive = {0};
+    async_result_t send = {0};
+
+    // a registered receive is completed by the next send
+    mu_assert("test_async: Receive was not registered", channel_receive_async(channel, helper_async_complete, &receive) == WOULDBLOCK);
+    mu_assert("test_async: Callback invoked early", receive.calls == 0);
+    mu_assert("test_async: Send failed", channel_send(channel, "First", true) == SUCCESS);
+    mu_assert("test_async: Receive not completed", receive.calls == 1 && receive.status == SUCCESS);
+    mu_assert("test_async: Wrong message", strcmp(receive.data, "First") == 0);
+    mu_assert("test_async: Message left in channel", channel_receive(channel, &receive.data, false) == WOULDBLOCK);
+
+    // a send that completes right away invokes its callback on the caller, a send on the full channel waits for a receive
+    mu_assert("test_async: Send not immediate", channel_send_async(channel, "Second", helper_async_complete, &send) == SUCCESS);
+    mu_assert("test_async: Send not completed", send.calls == 1 && send.status == SUCCESS);
+    mu_assert("test_async: Send was not registered", channel_send_async(channel, "Third", helper_async_complete, &send) == WOULDBLOCK);
+    mu_assert("test_async: Callback invoked early", send.calls == 1);
+    void* data = NULL;
+    mu_assert("test_async: Receive failed", channel_receive(channel, &data, true) == SUCCESS);
+    mu_assert("test_async: Wrong message", strcmp(data, "Second") == 0);
+    mu_assert("test_async: Send not completed", send.calls == 2 && send.status == SUCCESS);
+    mu_assert("test_async: Wrong message", strcmp(send.data, "Third") == 0);
+
+    // an immediate receive takes the waiting message
+    mu_assert("test_async: Receive not immediate", channel_receive_async(channel, helper_async_complete, &receive) == SUCCESS);
+    mu_assert("test_async: Receive not completed", receive.calls == 2 && strcmp(receive.data, "Third") == 0);
+
+    // close fails the registered operations, handing unsent messages back
+    mu_assert("test_async: Send not immediate", channel_send_async(channel, "Fourth", helper_async_complete, &send) == SUCCESS);
+    mu_assert("test_async: Send was not registered", channel_send_async(channel, "Fifth", helper_async_complete, &send) == WOULDBLOCK);
+    mu_assert("test_async: Close failed", channel_close(channel) == SUCCESS);
+    mu_assert("test_async: Send not failed", send.calls == 4 && send.status == CLOSED_ERROR);
+    mu_assert("test_async: Wrong message", strcmp(send.data, "Fifth") == 0);
+    mu_assert("test_async: Closed channel accepted a send", channel_send_async(channel, "Sixth", helper_async_complete, &send) == CLOSED_ERROR);
+    mu_assert("test_async: Closed channel accepted a receive", channel_receive_async(channel, helper_async_complete, &receive) == CLOSED_ERROR);
+    mu_assert("test_async: Callback invoked on error", send.calls == 4 && receive.calls == 2);
+    channel_destroy(channel);
+
+    channel = channel_create(1);
+    mu_assert("test_async: Receive was not registered", channel_receive_async(channel, helper_async_complete, &receive) == WOULDBLOCK);
+    mu_assert("test_async: Close failed", channel_close(channel) == SUCCESS);
+    mu_assert("test_async: Receive not failed", receive.calls == 3 && receive.status == CLOSED_ERROR);
+    channel_destroy(channel);
+
+    // an event loop receives every message of a producer thread without blocking or owning a thread
+    size_t MESSAGES = 10000;
+    channel = channel_create(4);
+    async_loop_t loop = {channel, MESSAGES, 0, 0};
+    mu_assert("test_async: Receive was not registered", channel_receive_async(channel, helper_async_loop, &loop) == WOULDBLOCK);
+    pthread_t pid;
+    pthread_create(&pid, NULL, helper_async_producer, &loop);
+    pthread_join(pid, NULL);
+    mu_assert("test_async: Messages lost", __atomic_load_n(&loop.received, __ATOMIC_ACQUIRE) == MESSAGES);
+    mu_assert("test_async: Close failed", channel_close(channel) == SUCCESS);
+    mu_assert("test_async: Loop did not see the close", __atomic_load_n(&loop.closed, __ATOMIC_ACQUIRE) == 1);
+    channel_destroy(channel);
+
+    return NULL;
+}
+
+// Arguments of a producer that sends its numbers on a per-CPU channel
+typedef struct {
+    chan_t* channel;
+    size_t first;
+    size_t count;
+} percpu_producer_t;
+
+void* helper_percpu_producer(void* arg) {
+    percpu_producer_t* producer = arg;
+    for (size_t i = 0; i < producer->count; i++) {
+        channel_send_percpu(producer->channel, (void*)(producer->first + i), true);
+    }
+    return NULL;
+}
+
+char* test_percpu_channel() {
+    print_test_details(__func__, "Testing per-CPU channel lanes");
+
+    mu_assert("test_percpu_channel: Empty lanes accepted", channel_create_percpu(4, 0) == NULL);
+
+    // messages sent on the lanes are received through the usual calls, in order for a single producer that stays on
+    // one lane, so the thread is pinned to its current CPU until the ordered checks are done
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    cpu_set_t pinned;
+    CPU_ZERO(&pinned);
+    int cpu = sched_getcpu();
+    mu_assert("test_percpu_channel: Could not read the current CPU", cpu >= 0);
+    CPU_SET((size_t)cpu, &pinned);
+    mu_assert("test_percpu_channel: Could not pin the thread", sched_setaffinity(0, sizeof(pinned), &pinned) == 0);
+    chan_t* channel = channel_create_percpu(2, 3);
+    void* data = NULL;
+    for (size_t i = 1; i <= 6; i++) {
+        mu_assert("test_percpu_channel: Send failed", channel_send_percpu(channel, (void*)i, false) == SUCCESS);
+    }
+    for (size_t i = 1; i <= 6; i++) {
+        mu_assert("test_percpu_channel: Receive failed", channel_receive(channel, &data, false) == SUCCESS);
+        mu_assert("test_percpu_channel: Wrong message", (size_t)data == i);
+    }
+    mu_assert("test_percpu_channel: Message left in channel", channel_receive(channel, &data, false) == WOULDBLOCK);
+
+    // once the lane (rounded up to 4) and the buffer are full, sends would block
+    size_t sent = 0;
+    while (channel_send_percpu(channel, (void*)(sent + 1), false) == SUCCESS) {
+        sent++;
+        mu_assert("test_percpu_channel: Channel never filled", sent <= 6);
+    }
+    mu_assert("test_percpu_channel: Wrong capacity", sent == 6);
+
+    // select and busy receive see messages still on a lane
+    select_t list[1];
+    list[0].channel = channel;
+    list[0].is_send = false;
+    size_t selected_index = 1;
+    mu_assert("test_percpu_channel: Select failed", channel_select(1, list, &selected_index) == SUCCESS);
+    mu_assert("test_percpu_channel: Wrong message", selected_index == 0 && (size_t)list[0].data == 1);
+    for (size_t i = 2; i <= sent; i++) {
+        mu_assert("test_percpu_channel: Busy receive failed", channel_receive_busy(channel, &data) == SUCCESS);
+        mu_assert("test_percpu_channel: Wrong message", (size_t)data == i);
+    }
+    sched_setaffinity(0, sizeof(allowed), &allowed);
+
+    // parked receivers, selects and asynchronous receives are woken up by a send on a lane
+    pthread_t pid;
+    receive_args args;
+    init_object_for_receive_api(&args, channel, NULL);
+    pthread_create(&pid, NULL, (void *)helper_receive, &args);
+    mu_assert("test_percpu_channel: Send failed", channel_send_percpu(channel, "Parked", true) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_percpu_channel: Parked receive failed", args.out == SUCCESS && strcmp(args.data, "Parked") == 0);
+    async_result_t receive = {0};
+    mu_assert("test_percpu_channel: Receive was not registered", channel_receive_async(channel, helper_async_complete, &receive) == WOULDBLOCK);
+    mu_assert("test_percpu_channel: Send failed", channel_send_percpu(channel, "Async", true) == SUCCESS);
+    mu_assert("test_percpu_channel: Receive not completed", receive.calls == 1 && strcmp(receive.data, "Async") == 0);
+
+    // close wakes up parked receivers and fails later sends
+    pthread_create(&pid, NULL, (void *)helper_receive, &args);
+    mu_assert("test_percpu_channel: Close failed", channel_close(channel) == SUCCESS);
+    pthread_join(pid, NULL);
+    mu_assert("test_percpu_channel: Receive did not see the close", args.out == CLOSED_ERROR);
+    mu_assert("test_percpu_channel: Closed channel accepted a send", channel_send_percpu(channel, "Closed", true) == CLOSED_ERROR);
+    channel_destroy(channel);
+
+    // every message of many producers is received exactly once
+    size_t PRODUCERS = 8;
+    size_t MESSAGES = 5000;
+    channel = channel_create_percpu(16, 64);
+    pthread_t producers[PRODUCERS];
+    percpu_producer_t arguments[PRODUCERS];
+    for (size_t i = 0; i < PRODUCERS; i++) {
+        arguments[i] = (percpu_producer_t){channel, i * MESSAGES + 1, MESSAGES};
+        pthread_create(&producers[i], NULL, helper_percpu_producer, &arguments[i]);
+    }
+    size_t total = PRODUCERS * MESSAGES;
+    size_t sum = 0;
+    for (size_t i = 0; i < total; i++) {
+        mu_assert("test_percpu_channel: Receive failed", channel_receive(channel, &data, true) == SUCCESS);
+        sum += (size_t)data;
+    }
+    for (size_t i = 0; i < PRODUCERS; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    mu_assert("test_percpu_channel: Messages lost or duplicated", sum == total * (total + 1) / 2);
+    mu_assert("test_percpu_channel: Message left in channel", channel_receive(channel, &data, false) == WOULDBLOCK);
+    channel_close(channel);
+    channel_destroy(channel);
+
+    return NULL;
+}
+
+void helper_count_changes(void* context) {
+    __atomic_add_fetch((size_t*)context, 1, __ATOMIC_RELAXED);
+}
+
+char* test_channel_watch() {
+    print_test_details(__func__, "Testing channel state watchers");
+
+    chan_t* channel = channel_create(2);
+    size_t changes = 0;
+    channel_watcher_t watcher = {helper_count_changes, &changes};
+    channel_watch(channel, &watcher);
+    void* data = NULL;
+
+    // every send and receive is reported, failed attempts are not
+    mu_assert("test_channel_watch: Send failed", channel_send(channel, "First", true) == SUCCESS);
+    mu_assert("test_channel_watch: Send not reported", changes == 1);
+    mu_assert("test_channel_watch: Send failed", channel_send(channel, "Second", true) == SUCCESS);
+    mu_assert("test_channel_watch: Send succeeded on a full channel", channel_send(channel, "Third", false) == WOULDBLOCK);
+    mu_assert("test_channel_watch: Failed send reported", changes == 2);
+    mu_assert("test_channel_watch: Receive failed", channel_receive(channel, &data, true) == SUCCESS);
+    mu_assert("test_channel_watch: Receive not reported", changes == 3);
+
+    // nothing is reported once unwatched
+    channel_unwatch(channel, &watcher);
+    mu_assert("test_channel_watch: Receive failed", channel_receive(channel, &data, true) == SUCCESS);
+    mu_assert("test_channel_watch: Change reported after unwatch", changes == 3);
+
+    // close is reported
+    channel_watch(channel, &watcher);
+    mu_assert("test_channel_watch: Close failed", channel_close(channel) == SUCCESS);
+    mu_assert("test_channel_watch: Close not reported", changes == 4);
+    channel_unwatch(channel, &watcher);
+    channel_destroy(channel);
+
+    // changes made through the lanes of a per-CPU channel are reported too
+    channel = channel_create_percpu(2, 4);
+    changes = 0;
+    channel_watch(channel, &watcher);
+    mu_assert("test_channel_watch: Send failed", channel_send_percpu(channel, "Lane", true) == SUCCESS);
+    mu_assert("test_channel_watch: Lane send not reported", changes >= 1);
+    channel_unwatch(channel, &watcher);
+    channel_close(channel);
+    channel_destroy(channel);
+
+    return NULL;
+}
+
+// Arguments of a stage thread of a pipeline ring
+typedef struct {
+    pipeline_ring_t* ring;
+    size_t stage;
+    size_t messages;
+    size_t batches;
+    bool ordered;
+} pipeline_stage_t;
+
+void* helper_pipeline_stage(void* arg) {
+    pipeline_stage_t* stage = arg;
+    size_t first = 0;
+    size_t count = 0;
+    size_t expected = 0;
+    while (pipeline_ring_acquire(stage->ring, stage->stage, 16, &first, &count, true) == SUCCESS) {
+        for (size_t i = 0; i < count; i++) {
+            size_t* message = *pipeline_ring_slot(stage->ring, first + i);
+            // every stage sees the work of the stages before it, and the messages in order
+            if (message[1] != stage->stage || (stage->ordered && message[0] != expected)) {
+                stage->ordered = false;
+            }
+            message[1]++;
+            expected++;
+        }
+        stage->messages += count;
+        stage->batches++;
+        pipeline_ring_release(stage->ring, stage->stage, count);
+    }
+    return NULL;
+}
+
+void* helper_pipeline_publisher(void* arg) {
+    pipeline_stage_t* publisher = arg;
+    size_t* messages = (size_t*)publisher->stage;
+    for (size_t i = 0; i < publisher->messages; i++) {
+        pipeline_ring_publish(publisher->ring, &messages[2 * i], true);
+    }
+    return NULL;
+}
+
+char* test_pipeline_ring() {
+    print_test_details(__func__, "Testing multi-stage pipeline rings");
+
+    mu_assert("test_pipeline_ring: Empty ring accepted", pipeline_ring_create(0, 2, CHANNEL_WAIT_PARK) == NULL);
+    mu_assert("test_pipeline_ring: Ring without stages accepted", pipeline_ring_create(4, 0, CHANNEL_WAIT_PARK) == NULL);
+
+    // a message reaches the next stage only once the stage before it released it, and frees its slot after the last
+    pipeline_ring_t* ring = pipeline_ring_create(3, 2, CHANNEL_WAIT_PARK);
+    size_t first = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < 4; i++) {
+        mu_assert("test_pipeline_ring: Publish failed", pipeline_ring_publish(ring, (void*)(i + 1), false) == SUCCESS);
+    }
+    mu_assert("test_pipeline_ring: Publish on a full ring", pipeline_ring_publish(ring, (void*)5, false) == WOULDBLOCK);
+    mu_assert("test_pipeline_ring: Second stage ran ahead", pipeline_ring_acquire(ring, 1, 8, &first, &count, false) == WOULDBLOCK);
+    mu_assert("test_pipeline_ring: Acquire failed", pipeline_ring_acquire(ring, 0, 3, &first, &count, false) == SUCCESS);
+    mu_assert("test_pipeline_ring: Wrong batch", first == 0 && count == 3);
+    *pipeline_ring_slot(ring, 0) = (void*)10;
+    pipeline_ring_release(ring, 0, 2);
+    mu_assert("test_pipeline_ring: Publish before the last stage released", pipeline_ring_publish(ring, (void*)5, false) == WOULDBLOCK);
+    mu_assert("test_pipeline_ring: Acquire failed", pipeline_ring_acquire(ring, 1, 8, &first, &count, false) == SUCCESS);
+    mu_assert("test_pipeline_ring: Wrong batch", first == 0 && count == 2);
+    mu_assert("test_pipeline_ring: Change not seen by the next stage", *pipeline_ring_slot(ring, 0) == (void*)10);
+    pipeline_ring_release(ring, 1, 1);
+    mu_assert("test_pipeline_ring: Publish failed", pipeline_ring_publish(ring, (void*)5, false) == SUCCESS);
+
+    // close stops the producers, the stages drain what was published
+    mu_assert("test_pipeline_ring: Close failed", pipeline_ring_close(ring) == SUCCESS);
+    mu_assert("test_pipeline_ring: Closed twice", pipeline_ring_close(ring) == CLOSED_ERROR);
+    mu_assert("test_pipeline_ring: Publish on a closed ring", pipeline_ring_publish(ring, (void*)6, true) == CLOSED_ERROR);
+    pipeline_ring_release(ring, 1, 1);
+    mu_assert("test_pipeline_ring: Acquire failed", pipeline_ring_acquire(ring, 0, 8, &first, &count, true) == SUCCESS);
+    mu_assert("test_pipeline_ring: Wrong batch", first == 2 && count == 3);
+    pipeline_ring_release(ring, 0, count);
+    mu_assert("test_pipeline_ring: Drained stage not closed", pipeline_ring_acquire(ring, 0, 8, &first, &count, true) == CLOSED_ERROR);
+    mu_assert("test_pipeline_ring: Acquire failed", pipeline_ring_acquire(ring, 1, 8, &first, &count, true) == SUCCESS);
+    mu_assert("test_pipeline_ring: Wrong batch", first == 2 && count == 3);
+    pipeline_ring_release(ring, 1, count);
+    mu_assert("test_pipeline_ring: Drained stage not closed", pipeline_ring_acquire(ring, 1, 8, &first, &count, false) == CLOSED_ERROR);
+    pipeline_ring_destroy(ring);
+
+    // messages of several producers go through every stage exactly once, in order for a single producer
+    size_t STAGES = 3;
+    size_t MESSAGES = 5000;
+    enum chan_wait STRATEGIES[] = {CHANNEL_WAIT_PARK, CHANNEL_WAIT_ADAPTIVE};
+    for (size_t producers = 1; producers <= 4; producers *= 4) {
+        for (size_t s = 0; s < sizeof(STRATEGIES) / sizeof(STRATEGIES[0]); s++) {
+            ring = pipeline_ring_create(64, STAGES, STRATEGIES[s]);
+            size_t* messages = calloc(2 * MESSAGES * producers, sizeof(size_t));
+            for (size_t i = 0; i < MESSAGES * producers; i++) {
+                messages[2 * i] = i;
+            }
+            pthread_t stage_pid[STAGES];
+            pipeline_stage_t stages[STAGES];
+            for (size_t i = 0; i < STAGES; i++) {
+                stages[i] = (pipeline_stage_t){ring, i, 0, 0, producers == 1};
+                pthread_create(&stage_pid[i], NULL, helper_pipeline_stage, &stages[i]);
+            }
+            pthread_t publisher_pid[producers];
+            pipeline_stage_t publishers[producers];
+            for (size_t i = 0; i < producers; i++) {
+                publishers[i] = (pipeline_stage_t){ring, (size_t)&messages[2 * MESSAGES * i], MESSAGES, 0, false};
+                pthread_create(&publisher_pid[i], NULL, helper_pipeline_publisher, &publishers[i]);
+            }
+            for (size_t i = 0; i < producers; i++) {
+                pthread_join(publisher_pid[i], NULL);
+            }
+            mu_assert("test_pipeline_ring: Close failed", pipeline_ring_close(ring) == SUCCESS);
+            for (size_t i = 0; i < STAGES; i++) {
+                pthread_join(stage_pid[i], NULL);
+                mu_assert("test_pipeline_ring: Messages lost", stages[i].messages == MESSAGES * producers);
+                mu_assert("test_pipeline_ring: Messages out of order", producers > 1 || stages[i].ordered);
+            }
+            for (size_t i = 0; i < MESSAGES * producers; i++) {
+                mu_assert("test_pipeline_ring: Message skipped a stage", messages[2 * i + 1] == STAGES);
+            }
+            free(messages);
+            pipeline_ring_destroy(ring);
+        }
+    }
+
+    return NULL;
+}
+
+char* test_stress_pipeline() {
+    print_test_details(__func__, "Benchmarking pipeline rings against chained channels");
+
+    size_t MESSAGES = 200000;
+    size_t STAGES[] = {1, 3};
+    enum chan_wait STRATEGIES[] = {CHANNEL_WAIT_PARK, CHANNEL_WAIT_ADAPTIVE};
+    const char* NAMES[] = {"park", "adaptive"};
+    for (size_t i = 0; i < sizeof(STAGES) / sizeof(STAGES[0]); i++) {
+        for (size_t s = 0; s < sizeof(STRATEGIES) / sizeof(STRATEGIES[0]); s++) {
+            double chained = run_stress_pipeline(STAGES[i], MESSAGES, false, STRATEGIES[s]);
+            double ring = run_stress_pipeline(STAGES[i], MESSAGES, true, STRATEGIES[s]);
+            printf("%zu stages, %s: chained channels %.0f messages/sec, ring %.0f messages/sec\n", STAGES[i], NAMES[s], chained, ring);
+            mu_assert("test_stress_pipeline: No throughput", chained > 0 && ring > 0);
+        }
+    }
+
+    return NULL;
+}
+
+// Counts the messages handled by the workers of a keyed channel, per partition
+typedef struct {
+    size_t handled[4];
+    bool wrong_partition;
+    keyed_channel_t* keyed;
+} keyed_count_t;
+
+void helper_keyed_count(void* context, size_t partition, void* data) {
+    keyed_count_t* count = context;
+    if (keyed_channel_partition(count->keyed, (uint64_t)(size_t)data) != partition) {
+        count->wrong_partition = true;
+    }
+    count->handled[partition]++;
+}
+
+// Arguments of a thread reading the counters of a keyed channel until told to stop
+typedef struct {
+    keyed_channel_t* keyed;
+    bool stop;
+} keyed_stats_reader_t;
+
+void* helper_keyed_stats_reader(void* arg) {
+    keyed_stats_reader_t* reader = arg;
+    keyed_channel_stats_t stats;
+    while (!__atomic_load_n(&reader->stop, __ATOMIC_ACQUIRE)) {
+        keyed_channel_stats(reader->keyed, KEYED_CHANNEL_ALL, &stats);
+    }
+    return NULL;
+}
+
+char* test_keyed_channel() {
+    print_test_details(__func__, "Testing keyed partitioned channels");
+
+    mu_assert("test_keyed_channel: Channel without partitions created", keyed_channel_create(0, 4) == NULL);
+    size_t PARTITIONS = 4;
+    keyed_channel_t* keyed = keyed_channel_create(PARTITIONS, 8);
+    mu_assert("test_keyed_channel: Wrong partition count", keyed_channel_partitions(keyed) == PARTITIONS);
+
+    // keys map to a fixed partition, and every partition gets some of them
+    size_t used[4] = {0};
+    for (uint64_t key = 0; key < 64; key++) {
+        size_t partition = keyed_channel_partition(keyed, key);
+        mu_assert("test_keyed_channel: Partition out of range", partition < PARTITIONS);
+        mu_assert("test_keyed_channel: Partition not stable", partition == keyed_channel_partition(keyed, key));
+        used[partition]++;
+    }
+    for (size_t i = 0; i < PARTITIONS; i++) {
+        mu_assert("test_keyed_channel: Keys not spread over the partitions", used[i] > 0);
+    }
+
+    // the messages of a key arrive in order on its partition
+    uint64_t key = 42;
+    size_t partition = keyed_channel_partition(keyed, key);
+    for (size_t i = 1; i <= 5; i++) {
+        mu_assert("test_keyed_channel: Send failed", keyed_channel_send(keyed, key, (void*)i, true) == SUCCESS);
+    }
+    keyed_channel_stats_t stats;
+    keyed_channel_stats(keyed, partition, &stats);
+    mu_assert("test_keyed_channel: Wrong partition stats", stats.sent == 5 && stats.queued == 5);
+    keyed_channel_stats(keyed, (partition + 1) % PARTITIONS, &stats);
+    mu_assert("test_keyed_channel: Message sent to the wrong partition", stats.sent == 0);
+    void* data = NULL;
+    mu_assert("test_keyed_channel: Receive failed", keyed_channel_receive(keyed, partition, &data, false) == SUCCESS);
+    mu_assert("test_keyed_channel: Wrong message", (size_t)data == 1);
+
+    // partitions join a select like any channel
+    select_t list[1];
+    list[0].channel = keyed_channel_get(keyed, partition);
+    list[0].is_send = false;
+    size_t selected_index = 1;
+    mu_assert("test_keyed_channel: Select failed", channel_select(1, list, &selected_index) == SUCCESS);
+    mu_assert("test_keyed_channel: Wrong message", selected_index == 0 && (size_t)list[0].data == 2);
+    for (size_t i = 3; i <= 5; i++) {
+        mu_assert("test_keyed_channel: Receive failed", keyed_channel_receive(keyed, partition, &data, false) == SUCCESS);
+        mu_assert("test_keyed_channel: Messages out of order", (size_t)data == i);
+    }
+
+    // workers handle every message of their partition before join returns
+    keyed_count_t count = {{0}, false, keyed};
+    mu_assert("test_keyed_channel: Workers not started", keyed_channel_start(keyed, helper_keyed_count, &count));
+    mu_assert("test_keyed_channel: Workers started twice", !keyed_channel_start(keyed, helper_keyed_count, &count));
+    size_t MESSAGES = 1000;
+    for (size_t i = 1; i <= MESSAGES; i++) {
+        mu_assert("test_keyed_channel: Send failed", keyed_channel_send(keyed, i, (void*)i, true) == SUCCESS);
+    }
+    // the counters may be read while join sends its end of stream markers
+    keyed_stats_reader_t reader = {keyed, false};
+    pthread_t reader_pid;
+    pthread_create(&reader_pid, NULL, helper_keyed_stats_reader, &reader);
+    keyed_channel_join(keyed);
+    __atomic_store_n(&reader.stop, true, __ATOMIC_RELEASE);
+    pthread_join(reader_pid, NULL);
+    mu_assert("test_keyed_channel: Message handled by the wrong worker", !count.wrong_partition);
+    size_t handled = 0;
+    for (size_t i = 0; i < PARTITIONS; i++) {
+        handled += count.handled[i];
+    }
+    mu_assert("test_keyed_channel: Messages lost", handled == MESSAGES);
+    keyed_channel_stats(keyed, KEYED_CHANNEL_ALL, &stats);
+    mu_assert("test_keyed_channel: Wrong stats", stats.sent == MESSAGES + 5 && stats.queued == 0);
+
+    // close stops started workers and is reported once
+    mu_assert("test_keyed_channel: Destroyed while open", keyed_channel_destroy(keyed) == DESTROY_ERROR);
+    mu_assert("test_keyed_channel: Workers not started", keyed_channel_start(keyed, helper_keyed_count, &count));
+    mu_assert("test_keyed_channel: Close failed", keyed_channel_close(keyed) == SUCCESS);
+    mu_assert("test_keyed_channel: Closed twice", keyed_channel_close(keyed) == CLOSED_ERROR);
+    mu_assert("test_keyed_channel: Send on a closed channel", keyed_channel_send(keyed, key, "Closed", true) == CLOSED_ERROR);
+    mu_assert("test_keyed_channel: Destroy failed", keyed_channel_destroy(keyed) == SUCCESS);
+
+    return NULL;
+}
+
+char* test_stress_keyed() {
+    print_test_details(__func__, "Benchmarking keyed channels with more partitions");
+
+    size_t MESSAGES = 20000;
+    size_t PARTITIONS[] = {1, 2, 4, 8};
+    for (size_t i = 0; i < sizeof(PARTITIONS) / sizeof(PARTITIONS[0]); i++) {
+        double rate = run_stress_keyed(PARTITIONS[i], 4, 256, MESSAGES, 1000);
+        printf("%zu partitions: %.0f messages/sec\n", PARTITIONS[i], rate);
+        mu_assert("test_stress_keyed: No throughput", rate > 0);
+    }
+
+    return NULL;
+}
+
+// Serves the calls of an rpc object, replying with twice the request, until it is closed
+void* helper_rpc_server(void* arg) {
+    rpc_t* rpc = arg;
+    rpc_call_t* call = NULL;
+    while (rpc_receive(rpc, &call, true) == SUCCESS) {
+        rpc_reply(rpc, call, (void*)((size_t)call->request * 2));
+    }
+    return NULL;
+}
+
+// Makes calls on an rpc object and counts the wrong replies
+typedef struct {
+    rpc_t* rpc;
+    size_t first;
+    size_t calls;
+    size_t wrong;
+} rpc_client_t;
+
+void* helper_rpc_client(void* arg) {
+    rpc_client_t* client = arg;
+    for (size_t i = client->first; i < client->first + client->calls; i++) {
+        void* reply = NULL;
+        if (rpc_call(client->rpc, (void*)i, &reply, 0) != SUCCESS || (size_t)reply != i * 2) {
+            client->wrong++;
+        }
+    }
+    return NULL;
+}
+
+char* test_rpc() {
+    print_test_details(__func__, "Testing request/reply calls over channels");
+
+    // timed receive gives up on an empty channel, and returns a message as soon as there is one
+    chan_t* channel = channel_create(1);
+    void* data = NULL;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    mu_assert("test_rpc: Timed receive did not time out", channel_receive_timed(channel, &data, 20000) == WOULDBLOCK);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long elapsed_usec = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+    mu_assert("test_rpc: Timed receive returned early", elapsed_usec >= 20000);
+    channel_send(channel, "Message", true);
+    mu_assert("test_rpc: Timed receive failed", channel_receive_timed(channel, &data, 20000) == SUCCESS);
+    mu_assert("test_rpc: Wrong message", strcmp(data, "Message") == 0);
+    channel_close(channel);
+    mu_assert("test_rpc: Timed receive on a closed channel", channel_receive_timed(channel, &data, 20000) == CLOSED_ERROR);
+    channel_destroy(channel);
+
+    mu_assert("test_rpc: Rpc without calls created", rpc_create(0, 4) == NULL);
+    rpc_t* rpc = rpc_create(1, 4);
+
+    // a round trip through the request channel and the reply channel of the call
+    rpc_call_t* call = NULL;
+    mu_assert("test_rpc: Start failed", rpc_start(rpc, (void*)21, &call, false) == SUCCESS);
+    rpc_call_t* other = NULL;
+    mu_assert("test_rpc: Started more calls than the pool holds", rpc_start(rpc, (void*)1, &other, false) == WOULDBLOCK);
+    rpc_call_t* served = NULL;
+    mu_assert("test_rpc: Receive failed", rpc_receive(rpc, &served, false) == SUCCESS);
+    mu_assert("test_rpc: Wrong call", served == call && (size_t)served->request == 21);
+    uint64_t id = served->id;
+    mu_assert("test_rpc: Reply failed", rpc_reply(rpc, served, (void*)42) == SUCCESS);
+    void* reply = NULL;
+    mu_assert("test_rpc: Wait failed", rpc_wait(rpc, call, &reply, 0) == SUCCESS);
+    mu_assert("test_rpc: Wrong reply", (size_t)reply == 42);
+
+    // a call that timed out is given up, its slot comes back once the server replies
+    mu_assert("test_rpc: Start failed", rpc_start(rpc, (void*)1, &call, false) == SUCCESS);
+    mu_assert("test_rpc: Same id twice", call->id != id);
+    mu_assert("test_rpc: Call did not time out", rpc_wait(rpc, call, &reply, 1000) == WOULDBLOCK);
+    mu_assert("test_rpc: Slot reused before the reply", rpc_start(rpc, (void*)1, &other, false) == WOULDBLOCK);
+    mu_assert("test_rpc: Receive failed", rpc_receive(rpc, &served, false) == SUCCESS);
+    mu_assert("test_rpc: Reply to an abandoned call delivered", rpc_reply(rpc, served, (void*)2) == CLOSED_ERROR);
+
+    // the reply channel joins a select, the call is then finished by hand
+    mu_assert("test_rpc: Start failed", rpc_start(rpc, (void*)3, &call, false) == SUCCESS);
+    mu_assert("test_rpc: Receive failed", rpc_receive(rpc, &served, false) == SUCCESS);
+    mu_assert("test_rpc: Reply failed", rpc_reply(rpc, served, (void*)6) == SUCCESS);
+    select_t list[1];
+    list[0].channel = call->reply;
+    list[0].is_send = false;
+    size_t selected_index = 1;
+    mu_assert("test_rpc: Select failed", channel_select(1, list, &selected_index) == SUCCESS);
+    mu_assert("test_rpc: Wrong reply", selected_index == 0 && (size_t)list[0].data == 6);
+    rpc_finish(rpc, call);
+
+    // a call finished before its reply leaves no stale reply for the next call
+    mu_assert("test_rpc: Start failed", rpc_start(rpc, (void*)4, &call, false) == SUCCESS);
+    rpc_finish(rpc, call);
+    mu_assert("test_rpc: Receive failed", rpc_receive(rpc, &served, false) == SUCCESS);
+    mu_assert("test_rpc: Reply to a finished call delivered", rpc_reply(rpc, served, (void*)8) == CLOSED_ERROR);
+    mu_assert("test_rpc: Start failed", rpc_start(rpc, (void*)5, &call, false) == SUCCESS);
+    mu_assert("test_rpc: Stale reply", rpc_wait(rpc, call, &reply, 1000) == WOULDBLOCK);
+    mu_assert("test_rpc: Receive failed", rpc_receive(rpc, &served, false) == SUCCESS);
+    rpc_reply(rpc, served, NULL);
+    mu_assert("test_rpc: Close failed", rpc_close(rpc) == SUCCESS);
+    mu_assert("test_rpc: Closed twice", rpc_close(rpc) == CLOSED_ERROR);
+    mu_assert("test_rpc: Call on a closed rpc", rpc_call(rpc, (void*)1, &reply, 0) == CLOSED_ERROR);
+    mu_assert("test_rpc: Destroy failed", rpc_destroy(rpc) == SUCCESS);
+
+    // clients and servers on their own threads, with fewer calls than clients
+    size_t SERVERS = 2;
+    size_t CLIENTS = 4;
+    size_t CALLS = 2000;
+    rpc = rpc_create(3, 2);
+    mu_assert("test_rpc: Destroyed while open", rpc_destroy(rpc) == DESTROY_ERROR);
+    pthread_t servers[SERVERS];
+    pthread_t clients[CLIENTS];
+    rpc_client_t args[CLIENTS];
+    for (size_t i = 0; i < SERVERS; i++) {
+        pthread_create(&servers[i], NULL, helper_rpc_server, rpc);
+    }
+    for (size_t i = 0; i < CLIENTS; i++) {
+        args[i] = (rpc_client_t){rpc, i * CALLS, CALLS, 0};
+        pthread_create(&clients[i], NULL, helper_rpc_client, &args[i]);
+    }
+    for (size_t i = 0; i < CLIENTS; i++) {
+        pthread_join(clients[i], NULL);
+        mu_assert("test_rpc: Wrong replies", args[i].wrong == 0);
+    }
+    rpc_close(rpc);
+    for (size_t i = 0; i < SERVERS; i++) {
+        pthread_join(servers[i], NULL);
+    }
+    rpc_destroy(rpc);
+
+    return NULL;
+}
+
+// Records the messages handled by the actors of a test, in the order they were handled
+typedef struct {
+    size_t log[64];
+    size_t logged;
+    // Blocks the handler on its first message until the gate gets a message
+    chan_t* gate;
+    // Gets a message once count messages were handled
+    chan_t* done;
+    size_t count;
+    size_t handled;
+    bool concurrent;
+    bool running;
+} actor_log_t;
+
+void helper_actor_log(actor_t* self, void* message, void* context) {
+    (void)self;
+    actor_log_t* log = context;
+    if (__atomic_exchange_n(&log->running, true, __ATOMIC_SEQ_CST)) {
+        log->concurrent = true;
+    }
+    if (log->gate) {
+        void* data = NULL;
+        channel_receive(log->gate, &data, true);
+        log->gate = NULL;
+    }
+    if (log->logged < 64) {
+        log->log[log->logged++] = (size_t)message;
+    }
+    __atomic_store_n(&log->running, false, __ATOMIC_SEQ_CST);
+    if (__atomic_add_fetch(&log->handled, 1, __ATOMIC_SEQ_CST) == log->count) {
+        channel_send(log->done, message, true);
+    }
+}
+
+char* test_actor() {
+    print_test_details(__func__, "Testing actors scheduled on a worker pool");
+
+    mu_assert("test_actor: System without workers created", actor_system_create(0, 4, 1) == NULL);
+    mu_assert("test_actor: System without batch created", actor_system_create(1, 4, 0) == NULL);
+
+    // with a single worker, runnable actors take turns of batch messages each
+    actor_system_t* system = actor_system_create(1, 3, 2);
+    chan_t* done = channel_create(4);
+    chan_t* gate = channel_create(1);
+    actor_log_t shared = {{0}, 0, NULL, done, 9, 0, false, false};
+    actor_log_t blocker = {{0}, 0, gate, done, 1, 0, false, false};
+    actor_t* first = actor_spawn(system, 8, helper_actor_log, &shared);
+    actor_t* second = actor_spawn(system, 8, helper_actor_log, &shared);
+    actor_t* busy = actor_spawn(system, 8, helper_actor_log, &blocker);
+    mu_assert("test_actor: Spawn failed", first && second && busy);
+    mu_assert("test_actor: More actors than the system holds", actor_spawn(system, 8, helper_actor_log, &shared) == NULL);
+    mu_assert("test_actor: Spawned without a mailbox", actor_spawn(system, 0, helper_actor_log, &shared) == NULL);
+    mu_assert("test_actor: Send failed", actor_send(busy, (void*)0, true) == SUCCESS);
+    for (size_t i = 1; i <= 4; i++) {
+        mu_assert("test_actor: Send failed", actor_send(first, (void*)i, true) == SUCCESS);
+        mu_assert("test_actor: Send failed", actor_send(second, (void*)(i + 10), true) == SUCCESS);
+    }
+    // a send through a select schedules the actor like actor_send
+    select_t list[1];
+    list[0].channel = actor_mailbox(second);
+    list[0].is_send = true;
+    list[0].data = (void*)15;
+    size_t selected_index = 1;
+    mu_assert("test_actor: Select failed", channel_select(1, list, &selected_index) == SUCCESS);
+    channel_send(gate, "Go", true);
+    void* data = NULL;
+    channel_receive(done, &data, true);
+    channel_receive(done, &data, true);
+    size_t EXPECTED[] = {1, 2, 11, 12, 3, 4, 13, 14, 15};
+    mu_assert("test_actor: Wrong number of messages handled", shared.logged == 9 && blocker.logged == 1);
+    for (size_t i = 0; i < 9; i++) {
+        mu_assert("test_actor: Actors did not take turns of a batch", shared.log[i] == EXPECTED[i]);
+    }
+
+    mu_assert("test_actor: Destroyed while open", actor_system_destroy(system) == DESTROY_ERROR);
+    mu_assert("test_actor: Close failed", actor_system_close(system) == SUCCESS);
+    mu_assert("test_actor: Closed twice", actor_system_close(system) == CLOSED_ERROR);
+    mu_assert("test_actor: Send to a closed actor", actor_send(first, (void*)1, true) == CLOSED_ERROR);
+    mu_assert("test_actor: Destroy failed", actor_system_destroy(system) == SUCCESS);
+
+    // with several workers, an actor still handles one message at a time, in order
+    size_t ACTORS = 4;
+    size_t MESSAGES = 2000;
+    system = actor_system_create(3, ACTORS, 16);
+    actor_log_t logs[ACTORS];
+    actor_t* actors[ACTORS];
+    for (size_t i = 0; i < ACTORS; i++) {
+        logs[i] = (actor_log_t){{0}, 0, NULL, done, MESSAGES, 0, false, false};
+        actors[i] = actor_spawn(system, 4, helper_actor_log, &logs[i]);
+    }
+    for (size_t m = 0; m < MESSAGES; m++) {
+        for (size_t i = 0; i < ACTORS; i++) {
+            mu_assert("test_actor: Send failed", actor_send(actors[i], (void*)m, true) == SUCCESS);
+        }
+    }
+    for (size_t i = 0; i < ACTORS; i++) {
+        channel_receive(done, &data, true);
+    }
+    for (size_t i = 0; i < ACTORS; i++) {
+        mu_assert("test_actor: Actor ran on two workers at once", !logs[i].concurrent);
+        for (size_t m = 0; m < 64; m++) {
+            mu_assert("test_actor: Messages out of order", logs[i].log[m] == m);
+        }
+    }
+    actor_system_close(system);
+    actor_system_destroy(system);
+    channel_close(done);
+    channel_destroy(done);
+    channel_close(gate);
+    channel_destroy(gate);
+
+    return NULL;
+}
+
+char* test_stress_actor() {
+    print_test_details(__func__, "Benchmarking actors on a worker pool against a thread per actor");
+
+    size_t ACTORS[] = {8, 64, 256};
+    for (size_t i = 0; i < sizeof(ACTORS) / sizeof(ACTORS[0]); i++) {
+        double threads = run_stress_actor(ACTORS[i], ACTORS[i] / 4, 20000, false, 0);
+        double pooled = run_stress_actor(ACTORS[i], ACTORS[i] / 4, 20000, true, 4);
+        printf("%zu actors: thread per actor %.0f hops/sec, worker pool %.0f hops/sec\n", ACTORS[i], threads, pooled);
+        mu_assert("test_stress_actor: No throughput", threads > 0 && pooled > 0);
+    }
+
+    return NULL;
+}
+
+// Defines a snapshot of a state cell test, every value equal to the version that published it
+typedef struct {
+    uint64_t values[13];
+    char tail[3];
+} cell_state_t;
+
+typedef struct {
+    state_cell_t* cell;
+    size_t snapshots;
+    size_t torn;
+} cell_reader_t;
+
+void* helper_cell_reader(void* arg) {
+    cell_reader_t* reader = arg;
+    cell_state_t state;
+    uint64_t version = 0;
+    while (state_cell_wait(reader->cell, &version, &state) == SUCCESS) {
+        for (size_t i = 0; i < 13; i++) {
+            if (state.values[i] != version || state.tail[i % 3] != (char)version) {
+                reader->torn++;
+            }
+        }
+        reader->snapshots++;
+    }
+    return NULL;
+}
+
+char* test_state_cell() {
+    print_test_details(__func__, "Testing the latest state cell");
+
+    mu_assert("test_state_cell: Cell without state created", state_cell_create(0) == NULL);
+    state_cell_t* cell = state_cell_create(sizeof(cell_state_t));
+    cell_state_t state;
+    memset(&state, 0xff, sizeof(state));
+    mu_assert("test_state_cell: Wrong initial version", state_cell_read(cell, &state) == 0);
+    mu_assert("test_state_cell: Initial state not zeroed", state.values[0] == 0 && state.tail[2] == 0);
+
+    // snapshots get consecutive versions, and readers copy the latest one
+    cell_state_t published;
+    for (uint64_t version = 1; version <= 3; version++) {
+        for (size_t i = 0; i < 13; i++) {
+            published.values[i] = version;
+        }
+        memset(published.tail, (char)version, sizeof(published.tail));
+        mu_assert("test_state_cell: Wrong version published", state_cell_publish(cell, &published) == version);
+    }
+    mu_assert("test_state_cell: Wrong version", state_cell_version(cell) == 3);
+    mu_assert("test_state_cell: Wrong version read", state_cell_read(cell, &state) == 3);
+    mu_assert("test_state_cell: Wrong state read", memcmp(&state, &published, sizeof(state)) == 0);
+    uint64_t version = 1;
+    mu_assert("test_state_cell: Wait for a newer version failed", state_cell_wait(cell, &version, &state) == SUCCESS);
+    mu_assert("test_state_cell: Wrong version waited for", version == 3 && state.values[12] == 3);
+
+    // subscriptions only keep the latest version, and join a select
+    chan_t* changes = state_cell_subscribe(cell);
+    for (uint64_t v = 4; v <= 5; v++) {
+        for (size_t i = 0; i < 13; i++) {
+            published.values[i] = v;
+        }
+        memset(published.tail, (char)v, sizeof(published.tail));
+        state_cell_publish(cell, &published);
+    }
+    select_t list[1];
+    list[0].channel = changes;
+    list[0].is_send = false;
+    size_t selected_index = 1;
+    mu_assert("test_state_cell: Select failed", channel_select(1, list, &selected_index) == SUCCESS);
+    mu_assert("test_state_cell: Not the latest version", selected_index == 0 && (uint64_t)(uintptr_t)list[0].data == 5);
+    void* data = NULL;
+    mu_assert("test_state_cell: Stale version notified", channel_receive(changes, &data, false) == WOULDBLOCK);
+    state_cell_unsubscribe(cell, changes);
+    changes = state_cell_subscribe(cell);
+
+    // readers waiting on a single writer never see a torn snapshot
+    size_t READERS = 3;
+    size_t SNAPSHOTS = 20000;
+    pthread_t pid[READERS];
+    cell_reader_t readers[READERS];
+    for (size_t i = 0; i < READERS; i++) {
+        readers[i] = (cell_reader_t){cell, 0, 0};
+        pthread_create(&pid[i], NULL, helper_cell_reader, &readers[i]);
+    }
+    for (uint64_t v = 6; v < 6 + SNAPSHOTS; v++) {
+        for (size_t i = 0; i < 13; i++) {
+            published.values[i] = v;
+        }
+        memset(published.tail, (char)v, sizeof(published.tail));
+        state_cell_publish(cell, &published);
+    }
+    mu_assert("test_state_cell: Close failed", state_cell_close(cell) == SUCCESS);
+    mu_assert("test_state_cell: Closed twice", state_cell_close(cell) == CLOSED_ERROR);
+    for (size_t i = 0; i < READERS; i++) {
+        pthread_join(pid[i], NULL);
+        mu_assert("test_state_cell: Torn snapshot read", readers[i].torn == 0);
+        mu_assert("test_state_cell: No snapshot read", readers[i].snapshots > 0);
+    }
+    mu_assert("test_state_cell: Subscription not closed", channel_receive(changes, &data, true) == CLOSED_ERROR);
+    mu_assert("test_state_cell: Subscribed to a closed cell", state_cell_subscribe(cell) == NULL);
+    version = state_cell_version(cell);
+    mu_assert("test_state_cell: Waited on a closed cell", state_cell_wait(cell, &version, &state) == CLOSED_ERROR);
+    mu_assert("test_state_cell: Latest state lost", state_cell_read(cell, &state) == 5 + SNAPSHOTS);
+    state_cell_destroy(cell);
+
+    return NULL;
+}
+
+// Sends a message on a channel after a short sleep, to wake up a waiting thread
+void* helper_delayed_send(void* arg) {
+    usleep(10000);
+    channel_send(arg, "Late", true);
+    return NULL;
+}
+
+char* test_waitset() {
+    print_test_details(__func__, "Testing wait sets over channels, file descriptors and timers");
+
+    waitset_t* waitset = waitset_create();
+    mu_assert("test_waitset: Create failed", waitset != NULL);
+    chan_t* channel = channel_create(1);
+    int fds[2];
+    mu_assert("test_waitset: Pipe failed", pipe(fds) == 0);
+    char channel_tag, fd_tag, timer_tag, full_tag;
+    int channel_id = waitset_add_channel(waitset, channel, false, &channel_tag);
+    mu_assert("test_waitset: Add channel failed", channel_id >= 0);
+    mu_assert("test_waitset: Add fd failed", waitset_add_fd(waitset, fds[0], EPOLLIN, &fd_tag) >= 0);
+    waitset_event_t events[4];
+    mu_assert("test_waitset: Event without anything ready", waitset_wait(waitset, events, 4, 0) == 0);
+
+    // channels and file descriptors are reported while ready
+    mu_assert("test_waitset: Channel ready before a send", !channel_ready(channel, false) && channel_ready(channel, true));
+    channel_send(channel, "Message", true);
+    mu_assert("test_waitset: Channel not ready after a send", channel_ready(channel, false) && !channel_ready(channel, true));
+    mu_assert("test_waitset: Channel not reported", waitset_wait(waitset, events, 4, -1) == 1 && events[0].tag == &channel_tag);
+    mu_assert("test_waitset: Write failed", write(fds[1], "x", 1) == 1);
+    mu_assert("test_waitset: Channel and fd not reported", waitset_wait(waitset, events, 4, -1) == 2);
+    mu_assert("test_waitset: Wrong events", events[0].tag == &channel_tag && events[1].tag == &fd_tag && (events[1].events & EPOLLIN));
+    void* data = NULL;
+    char byte;
+    channel_receive(channel, &data, true);
+    mu_assert("test_waitset: Read failed", read(fds[0], &byte, 1) == 1);
+    mu_assert("test_waitset: Event after both were drained", waitset_wait(waitset, events, 4, 0) == 0);
+
+    // a send from another thread wakes up the waiting thread
+    pthread_t pid;
+    pthread_create(&pid, NULL, helper_delayed_send, channel);
+    mu_assert("test_waitset: Send from another thread not reported", waitset_wait(waitset, events, 4, -1) == 1 && events[0].tag == &channel_tag);
+    pthread_join(pid, NULL);
+
+    // a send member is reported once the channel has room
+    int full_id = waitset_add_channel(waitset, channel, true, &full_tag);
+    mu_assert("test_waitset: Full channel reported for send", waitset_wait(waitset, events, 4, 0) == 1 && events[0].tag == &channel_tag);
+    channel_receive(channel, &data, true);
+    mu_assert("test_waitset: Channel with room not reported", waitset_wait(waitset, events, 4, 0) == 1 && events[0].tag == &full_tag);
+    mu_assert("test_waitset: Remove failed", waitset_remove(waitset, full_id));
+    mu_assert("test_waitset: Removed twice", !waitset_remove(waitset, full_id));
+
+    // timers and wait timeouts end a single sleep
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    mu_assert("test_waitset: Event before the timeout", waitset_wait(waitset, events, 4, 5000) == 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long elapsed_usec = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+    mu_assert("test_waitset: Wait returned before the timeout", elapsed_usec >= 5000);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    mu_assert("test_waitset: Add timer failed", waitset_add_timer(waitset, 10000, &timer_tag) >= 0);
+    mu_assert("test_waitset: Timer not reported", waitset_wait(waitset, events, 4, -1) == 1 && events[0].tag == &timer_tag);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed_usec = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+    mu_assert("test_waitset: Timer reported early", elapsed_usec >= 10000);
+    mu_assert("test_waitset: Timer reported twice", waitset_wait(waitset, events, 4, 0) == 0);
+
+    // a closed channel is ready, like in select
+    channel_close(channel);
+    mu_assert("test_waitset: Closed channel not reported", waitset_wait(waitset, events, 4, -1) == 1 && events[0].tag == &channel_tag);
+    mu_assert("test_waitset: Remove failed", waitset_remove(waitset, channel_id));
+    mu_assert("test_waitset: Removed channel reported", waitset_wait(waitset, events, 4, 0) == 0);
+    waitset_destroy(waitset);
+    channel_destroy(channel);
+    close(fds[0]);
+    close(fds[1]);
+
+    return NULL;
+}
+
+// Blocks in a send or a receive on a channel and keeps its status
+typedef struct {
+    chan_t* channel;
+    bool send;
+    enum chan_status status;
+} close_waiter_t;
+
+void* helper_close_waiter(void* arg) {
+    close_waiter_t* waiter = arg;
+    void* data = NULL;
+    waiter->status = waiter->send ? channel_send(waiter->channel, "Blocked", true) : channel_receive(waiter->channel, &data, true);
+    return NULL;
+}
+
+char* test_close_many_waiters() {
+    print_test_details(__func__, "Testing close with hundreds of parked senders and receivers");
+
+    size_t WAITERS = 200;
+    chan_t* empty = channel_create(1);
+    chan_t* full = channel_create(1);
+    channel_send(full, "Full", true);
+    pthread_t pid[2 * WAITERS];
+    close_waiter_t waiters[2 * WAITERS];
+    for (size_t i = 0; i < 2 * WAITERS; i++) {
+        waiters[i] = (close_waiter_t){i < WAITERS ? empty : full, i >= WAITERS, OTHER_ERROR};
+        pthread_create(&pid[i], NULL, helper_close_waiter, &waiters[i]);
+    }
+    usleep(200000);
+
+    // a single send or receive wakes up a single waiter, which gets through
+    channel_send(empty, "Message", true);
+    void* data = NULL;
+    channel_receive(full, &data, true);
+    usleep(100000);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    mu_assert("test_close_many_waiters: Close failed", channel_close(empty) == SUCCESS && channel_close(full) == SUCCESS);
+    for (size_t i = 0; i < 2 * WAITERS; i++) {
+        pthread_join(pid[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long elapsed_usec = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+    printf("%zu waiters returned %ld usec after close\n", 2 * WAITERS - 2, elapsed_usec);
+
+    size_t sent = 0, received = 0;
+    for (size_t i = 0; i < 2 * WAITERS; i++) {
+        if (waiters[i].status == SUCCESS) {
+            (*(waiters[i].send ? &sent : &received))++;
+        }
+        else {
+            mu_assert("test_close_many_waiters: Waiter did not get CLOSED_ERROR", waiters[i].status == CLOSED_ERROR);
+        }
+    }
+    mu_assert("test_close_many_waiters: Wrong number of waiters woken before close", sent == 1 && received == 1);
+    channel_destroy(empty);
+    channel_destroy(full);
+
+    return NULL;
+}
+
+// Marks small ids dirty on a work-set channel, many times each, without ever blocking
+typedef struct {
+    chan_t* channel;
+    size_t ids;
+    size_t sends;
+    size_t would_block;
+} dirty_marker_t;
+
+void* helper_mark_dirty(void* arg) {
+    dirty_marker_t* marker = arg;
+    for (size_t i = 0; i < marker->sends; i++) {
+        if (channel_send(marker->channel, (void*)(i * 7 % marker->ids), false) != SUCCESS) {
+            marker->would_block++;
+        }
+    }
+    return NULL;
+}
+
+// Counts the completions of asynchronous sends
+void helper_count_completion(void* context, enum chan_status status, void* data) {
+    (void)data;
+    if (status == SUCCESS) {
+        (*(size_t*)context)++;
+    }
+}
+
+char* test_work_set() {
+    print_test_details(__func__, "Testing deduplicating work-set channels");
+
+    // the hashed set agrees with a plain array through inserts and removals
+    size_t ITEMS = 64;
+    item_set_t* set = item_set_create(ITEMS, 0);
+    char items[ITEMS];
+    bool member[ITEMS];
+    memset(member, 0, sizeof(member));
+    srand(42);
+    for (size_t i = 0; i < 20000; i++) {
+        size_t item = (size_t)rand() % ITEMS;
+        if (rand() % 2) {
+            mu_assert("test_work_set: Wrong insert", item_set_insert(set, &items[item]) == !member[item]);
+            member[item] = true;
+        }
+        else {
+            mu_assert("test_work_set: Wrong remove", item_set_remove(set, &items[item]) == member[item]);
+            member[item] = false;
+        }
+        size_t check = (size_t)rand() % ITEMS;
+        mu_assert("test_work_set: Wrong membership", item_set_contains(set, &items[check]) == member[check]);
+    }
+    item_set_free(set);
+
+    // duplicates of a queued item are dropped, even when the channel is full, until the item is received
+    chan_t* channel = channel_create_set(2, 0);
+    void* data = NULL;
+    mu_assert("test_work_set: Send failed", channel_send(channel, "A", true) == SUCCESS);
+    mu_assert("test_work_set: Duplicate send failed", channel_send(channel, "A", true) == SUCCESS);
+    mu_assert("test_work_set: Duplicate queued", buffer_current_size(channel->buffer) == 1);
+    mu_assert("test_work_set: Send failed", channel_send(channel, "B", true) == SUCCESS);
+    mu_assert("test_work_set: Duplicate on a full channel failed", channel_send(channel, "A", false) == SUCCESS);
+    mu_assert("test_work_set: Full channel took a new item", channel_send(channel, "C", false) == WOULDBLOCK);
+    mu_assert("test_work_set: Receive failed", channel_receive(channel, &data, true) == SUCCESS && strcmp(data, "A") == 0);
+    mu_assert("test_work_set: Received item not queued again", channel_send(channel, "A", false) == SUCCESS);
+    mu_assert("test_work_set: Receive failed", channel_receive(channel, &data, true) == SUCCESS && strcmp(data, "B") == 0);
+
+    // asynchronous sends of a queued item complete at once, waiting ones without taking room
+    size_t completed = 0;
+    mu_assert("test_work_set: Async duplicate not completed", channel_send_async(channel, "A", helper_count_completion, &completed) == SUCCESS && completed == 1);
+    channel_send(channel, "B", true);
+    mu_assert("test_work_set: Async send not waiting", channel_send_async(channel, "C", helper_count_completion, &completed) == WOULDBLOCK);
+    mu_assert("test_work_set: Async send not waiting", channel_send_async(channel, "C", helper_count_completion, &completed) == WOULDBLOCK);
+    mu_assert("test_work_set: Receive failed", channel_receive(channel, &data, true) == SUCCESS && strcmp(data, "A") == 0);
+    mu_assert("test_work_set: Waiting send not completed", completed == 2);
+    mu_assert("test_work_set: Receive failed", channel_receive(channel, &data, true) == SUCCESS && strcmp(data, "B") == 0);
+    mu_assert("test_work_set: Waiting duplicate not completed", completed == 3);
+    mu_assert("test_work_set: Receive failed", channel_receive(channel, &data, true) == SUCCESS && strcmp(data, "C") == 0);
+    mu_assert("test_work_set: Item queued twice", channel_receive(channel, &data, false) == WOULDBLOCK);
+    channel_close(channel);
+    channel_destroy(channel);
+
+    // small ids are tracked in a bitmap, and the queue never holds more than one message per id
+    size_t IDS = 16;
+    size_t MARKERS = 4;
+    channel = channel_create_set(IDS, IDS);
+    mu_assert("test_work_set: Id out of range accepted", channel_send(channel, (void*)IDS, false) == OTHER_ERROR);
+    pthread_t pid[MARKERS];
+    dirty_marker_t markers[MARKERS];
+    for (size_t i = 0; i < MARKERS; i++) {
+        markers[i] = (dirty_marker_t){channel, IDS, 5000, 0};
+        pthread_create(&pid[i], NULL, helper_mark_dirty, &markers[i]);
+    }
+    size_t received = 0;
+    bool seen[IDS];
+    for (size_t i = 0; i < MARKERS; i++) {
+        pthread_join(pid[i], NULL);
+        mu_assert("test_work_set: Queue deeper than the number of ids", markers[i].would_block == 0);
+    }
+    memset(seen, 0, sizeof(seen));
+    while (channel_receive(channel, &data, false) == SUCCESS) {
+        mu_assert("test_work_set: Id queued twice", !seen[(size_t)data]);
+        seen[(size_t)data] = true;
+        received++;
+    }
+    mu_assert("test_work_set: Ids lost", received == IDS);
+
+    // an id out of range fails right away, even on a full channel where a valid send would wait
+    for (size_t i = 0; i < IDS; i++) {
+        mu_assert("test_work_set: Send failed", channel_send(channel, (void*)i, false) == SUCCESS);
+    }
+    mu_assert("test_work_set: Blocking send of an id out of range accepted", channel_send(channel, (void*)IDS, true) == OTHER_ERROR);
+    async_result_t send = {0};
+    mu_assert("test_work_set: Asynchronous send of an id out of range accepted", channel_send_async(channel, (void*)IDS, helper_async_complete, &send) == OTHER_ERROR);
+    mu_assert("test_work_set: Receive failed", channel_receive(channel, &data, false) == SUCCESS && (size_t)data == 0);
+    mu_assert("test_work_set: Failed send completed", send.calls == 0);
+    channel_close(channel);
+    channel_destroy(channel);
+
+    return NULL;
+}
+
+char* test_file_stage() {
+    print_test_details(__func__, "Testing file source and sink stages");
+
+    size_t SIZE = 1024 * 1024 + 12345;
+    size_t BLOCK_SIZE = 64 * 1024;
+    char input[] = "/tmp/file_stage_inXXXXXX";
+    char output[] = "/tmp/file_stage_outXXXXXX";
+    int fd = mkstemp(input);
+    mu_assert("test_file_stage: Could not create input file", fd >= 0);
+    char* contents = malloc(SIZE);
+    for (size_t i = 0; i < SIZE; i++) {
+        contents[i] = (char)(i * 7 + i / 4096);
+    }
+    mu_assert("test_file_stage: Could not write input file", write(fd, contents, SIZE) == (ssize_t)SIZE);
+    close(fd);
+    fd = mkstemp(output);
+    mu_assert("test_file_stage: Could not create output file", fd >= 0);
+    close(fd);
+
+    file_pool_t* pool = file_pool_create(8, BLOCK_SIZE);
+    mu_assert("test_file_stage: Could not create pool", pool != NULL);
+    mu_assert("test_file_stage: Unaligned block size accepted", file_pool_create(8, BLOCK_SIZE + 1) == NULL);
+    char* copy = malloc(SIZE + 1);
+    const char* NAMES[] = {"io_uring", "io_uring direct", "thread pool", "thread pool direct"};
+    for (size_t mode = 0; mode < 4; mode++) {
+        file_stage_options_t options = {4, mode % 2 == 1, mode >= 2};
+        chan_t* channel = channel_create(4);
+        file_stage_t* sink = file_sink_start(channel, output, pool, &options);
+        mu_assert("test_file_stage: Could not start sink", sink != NULL);
+        file_stage_t* source = file_source_start(channel, input, pool, &options);
+        mu_assert("test_file_stage: Could not start source", source != NULL);
+        file_stage_stats_t read_stats;
+        file_stage_stats_t write_stats;
+        file_stage_join(source, &read_stats);
+        file_stage_join(sink, &write_stats);
+        channel_close(channel);
+        channel_destroy(channel);
+        printf("%s: %zu read calls, %zu write calls\n", NAMES[mode], read_stats.syscalls, write_stats.syscalls);
+
+        size_t blocks = (SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        mu_assert("test_file_stage: Read failed", read_stats.error == 0 && read_stats.blocks == blocks && read_stats.bytes == SIZE);
+        mu_assert("test_file_stage: Write failed", write_stats.error == 0 && write_stats.blocks == blocks && write_stats.bytes == SIZE);
+        mu_assert("test_file_stage: Fallback used io_uring", mode < 2 || (!read_stats.uring && !write_stats.uring));
+        fd = open(output, O_RDONLY);
+        mu_assert("test_file_stage: Could not open output file", fd >= 0);
+        memset(copy, 0, SIZE);
+        mu_assert("test_file_stage: Wrong output size", read(fd, copy, SIZE + 1) == (ssize_t)SIZE);
+        close(fd);
+        mu_assert("test_file_stage: Wrong output contents", memcmp(copy, contents, SIZE) == 0);
+    }
+
+    // every block went back to the pool
+    for (size_t i = 0; i < 8; i++) {
+        void* data = NULL;
+        mu_assert("test_file_stage: Block not returned", channel_receive(pool->free, &data, false) == SUCCESS);
+        file_pool_put(pool, data);
+    }
+    file_stage_options_t options = {4, false, false};
+    chan_t* channel = channel_create(4);
+    mu_assert("test_file_stage: Missing file opened", file_source_start(channel, "/tmp/file_stage_missing/in", pool, &options) == NULL);
+    channel_close(channel);
+    channel_destroy(channel);
+
+    file_pool_destroy(pool);
+    free(copy);
+    free(contents);
+    unlink(input);
+    unlink(output);
+    return NULL;
+}
+
+// Defines a consumer of a map stream that checks every line of the test file in place
+typedef struct {
+    map_stream_t* stream;
+    chan_t* chunks;
+    size_t lines;
+    size_t mismatches;
+} map_consumer_t;
+
+void* helper_map_consumer(void* arg) {
+    map_consumer_t* consumer = arg;
+    void* data = NULL;
+    while (channel_receive(consumer->chunks, &data, true) == SUCCESS && data) {
+        map_chunk_t* chunk = data;
+        size_t line = chunk->first_record;
+        size_t start = 0;
+        while (start < chunk->length) {
+            const char* newline = memchr(chunk->data + start, '\n', chunk->length - start);
+            size_t end = newline ? (size_t)(newline - chunk->data) : chunk->length;
+            char expected[32];
+            int length = snprintf(expected, sizeof(expected), "line %zu", line);
+            if (end - start != (size_t)length || memcmp(chunk->data + start, expected, end - start) != 0) {
+                __atomic_add_fetch(&consumer->mismatches, 1, __ATOMIC_RELAXED);
+            }
+            __atomic_add_fetch(&consumer->lines, 1, __ATOMIC_RELAXED);
+            line++;
+            start = end + 1;
+        }
+        map_stream_release(consumer->stream, chunk);
+    }
+    return NULL;
+}
+
+char* test_map_stream() {
+    print_test_details(__func__, "Testing memory-mapped chunked file streaming");
+
+    size_t LINES = 50000;
+    size_t CONSUMERS = 3;
+    char filename[] = "/tmp/map_streamXXXXXX";
+    int fd = mkstemp(filename);
+    mu_assert("test_map_stream: Could not create file", fd >= 0);
+    FILE* file = fdopen(fd, "w");
+    for (size_t i = 0; i < LINES; i++) {
+        fprintf(file, "line %zu\n", i);
+    }
+    fclose(file);
+
+    map_stream_options_t options = {4096, 4, 2, '\n'};
+    map_stream_t* stream = map_stream_open(filename, &options);
+    mu_assert("test_map_stream: Could not open stream", stream != NULL);
+    size_t size = map_stream_size(stream);
+    chan_t* chunks = channel_create(2);
+    map_consumer_t consumer = {stream, chunks, 0, 0};
+    pthread_t pids[CONSUMERS];
+    for (size_t i = 0; i < CONSUMERS; i++) {
+        pthread_create(&pids[i], NULL, helper_map_consumer, &consumer);
+    }
+    mu_assert("test_map_stream: Could not start stream", map_stream_start(stream, chunks, CONSUMERS));
+    mu_assert("test_map_stream: Stream started twice", !map_stream_start(stream, chunks, CONSUMERS));
+    for (size_t i = 0; i < CONSUMERS; i++) {
+        pthread_join(pids[i], NULL);
+    }
+    map_stream_stats_t stats;
+    map_stream_close(stream, &stats);
+    channel_close(chunks);
+    channel_destroy(chunks);
+    printf("%zu chunks, %zu bytes, %zu bytes released, at most %zu chunks out\n", stats.chunks, stats.bytes, stats.released_bytes,
+           stats.peak_chunks);
+    mu_assert("test_map_stream: Wrong number of lines", consumer.lines == LINES);
+    mu_assert("test_map_stream: Lines split or out of place", consumer.mismatches == 0);
+    mu_assert("test_map_stream: Wrong number of bytes", stats.bytes == size && stats.released_bytes == size);
+    mu_assert("test_map_stream: Too few chunks", stats.chunks >= size / 4096);
+    mu_assert("test_map_stream: Window exceeded", stats.peak_chunks <= 4);
+
+    options.chunk_size = 0;
+    mu_assert("test_map_stream: Invalid options accepted", map_stream_open(filename, &options) == NULL);
+    options.chunk_size = 4096;
+    mu_assert("test_map_stream: Missing file opened", map_stream_open("/tmp/map_stream_missing/file", &options) == NULL);
+    unlink(filename);
+    return NULL;
+}
+
+char* test_stress_mapped_topology() {
+    print_test_details(__func__, "Testing topology parsing from a memory-mapped stream");
+
+    const char* TOPOLOGIES[] = {"topology.txt", "connected_topology.txt", "random_topology.txt", "random_topology_1.txt", "big_graph.txt"};
+    stress_options_t dense = {STRESS_SCHEDULE_FREE, 0, STRESS_ORDER_FREE, 0, false, NULL, NULL, 2};
+    stress_options_t lean = {STRESS_SCHEDULE_FREE, 0, STRESS_ORDER_FREE, 0, true, NULL, NULL, 2};
+    // run_stress asserts that every converged vector matches the shortest paths of the parsed topology
+    for (size_t i = 0; i < sizeof(TOPOLOGIES) / sizeof(TOPOLOGIES[0]); i++) {
+        run_stress_with_options(1, 1, TOPOLOGIES[i], &dense, NULL);
+        run_stress_with_options(1, 1, TOPOLOGIES[i], &lean, NULL);
+    }
+
+    stress_options_t lean_stdio = {STRESS_SCHEDULE_FREE, 0, STRESS_ORDER_FREE, 0, true, NULL, NULL, 0};
+    stress_stats_t mapped_stats;
+    stress_stats_t stdio_stats;
+    run_stress_with_options(1, 1, "big_graph.txt", &lean, &mapped_stats);
+    run_stress_with_options(1, 1, "big_graph.txt", &lean_stdio, &stdio_stats);
+    mu_assert("test_stress_mapped_topology: Parsed topologies differ", mapped_stats.topology_bytes == stdio_stats.topology_bytes);
+
+    return NULL;
+}
+
 typedef char* (*test_fn_t)();
 typedef struct {
     char* name;
@@ -2031,6 +4259,7 @@ test_t tests[] = {{"test_initialization", test_initialization},
                   {"test_select_with_same_channel_buffered", test_select_with_same_channel_buffered},
                   {"test_select_with_send_receive_on_same_channel_buffered", test_select_with_send_receive_on_same_channel_buffered},
                   {"test_select_with_duplicate_channel_buffered", test_select_with_duplicate_channel_buffered},
+                  {"test_select_with_concurrent_selects_buffered", test_select_with_concurrent_selects_buffered},
                   {"test_stress_buffered", test_stress_buffered},
                   {"test_select_response_time", test_select_response_time},
                   {"test_cpu_utilization_select", test_cpu_utilization_select},
@@ -2048,6 +4277,38 @@ test_t tests[] = {{"test_initialization", test_initialization},
                   {"test_select_mixed_buffered_unbuffered", test_select_mixed_buffered_unbuffered},
                   {"test_stress_unbuffered", test_stress_unbuffered},
                   {"test_stress_mixed_buffered_unbuffered", test_stress_mixed_buffered_unbuffered},
+                  {"test_lossy_channel", test_lossy_channel},
+                  {"test_compact_channel", test_compact_channel},
+                  {"test_idle_reclaim", test_idle_reclaim},
+                  {"test_watermarks", test_watermarks},
+                  {"test_socket_bridge", test_socket_bridge},
+                  {"test_stress_bridge", test_stress_bridge},
+                  {"test_record_replay", test_record_replay},
+                  {"test_partition", test_partition},
+                  {"test_stress_partitioned", test_stress_partitioned},
+                  {"test_stress_prioritized", test_stress_prioritized},
+                  {"test_stress_lean_validation", test_stress_lean_validation},
+                  {"test_stress_snapshot", test_stress_snapshot},
+                  {"test_busy_poll", test_busy_poll},
+                  {"test_stress_latency", test_stress_latency},
+                  {"test_stress_oversubscribed", test_stress_oversubscribed},
+                  {"test_async", test_async},
+                  {"test_file_stage", test_file_stage},
+                  {"test_map_stream", test_map_stream},
+                  {"test_stress_mapped_topology", test_stress_mapped_topology},
+                  {"test_percpu_channel", test_percpu_channel},
+                  {"test_channel_watch", test_channel_watch},
+                  {"test_pipeline_ring", test_pipeline_ring},
+                  {"test_stress_pipeline", test_stress_pipeline},
+                  {"test_keyed_channel", test_keyed_channel},
+                  {"test_stress_keyed", test_stress_keyed},
+                  {"test_rpc", test_rpc},
+                  {"test_actor", test_actor},
+                  {"test_stress_actor", test_stress_actor},
+                  {"test_state_cell", test_state_cell},
+                  {"test_waitset", test_waitset},
+                  {"test_close_many_waiters", test_close_many_waiters},
+                  {"test_work_set", test_work_set},
 };
 
 size_t num_tests = sizeof(tests)/sizeof(tests[0]);
@@ -0,0 +1,157 @@
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <semaphore>
+#include <thread>
+#include "channel_coro.hpp"
+
+#define mu_str_(text) #text
+#define mu_str(text) mu_str_(text)
+#define mu_assert(message, test) do { if (!(test)) return "FAILURE: See " __FILE__ " Line " mu_str(__LINE__) ": " message; } while (0)
+
+// Defines a coroutine that starts right away and frees its frame when it returns
+struct detached {
+    struct promise_type {
+        detached get_return_object()
+        {
+            return {};
+        }
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+};
+
+detached helper_receive(channel_coro::channel ch, channel_coro::result* out, std::atomic<bool>* done)
+{
+    *out = co_await ch.receive();
+    done->store(true);
+}
+
+detached helper_send(channel_coro::channel ch, void* data, enum chan_status* out, std::atomic<bool>* done)
+{
+    *out = co_await ch.send(data);
+    done->store(true);
+}
+
+detached helper_select(channel_coro::executor& exec, select_t* list, size_t count, channel_coro::select_result* out,
+                       std::binary_semaphore* done)
+{
+    *out = co_await channel_coro::select(exec, list, count);
+    done->release();
+}
+
+const char* test_coro_send_receive()
+{
+    chan_t* chan = channel_create(1);
+    channel_coro::channel ch(chan);
+
+    // a receive on an empty channel suspends, and is resumed inline by the send
+    channel_coro::result received{WOULDBLOCK, nullptr};
+    std::atomic<bool> done{false};
+    helper_receive(ch, &received, &done);
+    mu_assert("test_coro_send_receive: Receive did not suspend", !done.load());
+    mu_assert("test_coro_send_receive: Send failed", channel_send(chan, (void*)"First", true) == SUCCESS);
+    mu_assert("test_coro_send_receive: Receive not resumed", done.load());
+    mu_assert("test_coro_send_receive: Wrong message", received.status == SUCCESS && strcmp((char*)received.data, "First") == 0);
+
+    // a send on a non-full channel completes without suspending
+    enum chan_status sent = WOULDBLOCK;
+    done = false;
+    helper_send(ch, (void*)"Second", &sent, &done);
+    mu_assert("test_coro_send_receive: Send suspended", done.load() && sent == SUCCESS);
+
+    // a send on a full channel suspends, and is resumed inline by the receive
+    done = false;
+    helper_send(ch, (void*)"Third", &sent, &done);
+    mu_assert("test_coro_send_receive: Send did not suspend", !done.load());
+    void* data = nullptr;
+    mu_assert("test_coro_send_receive: Receive failed", channel_receive(chan, &data, true) == SUCCESS);
+    mu_assert("test_coro_send_receive: Wrong message", strcmp((char*)data, "Second") == 0);
+    mu_assert("test_coro_send_receive: Send not resumed", done.load() && sent == SUCCESS);
+    mu_assert("test_coro_send_receive: Receive failed", channel_receive(chan, &data, true) == SUCCESS);
+    mu_assert("test_coro_send_receive: Wrong message", strcmp((char*)data, "Third") == 0);
+
+    // close resumes a suspended receive with the error
+    done = false;
+    helper_receive(ch, &received, &done);
+    mu_assert("test_coro_send_receive: Close failed", channel_close(chan) == SUCCESS);
+    mu_assert("test_coro_send_receive: Receive did not see the close", done.load() && received.status == CLOSED_ERROR);
+    channel_destroy(chan);
+
+    return nullptr;
+}
+
+const char* test_coro_select()
+{
+    chan_t* first = channel_create(1);
+    chan_t* second = channel_create(1);
+    channel_coro::executor exec(16);
+    std::thread runner([&exec] { exec.run(); });
+
+    // a select with nothing ready suspends, and is resumed on the executor once a channel changes
+    select_t list[2];
+    list[0] = {first, false, nullptr};
+    list[1] = {second, false, nullptr};
+    channel_coro::select_result selected{WOULDBLOCK, 0};
+    std::binary_semaphore done(0);
+    helper_select(exec, list, 2, &selected, &done);
+    mu_assert("test_coro_select: Select did not suspend", !done.try_acquire());
+    mu_assert("test_coro_select: Send failed", channel_send(second, (void*)"Second", true) == SUCCESS);
+    done.acquire();
+    mu_assert("test_coro_select: Wrong entry", selected.status == SUCCESS && selected.index == 1);
+    mu_assert("test_coro_select: Wrong message", strcmp((char*)list[1].data, "Second") == 0);
+
+    // a select with an entry ready completes without suspending
+    mu_assert("test_coro_select: Send failed", channel_send(first, (void*)"First", true) == SUCCESS);
+    helper_select(exec, list, 2, &selected, &done);
+    mu_assert("test_coro_select: Select suspended", done.try_acquire());
+    mu_assert("test_coro_select: Wrong entry", selected.status == SUCCESS && selected.index == 0);
+    mu_assert("test_coro_select: Wrong message", strcmp((char*)list[0].data, "First") == 0);
+
+    // a send entry goes through once the channel has room
+    mu_assert("test_coro_select: Send failed", channel_send(first, (void*)"Full", true) == SUCCESS);
+    select_t send_list[1] = {{first, true, (void*)"Waiting"}};
+    helper_select(exec, send_list, 1, &selected, &done);
+    mu_assert("test_coro_select: Select did not suspend", !done.try_acquire());
+    void* data = nullptr;
+    mu_assert("test_coro_select: Receive failed", channel_receive(first, &data, true) == SUCCESS);
+    done.acquire();
+    mu_assert("test_coro_select: Wrong entry", selected.status == SUCCESS && selected.index == 0);
+    mu_assert("test_coro_select: Receive failed", channel_receive(first, &data, true) == SUCCESS);
+    mu_assert("test_coro_select: Wrong message", strcmp((char*)data, "Waiting") == 0);
+
+    exec.close();
+    runner.join();
+    channel_close(first);
+    channel_close(second);
+    channel_destroy(first);
+    channel_destroy(second);
+
+    return nullptr;
+}
+
+int main()
+{
+    const char* (*tests[])() = {test_coro_send_receive, test_coro_select};
+    for (auto test : tests) {
+        const char* result = test();
+        if (result) {
+            printf("%s\n", result);
+            return 1;
+        }
+    }
+    printf("ALL TESTS PASSED\n");
+    return 0;
+}
@@ -0,0 +1,310 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "waitset.h"
+
+// Epoll data of the eventfd and timerfd of the set, beyond any member id
+#define WAITSET_POKE_ID UINT64_MAX
+#define WAITSET_TIMER_ID (UINT64_MAX - 1)
+
+// Largest number of descriptors taken from epoll at once
+#define WAITSET_MAX_EPOLL_EVENTS 64
+
+#define WAITSET_CHANNEL 0
+#define WAITSET_FD 1
+#define WAITSET_TIMER 2
+
+// Defines a member of a wait set, allocated on its own since the watcher of a channel member must not move
+typedef struct {
+    waitset_t* waitset;
+    int kind;
+    void* tag;
+    chan_t* channel;
+    bool send;
+    channel_watcher_t watcher;
+    int fd;
+    uint64_t deadline;
+} waitset_member_t;
+
+struct waitset {
+    int epoll_fd;
+    int poke_fd;
+    int timer_fd;
+    // Members by id, NULL for the free ids
+    waitset_member_t** members;
+    size_t capacity;
+    // Member the scan of channels and timers starts from, so that members late in the set are reported too
+    size_t scan_start;
+    // Whether a channel poked the eventfd since the set last looked at its channels, so that a busy channel writes to
+    // the eventfd once per wait rather than on every message
+    bool poked;
+};
+
+static uint64_t waitset_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+// Watcher of a channel member, runs with the channel locked on the thread that changed its state
+static void waitset_channel_changed(void* context)
+{
+    waitset_member_t* member = context;
+    if (channel_ready(member->channel, member->send) && !__atomic_exchange_n(&member->waitset->poked, true, __ATOMIC_SEQ_CST)) {
+        uint64_t one = 1;
+        ssize_t written = write(member->waitset->poke_fd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+// Stores a new member in the first free id
+// Returns the id, or -1 on allocation failure
+static int waitset_insert(waitset_t* waitset, waitset_member_t* member)
+{
+    size_t id = 0;
+    while (id < waitset->capacity && waitset->members[id]) {
+        id++;
+    }
+    if (id == waitset->capacity) {
+        size_t capacity = waitset->capacity ? waitset->capacity * 2 : 8;
+        waitset_member_t** members = realloc(waitset->members, capacity * sizeof(waitset_member_t*));
+        if (!members) {
+            return -1;
+        }
+        for (size_t i = waitset->capacity; i < capacity; i++) {
+            members[i] = NULL;
+        }
+        waitset->members = members;
+        waitset->capacity = capacity;
+    }
+    waitset->members[id] = member;
+    return (int)id;
+}
+
+// Creates an empty wait set
+// Returns NULL if the epoll, eventfd or timerfd descriptors could not be created
+waitset_t* waitset_create()
+{
+    waitset_t* waitset = calloc(1, sizeof(waitset_t));
+    if (!waitset) {
+        return NULL;
+    }
+    waitset->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    waitset->poke_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    waitset->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct epoll_event poke = {.events = EPOLLIN, .data.u64 = WAITSET_POKE_ID};
+    struct epoll_event timer = {.events = EPOLLIN, .data.u64 = WAITSET_TIMER_ID};
+    if (waitset->epoll_fd < 0 || waitset->poke_fd < 0 || waitset->timer_fd < 0 ||
+        epoll_ctl(waitset->epoll_fd, EPOLL_CTL_ADD, waitset->poke_fd, &poke) < 0 ||
+        epoll_ctl(waitset->epoll_fd, EPOLL_CTL_ADD, waitset->timer_fd, &timer) < 0) {
+        waitset_destroy(waitset);
+        return NULL;
+    }
+    return waitset;
+}
+
+// Adds a channel to the set, reported while a send (send = true) or a receive on it would go ahead, like in
+// channel_select, so the caller then sends or receives without blocking (the channel may have been taken in between)
+// Returns the id of the member, or -1 on failure
+int waitset_add_channel(waitset_t* waitset, chan_t* channel, bool send, void* tag)
+{
+    waitset_member_t* member = calloc(1, sizeof(waitset_member_t));
+    if (!member) {
+        return -1;
+    }
+    member->waitset = waitset;
+    member->kind = WAITSET_CHANNEL;
+    member->tag = tag;
+    member->channel = channel;
+    member->send = send;
+    member->watcher.callback = waitset_channel_changed;
+    member->watcher.context = member;
+    int id = waitset_insert(waitset, member);
+    if (id < 0) {
+        free(member);
+        return -1;
+    }
+    channel_watch(channel, &member->watcher);
+    return id;
+}
+
+// Adds a file descriptor to the set, reported with its ready events among the given epoll events (level-triggered)
+// Returns the id of the member, or -1 on failure (errno is set)
+int waitset_add_fd(waitset_t* waitset, int fd, uint32_t events, void* tag)
+{
+    waitset_member_t* member = calloc(1, sizeof(waitset_member_t));
+    if (!member) {
+        return -1;
+    }
+    member->waitset = waitset;
+    member->kind = WAITSET_FD;
+    member->tag = tag;
+    member->fd = fd;
+    int id = waitset_insert(waitset, member);
+    if (id < 0) {
+        free(member);
+        return -1;
+    }
+    struct epoll_event event = {.events = events, .data.u64 = (uint64_t)id};
+    if (epoll_ctl(waitset->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        waitset->members[id] = NULL;
+        free(member);
+        return -1;
+    }
+    return id;
+}
+
+// Adds a timer to the set, reported once timeout_usec microseconds from now and removed from the set
+// Returns the id of the member, or -1 on failure
+int waitset_add_timer(waitset_t* waitset, uint64_t timeout_usec, void* tag)
+{
+    waitset_member_t* member = calloc(1, sizeof(waitset_member_t));
+    if (!member) {
+        return -1;
+    }
+    member->waitset = waitset;
+    member->kind = WAITSET_TIMER;
+    member->tag = tag;
+    member->deadline = waitset_now() + timeout_usec * 1000;
+    int id = waitset_insert(waitset, member);
+    if (id < 0) {
+        free(member);
+        return -1;
+    }
+    return id;
+}
+
+// Removes a member from the set, once this returns a channel member does not touch the set anymore
+// Returns false if there is no such member
+bool waitset_remove(waitset_t* waitset, int id)
+{
+    if (id < 0 || (size_t)id >= waitset->capacity || !waitset->members[id]) {
+        return false;
+    }
+    waitset_member_t* member = waitset->members[id];
+    if (member->kind == WAITSET_CHANNEL) {
+        channel_unwatch(member->channel, &member->watcher);
+    }
+    else if (member->kind == WAITSET_FD) {
+        epoll_ctl(waitset->epoll_fd, EPOLL_CTL_DEL, member->fd, NULL);
+    }
+    waitset->members[id] = NULL;
+    free(member);
+    return true;
+}
+
+// Stores the ready channels and expired timers in events, removing the timers
+// Returns the number of events stored, and the earliest deadline of the remaining timers in next_deadline (0 if none)
+static size_t waitset_scan(waitset_t* waitset, waitset_event_t* events, size_t max_events, uint64_t now,
+                           uint64_t* next_deadline)
+{
+    size_t count = 0;
+    *next_deadline = 0;
+    for (size_t i = 0; i < waitset->capacity; i++) {
+        size_t id = (waitset->scan_start + i) % waitset->capacity;
+        waitset_member_t* member = waitset->members[id];
+        if (!member || member->kind == WAITSET_FD) {
+            continue;
+        }
+        if (member->kind == WAITSET_TIMER && member->deadline > now) {
+            if (!*next_deadline || member->deadline < *next_deadline) {
+                *next_deadline = member->deadline;
+            }
+            continue;
+        }
+        if (count == max_events) {
+            continue;
+        }
+        if (member->kind == WAITSET_TIMER) {
+            events[count].tag = member->tag;
+            events[count++].events = 0;
+            waitset_remove(waitset, (int)id);
+        }
+        else if (channel_ready(member->channel, member->send)) {
+            events[count].tag = member->tag;
+            events[count++].events = 0;
+        }
+    }
+    if (waitset->capacity) {
+        waitset->scan_start = (waitset->scan_start + 1) % waitset->capacity;
+    }
+    return count;
+}
+
+// Waits up to timeout_usec microseconds (forever if negative) for members of the set to be ready, and stores up to
+// max_events of them in events
+// Returns the number of events stored, 0 if the timeout expired first, or -1 on failure (errno is set)
+int waitset_wait(waitset_t* waitset, waitset_event_t* events, size_t max_events, int64_t timeout_usec)
+{
+    uint64_t deadline = timeout_usec < 0 ? 0 : waitset_now() + (uint64_t)timeout_usec * 1000;
+    while (true) {
+        // cleared before looking at the channels, so that a channel getting ready afterwards pokes the eventfd again
+        __atomic_store_n(&waitset->poked, false, __ATOMIC_SEQ_CST);
+        uint64_t now = waitset_now();
+        uint64_t next_deadline = 0;
+        size_t count = waitset_scan(waitset, events, max_events, now, &next_deadline);
+        bool expired = deadline && now >= deadline;
+
+        // sleeps until a descriptor is ready, a channel pokes the eventfd, or the earliest deadline
+        int epoll_timeout = 0;
+        if (count == 0 && !expired) {
+            epoll_timeout = -1;
+            if (deadline && (!next_deadline || deadline < next_deadline)) {
+                next_deadline = deadline;
+            }
+            struct itimerspec timer = {0};
+            timer.it_value.tv_sec = (time_t)(next_deadline / 1000000000ull);
+            timer.it_value.tv_nsec = (long)(next_deadline % 1000000000ull);
+            timerfd_settime(waitset->timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+        }
+        struct epoll_event ready[WAITSET_MAX_EPOLL_EVENTS];
+        size_t room = max_events - count < WAITSET_MAX_EPOLL_EVENTS ? max_events - count : WAITSET_MAX_EPOLL_EVENTS;
+        // the eventfd and timerfd may take some of the epoll events, so there is always room for them
+        int num_ready = epoll_wait(waitset->epoll_fd, ready, (int)(room + 2 < WAITSET_MAX_EPOLL_EVENTS ? room + 2 : WAITSET_MAX_EPOLL_EVENTS), epoll_timeout);
+        if (num_ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        for (int i = 0; i < num_ready; i++) {
+            uint64_t id = ready[i].data.u64;
+            if (id == WAITSET_POKE_ID || id == WAITSET_TIMER_ID) {
+                uint64_t value;
+                ssize_t num_read = read(id == WAITSET_POKE_ID ? waitset->poke_fd : waitset->timer_fd, &value, sizeof(value));
+                (void)num_read;
+            }
+            else if (count < max_events && id < waitset->capacity && waitset->members[id]) {
+                events[count].tag = waitset->members[id]->tag;
+                events[count++].events = ready[i].events;
+            }
+        }
+        if (count > 0 || expired) {
+            return (int)count;
+        }
+    }
+}
+
+// Removes every member and frees the set, the file descriptors and channels added to it still belong to the caller
+void waitset_destroy(waitset_t* waitset)
+{
+    for (size_t i = 0; i < waitset->capacity; i++) {
+        waitset_remove(waitset, (int)i);
+    }
+    free(waitset->members);
+    if (waitset->epoll_fd >= 0) {
+        close(waitset->epoll_fd);
+    }
+    if (waitset->poke_fd >= 0) {
+        close(waitset->poke_fd);
+    }
+    if (waitset->timer_fd >= 0) {
+        close(waitset->timer_fd);
+    }
+    free(waitset);
+}
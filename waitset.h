@@ -0,0 +1,53 @@
+#ifndef WAITSET_H
+#define WAITSET_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "channel.h"
+
+// Defines an event reported by waitset_wait
+typedef struct {
+    // Tag given when the member was added
+    void* tag;
+    // Epoll events (EPOLLIN, EPOLLOUT...) of a file descriptor, 0 for channels and timers
+    uint32_t events;
+} waitset_event_t;
+
+// Defines a wait set, which waits for channels, file descriptors and timers at once, with a single sleep of the calling
+// thread on epoll
+// A channel in the set has a watcher that writes to an eventfd of the set when the channel becomes ready, so channels
+// only pay for the wake-up while they are part of a set
+// A wait set is used by a single thread, while the channels and file descriptors in it are used by any thread
+typedef struct waitset waitset_t;
+
+// Creates an empty wait set
+// Returns NULL if the epoll, eventfd or timerfd descriptors could not be created
+waitset_t* waitset_create();
+
+// Adds a channel to the set, reported while a send (send = true) or a receive on it would go ahead, like in
+// channel_select, so the caller then sends or receives without blocking (the channel may have been taken in between)
+// Returns the id of the member, or -1 on failure
+int waitset_add_channel(waitset_t* waitset, chan_t* channel, bool send, void* tag);
+
+// Adds a file descriptor to the set, reported with its ready events among the given epoll events (level-triggered)
+// Returns the id of the member, or -1 on failure (errno is set)
+int waitset_add_fd(waitset_t* waitset, int fd, uint32_t events, void* tag);
+
+// Adds a timer to the set, reported once timeout_usec microseconds from now and removed from the set
+// Returns the id of the member, or -1 on failure
+int waitset_add_timer(waitset_t* waitset, uint64_t timeout_usec, void* tag);
+
+// Removes a member from the set, once this returns a channel member does not touch the set anymore
+// Returns false if there is no such member
+bool waitset_remove(waitset_t* waitset, int id);
+
+// Waits up to timeout_usec microseconds (forever if negative) for members of the set to be ready, and stores up to
+// max_events of them in events
+// Returns the number of events stored, 0 if the timeout expired first, or -1 on failure (errno is set)
+int waitset_wait(waitset_t* waitset, waitset_event_t* events, size_t max_events, int64_t timeout_usec);
+
+// Removes every member and frees the set, the file descriptors and channels added to it still belong to the caller
+void waitset_destroy(waitset_t* waitset);
+
+#endif // WAITSET_H